@@ -0,0 +1,79 @@
+\ Dispatches per second through CASE over 16 values, against the chain of
+\ OVER = IF DROP ... ELSE tests that jonesforth.f.txt's CASE compiled, with
+\ jonesforth.f.txt as ~/.tomoko:
+\
+\   ./tomoko -j 1 bench/case.fs
+\
+\ Each line gives the result, the time in milliseconds for COUNT dispatches,
+\ cycling through the values, and the time per dispatch in picoseconds.
+
+\ jonesforth.f.txt's CONSTANT and VARIABLE call WORD before CREATE, which
+\ reads the name itself here, so the addresses are compiled with LITERAL.
+10000000 : COUNT LITERAL ;
+CELL 4 * ALLOCATE DROP : CELLS-AT LITERAL ;
+: TIMESPEC	CELLS-AT ;		\ Two cells.
+: START-SEC	CELLS-AT CELL 2 * + ;
+: START-NSEC	CELLS-AT CELL 3 * + ;
+
+: NOW ( -- sec nsec )
+	TIMESPEC 1 SYS_CLOCK_GETTIME SYSCALL2 DROP	\ CLOCK_MONOTONIC
+	TIMESPEC @ TIMESPEC CELL + @
+;
+
+: START ( -- ) NOW START-NSEC ! START-SEC ! ;
+
+: ELAPSED ( -- us )
+	NOW START-NSEC @ - 1000 /
+	SWAP START-SEC @ - 1000000 * +
+;
+
+: REPORT ( n -- )
+	ELAPSED SWAP 12 .R
+	DUP 1000 / 8 .R
+	1000000 COUNT */ 9 .R CR
+;
+
+\ The original CASE words from jonesforth.f.txt.
+: LINEAR-CASE IMMEDIATE 0 ;
+: LINEAR-OF IMMEDIATE ' OVER , ' = , [COMPILE] IF ' DROP , ;
+: LINEAR-ENDOF IMMEDIATE [COMPILE] ELSE ;
+: LINEAR-ENDCASE IMMEDIATE ' DROP , BEGIN ?DUP WHILE [COMPILE] THEN REPEAT ;
+
+: LINEAR ( n1 -- n2 )
+	LINEAR-CASE
+	0 LINEAR-OF 3 LINEAR-ENDOF 1 LINEAR-OF 1 LINEAR-ENDOF 2 LINEAR-OF 4 LINEAR-ENDOF 3 LINEAR-OF 1 LINEAR-ENDOF
+	4 LINEAR-OF 5 LINEAR-ENDOF 5 LINEAR-OF 9 LINEAR-ENDOF 6 LINEAR-OF 2 LINEAR-ENDOF 7 LINEAR-OF 6 LINEAR-ENDOF
+	8 LINEAR-OF 5 LINEAR-ENDOF 9 LINEAR-OF 3 LINEAR-ENDOF 10 LINEAR-OF 5 LINEAR-ENDOF 11 LINEAR-OF 8 LINEAR-ENDOF
+	12 LINEAR-OF 9 LINEAR-ENDOF 13 LINEAR-OF 7 LINEAR-ENDOF 14 LINEAR-OF 9 LINEAR-ENDOF 15 LINEAR-OF 3 LINEAR-ENDOF
+	0 SWAP
+	LINEAR-ENDCASE
+;
+
+: DENSE ( n1 -- n2 )
+	CASE
+	0 OF 3 ENDOF 1 OF 1 ENDOF 2 OF 4 ENDOF 3 OF 1 ENDOF
+	4 OF 5 ENDOF 5 OF 9 ENDOF 6 OF 2 ENDOF 7 OF 6 ENDOF
+	8 OF 5 ENDOF 9 OF 3 ENDOF 10 OF 5 ENDOF 11 OF 8 ENDOF
+	12 OF 9 ENDOF 13 OF 7 ENDOF 14 OF 9 ENDOF 15 OF 3 ENDOF
+	0 SWAP
+	ENDCASE
+;
+
+: SPARSE ( n1 -- n2 )
+	CASE
+	0 OF 3 ENDOF 37 OF 1 ENDOF 74 OF 4 ENDOF 111 OF 1 ENDOF
+	148 OF 5 ENDOF 185 OF 9 ENDOF 222 OF 2 ENDOF 259 OF 6 ENDOF
+	296 OF 5 ENDOF 333 OF 3 ENDOF 370 OF 5 ENDOF 407 OF 8 ENDOF
+	444 OF 9 ENDOF 481 OF 7 ENDOF 518 OF 9 ENDOF 555 OF 3 ENDOF
+	0 SWAP
+	ENDCASE
+;
+
+: LINEAR-LOOP ( -- n ) START 0 COUNT 0 DO I 15 AND LINEAR + LOOP ;
+: DENSE-LOOP ( -- n ) START 0 COUNT 0 DO I 15 AND DENSE + LOOP ;
+: SPARSE-LOOP ( -- n ) START 0 COUNT 0 DO I 15 AND 37 * SPARSE + LOOP ;
+
+."                   result      ms  ps/dispatch" CR
+." linear      " LINEAR-LOOP REPORT
+." jump table  " DENSE-LOOP REPORT
+." search      " SPARSE-LOOP REPORT
@@ -0,0 +1,136 @@
+\ Checks the cell-array words against plain Forth loops, with
+\ jonesforth.f.txt as ~/.tomoko:
+\
+\   ./tomoko -j 1 bench/cells.fs
+\
+\ Each CELLS- word runs on every length from 0 to LENGTHS-1 cells, starting
+\ at each byte offset from 0 to OFFSETS-1, which covers every alignment of a
+\ 32-byte vector and the tail after it.  The cells are random, with the most
+\ negative and most positive cells, -1 and small repeated values mixed in.
+\ CELLS-ADD and CELLS-SCALE must also leave the GUARD cells after the array
+\ alone.  Any mismatch is printed with its offset and length.
+
+\ jonesforth.f.txt's CONSTANT and VARIABLE call WORD before CREATE, which
+\ reads the name itself here, so the addresses are compiled with LITERAL.
+68 : LENGTHS LITERAL ;
+36 : OFFSETS LITERAL ;
+8 : GUARD LITERAL ;
+LENGTHS GUARD + CELLS OFFSETS + ALLOCATE DROP : A LITERAL ;
+LENGTHS GUARD + CELLS OFFSETS + ALLOCATE DROP : B LITERAL ;
+LENGTHS GUARD + CELLS OFFSETS + ALLOCATE DROP : C LITERAL ;
+LENGTHS GUARD + CELLS OFFSETS + ALLOCATE DROP : D LITERAL ;
+CELL 8 * ALLOCATE DROP : CELLS-AT LITERAL ;
+: SEED		CELLS-AT ;
+: OFFSET	CELLS-AT CELL + ;
+: LENGTH	CELLS-AT CELL 2 * + ;
+: CHECKS	CELLS-AT CELL 3 * + ;
+: FAILURES	CELLS-AT CELL 4 * + ;
+: ARGUMENT	CELLS-AT CELL 5 * + ;
+
+: LOWEST ( -- n ) 1 BEGIN DUP DUP + ?DUP WHILE NIP REPEAT ;
+LOWEST : MIN-CELL LITERAL ;
+MIN-CELL INVERT : MAX-CELL LITERAL ;
+
+\ The arrays for this offset and length: X and Y are the inputs, and P and Q
+\ the outputs of the reference loop and the word, started at another offset.
+: X ( -- addr ) A OFFSET @ + ;
+: Y ( -- addr ) B OFFSET @ 13 * OFFSETS MOD + ;
+: P ( -- addr ) C OFFSET @ 7 * OFFSETS MOD + ;
+: Q ( -- addr ) D OFFSET @ 7 * OFFSETS MOD + ;
+: N ( -- n ) LENGTH @ ;
+
+: RANDOM ( -- u ) SEED @ 1103515245 * 12345 + DUP SEED ! ;
+
+: RANDOM-CELL ( -- x )
+	RANDOM DUP 65536 / 7 AND CASE
+		0 OF DROP MIN-CELL ENDOF
+		1 OF DROP MAX-CELL ENDOF
+		2 OF DROP -1 ENDOF
+		3 OF 1048576 / 3 AND ENDOF
+	ENDCASE
+;
+
+: RANDOMIZE ( addr -- )
+	N GUARD + 0 DO RANDOM-CELL OVER I CELLS + ! LOOP DROP
+;
+
+\ The reference loops.
+: REF-SUM ( addr n -- sum ) 0 SWAP 0 ?DO OVER I CELLS + @ + LOOP NIP ;
+
+: REF-MAX ( addr n -- max )
+	MIN-CELL SWAP 0 ?DO OVER I CELLS + @ 2DUP < IF SWAP THEN DROP LOOP NIP
+;
+
+: REF-MIN ( addr n -- min )
+	MAX-CELL SWAP 0 ?DO OVER I CELLS + @ 2DUP > IF SWAP THEN DROP LOOP NIP
+;
+
+: REF-ADD ( source dest n -- )
+	0 ?DO OVER I CELLS + @ OVER I CELLS + +! LOOP 2DROP
+;
+
+: REF-SCALE ( addr n k -- )
+	SWAP 0 ?DO 2DUP SWAP I CELLS + DUP >R @ * R> ! LOOP 2DROP
+;
+
+: REF-DOT ( addr1 addr2 n -- n )
+	CELLS >R OVER - SWAP 0 SWAP DUP R> + SWAP ?DO
+		OVER I + @ I @ * +
+	CELL +LOOP NIP
+;
+
+: REF-FIND ( addr n x -- index )
+	SWAP 0 ?DO
+		OVER I CELLS + @ OVER = IF 2DROP I UNLOOP EXIT THEN
+	LOOP 2DROP -1
+;
+
+: REF-COUNT ( addr n x -- n )
+	0 2SWAP CELLS OVER + SWAP ?DO OVER I @ = IF 1+ THEN CELL +LOOP NIP
+;
+
+\ Count a check, and report it if flag is false.
+: RESULT ( c-addr u flag -- )
+	1 CHECKS +!
+	IF 2DROP EXIT THEN
+	1 FAILURES +!
+	TELL ."  fails at offset " OFFSET @ . ." length " N . CR
+;
+
+\ Copy the GUARD cells after the array too, and compare them afterwards.
+: P=Q ( -- flag ) P N GUARD + CELLS Q OVER COMPARE 0= ;
+: COPY-TO-PQ ( addr -- ) DUP P N GUARD + CELLS MOVE Q N GUARD + CELLS MOVE ;
+
+\ A value to look for: one from the array, if it has any, or a random one.
+: TARGET ( -- )
+	N 0<> RANDOM 65536 / 1 AND 0= AND IF
+		X RANDOM 65536 / 32767 AND N MOD CELLS + @
+	ELSE
+		RANDOM-CELL
+	THEN ARGUMENT !
+;
+
+: CHECK-CASE ( -- )
+	X RANDOMIZE Y RANDOMIZE
+	S" CELLS-SUM" X N CELLS-SUM X N REF-SUM = RESULT
+	S" CELLS-MAX" X N CELLS-MAX X N REF-MAX = RESULT
+	S" CELLS-MIN" X N CELLS-MIN X N REF-MIN = RESULT
+	S" CELLS-DOT" X Y N CELLS-DOT X Y N REF-DOT = RESULT
+	S" CELLS-ADD" Y COPY-TO-PQ X Q N CELLS-ADD X P N REF-ADD P=Q RESULT
+	S" CELLS-SCALE" X COPY-TO-PQ RANDOM-CELL ARGUMENT !
+	Q N ARGUMENT @ CELLS-SCALE P N ARGUMENT @ REF-SCALE P=Q RESULT
+	S" CELLS-FIND" TARGET
+	X N ARGUMENT @ CELLS-FIND X N ARGUMENT @ REF-FIND = RESULT
+	S" CELLS-COUNT" TARGET
+	X N ARGUMENT @ CELLS-COUNT X N ARGUMENT @ REF-COUNT = RESULT
+;
+
+: CHECK-ALL ( -- )
+	1 SEED ! 0 CHECKS ! 0 FAILURES !
+	OFFSETS 0 DO
+		LENGTHS 0 DO J OFFSET ! I LENGTH ! CHECK-CASE LOOP
+	LOOP
+	CHECKS @ . ." checks, " FAILURES @ . ." failures" CR
+;
+
+CHECK-ALL
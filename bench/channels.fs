@@ -0,0 +1,108 @@
+\ Messages per second through channels, between threads and between tasks of
+\ one thread, with jonesforth.f.txt as ~/.tomoko:
+\
+\   ./tomoko -j 1 bench/channels.fs
+\
+\ The ping-pong lines send COUNT cells each way, one at a time, and give the
+\ time per round trip.  The stream lines send COUNT cells one way, through a
+\ channel of CAPACITY cells, and give the time per cell: with SEND and RECV
+\ through an SPSC-CHANNEL and a CHANNEL (with two senders), and with SEND-N
+\ and RECV-N in batches of BATCH cells.  Each line gives the result, which is
+\ the round trips made or the sum of the cells received, the time in
+\ milliseconds and the time per message in nanoseconds.
+
+\ jonesforth.f.txt's CONSTANT and VARIABLE call WORD before CREATE, which
+\ reads the name itself here, so the addresses are compiled with LITERAL.
+200000 : COUNT LITERAL ;
+1024 : CAPACITY LITERAL ;
+1000 : BATCH LITERAL ;
+BATCH CELLS ALLOCATE DROP : SRC LITERAL ;
+BATCH CELLS ALLOCATE DROP : DST LITERAL ;
+CELL 8 * ALLOCATE DROP : CELLS-AT LITERAL ;
+: TIMESPEC	CELLS-AT ;		\ Two cells.
+: START-SEC	CELLS-AT CELL 2 * + ;
+: START-NSEC	CELLS-AT CELL 3 * + ;
+: CH1		CELLS-AT CELL 4 * + ;	\ The channel one way.
+: CH2		CELLS-AT CELL 5 * + ;	\ The channel back.
+
+: NOW ( -- sec nsec )
+	TIMESPEC 1 SYS_CLOCK_GETTIME SYSCALL2 DROP	\ CLOCK_MONOTONIC
+	TIMESPEC @ TIMESPEC CELL + @
+;
+
+: START ( -- ) NOW START-NSEC ! START-SEC ! ;
+
+: ELAPSED ( -- us )
+	NOW START-NSEC @ - 1000 /
+	SWAP START-SEC @ - 1000000 * +
+;
+
+: REPORT ( n -- )
+	ELAPSED SWAP 12 .R
+	DUP 1000 / 8 .R
+	1000 COUNT */ 8 .R CR
+;
+
+\ Ping-pong: send each cell back until 0 arrives.
+: PONG ( x -- 0 ) DROP BEGIN CH1 @ RECV DUP CH2 @ SEND 0= UNTIL 0 ;
+: PONG-TASK ( task -- ) ACTIVATE 0 PONG DROP ;
+
+: PING ( -- n )
+	COUNT 0 DO I 1+ CH1 @ SEND CH2 @ RECV DROP LOOP
+	0 CH1 @ SEND CH2 @ RECV DROP COUNT
+;
+
+: PING-PONG-CHANNELS ( -- ) 2 CHANNEL CH1 ! 2 CHANNEL CH2 ! ;
+
+: THREAD-PING-PONG ( -- )
+	PING-PONG-CHANNELS START
+	0 ['] PONG THREAD PING SWAP JOIN DROP REPORT
+;
+
+: TASK-PING-PONG ( -- )
+	PING-PONG-CHANNELS START
+	TASK PONG-TASK PING REPORT
+;
+
+\ Streams: the cells sent are 0 to BATCH-1 over and over, so every stream
+\ adds up to the same sum.
+: PRODUCE ( n -- 0 ) 0 DO I BATCH MOD CH1 @ SEND LOOP 0 ;
+: PRODUCE-TASK ( task -- ) ACTIVATE COUNT PRODUCE DROP ;
+: CONSUME ( -- sum ) 0 COUNT 0 DO CH1 @ RECV + LOOP ;
+
+: PRODUCE-N ( x -- 0 ) DROP COUNT BATCH / 0 DO SRC BATCH CH1 @ SEND-N LOOP 0 ;
+: CONSUME-N ( -- sum )
+	0 COUNT BATCH / 0 DO DST BATCH CH1 @ RECV-N DST BATCH CELLS-SUM + LOOP
+;
+
+: SPSC-STREAM ( -- )
+	CAPACITY SPSC-CHANNEL CH1 ! START
+	COUNT ['] PRODUCE THREAD CONSUME SWAP JOIN DROP REPORT
+;
+
+: MPMC-STREAM ( -- )
+	CAPACITY CHANNEL CH1 ! START
+	COUNT 2 / ['] PRODUCE THREAD COUNT 2 / ['] PRODUCE THREAD
+	CONSUME >R JOIN DROP JOIN DROP R> REPORT
+;
+
+: BATCH-STREAM ( -- )
+	CAPACITY SPSC-CHANNEL CH1 ! START
+	0 ['] PRODUCE-N THREAD CONSUME-N SWAP JOIN DROP REPORT
+;
+
+: TASK-STREAM ( -- )
+	CAPACITY SPSC-CHANNEL CH1 ! START
+	TASK PRODUCE-TASK CONSUME REPORT
+;
+
+: FILL-SRC ( -- ) BATCH 0 DO I SRC I CELLS + ! LOOP ;
+
+FILL-SRC
+."                             result      ms ns/msg" CR
+." ping-pong, threads    " THREAD-PING-PONG
+." ping-pong, tasks      " TASK-PING-PONG
+." SPSC stream, threads  " SPSC-STREAM
+." MPMC stream, threads  " MPMC-STREAM
+." SEND-N/RECV-N stream  " BATCH-STREAM
+." SPSC stream, tasks    " TASK-STREAM
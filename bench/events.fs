@@ -0,0 +1,183 @@
+\ Checks the event loop's timers, pipes and files, with jonesforth.f.txt as
+\ ~/.tomoko:
+\
+\   ./tomoko -j 1 bench/events.fs
+\
+\ Each check prints its name and "ok" or "FAILED", and the last line gives the
+\ checks and failures:
+\ - TIMER-AFTER callbacks, started out of order, run in order;
+\ - a task that waits with TIMER-AFTER resumes, and runs on afterwards;
+\ - ASYNC-WRITE and ASYNC-READ round trips through a pipe, with callbacks
+\   and with the waiting forms;
+\ - a 100000-byte ASYNC-WRITE to a pipe is drained by a reader task with
+\   3000-byte ASYNC-READs, and arrives intact;
+\ - ASYNC-WRITE and ASYNC-READ on a regular file in /tmp;
+\ - a read from a closed descriptor gives ior 9 (EBADF).
+
+\ jonesforth.f.txt's CONSTANT and VARIABLE call WORD before CREATE, which
+\ reads the name itself here, so the addresses are compiled with LITERAL.
+100000 : LENGTH LITERAL ;
+3000 : CHUNK LITERAL ;
+LENGTH ALLOCATE DROP : SRC LITERAL ;
+LENGTH CHUNK + ALLOCATE DROP : DST LITERAL ;
+256 ALLOCATE DROP : PATH LITERAL ;
+CELL 16 * ALLOCATE DROP : CELLS-AT LITERAL ;
+: FDS		CELLS-AT ;		\ Two ints, filled in by pipe().
+: READ-FD	CELLS-AT CELL 2 * + ;
+: WRITE-FD	CELLS-AT CELL 3 * + ;
+: LOG		CELLS-AT CELL 4 * + ;	\ Decimal digits, one per event.
+: RECEIVED	CELLS-AT CELL 5 * + ;
+: READ-IOR	CELLS-AT CELL 6 * + ;
+: WRITTEN	CELLS-AT CELL 7 * + ;
+: WRITE-IOR	CELLS-AT CELL 8 * + ;
+: FILE-FD	CELLS-AT CELL 9 * + ;
+: CHECKS	CELLS-AT CELL 10 * + ;
+: FAILURES	CELLS-AT CELL 11 * + ;
+
+\ Count a check and print its result.
+: RESULT ( c-addr u flag -- )
+	1 CHECKS +!
+	>R TELL R> IF ."  ok" CR EXIT THEN
+	1 FAILURES +!
+	."  FAILED" CR
+;
+
+: NAME ( "name" -- )
+	WORD 1+ PATH SWAP CMOVE		\ WORD leaves a NUL after the name.
+;
+
+: NOTE ( n -- ) LOG @ 10 * + LOG ! ;
+
+: WAIT ( ms -- ) 0 TIMER-AFTER ;
+
+\ Timers.
+: FIRST ( -- ) 1 NOTE ;
+: SECOND ( -- ) 2 NOTE ;
+: THIRD ( -- ) 3 NOTE ;
+
+: CHECK-TIMERS ( -- )
+	0 LOG !
+	30 ['] THIRD TIMER-AFTER
+	10 ['] FIRST TIMER-AFTER
+	20 ['] SECOND TIMER-AFTER
+	50 WAIT
+	S" timers in order" LOG @ 123 =
+	RESULT
+;
+
+: SLEEPER ( task -- ) ACTIVATE 1 NOTE 20 WAIT 2 NOTE 20 WAIT 3 NOTE ;
+
+: CHECK-RESUME ( -- )
+	0 LOG !
+	TASK SLEEPER 10 WAIT 9 NOTE
+	60 WAIT
+	S" task resumes after TIMER-AFTER" LOG @ 1923 =
+	RESULT
+;
+
+\ Pipes.  pipe() fills in two ints, which are read a byte at a time so that
+\ this works whatever the size of a cell.
+: INT@ ( addr -- n )
+	DUP 3 + C@ OVER 2 + C@ SWAP 256 * +
+	OVER 1+ C@ SWAP 256 * + SWAP C@ SWAP 256 * +
+;
+
+: OPEN-PIPE ( -- )
+	FDS SYS_PIPE SYSCALL1 DROP
+	FDS INT@ READ-FD ! FDS 4 + INT@ WRITE-FD !
+;
+
+: CLOSE-PIPE ( -- )
+	READ-FD @ SYS_CLOSE SYSCALL1 DROP
+	WRITE-FD @ SYS_CLOSE SYSCALL1 DROP
+;
+
+: FILL-SRC ( -- ) LENGTH 0 DO I 251 MOD SRC I + C! LOOP ;
+: SAME? ( n -- flag ) DUP >R SRC SWAP DST R> COMPARE 0= ;
+
+\ True if a transfer of u characters moved them all without an error.
+: MOVED? ( n ior u -- flag ) SWAP 0= >R = R> AND ;
+
+: READ-DONE ( n ior -- ) READ-IOR ! RECEIVED ! ;
+: WRITE-DONE ( n ior -- ) WRITE-IOR ! WRITTEN ! ;
+
+: CHECK-CALLBACKS ( -- )
+	OPEN-PIPE DST 100 ERASE -1 RECEIVED ! -1 WRITTEN !
+	DST 100 READ-FD @ ['] READ-DONE ASYNC-READ
+	SRC 100 WRITE-FD @ ['] WRITE-DONE ASYNC-WRITE
+	20 WAIT
+	S" pipe round trip with callbacks"
+	WRITTEN @ WRITE-IOR @ 100 MOVED?
+	RECEIVED @ READ-IOR @ 100 MOVED? AND
+	100 SAME? AND
+	RESULT
+	CLOSE-PIPE
+;
+
+: CHECK-WAITING ( -- )
+	OPEN-PIPE DST 100 ERASE
+	S" pipe round trip, waiting"
+	SRC 100 WRITE-FD @ 0 ASYNC-WRITE 100 MOVED?
+	DST 100 READ-FD @ 0 ASYNC-READ 100 MOVED? AND
+	100 SAME? AND
+	RESULT
+	CLOSE-PIPE
+;
+
+: READER ( task -- )
+	ACTIVATE
+	0 BEGIN
+		DUP DST + CHUNK READ-FD @ 0 ASYNC-READ
+		IF 2DROP -1 RECEIVED ! EXIT THEN
+		+ DUP LENGTH =
+	UNTIL
+	RECEIVED !
+;
+
+: CHECK-BIG-PIPE ( -- )
+	OPEN-PIPE DST LENGTH ERASE 0 RECEIVED !
+	TASK READER
+	S" 100000-byte pipe round trip"
+	SRC LENGTH WRITE-FD @ 0 ASYNC-WRITE LENGTH MOVED?
+	BEGIN RECEIVED @ 0= WHILE 10 WAIT REPEAT
+	RECEIVED @ LENGTH = AND LENGTH SAME? AND
+	RESULT
+	CLOSE-PIPE
+;
+
+\ Regular files, which cannot be polled.
+: CHECK-FILE ( -- )
+	420 578 PATH SYS_OPEN SYSCALL3 FILE-FD !	\ O_RDWR|O_CREAT|O_TRUNC
+	DST 5000 ERASE
+	S" regular file round trip"
+	SRC 5000 FILE-FD @ 0 ASYNC-WRITE 5000 MOVED?
+	0 0 FILE-FD @ SYS_LSEEK SYSCALL3 0= AND
+	DST 5000 FILE-FD @ 0 ASYNC-READ 5000 MOVED? AND
+	5000 SAME? AND
+	RESULT
+	FILE-FD @ SYS_CLOSE SYSCALL1 DROP
+	PATH SYS_UNLINK SYSCALL1 DROP
+;
+
+: CHECK-EBADF ( -- )
+	OPEN-PIPE CLOSE-PIPE
+	S" EBADF gives ior 9"
+	DST 100 READ-FD @ 0 ASYNC-READ 9 = NIP
+	RESULT
+;
+
+: CHECK-ALL ( -- )
+	0 CHECKS ! 0 FAILURES !
+	CHECK-TIMERS
+	CHECK-RESUME
+	FILL-SRC
+	CHECK-CALLBACKS
+	CHECK-WAITING
+	CHECK-BIG-PIPE
+	CHECK-FILE
+	CHECK-EBADF
+	CHECKS @ . ." checks, " FAILURES @ . ." failures" CR
+;
+
+NAME /tmp/tomoko-events.tmp
+CHECK-ALL
@@ -0,0 +1,91 @@
+\ Floats per second through F-SUM and F-DOT, against the same loops in
+\ threaded code, with jonesforth.f.txt as ~/.tomoko:
+\
+\   ./tomoko -j 1 bench/floats.fs
+\
+\ Each line gives the result, the time in milliseconds for PASSES passes over
+\ arrays of COUNT floats, and the time per float in picoseconds.
+
+\ jonesforth.f.txt's CONSTANT and VARIABLE call WORD before CREATE, which
+\ reads the name itself here, so the addresses are compiled with LITERAL.
+100000 : COUNT LITERAL ;
+100 : PASSES LITERAL ;
+COUNT FLOATS ALLOCATE DROP : A LITERAL ;
+COUNT FLOATS ALLOCATE DROP : B LITERAL ;
+CELL 4 * ALLOCATE DROP : CELLS-AT LITERAL ;
+: TIMESPEC	CELLS-AT ;		\ Two cells.
+: START-SEC	CELLS-AT CELL 2 * + ;
+: START-NSEC	CELLS-AT CELL 3 * + ;
+
+: NOW ( -- sec nsec )
+	TIMESPEC 1 SYS_CLOCK_GETTIME SYSCALL2 DROP	\ CLOCK_MONOTONIC
+	TIMESPEC @ TIMESPEC CELL + @
+;
+
+: START ( -- ) NOW START-NSEC ! START-SEC ! ;
+
+: ELAPSED ( -- us )
+	NOW START-NSEC @ - 1000 /
+	SWAP START-SEC @ - 1000000 * +
+;
+
+: REPORT ( -- ) ( F: r -- )
+	ELAPSED F.
+	DUP 1000 / 8 .R
+	1000000 COUNT PASSES * */ 11 .R CR
+;
+
+: FILL-ARRAYS ( -- )
+	0 BEGIN
+		DUP 0 D>F DUP FLOATS A + F!
+		0.5E DUP FLOATS B + F!
+		1+ DUP COUNT =
+	UNTIL DROP
+;
+
+: THREADED-SUM ( -- ) ( F: -- r )
+	0E A COUNT BEGIN
+		SWAP DUP F@ F+ FLOAT+ SWAP
+		1- DUP 0=
+	UNTIL 2DROP
+;
+
+: THREADED-DOT ( -- ) ( F: -- r )
+	0E A B COUNT BEGIN
+		>R
+		OVER F@ DUP F@ F* F+
+		FLOAT+ SWAP FLOAT+ SWAP
+		R> 1- DUP 0=
+	UNTIL DROP 2DROP
+;
+
+: SUM-PASSES ( -- ) ( F: -- r )
+	0E START PASSES BEGIN
+		FDROP THREADED-SUM 1- DUP 0=
+	UNTIL DROP
+;
+
+: F-SUM-PASSES ( -- ) ( F: -- r )
+	0E START PASSES BEGIN
+		FDROP A COUNT F-SUM 1- DUP 0=
+	UNTIL DROP
+;
+
+: DOT-PASSES ( -- ) ( F: -- r )
+	0E START PASSES BEGIN
+		FDROP THREADED-DOT 1- DUP 0=
+	UNTIL DROP
+;
+
+: F-DOT-PASSES ( -- ) ( F: -- r )
+	0E START PASSES BEGIN
+		FDROP A B COUNT F-DOT 1- DUP 0=
+	UNTIL DROP
+;
+
+FILL-ARRAYS
+."                 result      ms   ps/float" CR
+." threaded sum " SUM-PASSES REPORT
+." F-SUM        " F-SUM-PASSES REPORT
+." threaded dot " DOT-PASSES REPORT
+." F-DOT        " F-DOT-PASSES REPORT
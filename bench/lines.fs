@@ -0,0 +1,89 @@
+\ Lines per second through the file words, with jonesforth.f.txt as
+\ ~/.tomoko:
+\
+\   ./tomoko -j 1 bench/lines.fs
+\
+\ Writes a log of LINES lines, of 40 to 103 characters, to /tmp with
+\ WRITE-LINE, then reads it back a line at a time with READ-LINE, which
+\ copies each line out, and NEXT-LINE, which does not.  Each line gives the
+\ lines, the time in milliseconds, thousands of lines per second and MB/s.
+
+\ jonesforth.f.txt's CONSTANT and VARIABLE call WORD before CREATE, which
+\ reads the name itself here, so the addresses are compiled with LITERAL.
+1000000 : LINES LITERAL ;
+256 ALLOCATE DROP : BUFFER LITERAL ;
+256 ALLOCATE DROP : PATH LITERAL ;
+CELL 8 * ALLOCATE DROP : CELLS-AT LITERAL ;
+: TIMESPEC	CELLS-AT ;		\ Two cells.
+: START-SEC	CELLS-AT CELL 2 * + ;
+: START-NSEC	CELLS-AT CELL 3 * + ;
+: FID		CELLS-AT CELL 4 * + ;
+: BYTES		CELLS-AT CELL 5 * + ;
+: PATH-LENGTH	CELLS-AT CELL 6 * + ;
+
+: NAME ( "name" -- )
+	WORD DUP PATH-LENGTH !
+	1+ PATH SWAP CMOVE		\ WORD leaves a NUL after the name.
+;
+
+: NOW ( -- sec nsec )
+	TIMESPEC 1 SYS_CLOCK_GETTIME SYSCALL2 DROP	\ CLOCK_MONOTONIC
+	TIMESPEC @ TIMESPEC CELL + @
+;
+
+: START ( -- ) NOW START-NSEC ! START-SEC ! ;
+
+: ELAPSED ( -- us )
+	NOW START-NSEC @ - 1000 /
+	SWAP START-SEC @ - 1000000 * +
+;
+
+: REPORT ( lines -- )
+	ELAPSED
+	OVER 10 .R DUP 1000 / 8 .R
+	OVER 1000 * OVER / 10 .R		\ thousands of lines per second
+	BYTES @ SWAP / 8 .R CR			\ bytes per us = MB/s
+	DROP
+;
+
+: WRITE-LOG ( -- )
+	PATH PATH-LENGTH @ W/O CREATE-FILE DROP FID !
+	BUFFER 256 120 FILL 0 BYTES ! START
+	LINES BEGIN
+		DUP 63 AND 40 +
+		DUP 1+ BYTES +!
+		BUFFER SWAP FID @ WRITE-LINE DROP
+		1- DUP 0=
+	UNTIL DROP
+	FID @ CLOSE-FILE DROP
+	LINES REPORT
+;
+
+: READ-LINES ( -- )
+	PATH PATH-LENGTH @ R/O OPEN-FILE DROP FID ! START
+	0 BEGIN
+		BUFFER 256 FID @ READ-LINE DROP
+	WHILE
+		DROP 1+
+	REPEAT DROP
+	FID @ CLOSE-FILE DROP
+	REPORT
+;
+
+: NEXT-LINES ( -- )
+	PATH PATH-LENGTH @ R/O OPEN-FILE DROP FID ! START
+	0 BEGIN
+		FID @ NEXT-LINE DROP
+	WHILE
+		2DROP 1+
+	REPEAT 2DROP
+	FID @ CLOSE-FILE DROP
+	REPORT
+;
+
+NAME /tmp/tomoko-lines.log
+."      lines      ms  klines/s    MB/s" CR
+." WRITE-LINE" CR WRITE-LOG
+." READ-LINE" CR READ-LINES
+." NEXT-LINE" CR NEXT-LINES
+PATH SYS_UNLINK SYSCALL1 DROP
@@ -0,0 +1,63 @@
+\ Iterations per second through DO ... LOOP, against the same loops written
+\ with BEGIN ... UNTIL, with jonesforth.f.txt as ~/.tomoko:
+\
+\   ./tomoko -j 1 bench/loops.fs
+\
+\ Each line gives the result, the time in milliseconds for COUNT iterations
+\ and the time per iteration in picoseconds.
+
+\ jonesforth.f.txt's CONSTANT and VARIABLE call WORD before CREATE, which
+\ reads the name itself here, so the addresses are compiled with LITERAL.
+100000000 : COUNT LITERAL ;
+CELL 4 * ALLOCATE DROP : CELLS-AT LITERAL ;
+: TIMESPEC	CELLS-AT ;		\ Two cells.
+: START-SEC	CELLS-AT CELL 2 * + ;
+: START-NSEC	CELLS-AT CELL 3 * + ;
+
+: NOW ( -- sec nsec )
+	TIMESPEC 1 SYS_CLOCK_GETTIME SYSCALL2 DROP	\ CLOCK_MONOTONIC
+	TIMESPEC @ TIMESPEC CELL + @
+;
+
+: START ( -- ) NOW START-NSEC ! START-SEC ! ;
+
+: ELAPSED ( -- us )
+	NOW START-NSEC @ - 1000 /
+	SWAP START-SEC @ - 1000000 * +
+;
+
+: REPORT ( n -- )
+	ELAPSED SWAP 12 .R
+	DUP 1000 / 8 .R
+	1000000 COUNT */ 7 .R CR
+;
+
+: BEGIN-EMPTY ( -- n )
+	START COUNT BEGIN 1- DUP 0= UNTIL
+;
+
+: DO-EMPTY ( -- n )
+	START COUNT 0 DO LOOP 0
+;
+
+: BEGIN-SUM ( -- n )
+	START 0 0 BEGIN
+		SWAP OVER + SWAP
+		1+ DUP COUNT =
+	UNTIL DROP
+;
+
+: DO-SUM ( -- n )
+	START 0 COUNT 0 DO I + LOOP
+;
+
+: DO-SUM-BY-2 ( -- n )
+	START 0 COUNT 0 DO I + 2 +LOOP
+;
+
+."                   result      ms  ps/iter" CR
+." BEGIN empty " BEGIN-EMPTY REPORT
+." DO empty    " DO-EMPTY REPORT
+." BEGIN sum   " BEGIN-SUM REPORT
+." DO sum      " DO-SUM REPORT
+." DO sum +2   " DO-SUM-BY-2 REPORT
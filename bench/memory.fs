@@ -0,0 +1,73 @@
+\ Throughput of the bulk memory words from 16 bytes to 16 MB, with
+\ jonesforth.f.txt as ~/.tomoko:
+\
+\   ./tomoko -j 1 bench/memory.fs
+\
+\ For each word, each line moves TOTAL bytes, SIZE bytes at a time, between
+\ two buffers of 16 MB, and gives the size, the calls, the time per call in
+\ nanoseconds and the throughput in MB/s.  COMPARE compares equal buffers, so
+\ it reads both to the end.
+
+\ jonesforth.f.txt's CONSTANT and VARIABLE call WORD before CREATE, which
+\ reads the name itself here, so the addresses are compiled with LITERAL.
+16777216 : LARGEST LITERAL ;
+67108864 : TOTAL LITERAL ;
+LARGEST ALLOCATE DROP : A LITERAL ;
+LARGEST ALLOCATE DROP : B LITERAL ;
+CELL 8 * ALLOCATE DROP : CELLS-AT LITERAL ;
+: TIMESPEC	CELLS-AT ;		\ Two cells.
+: START-SEC	CELLS-AT CELL 2 * + ;
+: START-NSEC	CELLS-AT CELL 3 * + ;
+: SIZE		CELLS-AT CELL 4 * + ;
+: CALLS		CELLS-AT CELL 5 * + ;
+
+: NOW ( -- sec nsec )
+	TIMESPEC 1 SYS_CLOCK_GETTIME SYSCALL2 DROP	\ CLOCK_MONOTONIC
+	TIMESPEC @ TIMESPEC CELL + @
+;
+
+: START ( -- ) NOW START-NSEC ! START-SEC ! ;
+
+: ELAPSED ( -- us )
+	NOW START-NSEC @ - 1000 /
+	SWAP START-SEC @ - 1000000 * +
+;
+
+: REPORT ( -- )
+	ELAPSED
+	SIZE @ 10 .R CALLS @ 10 .R
+	DUP 1000 CALLS @ */ 10 .R		\ ns per call
+	CALLS @ SIZE @ * SWAP / 10 .R CR	\ bytes per us = MB/s
+;
+
+\ Each word called with the size alone.
+: FILL-A	( size -- ) A SWAP 120 FILL ;
+: ERASE-A	( size -- ) A SWAP ERASE ;
+: CMOVE-AB	( size -- ) >R A B R> CMOVE ;
+: CMOVE>-AB	( size -- ) >R A B R> CMOVE> ;
+: MOVE-AB	( size -- ) >R A B R> MOVE ;
+: COMPARE-AB	( size -- ) >R A R> B OVER COMPARE DROP ;
+
+: TIMES ( xt size -- )
+	DUP SIZE ! TOTAL SWAP / CALLS ! START
+	CALLS @ 0 DO SIZE @ OVER EXECUTE LOOP DROP
+	REPORT
+;
+
+\ Time the word named next at each size, 16 times the last.
+: SIZES ( "name" -- )
+	WORD FIND >CFA
+	16 BEGIN
+		2DUP TIMES
+		16 * DUP LARGEST >
+	UNTIL 2DROP
+;
+
+A LARGEST ERASE B LARGEST ERASE
+."       size     calls   ns/call      MB/s" CR
+." FILL" CR SIZES FILL-A
+." ERASE" CR SIZES ERASE-A
+." CMOVE" CR SIZES CMOVE-AB
+." CMOVE>" CR SIZES CMOVE>-AB
+." MOVE" CR SIZES MOVE-AB
+." COMPARE" CR SIZES COMPARE-AB
@@ -0,0 +1,87 @@
+\ Scaling of PAR-DO, PAR-MAP and PAR-REDUCE against the same loops run
+\ serially, with jonesforth.f.txt as ~/.tomoko.  The pool's size is fixed by
+\ -w when Tomoko starts, so run the script once for each size:
+\
+\   for w in 1 2 4 8; do echo "-w $w"; ./tomoko -w $w -j 1 bench/par.fs; done
+\
+\ Each loop runs over COUNT cells, and the bodies of PAR-DO and PAR-MAP count
+\ WORK steps for each.  Each line gives the result, the time in milliseconds
+\ and the speed of the loop as a percentage of the serial loop's.
+
+\ jonesforth.f.txt's CONSTANT and VARIABLE call WORD before CREATE, which
+\ reads the name itself here, so the addresses are compiled with LITERAL.
+1000000 : COUNT LITERAL ;
+50 : WORK LITERAL ;
+COUNT CELLS ALLOCATE DROP : SRC LITERAL ;
+COUNT CELLS ALLOCATE DROP : DST LITERAL ;
+CELL 8 * ALLOCATE DROP : CELLS-AT LITERAL ;
+: TIMESPEC	CELLS-AT ;		\ Two cells.
+: START-SEC	CELLS-AT CELL 2 * + ;
+: START-NSEC	CELLS-AT CELL 3 * + ;
+: SERIAL	CELLS-AT CELL 4 * + ;	\ The serial loop's time.
+
+: NOW ( -- sec nsec )
+	TIMESPEC 1 SYS_CLOCK_GETTIME SYSCALL2 DROP	\ CLOCK_MONOTONIC
+	TIMESPEC @ TIMESPEC CELL + @
+;
+
+: START ( -- ) NOW START-NSEC ! START-SEC ! ;
+
+: ELAPSED ( -- us )
+	NOW START-NSEC @ - 1000 /
+	SWAP START-SEC @ - 1000000 * +
+;
+
+: REPORT ( us n -- )
+	16 .R
+	DUP 1000 / 8 .R
+	>R SERIAL @ 100 R> */ 8 .R ." %" CR
+;
+
+\ The serial loop's line, which the parallel loop's that follows is measured
+\ against.
+: REPORT-SERIAL ( us n -- ) OVER SERIAL ! REPORT ;
+
+: FILL-SRC ( -- ) COUNT 0 DO I SRC I CELLS + ! LOOP ;
+: CLEAR-DST ( -- ) DST COUNT CELLS ERASE ;
+: DST-SUM ( -- n ) 0 COUNT 0 DO DST I CELLS + @ + LOOP ;
+
+: SPIN ( x -- y ) WORK 0 DO 1+ LOOP ;
+: STEP ( i -- ) DUP SPIN SWAP CELLS DST + ! ;
+
+: SERIAL-DO ( -- )
+	CLEAR-DST START COUNT 0 DO I STEP LOOP ELAPSED DST-SUM REPORT-SERIAL
+;
+
+: PAR-DO-STEP ( -- )
+	CLEAR-DST START ['] STEP COUNT PAR-DO ELAPSED DST-SUM REPORT
+;
+
+: SERIAL-MAP ( -- )
+	CLEAR-DST START
+	COUNT 0 DO SRC I CELLS + @ SPIN DST I CELLS + ! LOOP
+	ELAPSED DST-SUM REPORT-SERIAL
+;
+
+: PAR-MAP-SPIN ( -- )
+	CLEAR-DST START ['] SPIN SRC DST COUNT PAR-MAP ELAPSED DST-SUM REPORT
+;
+
+: SERIAL-REDUCE ( -- )
+	START 0 COUNT 0 DO SRC I CELLS + @ + LOOP
+	ELAPSED SWAP REPORT-SERIAL
+;
+
+: PAR-REDUCE-ADD ( -- )
+	START ['] + SRC COUNT 0 PAR-REDUCE
+	ELAPSED SWAP REPORT
+;
+
+FILL-SRC
+."                           result      ms   speed" CR
+." DO          " SERIAL-DO
+." PAR-DO      " PAR-DO-STEP
+." MAP         " SERIAL-MAP
+." PAR-MAP     " PAR-MAP-SPIN
+." REDUCE      " SERIAL-REDUCE
+." PAR-REDUCE  " PAR-REDUCE-ADD
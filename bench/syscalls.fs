@@ -0,0 +1,80 @@
+\ Raw read and write throughput from Forth through SYSCALL3, with
+\ jonesforth.f.txt as ~/.tomoko:
+\
+\   ./tomoko -j 1 bench/syscalls.fs
+\
+\ Each line reads /dev/zero or writes /dev/null CALLS times, SIZE bytes at a
+\ time, and gives the time per call in nanoseconds and the throughput in MB/s.
+
+\ jonesforth.f.txt's CONSTANT and VARIABLE call WORD before CREATE, which
+\ reads the name itself here, so the addresses are compiled with LITERAL.
+65536 ALLOCATE DROP : BUFFER LITERAL ;
+CELL 8 * ALLOCATE DROP : CELLS-AT LITERAL ;
+: TIMESPEC	CELLS-AT ;		\ Two cells.
+: START-SEC	CELLS-AT CELL 2 * + ;
+: START-NSEC	CELLS-AT CELL 3 * + ;
+: FD		CELLS-AT CELL 4 * + ;
+: SIZE		CELLS-AT CELL 5 * + ;
+: CALLS		CELLS-AT CELL 6 * + ;
+
+: OPEN ( flags "name" -- )
+	WORD HERE @ SWAP 1+ CMOVE	\ WORD leaves a NUL after the name.
+	HERE @ SYS_OPEN SYSCALL2 FD !
+;
+
+: CLOSE ( -- ) FD @ SYS_CLOSE SYSCALL1 DROP ;
+
+: NOW ( -- sec nsec )
+	TIMESPEC 1 SYS_CLOCK_GETTIME SYSCALL2 DROP	\ CLOCK_MONOTONIC
+	TIMESPEC @ TIMESPEC CELL + @
+;
+
+: START ( -- ) NOW START-NSEC ! START-SEC ! ;
+
+: ELAPSED ( -- us )
+	NOW START-NSEC @ - 1000 /
+	SWAP START-SEC @ - 1000000 * +
+;
+
+: REPORT ( -- )
+	ELAPSED
+	SIZE @ 8 .R CALLS @ 10 .R
+	DUP CALLS @ 1000 / / 10 .R		\ ns per call
+	CALLS @ SIZE @ * SWAP / 10 .R CR	\ bytes per us = MB/s
+;
+
+: WRITES ( size calls -- )
+	CALLS ! SIZE ! START
+	CALLS @ BEGIN
+		SIZE @ BUFFER FD @ SYS_WRITE SYSCALL3 DROP
+		1- DUP 0=
+	UNTIL DROP
+	REPORT
+;
+
+: READS ( size calls -- )
+	CALLS ! SIZE ! START
+	CALLS @ BEGIN
+		SIZE @ BUFFER FD @ SYS_READ SYSCALL3 DROP
+		1- DUP 0=
+	UNTIL DROP
+	REPORT
+;
+
+." write /dev/null" CR
+."     size     calls   ns/call      MB/s" CR
+O_WRONLY OPEN /dev/null
+1 1000000 WRITES
+64 1000000 WRITES
+4096 200000 WRITES
+65536 16000 WRITES
+CLOSE
+
+." read /dev/zero" CR
+."     size     calls   ns/call      MB/s" CR
+O_RDONLY OPEN /dev/zero
+1 1000000 READS
+64 1000000 READS
+4096 200000 READS
+65536 16000 READS
+CLOSE
@@ -0,0 +1,61 @@
+\ Scaling of a countdown loop split across threads, with jonesforth.f.txt as
+\ ~/.tomoko:
+\
+\   ./tomoko -j 1 bench/threads.fs
+\
+\ The first line, with 0 threads, counts COUNT down in the operator alone.
+\ Each line after it splits the count between 1, 2, 4 and so on THREADs, up
+\ to the number of processors (or at least 4), and JOINs them all.  Each line
+\ gives the threads, the iterations counted, the wall-clock time in
+\ milliseconds and the time per iteration in picoseconds.
+
+\ jonesforth.f.txt's CONSTANT and VARIABLE call WORD before CREATE, which
+\ reads the name itself here, so the addresses are compiled with LITERAL.
+20000000 : COUNT LITERAL ;
+CELL 4 * ALLOCATE DROP : CELLS-AT LITERAL ;
+: TIMESPEC	CELLS-AT ;		\ Two cells.
+: START-SEC	CELLS-AT CELL 2 * + ;
+: START-NSEC	CELLS-AT CELL 3 * + ;
+
+: NOW ( -- sec nsec )
+	TIMESPEC 1 SYS_CLOCK_GETTIME SYSCALL2 DROP	\ CLOCK_MONOTONIC
+	TIMESPEC @ TIMESPEC CELL + @
+;
+
+: START ( -- ) NOW START-NSEC ! START-SEC ! ;
+
+: ELAPSED ( -- us )
+	NOW START-NSEC @ - 1000 /
+	SWAP START-SEC @ - 1000000 * +
+;
+
+: REPORT ( threads n -- )
+	ELAPSED >R SWAP 8 .R 12 .R
+	R> DUP 1000 / 8 .R
+	1000000 COUNT */ 9 .R CR
+;
+
+: COUNTDOWN ( n -- n ) DUP BEGIN 1- DUP 0= UNTIL DROP ;
+
+: OPERATOR ( -- )
+	START 0 COUNT COUNTDOWN REPORT
+;
+
+\ Start that many threads on an equal share of COUNT each, then JOIN them and
+\ add up their counts.
+: SPLIT ( threads -- )
+	START
+	DUP 0 DO COUNT OVER / ['] COUNTDOWN THREAD SWAP LOOP
+	DUP >R 0 SWAP 0 DO SWAP JOIN + LOOP
+	R> SWAP REPORT
+;
+
+: MOST ( -- threads ) CPUS DUP 4 < IF DROP 4 THEN ;
+
+: SCALING ( -- )
+	1 BEGIN DUP SPLIT DUP + DUP MOST > UNTIL DROP
+;
+
+." threads  iterations      ms  ps/iter" CR
+OPERATOR
+SCALING
@@ -0,0 +1,288 @@
+//-----------------------------------------------------------------------------
+// Arenas
+//
+// An Arena is a heap block that heads a chain of chunks, newest first, and
+// allocates from the newest by advancing a pointer.  When a chunk runs out, a
+// new one is chained in front of it.  Chunks released by ARENA-RELEASE move
+// to a spare list and are reused before any more are taken from the heap.
+//
+// A mark is a cell allotted in the arena, holding the chunk it is in, so its
+// address is the allocation pointer to go back to.  Each chunk knows the next
+// newer one, so releasing to a mark splices the newer chunks onto the spare
+// list at once, and costs the same however many chunks or objects it frees.
+//-----------------------------------------------------------------------------
+
+#include <stddef.h>
+
+#include "arena.h"
+#include "heap.h"
+#include "machine.h"
+#include "thread.h"
+
+//-----------------------------------------------------------------------------
+// External references to a few Forth global variables:
+
+extern Cell HERE_value;
+
+//-----------------------------------------------------------------------------
+/**
+ * The number of bytes that an arena requests from the heap for each chunk,
+ * chosen to fill the largest heap size class exactly.  Larger allocations get
+ * a chunk of their own size.
+ */
+#define TOMOKO_ARENA_CHUNK (4096 - 2 * sizeof (Cell))
+
+//-----------------------------------------------------------------------------
+/**
+ * The header of a chunk.  The chunk's memory follows it.
+ */
+typedef struct ArenaChunk
+{
+  struct ArenaChunk *previous; ///< The next older chunk in the chain.
+  struct ArenaChunk *newer;    ///< The next newer chunk, if there is one.
+  uint8_t *limit;              ///< The end of this chunk's memory.
+} ArenaChunk;
+
+/**
+ * An arena.
+ */
+typedef struct
+{
+  ArenaChunk *chunk; ///< The newest chunk, which allocations come from.
+  uint8_t *next;     ///< The allocation pointer, in chunk.
+  ArenaChunk *spare; ///< Released chunks, kept for reuse.
+} Arena;
+
+/**
+ * The current arenas selected by WITH-ARENA in this thread, innermost last.
+ */
+static __thread Arena *currentArenas[TOMOKO_ARENA_NESTING];
+
+/**
+ * The number of arenas in currentArenas.
+ */
+static __thread Cell arenaNesting = 0;
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the first address in chunk.
+ */
+static uint8_t *chunkStart(ArenaChunk *chunk)
+{
+  return (uint8_t*) (chunk + 1);
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Chain a chunk with room for at least size bytes in front of the arena's
+ * chain, preferring one from the spare list.  Return 0 if there is not
+ * enough memory.
+ */
+static int arenaGrow(Arena *arena, size_t size)
+{
+  ArenaChunk *chunk = arena->spare;
+  if (chunk != NULL && (size_t) (chunk->limit - chunkStart(chunk)) >= size)
+  {
+    arena->spare = chunk->previous;
+  }
+  else
+  {
+    size_t bytes = sizeof (ArenaChunk) + size;
+    if (bytes < TOMOKO_ARENA_CHUNK)
+    {
+      bytes = TOMOKO_ARENA_CHUNK;
+    }
+    chunk = heapAllocate(bytes);
+    if (chunk == NULL)
+    {
+      return 0;
+    }
+    chunk->limit = (uint8_t*) chunk + bytes;
+  }
+
+  chunk->previous = arena->chunk;
+  if (arena->chunk != NULL)
+  {
+    arena->chunk->newer = chunk;
+  }
+  arena->chunk = chunk;
+  arena->next = chunkStart(chunk);
+  return 1;
+} // arenaGrow
+
+//-----------------------------------------------------------------------------
+/**
+ * Allocate count bytes, rounded up to whole cells, in arena.  Return NULL if
+ * there is not enough memory.
+ */
+static void *arenaAllot(Arena *arena, UCell count)
+{
+  size_t size = ((size_t) count + sizeof (Cell) - 1) & ~(sizeof (Cell) - 1);
+  if (size < count)
+  {
+    return NULL;
+  }
+  if ((size_t) (arena->chunk->limit - arena->next) < size &&
+      !arenaGrow(arena, size))
+  {
+    return NULL;
+  }
+
+  void *address = arena->next;
+  arena->next += size;
+  return address;
+} // arenaAllot
+
+//-----------------------------------------------------------------------------
+/**
+ * Move the chunks in front of the one that mark records (see ARENA-MARK) from
+ * the arena's chain to its spare list, then make mark the allocation pointer.
+ * A NULL mark leaves the arena unchanged.
+ */
+static void arenaRelease(Arena *arena, ArenaChunk **mark)
+{
+  if (mark == NULL)
+  {
+    return;
+  }
+
+  ArenaChunk *chunk = *mark;
+  if (arena->chunk != chunk)
+  {
+    chunk->newer->previous = arena->spare;
+    arena->spare = arena->chunk;
+    arena->chunk = chunk;
+  }
+  arena->next = (uint8_t*) mark;
+} // arenaRelease
+
+//-----------------------------------------------------------------------------
+/**
+ * Return every chunk in the chain starting at chunk to the heap.
+ */
+static void freeChunks(ArenaChunk *chunk)
+{
+  while (chunk != NULL)
+  {
+    ArenaChunk *previous = chunk->previous;
+    heapFree(chunk);
+    chunk = previous;
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_ARENA_NEW(void)
+{
+  Arena *arena = heapAllocate(sizeof (Arena));
+  if (arena != NULL)
+  {
+    arena->chunk = NULL;
+    arena->spare = NULL;
+    if (!arenaGrow(arena, 0))
+    {
+      heapFree(arena);
+      arena = NULL;
+    }
+  }
+  STACK_PUSH(sp, arena);
+} // fn_ARENA_NEW
+
+//-----------------------------------------------------------------------------
+
+void fn_ARENA_ALLOT(void)
+{
+  UCell count = STACK_POP(sp);
+  Arena *arena = (Arena*) STACK_POP(sp);
+  void *address = arenaAllot(arena, count);
+  STACK_PUSH(sp, address);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_ARENA_MARK(void)
+{
+  Arena *arena = (Arena*) STACK_POP(sp);
+  ArenaChunk **mark = arenaAllot(arena, sizeof (ArenaChunk*));
+  if (mark != NULL)
+  {
+    *mark = arena->chunk;
+  }
+  STACK_PUSH(sp, mark);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_ARENA_RELEASE(void)
+{
+  ArenaChunk **mark = (ArenaChunk**) STACK_POP(sp);
+  Arena *arena = (Arena*) STACK_POP(sp);
+  arenaRelease(arena, mark);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_ARENA_FREE(void)
+{
+  Arena *arena = (Arena*) STACK_POP(sp);
+  freeChunks(arena->chunk);
+  freeChunks(arena->spare);
+  heapFree(arena);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_WITH_ARENA(void)
+{
+  if (arenaNesting == TOMOKO_ARENA_NESTING)
+  {
+    raiseFault("WITH-ARENA nested more than %d deep", TOMOKO_ARENA_NESTING);
+  }
+  currentArenas[arenaNesting++] = (Arena*) STACK_POP(sp);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_END_ARENA(void)
+{
+  if (arenaNesting > 0)
+  {
+    --arenaNesting;
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_AALLOT(void)
+{
+  UCell count = STACK_POP(sp);
+  void *address;
+  if (arenaNesting > 0)
+  {
+    address = arenaAllot(currentArenas[arenaNesting - 1], count);
+  }
+  else
+  {
+    lockDictionary();
+    address = (void*) HERE_value;
+    HERE_value += count;
+    unlockDictionary();
+  }
+  STACK_PUSH(sp, address);
+} // fn_AALLOT
+
+//-----------------------------------------------------------------------------
+
+void fn_ACOMMA(void)
+{
+  STACK_PUSH(sp, sizeof (Cell));
+  fn_AALLOT();
+  Cell *address = (Cell*) STACK_POP(sp);
+  if (address == NULL)
+  {
+    raiseFault("out of memory in A,");
+  }
+  *address = STACK_POP(sp);
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,103 @@
+//-----------------------------------------------------------------------------
+// Arenas
+//
+// Regions of memory in which many small objects are allocated by bumping a
+// pointer, and then all released together.  An arena grows by chaining
+// chunks from the heap.  A mark records an arena's allocation point, and
+// releasing to a mark discards everything allocated since in one step,
+// regardless of how many objects that was.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_ARENA_H
+#define TOMOKO_ARENA_H
+
+//-----------------------------------------------------------------------------
+/**
+ * The number of arenas that WITH-ARENA can nest.
+ */
+#define TOMOKO_ARENA_NESTING 16
+
+//-----------------------------------------------------------------------------
+/**
+ * ARENA-NEW ( -- arena )
+ *
+ * Create an empty arena.  Return 0 if there is not enough memory.
+ */
+extern void fn_ARENA_NEW(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * ARENA-ALLOT ( arena n -- addr )
+ *
+ * Allocate n bytes, rounded up to a whole number of cells, in the arena and
+ * return their cell-aligned address, or 0 if there is not enough memory.
+ */
+extern void fn_ARENA_ALLOT(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * ARENA-MARK ( arena -- mark )
+ *
+ * Return a mark recording the arena's current allocation point, which takes
+ * a cell of the arena, or 0 if there is not enough memory.
+ */
+extern void fn_ARENA_MARK(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * ARENA-RELEASE ( arena mark -- )
+ *
+ * Release everything allocated in the arena since mark was taken, in
+ * constant time.  The memory is kept by the arena for reuse.  A mark taken by
+ * ARENA-MARK straight after ARENA-NEW releases everything.  mark must come
+ * from this arena, and must not have been released by an ARENA-RELEASE to an
+ * earlier mark.  A mark of 0 releases nothing.
+ */
+extern void fn_ARENA_RELEASE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * ARENA-FREE ( arena -- )
+ *
+ * Return the arena and all of its memory to the heap.
+ */
+extern void fn_ARENA_FREE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * WITH-ARENA ( arena -- )
+ *
+ * Make arena the current arena, the target of AALLOT and A,, until the
+ * matching END-ARENA.  WITH-ARENA and END-ARENA can be nested.
+ */
+extern void fn_WITH_ARENA(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * END-ARENA ( -- )
+ *
+ * Restore the current arena that was in effect before the last WITH-ARENA.
+ */
+extern void fn_END_ARENA(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * AALLOT ( n -- addr )
+ *
+ * Like ARENA-ALLOT on the current arena.  Outside WITH-ARENA, allocate n
+ * bytes from the dictionary at HERE instead, so that code written with
+ * AALLOT works either way.
+ */
+extern void fn_AALLOT(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * A, ( x -- )
+ *
+ * Append x to the current arena, or to the dictionary outside WITH-ARENA.
+ */
+extern void fn_ACOMMA(void);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_ARENA_H
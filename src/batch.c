@@ -0,0 +1,423 @@
+//-----------------------------------------------------------------------------
+// Batches
+//
+// The queue is a counter in memory shared with the workers: each takes the
+// next script by incrementing it, and forks a process to run it, so that
+// nothing a script leaves behind (variables, tasks, events, arenas, or the
+// settings that libtomoko swaps between instances) reaches the next one.
+// That process sends the result back on the worker's pipe, as a header
+// followed by the script's output and fault message, and the parent keeps
+// the results that arrive early until the scripts before them are done.
+//-----------------------------------------------------------------------------
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <linux/limits.h>       // For PATH_MAX.
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "input.h"
+#include "machine.h"
+#include "output.h"
+#include "task.h"
+#include "thread.h"
+
+// External reference to EVALUATE (see tomoko.c).
+extern CodeWord *const evaluateWord;
+
+//-----------------------------------------------------------------------------
+/**
+ * What a worker writes on its pipe before a script's output and message.
+ */
+typedef struct
+{
+  int index;             ///< The script's index in the command line list.
+  size_t outputLength;   ///< The number of characters it output.
+  size_t messageLength;  ///< The length of its fault message, or 0.
+} ResultHeader;
+
+/**
+ * A script's result, in the parent.
+ */
+typedef struct
+{
+  int done;              ///< True once the result has arrived.
+  char *text;            ///< The output, then the message, from malloc().
+  size_t outputLength;
+  size_t messageLength;
+} Result;
+
+/**
+ * What the parent has read from a worker's pipe, but not yet used.
+ */
+typedef struct
+{
+  int fd;         ///< The read end of the pipe, or -1 once it has ended.
+  pid_t pid;      ///< The worker.
+  char *chars;    ///< The characters, from malloc().
+  size_t length;  ///< The number in chars.
+  size_t size;    ///< The size of chars.
+} Worker;
+
+//-----------------------------------------------------------------------------
+/**
+ * Write all length characters at chars to fd, and return false if that
+ * fails.
+ */
+static int writeAll(int fd, const void *chars, size_t length)
+{
+  const char *next = chars;
+  while (length > 0)
+  {
+    ssize_t n = write(fd, next, length);
+    if (n < 0 && errno != EINTR)
+    {
+      return 0;
+    }
+    if (n > 0)
+    {
+      next += n;
+      length -= n;
+    }
+  }
+  return 1;
+} // writeAll
+
+//-----------------------------------------------------------------------------
+/**
+ * Run the script named fileName, with its output going to *output (from
+ * malloc()), and return a description of its fault, or NULL.
+ */
+static char *runScript(const char *fileName, char **output,
+                       size_t *outputLength)
+{
+  static char message[PATH_MAX + 100];
+  FILE *file = open_memstream(output, outputLength);
+  if (file == NULL)
+  {
+    snprintf(message, sizeof message, "%s: %s\n", fileName, strerror(errno));
+    *output = NULL;
+    *outputLength = 0;
+    return message;
+  }
+
+  size_t length;
+  char *text = readFile(fileName, &length);
+  if (text == NULL)
+  {
+    snprintf(message, sizeof message, "%s: %s\n", fileName, strerror(errno));
+    fclose(file);
+    return message;
+  }
+
+  sp = (Cell*) userArea[USER_S0];
+  rsp = (Cell*) userArea[USER_R0];
+  fsp = (Float*) userArea[USER_F0];
+  userArea[USER_BASE] = 10;
+  userArea[USER_STATE] = 0;
+  setOutputFile(file);
+
+  const char *fault = NULL;
+  if (sigsetjmp(stackFaultRecovery, 1) == 0)
+  {
+    STACK_PUSH(sp, text);
+    STACK_PUSH(sp, length);
+    executeWord(evaluateWord);
+  }
+  else
+  {
+    fault = stackFault;
+    dropDictionaryLock();
+    recoverOperator();
+    endSources(0);
+  }
+
+  setOutputFile(NULL);
+  fclose(file);
+  free(text);
+  if (fault == NULL)
+  {
+    return NULL;
+  }
+  snprintf(message, sizeof message, "%s: %s\n", fileName, fault);
+  return message;
+} // runScript
+
+//-----------------------------------------------------------------------------
+/**
+ * Send the result of the script at index on the pipe fd: the outputLength
+ * characters of output, then message, which may be NULL.  Return false if
+ * that fails.
+ */
+static int sendResult(int fd, int index, const char *output,
+                      size_t outputLength, const char *message)
+{
+  ResultHeader header = { index, outputLength, 0 };
+  header.messageLength = (message != NULL) ? strlen(message) : 0;
+  return writeAll(fd, &header, sizeof header)
+         && writeAll(fd, output, header.outputLength)
+         && writeAll(fd, message, header.messageLength);
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * The body of a worker process: run scripts from the queue, each in a
+ * process of its own that sends the result on the pipe fd, until there are
+ * none left.
+ */
+static void runWorker(int fd, char *const *scripts, int count, int *next)
+{
+  static char message[PATH_MAX + 100];
+  for (;;)
+  {
+    int index = __atomic_fetch_add(next, 1, __ATOMIC_RELAXED);
+    if (index >= count)
+    {
+      break;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+      char *output;
+      size_t outputLength;
+      char *fault = runScript(scripts[index], &output, &outputLength);
+      _exit(sendResult(fd, index, output, outputLength, fault)
+            ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    int status = 0;
+    if (pid < 0)
+    {
+      snprintf(message, sizeof message, "%s: %s\n", scripts[index],
+               strerror(errno));
+    }
+    else if (waitpid(pid, &status, 0) == pid && WIFSIGNALED(status))
+    {
+      snprintf(message, sizeof message, "%s: %s\n", scripts[index],
+               strsignal(WTERMSIG(status)));
+    }
+    else if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS)
+    {
+      continue;
+    }
+    else
+    {
+      _exit(EXIT_FAILURE);
+    }
+    if (! sendResult(fd, index, NULL, 0, message))
+    {
+      _exit(EXIT_FAILURE);
+    }
+  }
+  _exit(EXIT_SUCCESS);
+} // runWorker
+
+//-----------------------------------------------------------------------------
+/**
+ * Read what worker has sent, and take the complete results from it.  Return
+ * false if the pipe has ended.
+ */
+static int receive(Worker *worker, Result *results)
+{
+  if (worker->size - worker->length < 4096)
+  {
+    size_t size = (worker->size == 0) ? 65536 : 2 * worker->size;
+    char *bigger = realloc(worker->chars, size);
+    if (bigger == NULL)
+    {
+      return 0;
+    }
+    worker->chars = bigger;
+    worker->size = size;
+  }
+
+  ssize_t n = read(worker->fd, worker->chars + worker->length,
+                   worker->size - worker->length);
+  if (n <= 0)
+  {
+    return n < 0 && errno == EINTR;
+  }
+  worker->length += n;
+
+  size_t used = 0;
+  ResultHeader header;
+  while (worker->length - used >= sizeof header)
+  {
+    memcpy(&header, worker->chars + used, sizeof header);
+    size_t textLength = header.outputLength + header.messageLength;
+    if (worker->length - used - sizeof header < textLength)
+    {
+      break;
+    }
+
+    Result *result = &results[header.index];
+    result->text = malloc(textLength + 1);
+    if (result->text == NULL)
+    {
+      return 0;
+    }
+    memcpy(result->text, worker->chars + used + sizeof header, textLength);
+    result->outputLength = header.outputLength;
+    result->messageLength = header.messageLength;
+    result->done = 1;
+    used += sizeof header + textLength;
+  }
+  worker->length -= used;
+  memmove(worker->chars, worker->chars + used, worker->length);
+  return 1;
+} // receive
+
+//-----------------------------------------------------------------------------
+/**
+ * Write out the results from *first on that have arrived, in order, up to
+ * the first that has not, and return false if any of them faulted.
+ */
+static int writeResults(Result *results, int count, int *first)
+{
+  int ok = 1;
+  for (; *first < count && results[*first].done; ++*first)
+  {
+    Result *result = &results[*first];
+    fwrite(result->text, 1, result->outputLength, stdout);
+    if (result->messageLength > 0)
+    {
+      fflush(stdout);
+      fwrite(result->text + result->outputLength, 1, result->messageLength,
+             stderr);
+      ok = 0;
+    }
+    free(result->text);
+  }
+  fflush(stdout);
+  return ok;
+} // writeResults
+
+//-----------------------------------------------------------------------------
+
+int runBatch(int workers, char *const *scripts, int count)
+{
+  terminalInput = 0;
+  if (! loadPrelude())
+  {
+    return EXIT_FAILURE;
+  }
+  if (workers > count)
+  {
+    workers = count;
+  }
+  if (workers > TOMOKO_BATCH_MAX_WORKERS)
+  {
+    workers = TOMOKO_BATCH_MAX_WORKERS;
+  }
+
+  int *next = mmap(NULL, sizeof (int), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  Result *results = calloc(count, sizeof (Result));
+  Worker *worker = calloc(workers, sizeof (Worker));
+  struct pollfd *polls = calloc(workers, sizeof (struct pollfd));
+  if (next == MAP_FAILED || results == NULL || worker == NULL
+      || polls == NULL)
+  {
+    fprintf(stderr, "not enough memory for %d scripts\n", count);
+    return EXIT_FAILURE;
+  }
+  *next = 0;
+
+  // Nothing buffered may be written twice, by the parent and a worker.
+  fflush(stdout);
+  fflush(stderr);
+
+  int i;
+  for (i = 0; i < workers; ++i)
+  {
+    int fds[2];
+    if (pipe(fds) != 0 || (worker[i].pid = fork()) < 0)
+    {
+      perror("could not start a worker");
+      return EXIT_FAILURE;
+    }
+    if (worker[i].pid == 0)
+    {
+      int j;
+      for (j = 0; j < i; ++j)
+      {
+        close(worker[j].fd);
+      }
+      close(fds[0]);
+      runWorker(fds[1], scripts, count, next);
+    }
+    close(fds[1]);
+    worker[i].fd = fds[0];
+  }
+
+  int ok = 1;
+  int first = 0;
+  int running = workers;
+  while (running > 0)
+  {
+    for (i = 0; i < workers; ++i)
+    {
+      polls[i].fd = worker[i].fd;
+      polls[i].events = POLLIN;
+    }
+    if (poll(polls, workers, -1) < 0)
+    {
+      continue;
+    }
+
+    for (i = 0; i < workers; ++i)
+    {
+      if (worker[i].fd >= 0 && polls[i].revents != 0
+          && ! receive(&worker[i], results))
+      {
+        close(worker[i].fd);
+        worker[i].fd = -1;
+        --running;
+      }
+    }
+    ok &= writeResults(results, count, &first);
+  }
+
+  for (i = 0; i < workers; ++i)
+  {
+    waitpid(worker[i].pid, NULL, 0);
+    free(worker[i].chars);
+  }
+
+  // A worker that died took its script's result with it.
+  for (i = first; i < count; ++i)
+  {
+    if (! results[i].done)
+    {
+      static const char failed[] = ": worker failed\n";
+      size_t length = strlen(scripts[i]) + sizeof failed - 1;
+      results[i].text = malloc(length + 1);
+      results[i].outputLength = 0;
+      results[i].messageLength = (results[i].text != NULL) ? length : 0;
+      if (results[i].text != NULL)
+      {
+        strcpy(results[i].text, scripts[i]);
+        strcat(results[i].text, failed);
+      }
+      results[i].done = 1;
+      ok = 0;
+    }
+  }
+  ok &= writeResults(results, count, &first);
+
+  free(polls);
+  free(worker);
+  free(results);
+  munmap(next, sizeof (int));
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+} // runBatch
+
+//-----------------------------------------------------------------------------
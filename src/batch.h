@@ -0,0 +1,36 @@
+//-----------------------------------------------------------------------------
+// Batches
+//
+// With -j N, Tomoko loads ~/.tomoko once, then forks N worker processes,
+// which inherit the compiled dictionary copy-on-write and take the scripts
+// named on the command line from a shared queue, one at a time.  Each script
+// runs in a process forked from its worker, so it starts with empty stacks,
+// BASE 10 and everything else as ~/.tomoko left it, whatever the scripts
+// before it in the same worker did.
+//
+// Each script's output is collected, and written to stdout in the order in
+// which the scripts were named, as soon as the scripts before it are done.
+// A script that faults, or cannot be read, is reported on stderr at the
+// same point.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_BATCH_H
+#define TOMOKO_BATCH_H
+
+//-----------------------------------------------------------------------------
+/**
+ * The most worker processes, whatever -j asks for.
+ */
+#define TOMOKO_BATCH_MAX_WORKERS 256
+
+//-----------------------------------------------------------------------------
+/**
+ * Load ~/.tomoko, then run the count scripts named in scripts with workers
+ * worker processes, and return the exit status: EXIT_SUCCESS if every
+ * script ran without a fault.
+ */
+extern int runBatch(int workers, char *const *scripts, int count);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_BATCH_H
@@ -0,0 +1,441 @@
+//-----------------------------------------------------------------------------
+// Blocks
+//
+// Block n occupies bytes n * 1024 to n * 1024 + 1023 of the block file, which
+// is opened (and created if need be) the first time a block is used.
+//
+// The cache is TOMOKO_BLOCK_SETS sets of TOMOKO_BLOCK_WAYS buffers.  Each
+// buffer records when it was last used, and a miss replaces the least
+// recently used buffer in the block's set.  An updated buffer is written back
+// when it is replaced, together with any updated buffers holding the blocks
+// either side of it, in a single pwritev() call.  A miss on the block after
+// the previous miss is taken to be a sequential scan, and the next
+// TOMOKO_BLOCK_READ_AHEAD blocks are read along with it in a single preadv().
+//
+// The Forth variables BLOCK-HITS and BLOCK-MISSES count lookups, and
+// BLOCK-READS and BLOCK-WRITES count blocks transferred to and from the file.
+//-----------------------------------------------------------------------------
+
+#define _DEFAULT_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "block.h"
+#include "machine.h"
+#include "output.h"
+
+//-----------------------------------------------------------------------------
+// External references to a few Forth global variables:
+
+extern Cell BLOCK_HITS_value;
+extern Cell BLOCK_MISSES_value;
+extern Cell BLOCK_READS_value;
+extern Cell BLOCK_WRITES_value;
+
+//-----------------------------------------------------------------------------
+/**
+ * The most buffers that are written back in one batch.
+ */
+#define TOMOKO_BLOCK_BATCH 16
+
+//-----------------------------------------------------------------------------
+/**
+ * A block buffer.
+ */
+typedef struct
+{
+  UCell block;   ///< The block in the buffer, if assigned is true.
+  int assigned;  ///< True if the buffer holds a block.
+  int updated;   ///< True if the buffer has changed since it was read.
+  UCell lastUse; ///< The value of useClock when the buffer was last used.
+  char data[TOMOKO_BLOCK_SIZE];
+} BlockBuffer;
+
+/**
+ * The cache: block n can only be in buffers[n % TOMOKO_BLOCK_SETS].
+ */
+static BlockBuffer buffers[TOMOKO_BLOCK_SETS][TOMOKO_BLOCK_WAYS];
+
+/**
+ * Counts buffer uses, to find the least recently used buffer in a set.
+ */
+static UCell useClock = 0;
+
+/**
+ * The buffer most recently returned by BLOCK or BUFFER, for UPDATE.
+ */
+static BlockBuffer *currentBuffer = NULL;
+
+/**
+ * The block after the last one read by a miss (or read ahead with it).  A
+ * miss on this block continues a sequential scan.
+ */
+static UCell nextSequential = 0;
+
+/**
+ * The block file, or -1 if it is not open yet.
+ */
+static int blockFile = -1;
+
+/**
+ * The name of the block file.
+ */
+static char blockFileName[PATH_MAX] = TOMOKO_BLOCK_FILE;
+
+//-----------------------------------------------------------------------------
+/**
+ * Save the updated buffers as the program ends, reporting a failure to
+ * stderr: there is nothing left for a fault to return to.
+ */
+static void saveBuffersAtExit(void)
+{
+  if (sigsetjmp(stackFaultRecovery, 1) == 0)
+  {
+    saveBuffers();
+  }
+  else
+  {
+    fprintf(stderr, "%s\n", stackFault);
+  }
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Open the file called blockFileName as the block file, creating it if need
+ * be.  Return 0 or an errno.
+ */
+static int openBlockFile(void)
+{
+  static int registered = 0;
+  blockFile = open(blockFileName, O_RDWR | O_CREAT, 0644);
+  if (blockFile < 0)
+  {
+    return errno;
+  }
+
+  // Updates should not be lost just because the program ends.
+  if (! registered)
+  {
+    atexit(saveBuffersAtExit);
+    registered = 1;
+  }
+  return 0;
+} // openBlockFile
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the block file, opening it if need be.
+ */
+static int theBlockFile(void)
+{
+  if (blockFile < 0 && openBlockFile() != 0)
+  {
+    raiseFault("could not open block file \"%s\"", blockFileName);
+  }
+  return blockFile;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the buffer holding block, or NULL if it is not cached.
+ */
+static BlockBuffer *findBuffer(UCell block)
+{
+  BlockBuffer *set = buffers[block % TOMOKO_BLOCK_SETS];
+  int way;
+  for (way = 0; way < TOMOKO_BLOCK_WAYS; ++way)
+  {
+    if (set[way].assigned && set[way].block == block)
+    {
+      return &set[way];
+    }
+  }
+  return NULL;
+} // findBuffer
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the updated buffer holding block, or NULL if there is none.
+ */
+static BlockBuffer *findUpdated(UCell block)
+{
+  BlockBuffer *buffer = findBuffer(block);
+  return (buffer != NULL && buffer->updated) ? buffer : NULL;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Write the updated buffer to the block file, along with the updated buffers
+ * of the blocks either side of it, in one call.
+ */
+static void writeBack(BlockBuffer *buffer)
+{
+  UCell first = buffer->block;
+  UCell last = buffer->block;
+  while (first > 0 && last - first + 1 < TOMOKO_BLOCK_BATCH &&
+         findUpdated(first - 1) != NULL)
+  {
+    --first;
+  }
+  while (last < (UCell) -1 && last - first + 1 < TOMOKO_BLOCK_BATCH &&
+         findUpdated(last + 1) != NULL)
+  {
+    ++last;
+  }
+
+  struct iovec vector[TOMOKO_BLOCK_BATCH];
+  int count = 0;
+  UCell block;
+  for (block = first; block <= last && block >= first; ++block)
+  {
+    BlockBuffer *batched = findBuffer(block);
+    vector[count].iov_base = batched->data;
+    vector[count].iov_len = TOMOKO_BLOCK_SIZE;
+    ++count;
+    batched->updated = 0;
+  }
+
+  ssize_t length = (ssize_t) count * TOMOKO_BLOCK_SIZE;
+  if (pwritev(theBlockFile(), vector, count,
+              (off_t) first * TOMOKO_BLOCK_SIZE) != length)
+  {
+    raiseFault("could not write blocks %lu to %lu of \"%s\"",
+        (unsigned long) first, (unsigned long) last, blockFileName);
+  }
+  BLOCK_WRITES_value += count;
+} // writeBack
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the buffer to reassign to block, which is not cached: an unassigned
+ * buffer in its set, or else the least recently used one.  If that holds an
+ * update, it is written back first.
+ */
+static BlockBuffer *victim(UCell block)
+{
+  BlockBuffer *set = buffers[block % TOMOKO_BLOCK_SETS];
+  BlockBuffer *oldest = &set[0];
+  int way;
+  for (way = 0; way < TOMOKO_BLOCK_WAYS; ++way)
+  {
+    if (! set[way].assigned)
+    {
+      return &set[way];
+    }
+    if (set[way].lastUse < oldest->lastUse)
+    {
+      oldest = &set[way];
+    }
+  }
+
+  if (oldest->updated)
+  {
+    writeBack(oldest);
+  }
+  oldest->assigned = 0;
+  return oldest;
+} // victim
+
+//-----------------------------------------------------------------------------
+/**
+ * Read block, which is not cached, into a buffer and return it.  If block
+ * follows the last block read, read the next few uncached blocks into other
+ * sets' buffers with it.
+ */
+static BlockBuffer *readBlocks(UCell block)
+{
+  BlockBuffer *batch[1 + TOMOKO_BLOCK_READ_AHEAD];
+  struct iovec vector[1 + TOMOKO_BLOCK_READ_AHEAD];
+  int count = 0;
+  int wanted = (block == nextSequential) ? 1 + TOMOKO_BLOCK_READ_AHEAD : 1;
+
+  do
+  {
+    batch[count] = victim(block + count);
+    vector[count].iov_base = batch[count]->data;
+    vector[count].iov_len = TOMOKO_BLOCK_SIZE;
+    ++count;
+  }
+  while (count < wanted && block + count > block &&
+         findBuffer(block + count) == NULL);
+
+  ssize_t length = preadv(theBlockFile(), vector, count,
+                          (off_t) block * TOMOKO_BLOCK_SIZE);
+  if (length < 0)
+  {
+    raiseFault("could not read block %lu of \"%s\"",
+        (unsigned long) block, blockFileName);
+  }
+
+  // Blocks beyond the end of the file read as spaces.
+  int i;
+  for (i = 0; i < count; ++i)
+  {
+    ssize_t start = (ssize_t) i * TOMOKO_BLOCK_SIZE;
+    if (length < start + TOMOKO_BLOCK_SIZE)
+    {
+      ssize_t valid = (length > start) ? length - start : 0;
+      memset(batch[i]->data + valid, ' ', TOMOKO_BLOCK_SIZE - valid);
+    }
+    batch[i]->block = block + i;
+    batch[i]->assigned = 1;
+    batch[i]->updated = 0;
+    batch[i]->lastUse = useClock;
+  }
+
+  BLOCK_READS_value += count;
+  nextSequential = block + count;
+  return batch[0];
+} // readBlocks
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the buffer for block, reading it on a miss only if read is true, and
+ * make it the current buffer.
+ */
+static BlockBuffer *assignBuffer(UCell block, int read)
+{
+  theBlockFile();
+  BlockBuffer *buffer = findBuffer(block);
+  if (buffer != NULL)
+  {
+    ++BLOCK_HITS_value;
+  }
+  else
+  {
+    ++BLOCK_MISSES_value;
+    if (read)
+    {
+      buffer = readBlocks(block);
+    }
+    else
+    {
+      buffer = victim(block);
+      buffer->block = block;
+      buffer->assigned = 1;
+      buffer->updated = 0;
+    }
+  }
+
+  buffer->lastUse = ++useClock;
+  currentBuffer = buffer;
+  return buffer;
+} // assignBuffer
+
+//-----------------------------------------------------------------------------
+
+char *blockContents(UCell block)
+{
+  return assignBuffer(block, 1)->data;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Unassign all of the buffers, without saving them.
+ */
+static void emptyBuffers(void)
+{
+  memset(buffers, 0, sizeof (buffers));
+  currentBuffer = NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+void saveBuffers(void)
+{
+  BlockBuffer *buffer = &buffers[0][0];
+  BlockBuffer *end = buffer + TOMOKO_BLOCK_SETS * TOMOKO_BLOCK_WAYS;
+  for ( ; buffer < end; ++buffer)
+  {
+    if (buffer->assigned && buffer->updated)
+    {
+      writeBack(buffer);
+    }
+  }
+} // saveBuffers
+
+//-----------------------------------------------------------------------------
+
+void fn_BLOCK_FILE(void)
+{
+  UCell nameLength = STACK_POP(sp);
+  const char *name = (const char*) STACK_POP(sp);
+
+  int ior = 0;
+  if (nameLength >= sizeof (blockFileName))
+  {
+    ior = ENAMETOOLONG;
+  }
+  else
+  {
+    if (blockFile >= 0)
+    {
+      saveBuffers();
+      close(blockFile);
+    }
+    emptyBuffers();
+    memcpy(blockFileName, name, nameLength);
+    blockFileName[nameLength] = '\0';
+    ior = openBlockFile();
+  }
+  STACK_PUSH(sp, ior);
+} // fn_BLOCK_FILE
+
+//-----------------------------------------------------------------------------
+
+void fn_BLOCK(void)
+{
+  UCell block = STACK_POP(sp);
+  STACK_PUSH(sp, blockContents(block));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_BUFFER(void)
+{
+  UCell block = STACK_POP(sp);
+  STACK_PUSH(sp, assignBuffer(block, 0)->data);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_UPDATE(void)
+{
+  if (currentBuffer != NULL)
+  {
+    currentBuffer->updated = 1;
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_SAVE_BUFFERS(void)
+{
+  saveBuffers();
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_EMPTY_BUFFERS(void)
+{
+  emptyBuffers();
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FLUSH(void)
+{
+  saveBuffers();
+  emptyBuffers();
+  flushOutput();
+}
+
+//-----------------------------------------------------------------------------
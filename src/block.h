@@ -0,0 +1,125 @@
+//-----------------------------------------------------------------------------
+// Blocks
+//
+// The ANS Forth block word set.  Blocks are 1024-byte records of a block file,
+// accessed through a set-associative cache of buffers with LRU replacement
+// within each set.  Updated buffers are written back in batches of adjacent
+// blocks, and sequential reads prompt read-ahead of the following blocks.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_BLOCK_H
+#define TOMOKO_BLOCK_H
+
+#include "types.h"
+
+//-----------------------------------------------------------------------------
+/**
+ * The size of a block, which LOAD reads as TOMOKO_BLOCK_LINES lines of
+ * TOMOKO_BLOCK_LINE characters.
+ */
+#define TOMOKO_BLOCK_SIZE  1024
+#define TOMOKO_BLOCK_LINE  64
+#define TOMOKO_BLOCK_LINES (TOMOKO_BLOCK_SIZE / TOMOKO_BLOCK_LINE)
+
+/**
+ * The shape of the buffer cache: the number of sets, and of buffers (ways) in
+ * each.  Block n is cached in set n mod TOMOKO_BLOCK_SETS, so runs of
+ * consecutive blocks spread across the sets.
+ */
+#define TOMOKO_BLOCK_SETS 16
+#define TOMOKO_BLOCK_WAYS 4
+
+/**
+ * The number of following blocks read along with a block, when it is read
+ * just after the block before it.
+ */
+#define TOMOKO_BLOCK_READ_AHEAD 4
+
+/**
+ * The block file used if BLOCK-FILE has not named another.
+ */
+#define TOMOKO_BLOCK_FILE "blocks.fb"
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the address of a buffer holding the contents of the specified
+ * block, reading it if it is not already cached.  This is the native
+ * implementation behind BLOCK.
+ */
+extern char *blockContents(UCell block);
+
+//-----------------------------------------------------------------------------
+/**
+ * Write all updated buffers to the block file.  This is the native
+ * implementation behind SAVE-BUFFERS.
+ */
+extern void saveBuffers(void);
+
+//-----------------------------------------------------------------------------
+// Words.
+//-----------------------------------------------------------------------------
+/**
+ * BLOCK-FILE ( c-addr u -- ior )
+ *
+ * Save any updated buffers and switch to the block file named by the string
+ * c-addr u, creating it if need be.  The ior is 0 or a (positive) errno.
+ */
+extern void fn_BLOCK_FILE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * BLOCK ( u -- a-addr )
+ *
+ * Return the address of a buffer containing block u, reading it from the
+ * block file if it is not already in a buffer.  The contents of blocks
+ * beyond the end of the file read as spaces.  The address is valid until
+ * the next use of BLOCK or BUFFER.
+ */
+extern void fn_BLOCK(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * BUFFER ( u -- a-addr )
+ *
+ * Like BLOCK, but if block u is not already in a buffer, assign one to it
+ * without reading its contents from the file.
+ */
+extern void fn_BUFFER(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * UPDATE ( -- )
+ *
+ * Mark the buffer most recently returned by BLOCK or BUFFER as updated, so
+ * that it is written back before it is reused and by SAVE-BUFFERS.
+ */
+extern void fn_UPDATE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * SAVE-BUFFERS ( -- )
+ *
+ * Write all updated buffers to the block file.
+ */
+extern void fn_SAVE_BUFFERS(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * EMPTY-BUFFERS ( -- )
+ *
+ * Unassign all buffers, discarding any updates.
+ */
+extern void fn_EMPTY_BUFFERS(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * FLUSH ( -- )
+ *
+ * SAVE-BUFFERS then EMPTY-BUFFERS, as ANS Forth specifies.  FLUSH also writes
+ * any buffered output to stdout, which is what it did before blocks existed.
+ */
+extern void fn_FLUSH(void);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_BLOCK_H
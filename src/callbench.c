@@ -0,0 +1,246 @@
+//-----------------------------------------------------------------------------
+// Cost of a call into an embedded instance
+//
+//   callbench [-n calls] [-s spawns] [-p program]
+//
+// Times the three ways a host program can have Tomoko square a number: by
+// calling a word it has looked up once (tomokoPush, tomokoCall, tomokoPop),
+// by evaluating the text "3 SQ DROP" (tomokoEvaluate), and by running the
+// tomoko program on the same text through a pipe, as a program without the
+// library would.  Each line gives the calls made and the time per call.  The
+// program loads ~/.tomoko as it starts, as it always does, and that is most
+// of the time it takes; the instance does not.
+//-----------------------------------------------------------------------------
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libtomoko.h"
+
+//-----------------------------------------------------------------------------
+
+static const char definition[] = ": SQ DUP * ;";
+static const char request[] = "3 SQ DROP";
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the time, in nanoseconds, on a clock that does not jump.
+ */
+static long long nanoseconds(void)
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Print a line of results for calls that took elapsed nanoseconds in all.
+ */
+static void report(const char *what, long calls, long long elapsed)
+{
+  double each = (double) elapsed / calls;
+  if (each < 1e6)
+  {
+    printf("%-32s %9ld calls %10.2f us per call\n", what, calls, each / 1e3);
+  }
+  else
+  {
+    printf("%-32s %9ld calls %10.2f ms per call\n", what, calls, each / 1e6);
+  }
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Time calls of SQ through tomokoCall().  Return false on a failure.
+ */
+static int timeCall(Tomoko *tomoko, long calls)
+{
+  TomokoXt square = tomokoFind(tomoko, "SQ");
+  if (square == NULL)
+  {
+    return 0;
+  }
+
+  long long start = nanoseconds();
+  long i;
+  for (i = 0; i < calls; ++i)
+  {
+    Cell result;
+    if (tomokoPush(tomoko, 3) != TOMOKO_OK
+        || tomokoCall(tomoko, square) != TOMOKO_OK
+        || tomokoPop(tomoko, &result) != TOMOKO_OK
+        || result != 9)
+    {
+      return 0;
+    }
+  }
+  report("tomokoCall (push, SQ, pop)", calls, nanoseconds() - start);
+  return 1;
+} // timeCall
+
+//-----------------------------------------------------------------------------
+/**
+ * Time evaluations of the request through tomokoEvaluate().  Return false on
+ * a failure.
+ */
+static int timeEvaluate(Tomoko *tomoko, long calls)
+{
+  long long start = nanoseconds();
+  long i;
+  for (i = 0; i < calls; ++i)
+  {
+    if (tomokoEvaluate(tomoko, request, sizeof request - 1) != TOMOKO_OK)
+    {
+      return 0;
+    }
+  }
+  report("tomokoEvaluate \"3 SQ DROP\"", calls, nanoseconds() - start);
+  return 1;
+} // timeEvaluate
+
+//-----------------------------------------------------------------------------
+/**
+ * Run program once, with the definition and the request on its standard
+ * input and its standard output thrown away, and wait for it.  Return false
+ * on a failure.
+ */
+static int spawn(const char *program)
+{
+  int fds[2];
+  if (pipe(fds) != 0)
+  {
+    return 0;
+  }
+
+  pid_t pid = fork();
+  if (pid < 0)
+  {
+    close(fds[0]);
+    close(fds[1]);
+    return 0;
+  }
+  if (pid == 0)
+  {
+    int null = open("/dev/null", O_WRONLY);
+    dup2(fds[0], STDIN_FILENO);
+    dup2(null, STDOUT_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    close(null);
+    execl(program, program, (char*) NULL);
+    _exit(127);
+  }
+
+  close(fds[0]);
+  char text[sizeof definition + sizeof request + 1];
+  int length = snprintf(text, sizeof text, "%s\n%s\n", definition, request);
+  int written = (write(fds[1], text, length) == length);
+  close(fds[1]);
+
+  int status;
+  return waitpid(pid, &status, 0) == pid && written
+         && WIFEXITED(status) && WEXITSTATUS(status) != 127;
+} // spawn
+
+//-----------------------------------------------------------------------------
+/**
+ * Time runs of program.  Return false on a failure.
+ */
+static int timeSpawn(const char *program, long spawns)
+{
+  long long start = nanoseconds();
+  long i;
+  for (i = 0; i < spawns; ++i)
+  {
+    if (! spawn(program))
+    {
+      return 0;
+    }
+  }
+  char what[64];
+  snprintf(what, sizeof what, "spawning %s", program);
+  report(what, spawns, nanoseconds() - start);
+  return 1;
+} // timeSpawn
+
+//-----------------------------------------------------------------------------
+/**
+ * Print the command line usage and exit(EXIT_FAILURE).
+ */
+static void usage(const char *program)
+{
+  fprintf(stderr,
+          "usage: %s [-n calls] [-s spawns] [-p program]\n"
+          "  -n calls    calls through the library (default 1000000)\n"
+          "  -s spawns   runs of the program (default 100)\n"
+          "  -p program  the tomoko program to run (default ./tomoko)\n",
+          program);
+  exit(EXIT_FAILURE);
+} // usage
+
+//-----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+  long calls = 1000000;
+  long spawns = 100;
+  const char *program = "./tomoko";
+  int option;
+  while ((option = getopt(argc, argv, "n:s:p:")) != -1)
+  {
+    switch (option)
+    {
+      case 'n':
+        calls = strtol(optarg, NULL, 0);
+        break;
+
+      case 's':
+        spawns = strtol(optarg, NULL, 0);
+        break;
+
+      case 'p':
+        program = optarg;
+        break;
+
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc || calls < 1 || spawns < 0)
+  {
+    usage(argv[0]);
+  }
+
+  Tomoko *tomoko = tomokoCreate();
+  if (tomoko == NULL
+      || tomokoEvaluate(tomoko, definition, sizeof definition - 1)
+         != TOMOKO_OK)
+  {
+    fprintf(stderr, "could not create an instance\n");
+    return EXIT_FAILURE;
+  }
+  if (! timeCall(tomoko, calls) || ! timeEvaluate(tomoko, calls))
+  {
+    const char *error = tomokoError(tomoko);
+    fprintf(stderr, "call failed: %s\n", error ? error : "wrong result");
+    return EXIT_FAILURE;
+  }
+  tomokoDestroy(tomoko);
+
+  if (spawns > 0 && ! timeSpawn(program, spawns))
+  {
+    fprintf(stderr, "%s: could not run\n", program);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+} // main
+
+//-----------------------------------------------------------------------------
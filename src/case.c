@@ -0,0 +1,366 @@
+//-----------------------------------------------------------------------------
+// Case Statements
+//
+// Offsets are in bytes, relative to the cell holding them, as BRANCH's are,
+// except for those in a table, which are relative to the cell after
+// (TABLE-OF) or (SEARCH-OF), where ip points when it runs.  A jump table
+// holds the lowest value, the number of entries and then an offset for each
+// value in turn, or 0 where there is no clause; a search table holds the
+// number of values and then each value, in ascending order, with its offset.
+//
+// Until ENDCASE resolves them, the ENDOF branches are chained through their
+// offsets, each holding the address of the one before it, or 0.  The clause
+// after each starts just after it, so ENDCASE follows the chain back to find
+// the clauses, and each (LIT-OF) offset leads forward to the clause after.
+//-----------------------------------------------------------------------------
+
+#include <stddef.h>
+
+#include "case.h"
+#include "machine.h"
+#include "native.h"
+#include "thread.h"
+
+// External references to a few Forth global variables:
+extern Cell HERE_value;
+
+// ... and to the words that CASE and the rest look for and compile (see
+// tomoko.c).
+extern CodeWord *const litWord;
+extern CodeWord *const tickWord;
+extern CodeWord *const branchWord;
+extern CodeWord *const dropWord;
+extern CodeWord *const ofWord;
+extern CodeWord *const litOfWord;
+extern CodeWord *const tableOfWord;
+extern CodeWord *const searchOfWord;
+extern CodeWord *const endCaseWord;
+
+/**
+ * Return the address that the offset at offset refers to.
+ */
+static inline void *target(const Cell *offset)
+{
+  return (char*) offset + *offset;
+}
+
+//-----------------------------------------------------------------------------
+// Run-time words.
+//-----------------------------------------------------------------------------
+
+void fn_POF(void)
+{
+  Cell x2 = STACK_POP(sp);
+  if (sp[0] == x2)
+  {
+    ++sp;
+    ++ip;
+  }
+  else
+  {
+    ip = target((Cell*) ip);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_PLITOF(void)
+{
+  Cell *operand = (Cell*) ip;
+  if (sp[0] == operand[0])
+  {
+    ++sp;
+    ip = (CodeWord**) (operand + 2);
+  }
+  else
+  {
+    ip = target(&operand[1]);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_PTABLEOF(void)
+{
+  Cell *operand = (Cell*) ip;
+  const Cell *table = target(operand);
+  UCell i = (UCell) sp[0] - (UCell) table[0];
+  if (i < (UCell) table[1] && table[2 + i] != 0)
+  {
+    ++sp;
+    ip = (CodeWord**) ((char*) operand + table[2 + i]);
+  }
+  else
+  {
+    ip = target(&operand[1]);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_PSEARCHOF(void)
+{
+  Cell *operand = (Cell*) ip;
+  const Cell *table = target(operand);
+  const Cell *pairs = table + 1;
+  Cell x = sp[0];
+  UCell low = 0;
+  UCell high = table[0];
+  while (low < high)
+  {
+    UCell middle = low + (high - low) / 2;
+    Cell value = pairs[2 * middle];
+    if (value < x)
+    {
+      low = middle + 1;
+    }
+    else if (value > x)
+    {
+      high = middle;
+    }
+    else
+    {
+      ++sp;
+      ip = (CodeWord**) ((char*) operand + pairs[2 * middle + 1]);
+      return;
+    }
+  }
+  ip = target(&operand[1]);
+} // fn_PSEARCHOF
+
+//-----------------------------------------------------------------------------
+
+void fn_PENDCASE(void)
+{
+  ++sp;
+  ip = target((Cell*) ip);
+}
+
+//-----------------------------------------------------------------------------
+// Compiling words.
+//-----------------------------------------------------------------------------
+
+void fn_CASE(void)
+{
+  STACK_PUSH(sp, HERE_value);
+  STACK_PUSH(sp, 0);
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Return true, with its value in *value, if the test compiled from clause up
+ * to code is a literal: LIT or ' and its value, or a built-in constant, such
+ * as 0, 1 or a SYS_ number, whose value cannot change.
+ */
+static int literalTest(const Cell *clause, const Cell *code, Cell *value)
+{
+  if (code - clause == 2
+      && (clause[0] == (Cell) litWord || clause[0] == (Cell) tickWord))
+  {
+    *value = clause[1];
+    return 1;
+  }
+  if (code - clause == 1 && *(CodeWord*) clause[0] == fn_CONST)
+  {
+    *value = ((Cell*) clause[0])[1];
+    return 1;
+  }
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_OF(void)
+{
+  Cell *endofs = (Cell*) sp[0];
+  Cell *start = (Cell*) sp[1];
+  Cell *clause = (endofs != NULL) ? endofs + 1 : start;
+
+  lockDictionary();
+  Cell *code = (Cell*) HERE_value;
+  Cell value;
+  Cell *next;
+  if (literalTest(clause, code, &value))
+  {
+    // Replace the test with (LIT-OF) and its value.
+    clause[0] = (Cell) litOfWord;
+    clause[1] = value;
+    next = clause + 2;
+  }
+  else
+  {
+    code[0] = (Cell) ofWord;
+    next = code + 1;
+  }
+  *next = 0;
+  HERE_value = (Cell) (next + 1);
+  unlockDictionary();
+
+  STACK_PUSH(sp, next);
+} // fn_OF
+
+//-----------------------------------------------------------------------------
+
+void fn_ENDOF(void)
+{
+  Cell *next = (Cell*) STACK_POP(sp);
+  lockDictionary();
+  Cell *code = (Cell*) HERE_value;
+  code[0] = (Cell) branchWord;
+  code[1] = sp[0];
+  HERE_value = (Cell) (code + 2);
+  unlockDictionary();
+
+  sp[0] = (Cell) &code[1];
+  *next = (char*) (code + 2) - (char*) next;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Return true if the clause at clause, which is no later than the one after
+ * the ENDOF at last, starts with a literal test.
+ */
+static int isLiteral(const Cell *clause, const Cell *last)
+{
+  return clause <= last && clause[0] == (Cell) litOfWord;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Compile a table at table for the run of literal tests starting with the
+ * (LIT-OF) at first, up to the ENDOF at last, if it has enough, and return
+ * the address after it.
+ */
+static Cell *compileTable(Cell *first, const Cell *last, Cell *table)
+{
+  Cell *operand = first + 1;
+  Cell min = first[1];
+  Cell max = first[1];
+  UCell count = 0;
+  Cell *record;
+  for (record = first; isLiteral(record, last); record = target(&record[2]))
+  {
+    min = (record[1] < min) ? record[1] : min;
+    max = (record[1] > max) ? record[1] : max;
+    ++count;
+  }
+  Cell *end = record;
+  if (count < TOMOKO_CASE_TABLE_MIN)
+  {
+    return table;
+  }
+
+  // Earlier clauses take precedence over later ones with the same value.
+  Cell *after;
+  if ((UCell) max - (UCell) min < 2 * count)
+  {
+    UCell span = (UCell) max - (UCell) min + 1;
+    UCell i;
+    table[0] = min;
+    table[1] = span;
+    for (i = 0; i < span; ++i)
+    {
+      table[2 + i] = 0;
+    }
+    for (record = first; record != end; record = target(&record[2]))
+    {
+      Cell *entry = &table[2 + ((UCell) record[1] - (UCell) min)];
+      if (*entry == 0)
+      {
+        *entry = (char*) (record + 3) - (char*) operand;
+      }
+    }
+    first[0] = (Cell) tableOfWord;
+    after = table + 2 + span;
+  }
+  else
+  {
+    // Insertion sort the values into pairs, keeping the first of each.
+    Cell *pairs = table + 1;
+    UCell n = 0;
+    for (record = first; record != end; record = target(&record[2]))
+    {
+      UCell i = n;
+      while (i > 0 && pairs[2 * (i - 1)] > record[1])
+      {
+        --i;
+      }
+      if (i > 0 && pairs[2 * (i - 1)] == record[1])
+      {
+        continue;
+      }
+      UCell j;
+      for (j = n; j > i; --j)
+      {
+        pairs[2 * j] = pairs[2 * (j - 1)];
+        pairs[2 * j + 1] = pairs[2 * (j - 1) + 1];
+      }
+      pairs[2 * i] = record[1];
+      pairs[2 * i + 1] = (char*) (record + 3) - (char*) operand;
+      ++n;
+    }
+    table[0] = n;
+    first[0] = (Cell) searchOfWord;
+    after = pairs + 2 * n;
+  }
+
+  first[1] = (char*) table - (char*) &first[1];
+  first[2] = (char*) end - (char*) &first[2];
+  return after;
+} // compileTable
+
+//-----------------------------------------------------------------------------
+
+void fn_ENDCASE(void)
+{
+  Cell *endofs = (Cell*) STACK_POP(sp);
+  Cell *start = (Cell*) STACK_POP(sp);
+
+  lockDictionary();
+  Cell *code = (Cell*) HERE_value;
+  Cell *tables = code + 2;
+  Cell *end = tables;
+
+  // Find the first clause of each run of literal tests, from the last.
+  Cell *endof;
+  for (endof = endofs; endof != NULL; endof = (Cell*) *endof)
+  {
+    Cell *before = (Cell*) *endof;
+    Cell *clause = (before != NULL) ? before + 1 : start;
+    if (isLiteral(clause, endofs))
+    {
+      Cell *earlier = NULL;
+      if (before != NULL)
+      {
+        earlier = (*before != 0) ? (Cell*) *before + 1 : start;
+      }
+      if (earlier == NULL || ! isLiteral(earlier, endofs))
+      {
+        end = compileTable(clause, endofs, end);
+      }
+    }
+  }
+
+  if (end == tables)
+  {
+    code[0] = (Cell) dropWord;
+    end = code + 1;
+  }
+  else
+  {
+    code[0] = (Cell) endCaseWord;
+    code[1] = (char*) end - (char*) &code[1];
+  }
+  HERE_value = (Cell) end;
+
+  // Point the ENDOF branches past it all.
+  while (endofs != NULL)
+  {
+    Cell *before = (Cell*) *endofs;
+    *endofs = (char*) end - (char*) endofs;
+    endofs = before;
+  }
+  unlockDictionary();
+} // fn_ENDCASE
+
+//-----------------------------------------------------------------------------
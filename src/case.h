@@ -0,0 +1,126 @@
+//-----------------------------------------------------------------------------
+// Case Statements
+//
+// CASE, OF, ENDOF and ENDCASE, in the ANS Forth syntax:
+//
+//   CASE
+//     test1 OF ... ENDOF
+//     test2 OF ... ENDOF
+//     ... ( default case, with the value still on the stack )
+//   ENDCASE
+//
+// A test that is just a literal (a number, ' followed by a word, or a built-in
+// constant such as 0 or SYS_READ) is taken out of the code, and OF compiles
+// (LIT-OF) with the value inline instead.  Any other test is left to run, and
+// OF compiles (OF) to compare with it:
+//
+//   5 OF ... ENDOF         -->  (LIT-OF) 5 next ... BRANCH end
+//   n 1+ OF ... ENDOF      -->  n 1+ (OF) next ... BRANCH end
+//   ENDCASE                -->  DROP
+//
+// ENDCASE then looks for runs of at least TOMOKO_CASE_TABLE_MIN consecutive
+// literal tests, and replaces the first (LIT-OF) of each with (TABLE-OF) if
+// the values are dense enough for a jump table, or (SEARCH-OF), to binary
+// search them, otherwise.  Either finds the clause for the value in one
+// instruction, or branches past the run to the tests that follow it, and on
+// to the default clause.  The tables follow ENDCASE's DROP, as (ENDCASE):
+//
+//   ENDCASE                -->  (ENDCASE) end table...
+//
+// The tests are still made in order, so the first of two clauses with the
+// same value is the one that runs.  As with IF and BEGIN, CASE and the rest
+// only work inside definitions.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_CASE_H
+#define TOMOKO_CASE_H
+
+//-----------------------------------------------------------------------------
+/**
+ * The fewest consecutive literal tests that ENDCASE compiles into a table.
+ */
+#define TOMOKO_CASE_TABLE_MIN 4
+
+//-----------------------------------------------------------------------------
+// Run-time words.
+//-----------------------------------------------------------------------------
+/**
+ * (OF) ( x1 x2 -- x1 | )
+ *
+ * If x1 and x2 are equal, drop them both and continue into the clause, or
+ * else drop x2 and branch to the next test by the offset in the cell after
+ * (OF).
+ */
+extern void fn_POF(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * (LIT-OF) ( x -- x | )
+ *
+ * Like (OF), comparing x with the value in the cell after (LIT-OF), which is
+ * followed by the offset.
+ */
+extern void fn_PLITOF(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * (TABLE-OF)  ( x -- x | )
+ * (SEARCH-OF) ( x -- x | )
+ *
+ * Find the clause for x in the table at the offset in the cell after the
+ * word, drop x and branch to the clause, or branch past the run of clauses by
+ * the offset in the cell after that if there is none.  (TABLE-OF) indexes a
+ * jump table with x; (SEARCH-OF) binary searches the values.
+ */
+extern void fn_PTABLEOF(void);
+extern void fn_PSEARCHOF(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * (ENDCASE) ( x -- )
+ *
+ * Drop x and branch over the tables by the offset in the cell after
+ * (ENDCASE).
+ */
+extern void fn_PENDCASE(void);
+
+//-----------------------------------------------------------------------------
+// Compiling words.  These are immediate words.
+//-----------------------------------------------------------------------------
+/**
+ * CASE ( -- start endofs )
+ *
+ * Return the start of the first clause and an empty chain of ENDOF branches.
+ */
+extern void fn_CASE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * OF ( start endofs -- start endofs next )
+ *
+ * Compile (LIT-OF) in place of a literal test, or (OF) after any other, and
+ * return the address of its offset to the next test.
+ */
+extern void fn_OF(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * ENDOF ( start endofs next -- start endofs' )
+ *
+ * Compile a BRANCH to be resolved by ENDCASE, chaining it onto endofs, and
+ * point next at the test that follows.
+ */
+extern void fn_ENDOF(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * ENDCASE ( start endofs -- )
+ *
+ * Compile DROP, or (ENDCASE) and the tables for the runs of literal tests,
+ * and point the ENDOF branches past them.
+ */
+extern void fn_ENDCASE(void);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_CASE_H
@@ -0,0 +1,587 @@
+//-----------------------------------------------------------------------------
+// Cell Arrays
+//
+// Each word is implemented by a kernel function in a CellKernels table.  There
+// is a portable scalar table, and on x86 hosts SSE2 and AVX2 tables, compiled
+// with GCC's target attribute so that the rest of Tomoko needn't be.  The
+// best table that the CPU supports is selected the first time a word is used.
+// The vector kernels assume 32-bit cells, which is what Tomoko is built for;
+// with any other Cell size, the scalar kernels are always used.
+//-----------------------------------------------------------------------------
+
+#include <stddef.h>
+
+#include "cells.h"
+#include "machine.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define TOMOKO_HAVE_CELL_SIMD 1
+#include <immintrin.h>
+#endif
+
+//-----------------------------------------------------------------------------
+/**
+ * The most negative Cell: the identity for CELLS-MAX.
+ */
+#define CELL_MIN ((Cell)((UCell) 1 << (CELL_BITS - 1)))
+
+/**
+ * The most positive Cell: the identity for CELLS-MIN.
+ */
+#define CELL_MAX ((Cell) ~CELL_MIN)
+
+//-----------------------------------------------------------------------------
+/**
+ * A set of implementations of the cell array words, for a particular
+ * instruction set.
+ */
+typedef struct
+{
+  Cell (*sum)(const Cell *a, size_t n);
+  Cell (*max)(const Cell *a, size_t n);
+  Cell (*min)(const Cell *a, size_t n);
+  void (*add)(const Cell *a, Cell *b, size_t n);
+  void (*scale)(Cell *a, size_t n, Cell k);
+  Cell (*dot)(const Cell *a, const Cell *b, size_t n);
+  Cell (*find)(const Cell *a, size_t n, Cell x);
+  Cell (*count)(const Cell *a, size_t n, Cell x);
+} CellKernels;
+
+//-----------------------------------------------------------------------------
+// Scalar kernels.
+//-----------------------------------------------------------------------------
+
+static Cell scalarSum(const Cell *a, size_t n)
+{
+  UCell sum = 0;
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    sum += a[i];
+  }
+  return (Cell) sum;
+}
+
+static Cell scalarMax(const Cell *a, size_t n)
+{
+  Cell max = CELL_MIN;
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    if (a[i] > max)
+    {
+      max = a[i];
+    }
+  }
+  return max;
+}
+
+static Cell scalarMin(const Cell *a, size_t n)
+{
+  Cell min = CELL_MAX;
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    if (a[i] < min)
+    {
+      min = a[i];
+    }
+  }
+  return min;
+}
+
+static void scalarAdd(const Cell *a, Cell *b, size_t n)
+{
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    b[i] = (Cell)((UCell) b[i] + (UCell) a[i]);
+  }
+}
+
+static void scalarScale(Cell *a, size_t n, Cell k)
+{
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    a[i] = (Cell)((UCell) a[i] * (UCell) k);
+  }
+}
+
+static Cell scalarDot(const Cell *a, const Cell *b, size_t n)
+{
+  UCell sum = 0;
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    sum += (UCell) a[i] * (UCell) b[i];
+  }
+  return (Cell) sum;
+}
+
+static Cell scalarFind(const Cell *a, size_t n, Cell x)
+{
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    if (a[i] == x)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static Cell scalarCount(const Cell *a, size_t n, Cell x)
+{
+  Cell count = 0;
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    count += (a[i] == x);
+  }
+  return count;
+}
+
+static const CellKernels scalarKernels =
+{
+  scalarSum, scalarMax, scalarMin, scalarAdd,
+  scalarScale, scalarDot, scalarFind, scalarCount
+};
+
+#ifdef TOMOKO_HAVE_CELL_SIMD
+//-----------------------------------------------------------------------------
+// SSE2 kernels: 4 cells per vector.
+//-----------------------------------------------------------------------------
+
+#define SSE2 __attribute__((target("sse2")))
+
+/**
+ * Return the low 32 bits of the products of corresponding lanes.  SSE2 only
+ * has a widening multiply of the even lanes (pmulld is SSE4.1).
+ */
+static inline SSE2 __m128i sse2MulLo(__m128i a, __m128i b)
+{
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+/**
+ * Return the sum of the four lanes.
+ */
+static inline SSE2 Cell sse2Total(__m128i v)
+{
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(v);
+}
+
+/**
+ * Select lanes of a where mask is set and lanes of b elsewhere.
+ */
+static inline SSE2 __m128i sse2Select(__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static SSE2 Cell sse2Sum(const Cell *a, size_t n)
+{
+  __m128i sum = _mm_setzero_si128();
+  size_t i;
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    sum = _mm_add_epi32(sum, _mm_loadu_si128((const __m128i*) &a[i]));
+  }
+  return (Cell)((UCell) sse2Total(sum) + (UCell) scalarSum(&a[i], n - i));
+}
+
+static SSE2 Cell sse2Max(const Cell *a, size_t n)
+{
+  __m128i max = _mm_set1_epi32(CELL_MIN);
+  size_t i;
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*) &a[i]);
+    max = sse2Select(_mm_cmpgt_epi32(v, max), v, max);
+  }
+
+  Cell lanes[4];
+  _mm_storeu_si128((__m128i*) lanes, max);
+  Cell result = scalarMax(&a[i], n - i);
+  int j;
+  for (j = 0; j < 4; ++j)
+  {
+    result = (lanes[j] > result) ? lanes[j] : result;
+  }
+  return result;
+}
+
+static SSE2 Cell sse2Min(const Cell *a, size_t n)
+{
+  __m128i min = _mm_set1_epi32(CELL_MAX);
+  size_t i;
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*) &a[i]);
+    min = sse2Select(_mm_cmplt_epi32(v, min), v, min);
+  }
+
+  Cell lanes[4];
+  _mm_storeu_si128((__m128i*) lanes, min);
+  Cell result = scalarMin(&a[i], n - i);
+  int j;
+  for (j = 0; j < 4; ++j)
+  {
+    result = (lanes[j] < result) ? lanes[j] : result;
+  }
+  return result;
+}
+
+static SSE2 void sse2Add(const Cell *a, Cell *b, size_t n)
+{
+  size_t i;
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    __m128i v = _mm_add_epi32(_mm_loadu_si128((const __m128i*) &a[i]),
+                              _mm_loadu_si128((const __m128i*) &b[i]));
+    _mm_storeu_si128((__m128i*) &b[i], v);
+  }
+  scalarAdd(&a[i], &b[i], n - i);
+}
+
+static SSE2 void sse2Scale(Cell *a, size_t n, Cell k)
+{
+  __m128i factor = _mm_set1_epi32(k);
+  size_t i;
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*) &a[i]);
+    _mm_storeu_si128((__m128i*) &a[i], sse2MulLo(v, factor));
+  }
+  scalarScale(&a[i], n - i, k);
+}
+
+static SSE2 Cell sse2Dot(const Cell *a, const Cell *b, size_t n)
+{
+  __m128i sum = _mm_setzero_si128();
+  size_t i;
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    __m128i product = sse2MulLo(_mm_loadu_si128((const __m128i*) &a[i]),
+                                _mm_loadu_si128((const __m128i*) &b[i]));
+    sum = _mm_add_epi32(sum, product);
+  }
+  return (Cell)((UCell) sse2Total(sum) + (UCell) scalarDot(&a[i], &b[i], n - i));
+}
+
+static SSE2 Cell sse2Find(const Cell *a, size_t n, Cell x)
+{
+  __m128i target = _mm_set1_epi32(x);
+  size_t i;
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    __m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) &a[i]),
+                                    target);
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(equal));
+    if (mask != 0)
+    {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  Cell index = scalarFind(&a[i], n - i, x);
+  return (index < 0) ? -1 : (Cell)(i + index);
+}
+
+static SSE2 Cell sse2Count(const Cell *a, size_t n, Cell x)
+{
+  __m128i target = _mm_set1_epi32(x);
+  __m128i count = _mm_setzero_si128();
+  size_t i;
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    // Equal lanes are -1, so subtracting counts them.
+    __m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) &a[i]),
+                                    target);
+    count = _mm_sub_epi32(count, equal);
+  }
+  return sse2Total(count) + scalarCount(&a[i], n - i, x);
+}
+
+static const CellKernels sse2Kernels =
+{
+  sse2Sum, sse2Max, sse2Min, sse2Add,
+  sse2Scale, sse2Dot, sse2Find, sse2Count
+};
+
+//-----------------------------------------------------------------------------
+// AVX2 kernels: 8 cells per vector.
+//-----------------------------------------------------------------------------
+
+#define AVX2 __attribute__((target("avx2")))
+
+/**
+ * Return the sum of the eight lanes.
+ */
+static inline AVX2 Cell avx2Total(__m256i v)
+{
+  __m128i half = _mm_add_epi32(_mm256_castsi256_si128(v),
+                               _mm256_extracti128_si256(v, 1));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(half);
+}
+
+static AVX2 Cell avx2Sum(const Cell *a, size_t n)
+{
+  __m256i sum = _mm256_setzero_si256();
+  size_t i;
+  for (i = 0; i + 8 <= n; i += 8)
+  {
+    sum = _mm256_add_epi32(sum, _mm256_loadu_si256((const __m256i*) &a[i]));
+  }
+  return (Cell)((UCell) avx2Total(sum) + (UCell) scalarSum(&a[i], n - i));
+}
+
+static AVX2 Cell avx2Max(const Cell *a, size_t n)
+{
+  __m256i max = _mm256_set1_epi32(CELL_MIN);
+  size_t i;
+  for (i = 0; i + 8 <= n; i += 8)
+  {
+    max = _mm256_max_epi32(max, _mm256_loadu_si256((const __m256i*) &a[i]));
+  }
+
+  Cell lanes[8];
+  _mm256_storeu_si256((__m256i*) lanes, max);
+  Cell result = scalarMax(&a[i], n - i);
+  int j;
+  for (j = 0; j < 8; ++j)
+  {
+    result = (lanes[j] > result) ? lanes[j] : result;
+  }
+  return result;
+}
+
+static AVX2 Cell avx2Min(const Cell *a, size_t n)
+{
+  __m256i min = _mm256_set1_epi32(CELL_MAX);
+  size_t i;
+  for (i = 0; i + 8 <= n; i += 8)
+  {
+    min = _mm256_min_epi32(min, _mm256_loadu_si256((const __m256i*) &a[i]));
+  }
+
+  Cell lanes[8];
+  _mm256_storeu_si256((__m256i*) lanes, min);
+  Cell result = scalarMin(&a[i], n - i);
+  int j;
+  for (j = 0; j < 8; ++j)
+  {
+    result = (lanes[j] < result) ? lanes[j] : result;
+  }
+  return result;
+}
+
+static AVX2 void avx2Add(const Cell *a, Cell *b, size_t n)
+{
+  size_t i;
+  for (i = 0; i + 8 <= n; i += 8)
+  {
+    __m256i v = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*) &a[i]),
+                                 _mm256_loadu_si256((const __m256i*) &b[i]));
+    _mm256_storeu_si256((__m256i*) &b[i], v);
+  }
+  scalarAdd(&a[i], &b[i], n - i);
+}
+
+static AVX2 void avx2Scale(Cell *a, size_t n, Cell k)
+{
+  __m256i factor = _mm256_set1_epi32(k);
+  size_t i;
+  for (i = 0; i + 8 <= n; i += 8)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i*) &a[i]);
+    _mm256_storeu_si256((__m256i*) &a[i], _mm256_mullo_epi32(v, factor));
+  }
+  scalarScale(&a[i], n - i, k);
+}
+
+static AVX2 Cell avx2Dot(const Cell *a, const Cell *b, size_t n)
+{
+  __m256i sum = _mm256_setzero_si256();
+  size_t i;
+  for (i = 0; i + 8 <= n; i += 8)
+  {
+    __m256i product =
+      _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*) &a[i]),
+                         _mm256_loadu_si256((const __m256i*) &b[i]));
+    sum = _mm256_add_epi32(sum, product);
+  }
+  return (Cell)((UCell) avx2Total(sum) + (UCell) scalarDot(&a[i], &b[i], n - i));
+}
+
+static AVX2 Cell avx2Find(const Cell *a, size_t n, Cell x)
+{
+  __m256i target = _mm256_set1_epi32(x);
+  size_t i;
+  for (i = 0; i + 8 <= n; i += 8)
+  {
+    __m256i equal =
+      _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) &a[i]), target);
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(equal));
+    if (mask != 0)
+    {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  Cell index = scalarFind(&a[i], n - i, x);
+  return (index < 0) ? -1 : (Cell)(i + index);
+}
+
+static AVX2 Cell avx2Count(const Cell *a, size_t n, Cell x)
+{
+  __m256i target = _mm256_set1_epi32(x);
+  __m256i count = _mm256_setzero_si256();
+  size_t i;
+  for (i = 0; i + 8 <= n; i += 8)
+  {
+    __m256i equal =
+      _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) &a[i]), target);
+    count = _mm256_sub_epi32(count, equal);
+  }
+  return avx2Total(count) + scalarCount(&a[i], n - i, x);
+}
+
+static const CellKernels avx2Kernels =
+{
+  avx2Sum, avx2Max, avx2Min, avx2Add,
+  avx2Scale, avx2Dot, avx2Find, avx2Count
+};
+
+#endif // TOMOKO_HAVE_CELL_SIMD
+
+//-----------------------------------------------------------------------------
+/**
+ * The kernels in use, or NULL until they have been selected.
+ */
+static const CellKernels *kernels = NULL;
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the fastest kernels that this CPU supports, selecting them on the
+ * first call.
+ */
+static const CellKernels *cellKernels(void)
+{
+  if (kernels == NULL)
+  {
+    kernels = &scalarKernels;
+#ifdef TOMOKO_HAVE_CELL_SIMD
+    if (sizeof (Cell) == sizeof (int32_t))
+    {
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2"))
+      {
+        kernels = &avx2Kernels;
+      }
+      else if (__builtin_cpu_supports("sse2"))
+      {
+        kernels = &sse2Kernels;
+      }
+    }
+#endif
+  }
+  return kernels;
+} // cellKernels
+
+//-----------------------------------------------------------------------------
+/**
+ * Return count as a size_t, treating a negative count as zero.
+ */
+static size_t cellCount(Cell count)
+{
+  return (count > 0) ? (size_t) count : 0;
+}
+
+//-----------------------------------------------------------------------------
+// Words.
+//-----------------------------------------------------------------------------
+
+void fn_CELLS_SUM(void)
+{
+  size_t count = cellCount(STACK_POP(sp));
+  const Cell *addr = (const Cell*) STACK_POP(sp);
+  STACK_PUSH(sp, cellKernels()->sum(addr, count));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_CELLS_MAX(void)
+{
+  size_t count = cellCount(STACK_POP(sp));
+  const Cell *addr = (const Cell*) STACK_POP(sp);
+  STACK_PUSH(sp, cellKernels()->max(addr, count));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_CELLS_MIN(void)
+{
+  size_t count = cellCount(STACK_POP(sp));
+  const Cell *addr = (const Cell*) STACK_POP(sp);
+  STACK_PUSH(sp, cellKernels()->min(addr, count));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_CELLS_ADD(void)
+{
+  size_t count = cellCount(STACK_POP(sp));
+  Cell *dest = (Cell*) STACK_POP(sp);
+  const Cell *source = (const Cell*) STACK_POP(sp);
+  cellKernels()->add(source, dest, count);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_CELLS_SCALE(void)
+{
+  Cell n = STACK_POP(sp);
+  size_t count = cellCount(STACK_POP(sp));
+  Cell *addr = (Cell*) STACK_POP(sp);
+  cellKernels()->scale(addr, count, n);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_CELLS_DOT(void)
+{
+  size_t count = cellCount(STACK_POP(sp));
+  const Cell *addr2 = (const Cell*) STACK_POP(sp);
+  const Cell *addr1 = (const Cell*) STACK_POP(sp);
+  STACK_PUSH(sp, cellKernels()->dot(addr1, addr2, count));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_CELLS_FIND(void)
+{
+  Cell x = STACK_POP(sp);
+  size_t count = cellCount(STACK_POP(sp));
+  const Cell *addr = (const Cell*) STACK_POP(sp);
+  STACK_PUSH(sp, cellKernels()->find(addr, count, x));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_CELLS_COUNT(void)
+{
+  Cell x = STACK_POP(sp);
+  size_t count = cellCount(STACK_POP(sp));
+  const Cell *addr = (const Cell*) STACK_POP(sp);
+  STACK_PUSH(sp, cellKernels()->count(addr, count, x));
+}
+
+//-----------------------------------------------------------------------------
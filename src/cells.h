@@ -0,0 +1,82 @@
+//-----------------------------------------------------------------------------
+// Cell Arrays
+//
+// Native words that operate on whole arrays of cells, given as (addr count),
+// replacing loops of @ + CELL+ and the like.  Where the CPU supports it, the
+// work is done with SSE2 or AVX2 vector instructions, selected at run-time.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_CELLS_H
+#define TOMOKO_CELLS_H
+
+//-----------------------------------------------------------------------------
+/**
+ * CELLS-SUM ( addr count -- sum )
+ *
+ * Return the sum of count cells at addr.  The sum wraps on overflow, like +.
+ */
+extern void fn_CELLS_SUM(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * CELLS-MAX ( addr count -- max )
+ *
+ * Return the largest (signed) of count cells at addr.  If count is 0, return
+ * the most negative Cell.
+ */
+extern void fn_CELLS_MAX(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * CELLS-MIN ( addr count -- min )
+ *
+ * Return the smallest (signed) of count cells at addr.  If count is 0, return
+ * the most positive Cell.
+ */
+extern void fn_CELLS_MIN(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * CELLS-ADD ( source dest count -- )
+ *
+ * Add each of count cells at source to the corresponding cell at dest.
+ */
+extern void fn_CELLS_ADD(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * CELLS-SCALE ( addr count n -- )
+ *
+ * Multiply each of count cells at addr by n.
+ */
+extern void fn_CELLS_SCALE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * CELLS-DOT ( addr1 addr2 count -- n )
+ *
+ * Return the dot product of the count cells at addr1 and addr2: the sum of
+ * the products of corresponding cells.  The result wraps on overflow.
+ */
+extern void fn_CELLS_DOT(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * CELLS-FIND ( addr count x -- index )
+ *
+ * Return the index of the first of count cells at addr that is equal to x,
+ * or -1 if there is none.
+ */
+extern void fn_CELLS_FIND(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * CELLS-COUNT ( addr count x -- n )
+ *
+ * Return the number of the count cells at addr that are equal to x.
+ */
+extern void fn_CELLS_COUNT(void);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_CELLS_H
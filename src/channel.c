@@ -0,0 +1,484 @@
+//-----------------------------------------------------------------------------
+// Channels
+//
+// A channel is a bounded ring buffer of slots in which senders and receivers
+// claim positions with atomic operations, without taking a lock.  Each slot
+// has a sequence number that says which position may use it next: for the
+// slot at position p, the sequence is p while it is free for the sender of p,
+// p + 1 once that sender has filled it, and p + capacity once the receiver of
+// p has emptied it for the next lap of the ring.  A sender that finds the
+// sequence of the slot at the tail behind the tail knows that the channel is
+// full, and a receiver likewise knows when it is empty.
+//
+// The receivers' head and the senders' tail are on cache lines of their own,
+// so that the two ends do not slow each other down.
+//
+// Only a thread that has run out of other things to do sleeps on the
+// channel's condition variable, counting itself in sleepers first, and SEND
+// and RECV take the lock to wake sleepers only when there are any.
+//-----------------------------------------------------------------------------
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "channel.h"
+#include "event.h"
+#include "machine.h"
+#include "task.h"
+
+//-----------------------------------------------------------------------------
+/**
+ * A slot in a channel's ring buffer.
+ */
+typedef struct
+{
+  UCell sequence;  ///< The position that may use the slot next, as above.
+  Cell value;      ///< The cell in the slot, if it is full.
+} Slot;
+
+/**
+ * A channel.
+ */
+typedef struct
+{
+  UCell head __attribute__ ((aligned (64))); ///< The next position to RECV.
+  UCell tail __attribute__ ((aligned (64))); ///< The next position to SEND.
+  UCell mask __attribute__ ((aligned (64))); ///< The capacity minus 1.
+  int single;              ///< True for an SPSC-CHANNEL.
+  int sleepers;            ///< The number of threads waiting on changed.
+  pthread_mutex_t lock;    ///< Held while waiting on or signalling changed.
+  pthread_cond_t changed;  ///< Signalled after a SEND or RECV, if sleepers.
+  Slot slots[];            ///< The ring buffer.
+} Channel;
+
+//-----------------------------------------------------------------------------
+/**
+ * Add x to channel and return true, or return false if it is full.
+ */
+static int trySend(Channel *channel, Cell x)
+{
+  UCell position = __atomic_load_n(&channel->tail, __ATOMIC_RELAXED);
+  Slot *slot;
+  for (;;)
+  {
+    slot = &channel->slots[position & channel->mask];
+    Cell behind = (Cell) (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE)
+                          - position);
+    if (behind < 0)
+    {
+      return 0;
+    }
+    else if (behind > 0)
+    {
+      // Another sender has taken the position.
+      position = __atomic_load_n(&channel->tail, __ATOMIC_RELAXED);
+    }
+    else if (channel->single)
+    {
+      __atomic_store_n(&channel->tail, position + 1, __ATOMIC_RELAXED);
+      break;
+    }
+    else if (__atomic_compare_exchange_n(&channel->tail, &position,
+                                         position + 1, 1, __ATOMIC_RELAXED,
+                                         __ATOMIC_RELAXED))
+    {
+      break;
+    }
+  }
+
+  slot->value = x;
+  __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+  return 1;
+} // trySend
+
+//-----------------------------------------------------------------------------
+/**
+ * Remove the oldest cell from channel into *x and return true, or return
+ * false if it is empty.
+ */
+static int tryReceive(Channel *channel, Cell *x)
+{
+  UCell position = __atomic_load_n(&channel->head, __ATOMIC_RELAXED);
+  Slot *slot;
+  for (;;)
+  {
+    slot = &channel->slots[position & channel->mask];
+    Cell behind = (Cell) (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE)
+                          - (position + 1));
+    if (behind < 0)
+    {
+      return 0;
+    }
+    else if (behind > 0)
+    {
+      // Another receiver has taken the position.
+      position = __atomic_load_n(&channel->head, __ATOMIC_RELAXED);
+    }
+    else if (channel->single)
+    {
+      __atomic_store_n(&channel->head, position + 1, __ATOMIC_RELAXED);
+      break;
+    }
+    else if (__atomic_compare_exchange_n(&channel->head, &position,
+                                         position + 1, 1, __ATOMIC_RELAXED,
+                                         __ATOMIC_RELAXED))
+    {
+      break;
+    }
+  }
+
+  *x = slot->value;
+  __atomic_store_n(&slot->sequence, position + channel->mask + 1,
+                   __ATOMIC_RELEASE);
+  return 1;
+} // tryReceive
+
+//-----------------------------------------------------------------------------
+/**
+ * Return true if channel has room for a SEND (if sending is true) or a cell
+ * to RECV (if not), without claiming it.
+ */
+static int isReady(Channel *channel, int sending)
+{
+  UCell position = __atomic_load_n(sending ? &channel->tail : &channel->head,
+                                   __ATOMIC_SEQ_CST);
+  UCell sequence = __atomic_load_n(
+    &channel->slots[position & channel->mask].sequence, __ATOMIC_SEQ_CST);
+  return (Cell) (sequence - position - (sending ? 0 : 1)) >= 0;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Wake the threads sleeping on channel, if there are any, after a SEND or
+ * RECV.
+ */
+static void notify(Channel *channel)
+{
+  // Order the SEND or RECV before the check of sleepers, to pair with
+  // await()'s update of sleepers before its check of the channel.
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&channel->sleepers, __ATOMIC_RELAXED) > 0)
+  {
+    pthread_mutex_lock(&channel->lock);
+    pthread_cond_broadcast(&channel->changed);
+    pthread_mutex_unlock(&channel->lock);
+  }
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Wait, in a thread with no other tasks ready, until channel may be ready for
+ * a SEND (if sending is true) or a RECV (if not), or for timeout milliseconds
+ * if that is not negative.  Another thread may still get there first.
+ */
+static void await(Channel *channel, int sending, int timeout)
+{
+  int spins;
+  for (spins = 0; spins < TOMOKO_CHANNEL_SPINS; ++spins)
+  {
+    sched_yield();
+    if (isReady(channel, sending))
+    {
+      return;
+    }
+  }
+
+  struct timespec deadline;
+  if (timeout >= 0)
+  {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+      ++deadline.tv_sec;
+      deadline.tv_nsec -= 1000000000L;
+    }
+  }
+
+  pthread_mutex_lock(&channel->lock);
+  __atomic_add_fetch(&channel->sleepers, 1, __ATOMIC_SEQ_CST);
+  while (! isReady(channel, sending))
+  {
+    if (timeout < 0)
+    {
+      pthread_cond_wait(&channel->changed, &channel->lock);
+    }
+    else if (pthread_cond_timedwait(&channel->changed, &channel->lock,
+                                    &deadline) == ETIMEDOUT)
+    {
+      break;
+    }
+  }
+  __atomic_sub_fetch(&channel->sleepers, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&channel->lock);
+} // await
+
+//-----------------------------------------------------------------------------
+/**
+ * The native word that ends a retry thread (see below), returning to the
+ * thread that called the word being retried.
+ */
+static void resume(void)
+{
+  ip = (CodeWord**) STACK_POP(rsp);
+}
+
+static CodeWord resumeCodeWord = &resume;
+
+/**
+ * Retry threads, each of which runs a word that waits and then resumes.  A
+ * word that has to wait in a thread with other tasks puts its arguments back
+ * on the stack, arranges to continue in its retry thread, and PAUSEs; its
+ * next turn then runs it again from the beginning.
+ */
+static CodeWord sendCodeWord = &fn_SEND;
+static CodeWord receiveCodeWord = &fn_RECV;
+static CodeWord sendNCodeWord = &fn_SEND_N;
+static CodeWord receiveNCodeWord = &fn_RECV_N;
+
+static CodeWord *sendRetry[] = { &sendCodeWord, &resumeCodeWord };
+static CodeWord *receiveRetry[] = { &receiveCodeWord, &resumeCodeWord };
+static CodeWord *sendNRetry[] = { &sendNCodeWord, &resumeCodeWord };
+static CodeWord *receiveNRetry[] = { &receiveNCodeWord, &resumeCodeWord };
+
+/**
+ * Continue in the retry thread retry, and PAUSE.  The caller's ip is saved
+ * on the return stack, unless the word is already being retried.
+ */
+static void pauseAndRetry(CodeWord **retry)
+{
+  if (ip != &retry[1])
+  {
+    STACK_PUSH(rsp, ip);
+  }
+  ip = retry;
+  fn_PAUSE();
+}
+
+/**
+ * Wait, in a thread with other tasks, until channel may be ready for a SEND
+ * (if sending is true) or a RECV (if not), or another task may be, then
+ * continue in the retry thread retry, and PAUSE.  The wait ends straight
+ * away if another task is ready.  If none is, it lasts until the earliest
+ * MSLEEP ends, on the channel.  If some tasks wait for events, it is instead
+ * a turn of the event loop of at most TOMOKO_CHANNEL_POLL milliseconds.
+ * Without it, the task would PAUSE only to run again itself, and spin.
+ */
+static void waitAndRetry(Channel *channel, int sending, CodeWord **retry)
+{
+  int delay = timeUntilOthersReady();
+  if (delay != 0)
+  {
+    if (hasEvents())
+    {
+      runEvents((delay < 0 || delay > TOMOKO_CHANNEL_POLL)
+                ? TOMOKO_CHANNEL_POLL : delay, -1);
+    }
+    else
+    {
+      await(channel, sending, delay);
+    }
+  }
+  pauseAndRetry(retry);
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Push a new channel with room for at least the number of cells on top of
+ * the stack (or 0 if there is not enough memory).
+ */
+static void newChannel(int single)
+{
+  Cell capacity = STACK_POP(sp);
+  if (capacity < 0
+      || (UCell) capacity > ((UCell) ~0 >> 2) / sizeof (Slot))
+  {
+    STACK_PUSH(sp, 0);
+    return;
+  }
+
+  // A ring of one slot cannot tell full from empty.
+  UCell size = 2;
+  while (size < (UCell) capacity)
+  {
+    size <<= 1;
+  }
+
+  Channel *channel;
+  if (posix_memalign((void**) &channel, 64,
+                     sizeof (Channel) + size * sizeof (Slot)) != 0)
+  {
+    STACK_PUSH(sp, 0);
+    return;
+  }
+
+  channel->head = 0;
+  channel->tail = 0;
+  channel->mask = size - 1;
+  channel->single = single;
+  channel->sleepers = 0;
+  pthread_mutex_init(&channel->lock, NULL);
+  pthread_cond_init(&channel->changed, NULL);
+  UCell i;
+  for (i = 0; i < size; ++i)
+  {
+    channel->slots[i].sequence = i;
+  }
+  STACK_PUSH(sp, channel);
+} // newChannel
+
+//-----------------------------------------------------------------------------
+
+void fn_CHANNEL(void)
+{
+  newChannel(0);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_SPSC_CHANNEL(void)
+{
+  newChannel(1);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_SEND(void)
+{
+  Channel *channel = (Channel*) STACK_POP(sp);
+  Cell x = STACK_POP(sp);
+  while (! trySend(channel, x))
+  {
+    if (hasTasks())
+    {
+      STACK_PUSH(sp, x);
+      STACK_PUSH(sp, channel);
+      waitAndRetry(channel, 1, sendRetry);
+      return;
+    }
+    await(channel, 1, -1);
+  }
+  notify(channel);
+} // fn_SEND
+
+//-----------------------------------------------------------------------------
+
+void fn_RECV(void)
+{
+  Channel *channel = (Channel*) STACK_POP(sp);
+  Cell x;
+  while (! tryReceive(channel, &x))
+  {
+    if (hasTasks())
+    {
+      STACK_PUSH(sp, channel);
+      waitAndRetry(channel, 0, receiveRetry);
+      return;
+    }
+    await(channel, 0, -1);
+  }
+  notify(channel);
+  STACK_PUSH(sp, x);
+} // fn_RECV
+
+//-----------------------------------------------------------------------------
+
+void fn_TRY_SEND(void)
+{
+  Channel *channel = (Channel*) STACK_POP(sp);
+  Cell x = STACK_POP(sp);
+  int sent = trySend(channel, x);
+  if (sent)
+  {
+    notify(channel);
+  }
+  STACK_PUSH(sp, BOOLEAN(sent));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_TRY_RECV(void)
+{
+  Channel *channel = (Channel*) STACK_POP(sp);
+  Cell x;
+  if (tryReceive(channel, &x))
+  {
+    notify(channel);
+    STACK_PUSH(sp, x);
+    STACK_PUSH(sp, BOOLEAN(1));
+  }
+  else
+  {
+    STACK_PUSH(sp, BOOLEAN(0));
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_SEND_N(void)
+{
+  Channel *channel = (Channel*) STACK_POP(sp);
+  UCell n = STACK_POP(sp);
+  const Cell *cells = (const Cell*) STACK_POP(sp);
+  UCell sent = 0;
+  while (sent < n)
+  {
+    if (trySend(channel, cells[sent]))
+    {
+      ++sent;
+      continue;
+    }
+
+    // Let the receivers have what has been sent so far.
+    notify(channel);
+    if (hasTasks())
+    {
+      STACK_PUSH(sp, cells + sent);
+      STACK_PUSH(sp, n - sent);
+      STACK_PUSH(sp, channel);
+      waitAndRetry(channel, 1, sendNRetry);
+      return;
+    }
+    await(channel, 1, -1);
+  }
+  notify(channel);
+} // fn_SEND_N
+
+//-----------------------------------------------------------------------------
+
+void fn_RECV_N(void)
+{
+  Channel *channel = (Channel*) STACK_POP(sp);
+  UCell n = STACK_POP(sp);
+  Cell *cells = (Cell*) STACK_POP(sp);
+  UCell received = 0;
+  while (received < n)
+  {
+    if (tryReceive(channel, &cells[received]))
+    {
+      ++received;
+      continue;
+    }
+
+    // Let the senders have the room made so far.
+    notify(channel);
+    if (hasTasks())
+    {
+      STACK_PUSH(sp, cells + received);
+      STACK_PUSH(sp, n - received);
+      STACK_PUSH(sp, channel);
+      waitAndRetry(channel, 0, receiveNRetry);
+      return;
+    }
+    await(channel, 0, -1);
+  }
+  notify(channel);
+} // fn_RECV_N
+
+//-----------------------------------------------------------------------------
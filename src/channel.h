@@ -0,0 +1,107 @@
+//-----------------------------------------------------------------------------
+// Channels
+//
+// Bounded queues of cells for passing values between tasks and threads.  A
+// channel is a ring buffer whose capacity is rounded up to a power of two.
+// Any number of tasks or threads may SEND to and RECV from a CHANNEL; an
+// SPSC-CHANNEL is a little cheaper but allows only one sender and one
+// receiver at a time.
+//
+// SEND waits while the channel is full, and RECV while it is empty.  A task
+// in a thread that has other tasks PAUSEs while it waits, so the other tasks
+// (one of which may be at the other end of the channel) keep running;
+// otherwise the thread sleeps until the channel changes.  If the other tasks
+// are all in MSLEEP or waiting for events, the thread sleeps until the
+// channel changes or one of them is due to run.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_CHANNEL_H
+#define TOMOKO_CHANNEL_H
+
+//-----------------------------------------------------------------------------
+/**
+ * The number of times a thread with no other tasks gives up the processor,
+ * checking the channel in between, before it sleeps until the channel
+ * changes.
+ */
+#define TOMOKO_CHANNEL_SPINS 100
+
+/**
+ * The longest, in milliseconds, that a thread whose other tasks are waiting
+ * for events runs its event loop before it looks at the channel again.
+ */
+#define TOMOKO_CHANNEL_POLL 1
+
+//-----------------------------------------------------------------------------
+// Words.
+//-----------------------------------------------------------------------------
+/**
+ * CHANNEL ( capacity -- ch )
+ *
+ * Create a channel that holds at least capacity cells, for any number of
+ * senders and receivers.  Return 0 if there is not enough memory.
+ */
+extern void fn_CHANNEL(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * SPSC-CHANNEL ( capacity -- ch )
+ *
+ * Create a channel like CHANNEL, for a single sender and a single receiver.
+ */
+extern void fn_SPSC_CHANNEL(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * SEND ( x ch -- )
+ *
+ * Add x to the channel ch, waiting while it is full.
+ */
+extern void fn_SEND(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * RECV ( ch -- x )
+ *
+ * Remove the oldest cell x from the channel ch, waiting while it is empty.
+ */
+extern void fn_RECV(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * TRY-SEND ( x ch -- flag )
+ *
+ * Add x to the channel ch and return true, or return false if it is full.
+ */
+extern void fn_TRY_SEND(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * TRY-RECV ( ch -- x true | false )
+ *
+ * Remove the oldest cell x from the channel ch and return it with true, or
+ * return false if the channel is empty.
+ */
+extern void fn_TRY_RECV(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * SEND-N ( addr n ch -- )
+ *
+ * SEND the n cells starting at addr, in order, waking the receivers once
+ * rather than for each cell.
+ */
+extern void fn_SEND_N(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * RECV-N ( addr n ch -- )
+ *
+ * RECV n cells into the array at addr, waking the senders once rather than
+ * for each cell.
+ */
+extern void fn_RECV_N(void);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_CHANNEL_H
@@ -12,6 +12,7 @@
 //   DEF_CONST(,,,)           Define a Forth constant.
 //   DEF_CONST_STRING(,,,)    Define a Forth string constant.
 //   DEF_VAR(,,,)             Define a Forth variable.
+//   DEF_USER(,,,)            Define a Forth user variable (one per task).
 //   DEF_CODE(,,,)            Define a Forth word implemented in terms of a 
 //                            native (i.e. C/C++) function.
 //   BEGIN_COLON(,,,,)        
@@ -191,6 +192,36 @@ extern void fn_CONST_STRING(void);
 
 extern void fn_VAR(void);
 
+//-----------------------------------------------------------------------------
+/**
+ * DEF_USER() defines a dictionary entry for a user variable: a variable of
+ * which each task has its own copy, in its user area.  It references
+ * fn_USER(void), which is the native implementation, to be defined later.
+ * The parameter field holds the index of the variable in the user area.
+ *
+ * @param linkInit   the address of the previous dictionary entry. It should be 
+ *                   passed a value of the form LINK(label), where label is the 
+ *                   label parameter to the DEF_...() macro that defined the 
+ *                   previous entry.
+ * @param label      the C variable name used to hold the dictionary entry 
+ *                   defined by this macro.
+ * @param forthName  the name of the Forth word as a string constant.
+ * @param userIndex  the index of the variable in the user area, one of the
+ *                   USER_... constants in machine.h.
+ */
+#define DEF_USER(linkInit,label,forthName,userIndex)                          \
+  const struct                                                                \
+  {                                                                           \
+    DECLARE_HEADER(forthName);                                                \
+    CodeWord codeWord;                                                        \
+    Cell index;                                                               \
+  } label = {                                                                 \
+    { { (linkInit), sizeof (forthName) - 1, (forthName) } },                  \
+    &fn_USER, (userIndex)                                                     \
+  }
+
+extern void fn_USER(void);
+
 //-----------------------------------------------------------------------------
 /**
  * DEF_NATIVE() defines a dictionary entry for a native word, comprising a 
@@ -297,6 +328,24 @@ extern void fn_VAR(void);
  */
 #define XT(name) ((Cell)(&name.codeWord))
 
+//-----------------------------------------------------------------------------
+/**
+ * Lay out a dictionary header for the word named by the length characters at
+ * name, as CREATE does: at HERE, aligned to a cell, with the link, the length
+ * byte, the name and a NUL, padded to a cell.  Leave room for cells cells
+ * after it, starting with the code field, make it LATEST and move HERE past
+ * it.  Return the address of the code field, or NULL, with nothing changed,
+ * if the name is empty or too long or the dictionary has no room.  The
+ * dictionary must be locked (see lockDictionary() in thread.h).
+ */
+extern Cell *createHeader(const char *name, UCell length, UCell cells);
+
+/**
+ * Return the code field of the word whose header starts at link, as >CFA
+ * does.
+ */
+extern CodeWord *codeField(const Cell *link);
+
 //-----------------------------------------------------------------------------
 
 #endif // TOMOKO_DICTIONARY_H
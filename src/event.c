@@ -0,0 +1,529 @@
+//-----------------------------------------------------------------------------
+// Events
+//
+// The outstanding operations and timers of a thread are kept in a list, in
+// the order they were started.  The epoll set holds each file descriptor that
+// an operation is waiting on, for reading, writing or both, and the terminal
+// while the operator waits for input.  A turn of the loop waits on the set,
+// then takes from the list, in order, each operation that can go ahead and
+// each timer that is due, so that at most one read and one write per file
+// descriptor proceed each turn.  Only then are the callbacks called and the
+// waiting tasks woken, since a callback may start further operations.  Each
+// of those events stays on the list, marked finished, until just before its
+// callback is called, so that if a callback faults the rest are completed on
+// the next turn rather than lost.
+//
+// An ASYNC-WRITE to a pipe writes at most PIPE_BUF characters each turn,
+// which epoll's readiness guarantees will not block.
+//-----------------------------------------------------------------------------
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "event.h"
+#include "machine.h"
+#include "thread.h"
+
+//-----------------------------------------------------------------------------
+/**
+ * The kinds of event.
+ */
+typedef enum
+{
+  EVENT_READ,   ///< An ASYNC-READ.
+  EVENT_WRITE,  ///< An ASYNC-WRITE.
+  EVENT_TIMER   ///< A TIMER-AFTER.
+} EventKind;
+
+/**
+ * An outstanding operation or timer.
+ */
+typedef struct Event
+{
+  struct Event *next;  ///< The next event in the list.
+  EventKind kind;
+  int fd;              ///< The file descriptor read or written.
+  int polled;          ///< True if fd is in the epoll set for the event.
+  char *buffer;        ///< The characters read or written.
+  UCell length;        ///< The number of characters to read or write.
+  UCell done;          ///< The number read or written so far.
+  Cell ior;            ///< 0, or the errno of a failed read or write.
+  int finished;        ///< True once it has happened, until it is completed.
+  long long at;        ///< When a timer is due (see now()).
+  CodeWord *xt;        ///< The callback, or NULL if a task waits instead.
+  Task *waiter;        ///< The task waiting for the event, if xt is NULL.
+} Event;
+
+/**
+ * The calling thread's events, oldest first.
+ */
+static __thread Event *events = NULL;
+
+/**
+ * The calling thread's epoll instance, or -1 until it is needed.
+ */
+static __thread int epollFd = -1;
+
+/**
+ * The terminal, while runEvents() is waiting for input from it, else -1.
+ */
+static __thread int inputFd = -1;
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the epoll events that fd is waited on for.
+ */
+static uint32_t interest(int fd)
+{
+  uint32_t mask = (fd == inputFd) ? EPOLLIN : 0;
+  const Event *event;
+  for (event = events; event != NULL; event = event->next)
+  {
+    if (event->polled && event->fd == fd)
+    {
+      mask |= (event->kind == EVENT_READ) ? EPOLLIN : EPOLLOUT;
+    }
+  }
+  return mask;
+} // interest
+
+//-----------------------------------------------------------------------------
+/**
+ * Bring fd's entry in the epoll set up to date with interest(), after a
+ * change to what it is waited on for from old.  Return false if fd cannot be
+ * added to the set: if it is a regular file, for example.
+ */
+static int watch(int fd, uint32_t old)
+{
+  uint32_t mask = interest(fd);
+  if (mask == old)
+  {
+    return 1;
+  }
+  if (epollFd < 0 && (epollFd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+  {
+    return 0;
+  }
+
+  struct epoll_event change = { mask, { .fd = fd } };
+  if (old == 0)
+  {
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &change) == 0;
+  }
+  else if (mask == 0)
+  {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, &change);
+  }
+  else if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &change) != 0
+           && errno == ENOENT)
+  {
+    // fd was closed, which took it out of the set, and then reused.
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &change) == 0;
+  }
+  return 1;
+} // watch
+
+//-----------------------------------------------------------------------------
+/**
+ * Return true if epoll reported any of bits for fd in the count entries of
+ * ready, and clear them so that only one event uses them.
+ */
+static int takeReady(int fd, uint32_t bits, struct epoll_event *ready,
+                     int count)
+{
+  int i;
+  for (i = 0; i < count; ++i)
+  {
+    if (ready[i].data.fd == fd && (ready[i].events & bits) != 0)
+    {
+      ready[i].events &= ~bits;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Read or write as much of event's transfer as will go without blocking, and
+ * return true if it is finished, with event->done and event->ior set.
+ */
+static int transfer(Event *event)
+{
+  for (;;)
+  {
+    ssize_t n;
+    if (event->kind == EVENT_READ)
+    {
+      n = read(event->fd, event->buffer, event->length);
+    }
+    else
+    {
+      size_t part = event->length - event->done;
+      if (event->polled && part > PIPE_BUF)
+      {
+        part = PIPE_BUF;
+      }
+      n = write(event->fd, event->buffer + event->done, part);
+    }
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+        return 0;
+      }
+      event->ior = errno;
+      return 1;
+    }
+
+    event->done += n;
+    if (event->kind == EVENT_READ || event->done == event->length)
+    {
+      return 1;
+    }
+    if (event->polled)
+    {
+      // Wait for the next turn rather than risk blocking.
+      return 0;
+    }
+  }
+} // transfer
+
+//-----------------------------------------------------------------------------
+/**
+ * Call the callback xt, or resume the task waiter, with the count cells of
+ * results.
+ */
+static void finish(CodeWord *xt, Task *waiter, const Cell *results,
+                   int count)
+{
+  if (xt == NULL)
+  {
+    resumeTask(waiter, results, count);
+    return;
+  }
+
+  int i;
+  for (i = 0; i < count; ++i)
+  {
+    STACK_PUSH(sp, results[i]);
+  }
+  executeWord(xt);
+} // finish
+
+//-----------------------------------------------------------------------------
+/**
+ * Free a completed event and call its callback or resume its task.
+ */
+static void complete(Event *event)
+{
+  Cell results[2] = { event->done, event->ior };
+  int count = (event->kind == EVENT_TIMER) ? 0 : 2;
+  CodeWord *xt = event->xt;
+  Task *waiter = event->waiter;
+  free(event);
+  finish(xt, waiter, results, count);
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Take the oldest finished event from the list and return it, or return NULL
+ * if there is none.
+ */
+static Event *firstFinished(void)
+{
+  Event *event;
+  Event **link = &events;
+  while ((event = *link) != NULL && ! event->finished)
+  {
+    link = &event->next;
+  }
+  if (event != NULL)
+  {
+    uint32_t old = interest(event->fd);
+    *link = event->next;
+    if (event->polled)
+    {
+      watch(event->fd, old);
+    }
+  }
+  return event;
+} // firstFinished
+
+//-----------------------------------------------------------------------------
+
+int hasEvents(void)
+{
+  return events != NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+int runEvents(int timeout, int fd)
+{
+  long long t = now();
+  Event *event;
+  for (event = events; event != NULL; event = event->next)
+  {
+    if (event->finished)
+    {
+      timeout = 0;
+    }
+    else if (event->kind == EVENT_TIMER)
+    {
+      long long wait = (event->at > t) ? event->at - t : 0;
+      if (timeout < 0 || wait < timeout)
+      {
+        timeout = (int) wait;
+      }
+    }
+    else if (! event->polled)
+    {
+      timeout = 0;
+    }
+  }
+
+  int inputReady = 0;
+  if (fd >= 0)
+  {
+    uint32_t old = interest(fd);
+    inputFd = fd;
+    if (! watch(fd, old))
+    {
+      // The terminal is a regular file, which is always ready.
+      inputFd = -1;
+      inputReady = 1;
+      timeout = 0;
+    }
+  }
+
+  struct epoll_event ready[TOMOKO_EVENTS_MAX];
+  int count = 0;
+  if (epollFd >= 0)
+  {
+    count = epoll_wait(epollFd, ready, TOMOKO_EVENTS_MAX, timeout);
+    if (count < 0)
+    {
+      count = 0;
+    }
+  }
+  else if (timeout > 0)
+  {
+    struct timespec pause = { timeout / 1000, (timeout % 1000) * 1000000L };
+    nanosleep(&pause, NULL);
+  }
+
+  if (inputFd >= 0)
+  {
+    int i;
+    for (i = 0; i < count; ++i)
+    {
+      inputReady |= (ready[i].data.fd == inputFd);
+    }
+    uint32_t old = interest(fd);
+    inputFd = -1;
+    watch(fd, old);
+  }
+
+  // Mark the events that have happened.
+  t = now();
+  for (event = events; event != NULL; event = event->next)
+  {
+    if (event->finished)
+    {
+      // Left over from a turn in which a callback faulted.
+      continue;
+    }
+    if (event->kind == EVENT_TIMER)
+    {
+      event->finished = (event->at <= t);
+    }
+    else if (! event->polled)
+    {
+      event->finished = transfer(event);
+    }
+    else
+    {
+      uint32_t bits = EPOLLERR | EPOLLHUP
+                      | ((event->kind == EVENT_READ) ? EPOLLIN : EPOLLOUT);
+      event->finished = takeReady(event->fd, bits, ready, count)
+                        && transfer(event);
+    }
+  }
+
+  // Complete them, oldest first, taking each from the list just before its
+  // callback, which may change the list.
+  while ((event = firstFinished()) != NULL)
+  {
+    complete(event);
+  }
+  return inputReady;
+} // runEvents
+
+//-----------------------------------------------------------------------------
+
+void cancelEvents(Task *task)
+{
+  Event *event;
+  Event **link = &events;
+  while ((event = *link) != NULL)
+  {
+    if (event->xt == NULL && event->waiter == task)
+    {
+      uint32_t old = interest(event->fd);
+      *link = event->next;
+      if (event->polled)
+      {
+        watch(event->fd, old);
+      }
+      free(event);
+    }
+    else
+    {
+      link = &event->next;
+    }
+  }
+} // cancelEvents
+
+//-----------------------------------------------------------------------------
+
+void endEvents(void)
+{
+  while (events != NULL)
+  {
+    Event *event = events;
+    events = event->next;
+    free(event);
+  }
+  if (epollFd >= 0)
+  {
+    close(epollFd);
+    epollFd = -1;
+  }
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Add event to the end of the list, and then wait for it if it has no
+ * callback.
+ */
+static void start(Event *event)
+{
+  Event **link = &events;
+  while (*link != NULL)
+  {
+    link = &(*link)->next;
+  }
+  *link = event;
+
+  if (event->kind != EVENT_TIMER)
+  {
+    uint32_t old = interest(event->fd);
+    event->polled = 1;
+    if (! watch(event->fd, old))
+    {
+      // Read or write it, or find out what is wrong with it, next turn.
+      event->polled = 0;
+    }
+  }
+
+  if (event->xt == NULL)
+  {
+    event->waiter = suspendTask();
+    fn_PAUSE();
+  }
+} // start
+
+//-----------------------------------------------------------------------------
+/**
+ * Start an ASYNC-READ or ASYNC-WRITE with the arguments on the stack.
+ */
+static void startTransfer(EventKind kind)
+{
+  CodeWord *xt = (CodeWord*) STACK_POP(sp);
+  int fd = STACK_POP(sp);
+  UCell length = STACK_POP(sp);
+  char *buffer = (char*) STACK_POP(sp);
+
+  Event *event = malloc(sizeof (Event));
+  if (event == NULL)
+  {
+    Cell results[2] = { 0, ENOMEM };
+    if (xt == NULL)
+    {
+      STACK_PUSH(sp, results[0]);
+      STACK_PUSH(sp, results[1]);
+    }
+    else
+    {
+      finish(xt, NULL, results, 2);
+    }
+    return;
+  }
+
+  event->next = NULL;
+  event->kind = kind;
+  event->fd = fd;
+  event->polled = 0;
+  event->buffer = buffer;
+  event->length = length;
+  event->done = 0;
+  event->ior = 0;
+  event->finished = 0;
+  event->at = 0;
+  event->xt = xt;
+  event->waiter = NULL;
+  start(event);
+} // startTransfer
+
+//-----------------------------------------------------------------------------
+
+void fn_ASYNC_READ(void)
+{
+  startTransfer(EVENT_READ);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_ASYNC_WRITE(void)
+{
+  startTransfer(EVENT_WRITE);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_TIMER_AFTER(void)
+{
+  CodeWord *xt = (CodeWord*) STACK_POP(sp);
+  Cell milliseconds = STACK_POP(sp);
+
+  Event *event = calloc(1, sizeof (Event));
+  if (event == NULL)
+  {
+    // Fire straight away rather than never.
+    if (xt != NULL)
+    {
+      executeWord(xt);
+    }
+    return;
+  }
+
+  event->kind = EVENT_TIMER;
+  event->fd = -1;
+  event->at = now() + ((milliseconds > 0) ? milliseconds : 0);
+  event->xt = xt;
+  start(event);
+} // fn_TIMER_AFTER
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,99 @@
+//-----------------------------------------------------------------------------
+// Events
+//
+// An event loop for asynchronous reads, writes and timers, built on epoll.
+// Each thread has its own loop, which the task scheduler runs whenever a task
+// PAUSEs or waits, and while the operator waits for terminal input, so that
+// timers fire and transfers complete at the prompt too.
+//
+// Each operation names an xt to call when it completes, or 0 to make the
+// running task wait for it while the other tasks carry on.  Callbacks run on
+// the stacks of whichever task is running the loop, so they must not PAUSE or
+// wait; they can WAKE a task or TRY-SEND to a channel to hand on longer work.
+//
+// Regular files cannot be polled, and are read and written without waiting
+// for the next turn of the loop.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_EVENT_H
+#define TOMOKO_EVENT_H
+
+#include "task.h"
+
+//-----------------------------------------------------------------------------
+/**
+ * The most file descriptors that one turn of the loop takes from epoll.
+ */
+#define TOMOKO_EVENTS_MAX 64
+
+//-----------------------------------------------------------------------------
+/**
+ * Return true if the calling thread has operations or timers outstanding.
+ */
+extern int hasEvents(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * Wait up to timeout milliseconds (forever if timeout is negative, or not at
+ * all if it is 0) for something to happen, then complete the operations and
+ * timers that are due.  Wait no longer than the next timer, and not at all if
+ * a regular file has a transfer outstanding.
+ *
+ * If fd is not negative, also stop waiting when fd has input to read (or end
+ * of file, or an error), and return true if it has.
+ */
+extern int runEvents(int timeout, int fd);
+
+//-----------------------------------------------------------------------------
+/**
+ * Forget the operations that task is waiting for, which will never complete.
+ * This is called when the operator is restarted after a stack fault.
+ */
+extern void cancelEvents(Task *task);
+
+//-----------------------------------------------------------------------------
+/**
+ * Forget the calling thread's operations and timers and close its epoll
+ * instance.  This is called when a thread ends.
+ */
+extern void endEvents(void);
+
+//-----------------------------------------------------------------------------
+// Words.
+//-----------------------------------------------------------------------------
+/**
+ * ASYNC-READ ( c-addr u fd xt -- )
+ * ASYNC-READ ( c-addr u fd 0 -- n ior )
+ *
+ * Read up to u characters from the file descriptor fd into the buffer at
+ * c-addr once there is something to read, and call xt ( n ior -- ) with the
+ * number read (0 at end of file) and an ior of 0 or the (positive) errno.
+ * With an xt of 0, the running task waits and receives n and ior itself.
+ */
+extern void fn_ASYNC_READ(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * ASYNC-WRITE ( c-addr u fd xt -- )
+ * ASYNC-WRITE ( c-addr u fd 0 -- n ior )
+ *
+ * Write the u characters at c-addr to the file descriptor fd, as fast as it
+ * will take them, and call xt ( n ior -- ) with the number written (u unless
+ * there is an error) and an ior of 0 or the (positive) errno.  With an xt of
+ * 0, the running task waits and receives n and ior itself.  The buffer must
+ * not change until then.
+ */
+extern void fn_ASYNC_WRITE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * TIMER-AFTER ( n xt -- )
+ *
+ * Call xt ( -- ) once n milliseconds have passed.  With an xt of 0, the
+ * running task waits that long, like MSLEEP.
+ */
+extern void fn_TIMER_AFTER(void);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_EVENT_H
@@ -0,0 +1,167 @@
+//-----------------------------------------------------------------------------
+// Foreign Functions
+//
+// A word defined by FUNCTION: has one of the stubs below as its code word,
+// chosen by the function's number of arguments and whether it returns a
+// result, and the function's address as its only parameter.  The stub takes
+// the arguments straight from the parameter stack, deepest first, calls the
+// function and replaces them with the result.
+//-----------------------------------------------------------------------------
+
+#define _GNU_SOURCE             // For RTLD_DEFAULT.
+
+#include <dlfcn.h>
+#include <linux/limits.h>       // For PATH_MAX.
+#include <string.h>
+
+#include "dictionary.h"
+#include "ffi.h"
+#include "input.h"
+#include "machine.h"
+#include "thread.h"
+
+//-----------------------------------------------------------------------------
+// Stubs.
+//
+// DEF_STUBS(n, parameters, arguments) defines stubn(), for functions of n
+// arguments that return a cell, and stubnVoid(), for those that return
+// nothing.  arguments picks the function's arguments off the stack.
+
+#define DEF_STUBS(n,parameters,arguments)                                     \
+  static void stub##n(void)                                                   \
+  {                                                                           \
+    Cell (*function)parameters = (Cell (*)parameters) ((Cell*) w)[1];         \
+    Cell result = function arguments;                                         \
+    sp += n;                                                                  \
+    STACK_PUSH(sp, result);                                                   \
+  }                                                                           \
+  static void stub##n##Void(void)                                             \
+  {                                                                           \
+    void (*function)parameters = (void (*)parameters) ((Cell*) w)[1];         \
+    function arguments;                                                       \
+    sp += n;                                                                  \
+  }
+
+DEF_STUBS(0, (void), ())
+DEF_STUBS(1, (Cell), (sp[0]))
+DEF_STUBS(2, (Cell, Cell), (sp[1], sp[0]))
+DEF_STUBS(3, (Cell, Cell, Cell), (sp[2], sp[1], sp[0]))
+DEF_STUBS(4, (Cell, Cell, Cell, Cell), (sp[3], sp[2], sp[1], sp[0]))
+DEF_STUBS(5, (Cell, Cell, Cell, Cell, Cell),
+          (sp[4], sp[3], sp[2], sp[1], sp[0]))
+DEF_STUBS(6, (Cell, Cell, Cell, Cell, Cell, Cell),
+          (sp[5], sp[4], sp[3], sp[2], sp[1], sp[0]))
+
+/**
+ * The stubs, by number of results, then number of arguments.
+ */
+static const CodeWord stubs[2][TOMOKO_FFI_MAX_ARGS + 1] =
+{
+  { &stub0Void, &stub1Void, &stub2Void, &stub3Void, &stub4Void, &stub5Void,
+    &stub6Void },
+  { &stub0, &stub1, &stub2, &stub3, &stub4, &stub5, &stub6 }
+};
+
+//-----------------------------------------------------------------------------
+/**
+ * Read the next word of input into name, which has room for size characters,
+ * NUL terminated, and return its length.
+ */
+static size_t nextWord(char *name, size_t size)
+{
+  fn_WORD();
+  size_t length = STACK_POP(sp);
+  const char *word = (const char*) STACK_POP(sp);
+  if (length >= size)
+  {
+    length = size - 1;
+  }
+  memcpy(name, word, length);
+  name[length] = '\0';
+  return length;
+} // nextWord
+
+//-----------------------------------------------------------------------------
+
+void fn_LIBRARY(void)
+{
+  size_t length = STACK_POP(sp);
+  const char *addr = (const char*) STACK_POP(sp);
+  char name[PATH_MAX];
+  if (length >= sizeof name)
+  {
+    length = sizeof name - 1;
+  }
+  memcpy(name, addr, length);
+  name[length] = '\0';
+
+  void *library = dlopen(name, RTLD_NOW | RTLD_GLOBAL);
+  if (library == NULL)
+  {
+    raiseFault("%s", dlerror());
+  }
+  STACK_PUSH(sp, library);
+} // fn_LIBRARY
+
+//-----------------------------------------------------------------------------
+
+void fn_FUNCTION_COLON(void)
+{
+  void *library = (void*) STACK_POP(sp);
+  char name[LENGTH_BITS + 1];
+  size_t length = nextWord(name, sizeof name);
+
+  // Count the arguments and results in the stack comment.
+  char word[LENGTH_BITS + 1];
+  nextWord(word, sizeof word);
+  if (strcmp(word, "(") != 0)
+  {
+    raiseFault("FUNCTION: %s needs a stack comment", name);
+  }
+  int args = 0;
+  int results = -1;
+  while (nextWord(word, sizeof word), strcmp(word, ")") != 0)
+  {
+    if (strcmp(word, "--") == 0 && results < 0)
+    {
+      results = 0;
+    }
+    else if (results < 0)
+    {
+      ++args;
+    }
+    else
+    {
+      ++results;
+    }
+  }
+  if (args > TOMOKO_FFI_MAX_ARGS)
+  {
+    raiseFault("%s: too many arguments", name);
+  }
+  if (results > 1)
+  {
+    raiseFault("%s: too many results", name);
+  }
+
+  void *function = dlsym((library != NULL) ? library : RTLD_DEFAULT, name);
+  if (function == NULL)
+  {
+    raiseFault("%s", dlerror());
+  }
+
+  // The header, then the stub and the function, as CREATE and , would lay
+  // them out.
+  lockDictionary();
+  Cell *code = createHeader(name, length, 2);
+  if (code == NULL)
+  {
+    unlockDictionary();
+    raiseFault("%s: dictionary full", name);
+  }
+  code[0] = (Cell) stubs[results > 0][args];
+  code[1] = (Cell) function;
+  unlockDictionary();
+} // fn_FUNCTION_COLON
+
+//-----------------------------------------------------------------------------
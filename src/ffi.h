@@ -0,0 +1,59 @@
+//-----------------------------------------------------------------------------
+// Foreign Functions
+//
+// Words that call C functions in shared libraries.  The library is opened and
+// the function looked up once, when the word that calls it is defined; the
+// word's code word is a stub for the function's number of arguments, which
+// takes them from the parameter stack and calls the function directly, so a
+// call costs no more than a native word and an indirect call.
+//
+//   S" libz.so.1" LIBRARY CONSTANT LIBZ
+//   LIBZ FUNCTION: zlibVersion ( -- addr )
+//   0 FUNCTION: labs ( n -- u )
+//
+// Each argument and the result are one cell, so integers and pointers can be
+// passed but not floating-point values or structures, and functions with
+// variable arguments can be called only on i386.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_FFI_H
+#define TOMOKO_FFI_H
+
+//-----------------------------------------------------------------------------
+/**
+ * The most arguments that a foreign function can take.
+ */
+#define TOMOKO_FFI_MAX_ARGS 6
+
+//-----------------------------------------------------------------------------
+// Words.
+//-----------------------------------------------------------------------------
+/**
+ * LIBRARY ( c-addr u -- lib )
+ *
+ * Open the shared library named by the string c-addr u, searched for as
+ * dlopen() searches, and return its handle.  Fault if it cannot be opened.
+ * Opening a library twice gives the same handle.
+ */
+extern void fn_LIBRARY(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * FUNCTION: ( lib "name" "( args -- ret )" -- )
+ *
+ * Define name as a word that calls the C function called name in the library
+ * lib (or, if lib is 0, in the program or any library it has loaded), with
+ * the stack effect given by the stack comment that follows.  Each word before
+ * -- in the comment is an argument, the first deepest on the stack, and the
+ * word after it, if any, is the result; for example
+ *
+ *   0 FUNCTION: write ( fd addr len -- n )
+ *
+ * Fault if the function cannot be found, if it takes more than
+ * TOMOKO_FFI_MAX_ARGS arguments, or if it returns more than one cell.
+ */
+extern void fn_FUNCTION_COLON(void);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_FFI_H
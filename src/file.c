@@ -0,0 +1,541 @@
+//-----------------------------------------------------------------------------
+// Files
+//
+// A fileid is the address of a File.  Its buffer holds either characters read
+// ahead of the caller, from start to end, or characters waiting to be
+// written, the first pending ones; never both.  Before a write, read-ahead is
+// dropped by seeking the file descriptor back to where the caller has read
+// to, and before a read, the pending writes are written out.
+//
+// Large-file support is enabled, so positions and sizes are double cells
+// whatever the size of a cell.
+//-----------------------------------------------------------------------------
+
+#define _FILE_OFFSET_BITS 64
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "file.h"
+#include "machine.h"
+
+//-----------------------------------------------------------------------------
+/**
+ * An open file.
+ */
+typedef struct File
+{
+  int fd;               ///< The file descriptor.
+  off_t offset;         ///< The position of fd in the file.
+  size_t start;         ///< The next character read ahead in buffer.
+  size_t end;           ///< The end of the characters read ahead.
+  size_t pending;       ///< The number of characters waiting to be written.
+  struct File *previous;
+  struct File *next;    ///< The open files are in a list, for flushFiles().
+  char buffer[TOMOKO_FILE_BUFFER_SIZE];
+} File;
+
+/**
+ * The open files, and a lock for the list.
+ */
+static File *openFiles = NULL;
+static pthread_mutex_t openFilesLock = PTHREAD_MUTEX_INITIALIZER;
+
+//-----------------------------------------------------------------------------
+/**
+ * Write all length characters at chars to fd, and return 0 or an errno.
+ */
+static int writeAll(int fd, const char *chars, size_t length)
+{
+  while (length > 0)
+  {
+    ssize_t n = write(fd, chars, length);
+    if (n < 0 && errno != EINTR)
+    {
+      return errno;
+    }
+    if (n > 0)
+    {
+      chars += n;
+      length -= n;
+    }
+  }
+  return 0;
+} // writeAll
+
+//-----------------------------------------------------------------------------
+/**
+ * Write out file's pending writes, and return 0 or an errno.
+ */
+static int flushWrites(File *file)
+{
+  if (file->pending == 0)
+  {
+    return 0;
+  }
+  int ior = writeAll(file->fd, file->buffer, file->pending);
+  if (ior == 0)
+  {
+    file->offset += file->pending;
+    file->pending = 0;
+  }
+  return ior;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Write out the pending writes of every open file.  This is an atexit()
+ * handler.
+ */
+static void flushFiles(void)
+{
+  pthread_mutex_lock(&openFilesLock);
+  File *file;
+  for (file = openFiles; file != NULL; file = file->next)
+  {
+    flushWrites(file);
+  }
+  pthread_mutex_unlock(&openFilesLock);
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Drop file's read-ahead, leaving fd where the caller has read to.
+ */
+static void dropReads(File *file)
+{
+  if (file->start < file->end)
+  {
+    off_t position = file->offset - (file->end - file->start);
+    if (lseek(file->fd, position, SEEK_SET) >= 0)
+    {
+      file->offset = position;
+    }
+  }
+  file->start = file->end = 0;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Move file's read-ahead to the start of its buffer, then read as much as
+ * will fit after it.  Return the number of characters read, 0 at the end of
+ * the file, or -1 with errno set.
+ */
+static ssize_t fill(File *file)
+{
+  size_t unread = file->end - file->start;
+  memmove(file->buffer, file->buffer + file->start, unread);
+  file->start = 0;
+  file->end = unread;
+
+  ssize_t n;
+  do
+  {
+    n = read(file->fd, file->buffer + file->end,
+             sizeof file->buffer - file->end);
+  } while (n < 0 && errno == EINTR);
+  if (n > 0)
+  {
+    file->end += n;
+    file->offset += n;
+  }
+  return n;
+} // fill
+
+//-----------------------------------------------------------------------------
+/**
+ * Write the length characters at chars to file, through its buffer unless
+ * there are too many to fit.  Return 0 or an errno.
+ */
+static int writeChars(File *file, const char *chars, size_t length)
+{
+  dropReads(file);
+  if (file->pending + length > sizeof file->buffer)
+  {
+    int ior = flushWrites(file);
+    if (ior != 0)
+    {
+      return ior;
+    }
+  }
+  if (length >= sizeof file->buffer)
+  {
+    int ior = writeAll(file->fd, chars, length);
+    if (ior == 0)
+    {
+      file->offset += length;
+    }
+    return ior;
+  }
+  memcpy(file->buffer + file->pending, chars, length);
+  file->pending += length;
+  return 0;
+} // writeChars
+
+//-----------------------------------------------------------------------------
+/**
+ * Open the file called name, of nameLength characters, with the open() flags,
+ * and push its fileid and an ior.
+ */
+static void openFile(const char *name, UCell nameLength, int flags)
+{
+  char path[PATH_MAX];
+  File *file = NULL;
+  int ior = 0;
+  if (nameLength >= sizeof path)
+  {
+    ior = ENAMETOOLONG;
+  }
+  else if ((file = malloc(sizeof (File))) == NULL)
+  {
+    ior = ENOMEM;
+  }
+  else
+  {
+    memcpy(path, name, nameLength);
+    path[nameLength] = '\0';
+    file->fd = open(path, flags, 0666);
+    if (file->fd < 0)
+    {
+      ior = errno;
+      free(file);
+      file = NULL;
+    }
+  }
+
+  if (file != NULL)
+  {
+    static int registered = 0;
+    file->offset = 0;
+    file->start = file->end = file->pending = 0;
+    pthread_mutex_lock(&openFilesLock);
+    file->previous = NULL;
+    file->next = openFiles;
+    if (openFiles != NULL)
+    {
+      openFiles->previous = file;
+    }
+    openFiles = file;
+
+    // Writes should not be lost just because the program ends.
+    if (! registered)
+    {
+      atexit(flushFiles);
+      registered = 1;
+    }
+    pthread_mutex_unlock(&openFilesLock);
+  }
+
+  STACK_PUSH(sp, file);
+  STACK_PUSH(sp, ior);
+} // openFile
+
+//-----------------------------------------------------------------------------
+/**
+ * Push the double cell ud.
+ */
+static void pushDouble(UDCell ud)
+{
+  STACK_PUSH(sp, (UCell) ud);
+  STACK_PUSH(sp, (UCell) (ud >> (8 * sizeof (Cell))));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_BIN(void)
+{
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_OPEN_FILE(void)
+{
+  Cell fam = STACK_POP(sp);
+  UCell nameLength = STACK_POP(sp);
+  const char *name = (const char*) STACK_POP(sp);
+  openFile(name, nameLength, fam & O_ACCMODE);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_CREATE_FILE(void)
+{
+  Cell fam = STACK_POP(sp);
+  UCell nameLength = STACK_POP(sp);
+  const char *name = (const char*) STACK_POP(sp);
+  openFile(name, nameLength, (fam & O_ACCMODE) | O_CREAT | O_TRUNC);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_CLOSE_FILE(void)
+{
+  File *file = (File*) STACK_POP(sp);
+  pthread_mutex_lock(&openFilesLock);
+  if (file->previous != NULL)
+  {
+    file->previous->next = file->next;
+  }
+  else
+  {
+    openFiles = file->next;
+  }
+  if (file->next != NULL)
+  {
+    file->next->previous = file->previous;
+  }
+  pthread_mutex_unlock(&openFilesLock);
+
+  int ior = flushWrites(file);
+  if (close(file->fd) != 0 && ior == 0)
+  {
+    ior = errno;
+  }
+  free(file);
+  STACK_PUSH(sp, ior);
+} // fn_CLOSE_FILE
+
+//-----------------------------------------------------------------------------
+
+void fn_READ_FILE(void)
+{
+  File *file = (File*) STACK_POP(sp);
+  size_t length = (UCell) STACK_POP(sp);
+  char *addr = (char*) STACK_POP(sp);
+  size_t copied = 0;
+  int ior = flushWrites(file);
+  while (ior == 0 && copied < length)
+  {
+    if (file->start < file->end)
+    {
+      // Take what has been read ahead.
+      size_t n = file->end - file->start;
+      if (n > length - copied)
+      {
+        n = length - copied;
+      }
+      memcpy(addr + copied, file->buffer + file->start, n);
+      file->start += n;
+      copied += n;
+      continue;
+    }
+
+    ssize_t n;
+    if (length - copied >= sizeof file->buffer)
+    {
+      // Read the rest straight into addr.
+      do
+      {
+        n = read(file->fd, addr + copied, length - copied);
+      } while (n < 0 && errno == EINTR);
+      if (n > 0)
+      {
+        file->offset += n;
+        copied += n;
+      }
+    }
+    else
+    {
+      n = fill(file);
+    }
+    if (n == 0)
+    {
+      break;
+    }
+    if (n < 0)
+    {
+      ior = errno;
+    }
+  }
+  STACK_PUSH(sp, copied);
+  STACK_PUSH(sp, ior);
+} // fn_READ_FILE
+
+//-----------------------------------------------------------------------------
+
+void fn_READ_LINE(void)
+{
+  File *file = (File*) STACK_POP(sp);
+  size_t length = (UCell) STACK_POP(sp);
+  char *addr = (char*) STACK_POP(sp);
+  size_t copied = 0;
+  int ior = flushWrites(file);
+  Cell flag = 0;
+  while (ior == 0)
+  {
+    if (file->start == file->end)
+    {
+      ssize_t n = fill(file);
+      if (n <= 0)
+      {
+        // A last line with no LF is still a line.
+        ior = (n < 0) ? errno : 0;
+        flag = BOOLEAN(copied > 0);
+        break;
+      }
+    }
+
+    // Look for the LF one character past the room left, so that a line of
+    // exactly length characters takes its LF with it.
+    const char *next = file->buffer + file->start;
+    size_t available = file->end - file->start;
+    size_t room = length - copied;
+    const char *lf = memchr(next, '\n', (available <= room) ? available
+                                                            : room + 1);
+    if (lf != NULL)
+    {
+      memcpy(addr + copied, next, lf - next);
+      copied += lf - next;
+      file->start += lf - next + 1;
+      flag = ~0;
+      break;
+    }
+
+    size_t n = (available <= room) ? available : room;
+    memcpy(addr + copied, next, n);
+    copied += n;
+    file->start += n;
+    if (copied == length && file->start < file->end)
+    {
+      // The line goes on past length characters.
+      flag = ~0;
+      break;
+    }
+  }
+  STACK_PUSH(sp, copied);
+  STACK_PUSH(sp, flag);
+  STACK_PUSH(sp, ior);
+} // fn_READ_LINE
+
+//-----------------------------------------------------------------------------
+
+void fn_NEXT_LINE(void)
+{
+  File *file = (File*) STACK_POP(sp);
+  const char *line = file->buffer;
+  size_t length = 0;
+  Cell flag = 0;
+  int ior = flushWrites(file);
+
+  // The characters from start to start + searched have no LF.
+  size_t searched = 0;
+  while (ior == 0)
+  {
+    line = file->buffer + file->start;
+    size_t available = file->end - file->start;
+    const char *lf = memchr(line + searched, '\n', available - searched);
+    if (lf != NULL)
+    {
+      length = lf - line;
+      file->start += length + 1;
+      flag = ~0;
+      break;
+    }
+    if (available == sizeof file->buffer)
+    {
+      // The line is longer than the buffer: return a buffer full of it.
+      length = available;
+      file->start = file->end;
+      flag = ~0;
+      break;
+    }
+
+    searched = available;
+    ssize_t n = fill(file);
+    if (n <= 0)
+    {
+      // A last line with no LF is still a line.
+      ior = (n < 0) ? errno : 0;
+      line = file->buffer;
+      length = file->end;
+      file->start = file->end;
+      flag = BOOLEAN(length > 0);
+      break;
+    }
+  }
+  STACK_PUSH(sp, line);
+  STACK_PUSH(sp, length);
+  STACK_PUSH(sp, flag);
+  STACK_PUSH(sp, ior);
+} // fn_NEXT_LINE
+
+//-----------------------------------------------------------------------------
+
+void fn_WRITE_FILE(void)
+{
+  File *file = (File*) STACK_POP(sp);
+  size_t length = (UCell) STACK_POP(sp);
+  const char *addr = (const char*) STACK_POP(sp);
+  STACK_PUSH(sp, writeChars(file, addr, length));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_WRITE_LINE(void)
+{
+  File *file = (File*) STACK_POP(sp);
+  size_t length = (UCell) STACK_POP(sp);
+  const char *addr = (const char*) STACK_POP(sp);
+  int ior = writeChars(file, addr, length);
+  if (ior == 0)
+  {
+    ior = writeChars(file, "\n", 1);
+  }
+  STACK_PUSH(sp, ior);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FILE_SIZE(void)
+{
+  File *file = (File*) STACK_POP(sp);
+  struct stat status;
+  int ior = flushWrites(file);
+  if (ior == 0 && fstat(file->fd, &status) != 0)
+  {
+    ior = errno;
+  }
+  pushDouble((ior == 0) ? status.st_size : 0);
+  STACK_PUSH(sp, ior);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FILE_POSITION(void)
+{
+  File *file = (File*) STACK_POP(sp);
+  pushDouble(file->offset - (file->end - file->start) + file->pending);
+  STACK_PUSH(sp, 0);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_REPOSITION_FILE(void)
+{
+  File *file = (File*) STACK_POP(sp);
+  UDCell high = (UCell) STACK_POP(sp);
+  UDCell low = (UCell) STACK_POP(sp);
+  off_t position = (high << (8 * sizeof (Cell))) | low;
+  int ior = flushWrites(file);
+  if (ior == 0)
+  {
+    if (lseek(file->fd, position, SEEK_SET) < 0)
+    {
+      ior = errno;
+    }
+    else
+    {
+      file->offset = position;
+      file->start = file->end = 0;
+    }
+  }
+  STACK_PUSH(sp, ior);
+} // fn_REPOSITION_FILE
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,142 @@
+//-----------------------------------------------------------------------------
+// Files
+//
+// The ANS file access words, with buffering.  A fileid is a handle with its
+// own TOMOKO_FILE_BUFFER_SIZE buffer, which serves both reads and writes, so
+// READ-FILE and READ-LINE make one read() per buffer full rather than one per
+// call, and WRITE-FILE and WRITE-LINE one write() per buffer full.  Reads and
+// writes at least as long as the buffer go straight between the file and the
+// caller's memory.
+//
+// READ-LINE finds the end of each line with memchr() in the buffer and copies
+// only the line itself out; NEXT-LINE does not copy it at all.  Lines end
+// with LF; the LF is not part of the line.
+//
+// As in the mapped file words, an ior is 0 on success or else the (positive)
+// errno of the failure.  Files still open when the program exits have their
+// buffered writes written out.
+//
+// These words are independent of the input sources in input.h: a file opened
+// here is only read by these words.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_FILE_H
+#define TOMOKO_FILE_H
+
+//-----------------------------------------------------------------------------
+/**
+ * The size of each file's buffer, in characters.  This is also the longest
+ * line that NEXT-LINE returns whole.
+ */
+#define TOMOKO_FILE_BUFFER_SIZE 65536
+
+//-----------------------------------------------------------------------------
+// Words.
+//-----------------------------------------------------------------------------
+/**
+ * BIN ( fam1 -- fam2 )
+ *
+ * Make fam1 a binary access method.  Files are not translated in any way, so
+ * this does nothing.
+ */
+extern void fn_BIN(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * OPEN-FILE ( c-addr u fam -- fileid ior )
+ *
+ * Open the existing file named by the string c-addr u, for access fam (R/O,
+ * W/O or R/W), positioned at its start.
+ */
+extern void fn_OPEN_FILE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * CREATE-FILE ( c-addr u fam -- fileid ior )
+ *
+ * Create the file named by the string c-addr u, or empty it if it exists, and
+ * open it for access fam.
+ */
+extern void fn_CREATE_FILE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * CLOSE-FILE ( fileid -- ior )
+ *
+ * Write out fileid's buffered writes, close it, and free its buffer.
+ */
+extern void fn_CLOSE_FILE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * READ-FILE ( c-addr u1 fileid -- u2 ior )
+ *
+ * Read up to u1 characters from fileid into c-addr, and return the number
+ * read, u2, which is less than u1 only at the end of the file or on error.
+ */
+extern void fn_READ_FILE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * READ-LINE ( c-addr u1 fileid -- u2 flag ior )
+ *
+ * Read the next line from fileid into c-addr, without its LF, and return its
+ * length u2 and true.  A line longer than u1 characters is returned u1
+ * characters at a time.  At the end of the file, return 0 and false.
+ */
+extern void fn_READ_LINE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * NEXT-LINE ( fileid -- c-addr u flag ior )
+ *
+ * Like READ-LINE, but return the line where it lies in fileid's buffer,
+ * which is valid until the next operation on fileid.  A line longer than
+ * TOMOKO_FILE_BUFFER_SIZE is returned in pieces of that size.
+ */
+extern void fn_NEXT_LINE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * WRITE-FILE ( c-addr u fileid -- ior )
+ *
+ * Write the u characters at c-addr to fileid.
+ */
+extern void fn_WRITE_FILE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * WRITE-LINE ( c-addr u fileid -- ior )
+ *
+ * Write the u characters at c-addr to fileid, then an LF.
+ */
+extern void fn_WRITE_LINE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * FILE-SIZE ( fileid -- ud ior )
+ *
+ * Return the size of fileid in characters, including its buffered writes.
+ */
+extern void fn_FILE_SIZE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * FILE-POSITION ( fileid -- ud ior )
+ *
+ * Return the position in fileid at which the next read or write will happen.
+ */
+extern void fn_FILE_POSITION(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * REPOSITION-FILE ( ud fileid -- ior )
+ *
+ * Make ud the position in fileid at which the next read or write will
+ * happen.
+ */
+extern void fn_REPOSITION_FILE(void);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_FILE_H
@@ -0,0 +1,384 @@
+//-----------------------------------------------------------------------------
+// Floating Point
+//
+// The floating-point stack grows downwards, like the others, with fsp
+// pointing at the top float.  Its guard pages catch overflow and underflow,
+// so these words make no depth checks.
+//
+// A float compiled by FLITERAL takes FLOAT_CELLS cells after FLIT: two on
+// i386, where it is only cell-aligned, which x86 allows.
+//-----------------------------------------------------------------------------
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "floating.h"
+#include "machine.h"
+#include "output.h"
+#include "thread.h"
+
+// External references to a few Forth global variables:
+extern Cell HERE_value;
+
+// ... and to FLIT (see tomoko.c).
+extern CodeWord *const flitWord;
+
+/**
+ * The number of cells that a float compiled after FLIT takes.
+ */
+#define FLOAT_CELLS ((sizeof (Float) + sizeof (Cell) - 1) / sizeof (Cell))
+
+//-----------------------------------------------------------------------------
+// Stack.
+//-----------------------------------------------------------------------------
+
+void fn_FDROP(void)
+{
+  ++fsp;
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FDUP(void)
+{
+  Float r = fsp[0];
+  FLOAT_PUSH(fsp, r);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FSWAP(void)
+{
+  Float r = fsp[0];
+  fsp[0] = fsp[1];
+  fsp[1] = r;
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FOVER(void)
+{
+  Float r = fsp[1];
+  FLOAT_PUSH(fsp, r);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FDEPTH(void)
+{
+  STACK_PUSH(sp, (Float*) userArea[USER_F0] - fsp);
+}
+
+//-----------------------------------------------------------------------------
+// Memory.
+//-----------------------------------------------------------------------------
+
+void fn_FFETCH(void)
+{
+  const Float *addr = (const Float*) STACK_POP(sp);
+  FLOAT_PUSH(fsp, *addr);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FSTORE(void)
+{
+  Float *addr = (Float*) STACK_POP(sp);
+  *addr = FLOAT_POP(fsp);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FLOATS(void)
+{
+  Cell n = STACK_POP(sp);
+  STACK_PUSH(sp, n * (Cell) sizeof (Float));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FLOATPLUS(void)
+{
+  Cell addr = STACK_POP(sp);
+  STACK_PUSH(sp, addr + sizeof (Float));
+}
+
+//-----------------------------------------------------------------------------
+// Arithmetic.
+//-----------------------------------------------------------------------------
+/**
+ * Define fn_name() to replace the top two floats with the result of a binary
+ * operator.
+ */
+#define DEF_FLOAT_OP_FN(name,op)                                              \
+  void fn_##name(void)                                                        \
+  {                                                                           \
+    Float r2 = FLOAT_POP(fsp);                                                \
+    fsp[0] = fsp[0] op r2;                                                    \
+  }
+
+/**
+ * Define fn_name() to replace the top float with the result of a function.
+ */
+#define DEF_FLOAT_FUNCTION_FN(name,function)                                  \
+  void fn_##name(void)                                                        \
+  {                                                                           \
+    fsp[0] = function(fsp[0]);                                                \
+  }
+
+DEF_FLOAT_OP_FN(FADD, +);
+DEF_FLOAT_OP_FN(FSUB, -);
+DEF_FLOAT_OP_FN(FMUL, *);
+DEF_FLOAT_OP_FN(FDIV, /);
+DEF_FLOAT_FUNCTION_FN(FNEGATE, -);
+DEF_FLOAT_FUNCTION_FN(FSQRT, sqrt);
+DEF_FLOAT_FUNCTION_FN(FEXP, exp);
+DEF_FLOAT_FUNCTION_FN(FLN, log);
+
+//-----------------------------------------------------------------------------
+
+void fn_FLT(void)
+{
+  Float r2 = FLOAT_POP(fsp);
+  Float r1 = FLOAT_POP(fsp);
+  STACK_PUSH(sp, BOOLEAN(r1 < r2));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FEQ0(void)
+{
+  Float r = FLOAT_POP(fsp);
+  STACK_PUSH(sp, BOOLEAN(r == 0));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FLT0(void)
+{
+  Float r = FLOAT_POP(fsp);
+  STACK_PUSH(sp, BOOLEAN(r < 0));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_DTOF(void)
+{
+  DCell d = STACK_POP_DOUBLE(sp);
+  FLOAT_PUSH(fsp, d);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FTOD(void)
+{
+  Float r = FLOAT_POP(fsp);
+  STACK_PUSH_DOUBLE(sp, (DCell) r);
+}
+
+//-----------------------------------------------------------------------------
+// Arrays.
+//
+// Each kernel keeps four partial sums, which the compiler may not do itself
+// since floating-point addition is not associative, so that four additions
+// are in flight at once instead of each waiting for the one before.
+//-----------------------------------------------------------------------------
+
+void fn_F_SUM(void)
+{
+  size_t n = STACK_POP(sp);
+  const Float *a = (const Float*) STACK_POP(sp);
+  Float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  size_t i;
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    s0 += a[i];
+    s1 += a[i + 1];
+    s2 += a[i + 2];
+    s3 += a[i + 3];
+  }
+  for (; i < n; ++i)
+  {
+    s0 += a[i];
+  }
+  FLOAT_PUSH(fsp, (s0 + s1) + (s2 + s3));
+} // fn_F_SUM
+
+//-----------------------------------------------------------------------------
+
+void fn_F_DOT(void)
+{
+  size_t n = STACK_POP(sp);
+  const Float *b = (const Float*) STACK_POP(sp);
+  const Float *a = (const Float*) STACK_POP(sp);
+  Float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  size_t i;
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    s0 += a[i] * b[i];
+    s1 += a[i + 1] * b[i + 1];
+    s2 += a[i + 2] * b[i + 2];
+    s3 += a[i + 3] * b[i + 3];
+  }
+  for (; i < n; ++i)
+  {
+    s0 += a[i] * b[i];
+  }
+  FLOAT_PUSH(fsp, (s0 + s1) + (s2 + s3));
+} // fn_F_DOT
+
+//-----------------------------------------------------------------------------
+// Conversion, literals and display.
+//-----------------------------------------------------------------------------
+/**
+ * Convert the length characters at text to a float in *r, and return true if
+ * they have the syntax of one: an optional sign, digits with an optional
+ * decimal point, and then an exponent, which must start with E or e if
+ * literal is true, as in a literal, or else may be anything >FLOAT allows.
+ * The string is rewritten into the syntax strtod() expects, so that it
+ * accepts nothing else (such as hexadecimal, INF or NAN).
+ */
+static int parseFloat(const char *text, size_t length, int literal, Float *r)
+{
+  char buffer[TOMOKO_FLOAT_TEXT_MAX + 4];
+  size_t i = 0;
+  size_t n = 0;
+  size_t digits = 0;
+  if (length > TOMOKO_FLOAT_TEXT_MAX)
+  {
+    return 0;
+  }
+
+  // The significand.
+  if (i < length && (text[i] == '+' || text[i] == '-'))
+  {
+    buffer[n++] = text[i++];
+  }
+  for (; i < length && isdigit((unsigned char) text[i]); ++digits)
+  {
+    buffer[n++] = text[i++];
+  }
+  if (i < length && text[i] == '.')
+  {
+    buffer[n++] = text[i++];
+  }
+  for (; i < length && isdigit((unsigned char) text[i]); ++digits)
+  {
+    buffer[n++] = text[i++];
+  }
+  if (digits == 0)
+  {
+    return 0;
+  }
+
+  // The exponent, with a 0 before its digits in case it has none.
+  int marked = i < length && (text[i] == 'E' || text[i] == 'e'
+                              || (! literal
+                                  && (text[i] == 'D' || text[i] == 'd')));
+  if (marked)
+  {
+    ++i;
+  }
+  else if (literal)
+  {
+    return 0;
+  }
+  buffer[n++] = 'e';
+  if (i < length && (text[i] == '+' || text[i] == '-'))
+  {
+    buffer[n++] = text[i++];
+  }
+  buffer[n++] = '0';
+  while (i < length && isdigit((unsigned char) text[i]))
+  {
+    buffer[n++] = text[i++];
+  }
+  if (i < length)
+  {
+    return 0;
+  }
+
+  buffer[n] = '\0';
+  *r = strtod(buffer, NULL);
+  return 1;
+} // parseFloat
+
+//-----------------------------------------------------------------------------
+
+void fn_TOFLOAT(void)
+{
+  size_t length = STACK_POP(sp);
+  const char *text = (const char*) STACK_POP(sp);
+  size_t i;
+  for (i = 0; i < length && text[i] == ' '; ++i)
+  {
+  }
+
+  Float r = 0;
+  int ok = (i == length) || parseFloat(text, length, 0, &r);
+  if (ok)
+  {
+    FLOAT_PUSH(fsp, r);
+  }
+  STACK_PUSH(sp, BOOLEAN(ok));
+} // fn_TOFLOAT
+
+//-----------------------------------------------------------------------------
+
+void fn_TOFLOAT_LITERAL(void)
+{
+  size_t length = STACK_POP(sp);
+  const char *text = (const char*) STACK_POP(sp);
+  Float r;
+  int ok = userArea[USER_BASE] == 10 && parseFloat(text, length, 1, &r);
+  if (ok)
+  {
+    FLOAT_PUSH(fsp, r);
+  }
+  STACK_PUSH(sp, BOOLEAN(ok));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FLIT(void)
+{
+  Float r;
+  memcpy(&r, ip, sizeof r);
+  FLOAT_PUSH(fsp, r);
+
+  // Skip over the cells containing the literal.
+  ip = (CodeWord**) ((Cell*) ip + FLOAT_CELLS);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FLITERAL(void)
+{
+  Float r = FLOAT_POP(fsp);
+  lockDictionary();
+  Cell *code = (Cell*) HERE_value;
+  code[0] = (Cell) flitWord;
+  memcpy(&code[1], &r, sizeof r);
+  HERE_value = (Cell) (code + 1 + FLOAT_CELLS);
+  unlockDictionary();
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FDOT(void)
+{
+  char buffer[TOMOKO_FLOAT_DIGITS + 16];
+  int length = snprintf(buffer, sizeof buffer - 2, "%.*g",
+                        TOMOKO_FLOAT_DIGITS, FLOAT_POP(fsp));
+  if (strpbrk(buffer, ".ein") == NULL)
+  {
+    buffer[length++] = '.';
+  }
+  buffer[length++] = ' ';
+  charsOut(buffer, length);
+} // fn_FDOT
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,198 @@
+//-----------------------------------------------------------------------------
+// Floating Point
+//
+// The ANS floating-point words.  Floats are IEEE doubles (Float, in types.h),
+// kept on a floating-point stack of their own, which each task has, like its
+// parameter and return stacks, between guard pages.  Its size is set with -f.
+//
+// The interpreter takes a word that is neither defined nor an integer as a
+// float if it has the syntax of a literal (an optional sign, digits with an
+// optional decimal point, then E or e and an optional signed exponent) and
+// BASE is decimal:
+//
+//   1E0 2.5e-3 -1.5E F+ F.
+//
+// FLITERAL compiles a float inline, in the cells after FLIT, as LITERAL
+// compiles a cell after LIT.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_FLOATING_H
+#define TOMOKO_FLOATING_H
+
+//-----------------------------------------------------------------------------
+/**
+ * The longest string that >FLOAT converts.
+ */
+#define TOMOKO_FLOAT_TEXT_MAX 64
+
+/**
+ * The number of significant digits that F. displays.
+ */
+#define TOMOKO_FLOAT_DIGITS 15
+
+//-----------------------------------------------------------------------------
+// Stack.
+//-----------------------------------------------------------------------------
+/**
+ * FDROP ( F: r -- )
+ * FDUP  ( F: r -- r r )
+ * FSWAP ( F: r1 r2 -- r2 r1 )
+ * FOVER ( F: r1 r2 -- r1 r2 r1 )
+ */
+extern void fn_FDROP(void);
+extern void fn_FDUP(void);
+extern void fn_FSWAP(void);
+extern void fn_FOVER(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * FDEPTH ( -- n )
+ *
+ * Return the number of floats on the floating-point stack.
+ */
+extern void fn_FDEPTH(void);
+
+//-----------------------------------------------------------------------------
+// Memory.
+//-----------------------------------------------------------------------------
+/**
+ * F@ ( f-addr -- ) ( F: -- r )
+ * F! ( f-addr -- ) ( F: r -- )
+ */
+extern void fn_FFETCH(void);
+extern void fn_FSTORE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * FLOATS ( n1 -- n2 )
+ *
+ * Return the size of n1 floats, in characters.
+ */
+extern void fn_FLOATS(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * FLOAT+ ( f-addr1 -- f-addr2 )
+ *
+ * Add the size of a float to f-addr1.
+ */
+extern void fn_FLOATPLUS(void);
+
+//-----------------------------------------------------------------------------
+// Arithmetic.
+//-----------------------------------------------------------------------------
+/**
+ * F+ ( F: r1 r2 -- r3 )
+ * F- ( F: r1 r2 -- r3 )
+ * F* ( F: r1 r2 -- r3 )
+ * F/ ( F: r1 r2 -- r3 )
+ * FNEGATE ( F: r1 -- r2 )
+ */
+extern void fn_FADD(void);
+extern void fn_FSUB(void);
+extern void fn_FMUL(void);
+extern void fn_FDIV(void);
+extern void fn_FNEGATE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * FSQRT ( F: r1 -- r2 )
+ * FEXP  ( F: r1 -- r2 )
+ * FLN   ( F: r1 -- r2 )
+ *
+ * The square root, e to the power r1 and the natural logarithm.
+ */
+extern void fn_FSQRT(void);
+extern void fn_FEXP(void);
+extern void fn_FLN(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * F<  ( -- flag ) ( F: r1 r2 -- )
+ * F0= ( -- flag ) ( F: r -- )
+ * F0< ( -- flag ) ( F: r -- )
+ */
+extern void fn_FLT(void);
+extern void fn_FEQ0(void);
+extern void fn_FLT0(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * D>F ( d -- ) ( F: -- r )
+ * F>D ( -- d ) ( F: r -- )
+ *
+ * Convert between double cells and floats.  F>D rounds towards zero.
+ */
+extern void fn_DTOF(void);
+extern void fn_FTOD(void);
+
+//-----------------------------------------------------------------------------
+// Arrays.
+//-----------------------------------------------------------------------------
+/**
+ * F-SUM ( f-addr u -- ) ( F: -- r )
+ *
+ * Return the sum of the u floats at f-addr.
+ */
+extern void fn_F_SUM(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * F-DOT ( f-addr1 f-addr2 u -- ) ( F: -- r )
+ *
+ * Return the dot product of the u floats at f-addr1 and f-addr2: the sum of
+ * the products of corresponding floats.
+ */
+extern void fn_F_DOT(void);
+
+//-----------------------------------------------------------------------------
+// Conversion, literals and display.
+//-----------------------------------------------------------------------------
+/**
+ * >FLOAT ( c-addr u -- flag ) ( F: -- r | )
+ *
+ * Convert the string c-addr u to a float and return true, or return false if
+ * it is not one.  The exponent is optional, may start with E, e, D or d or
+ * just a sign, and may have no digits: 1.5, 15E-1 and 15-1 are all 1.5.  A
+ * string of spaces is 0.
+ */
+extern void fn_TOFLOAT(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * >FLOAT-LITERAL ( c-addr u -- flag ) ( F: -- r | )
+ *
+ * Like >FLOAT, but only for a float literal as the interpreter accepts it:
+ * with an exponent starting with E or e, in a decimal BASE.
+ */
+extern void fn_TOFLOAT_LITERAL(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * FLIT ( F: -- r )
+ *
+ * Push the float compiled in the cells after FLIT, and skip over them.
+ */
+extern void fn_FLIT(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * FLITERAL ( F: r -- )
+ *
+ * Compile FLIT and r into the current definition.  This is an immediate word.
+ */
+extern void fn_FLITERAL(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * F. ( F: r -- )
+ *
+ * Display r with up to TOMOKO_FLOAT_DIGITS significant digits, followed by a
+ * space.  A whole number is displayed with a decimal point, as in 2. , so that
+ * it reads back as a float.
+ */
+extern void fn_FDOT(void);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_FLOATING_H
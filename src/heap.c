@@ -0,0 +1,627 @@
+//-----------------------------------------------------------------------------
+// Heap
+//
+// Every block starts with a two-cell BlockHeader, so that the user's address
+// is aligned to two cells and FREE and RESIZE can find the block's size class.
+//
+// Blocks of up to TOMOKO_HEAP_SMALL_MAX bytes (header included) are rounded
+// up to one of a fixed set of size classes.  Each class is carved from 64 KB
+// slabs mapped from the system, and freed blocks go on a per-class free list
+// for reuse, so building and discarding temporary buffers costs a few pointer
+// operations and no system calls.  Slabs are never returned to the system.
+//
+// Larger blocks are mapped individually and unmapped by FREE.  RESIZE grows
+// them with mremap() where it is available, which avoids copying the data.
+//
+// A hash table records every page of every slab, with the slab's class and
+// the page's place in it, and the first page of every large block.  FREE and
+// RESIZE look an address up there before they read its header, and accept a
+// small block only on a boundary between its slab's blocks, so a block freed
+// twice, or an address the heap never gave out, is reported rather than read
+// from memory that may no longer be mapped or taken for a header by chance.
+//
+// The heap is shared by all threads, and a single mutex protects it.
+//-----------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "heap.h"
+#include "machine.h"
+#include "output.h"
+
+//-----------------------------------------------------------------------------
+/**
+ * The size of the slabs that small blocks are carved from.
+ */
+#define TOMOKO_HEAP_SLAB (64 * 1024)
+
+/**
+ * The largest size class.  Blocks bigger than this are mapped individually.
+ */
+#define TOMOKO_HEAP_SMALL_MAX 4096
+
+/**
+ * Size classes are multiples of this, which is also the granularity of the
+ * table that maps a size to its class.
+ */
+#define TOMOKO_HEAP_QUANTUM 16
+
+/**
+ * The granularity of the system's mappings, in bytes.
+ */
+#define TOMOKO_HEAP_PAGE 4096
+
+/**
+ * Tag values in a BlockHeader, identifying live and freed blocks.  The class
+ * index is added to the tag of a live block.
+ */
+#define BLOCK_LIVE  0x7A0C0000u
+#define BLOCK_FREED 0x7A0CFFFFu
+
+//-----------------------------------------------------------------------------
+/**
+ * The header in front of every block.
+ */
+typedef struct
+{
+  UCell size; ///< The size requested by the user, in bytes.
+  UCell tag;  ///< BLOCK_LIVE + class index, or BLOCK_FREED.
+} BlockHeader;
+
+/**
+ * The size classes, in bytes including the header.  Successive classes are
+ * about 1.25 to 1.5 times larger, which bounds the space lost to rounding.
+ */
+static const UCell classSizes[] =
+{
+  16, 32, 48, 64, 80, 96, 128, 160, 192, 256, 320, 384, 512, 640, 768,
+  1024, 1280, 1536, 2048, 2560, 3072, 4096
+};
+
+#define TOMOKO_HEAP_CLASSES (sizeof (classSizes) / sizeof (classSizes[0]))
+
+/**
+ * The class index used in the tag of a large, individually mapped block.
+ */
+#define LARGE_CLASS TOMOKO_HEAP_CLASSES
+
+/**
+ * The state of one size class.
+ */
+typedef struct
+{
+  void *freeList;   ///< Freed blocks, linked through their first word.
+  uint8_t *next;    ///< The next uncarved block in the current slab.
+  uint8_t *limit;   ///< The end of the current slab.
+  UCell blocks;     ///< The number of blocks allocated.
+  UCell bytes;      ///< The bytes requested for those blocks.
+  UCell reserved;   ///< The bytes of slab mapped for this class.
+} SizeClass;
+
+static SizeClass classes[TOMOKO_HEAP_CLASSES + 1]; // + 1 for LARGE_CLASS.
+
+/**
+ * Maps a size in quanta, rounded up, to the index of the smallest class that
+ * can hold it.  Filled in on first use.
+ */
+static uint8_t classOfQuanta[TOMOKO_HEAP_SMALL_MAX / TOMOKO_HEAP_QUANTUM + 1];
+
+/**
+ * The kinds of page in pageTable, kept in the low bits of each entry.  Above
+ * the kind, a slab page's entry holds the page's index in its slab, from
+ * PAGE_PLACE_SHIFT, and the slab's class, from PAGE_CLASS_SHIFT; both fit
+ * below TOMOKO_HEAP_PAGE.
+ */
+#define PAGE_SLAB  1u
+#define PAGE_LARGE 2u
+#define PAGE_TYPE  3u
+#define PAGE_KIND  ((UCell) TOMOKO_HEAP_PAGE - 1)
+#define PAGE_PLACE_SHIFT 2
+#define PAGE_CLASS_SHIFT 6
+
+/**
+ * An open-addressed hash table of the pages the heap has mapped, each entry
+ * a page address plus its kind, or 0 for an empty slot.  It is mapped from
+ * the system like the slabs, and doubled whenever it would be half full.
+ */
+static UCell *pageTable = NULL;
+static size_t pageCapacity = 0;
+static size_t pageCount = 0;
+
+/**
+ * Held while the classes (and classOfQuanta) and pageTable are used.
+ */
+static pthread_mutex_t heapLock = PTHREAD_MUTEX_INITIALIZER;
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the index of the smallest class that holds total bytes, or
+ * LARGE_CLASS if it is bigger than all of them.
+ */
+static UCell classOf(size_t total)
+{
+  if (total > TOMOKO_HEAP_SMALL_MAX)
+  {
+    return LARGE_CLASS;
+  }
+
+  static int tableReady = 0;
+  if (!tableReady)
+  {
+    UCell index = 0;
+    size_t q;
+    for (q = 0; q < sizeof (classOfQuanta); ++q)
+    {
+      while (classSizes[index] < q * TOMOKO_HEAP_QUANTUM)
+      {
+        ++index;
+      }
+      classOfQuanta[q] = (uint8_t) index;
+    }
+    tableReady = 1;
+  }
+  return classOfQuanta[(total + TOMOKO_HEAP_QUANTUM - 1) / TOMOKO_HEAP_QUANTUM];
+} // classOf
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the number of bytes to map for a large block of total bytes.
+ */
+static size_t mappedSize(size_t total)
+{
+  size_t page = TOMOKO_HEAP_PAGE;
+  return (total + page - 1) & ~(page - 1);
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the slot in pageTable where the search for page starts.
+ */
+static size_t pageSlot(UCell page)
+{
+  return (size_t) ((page / TOMOKO_HEAP_PAGE) * 2654435761u) &
+         (pageCapacity - 1);
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the entry in pageTable for page, or NULL if it has none.
+ */
+static UCell *findPage(UCell page)
+{
+  if (pageCapacity == 0)
+  {
+    return NULL;
+  }
+
+  size_t slot;
+  for (slot = pageSlot(page); pageTable[slot] != 0;
+       slot = (slot + 1) & (pageCapacity - 1))
+  {
+    if ((pageTable[slot] & ~PAGE_KIND) == page)
+    {
+      return &pageTable[slot];
+    }
+  }
+  return NULL;
+} // findPage
+
+//-----------------------------------------------------------------------------
+/**
+ * Add entry, a page address plus its kind, to pageTable, which must have room
+ * for it (see reservePages()).
+ */
+static void insertPage(UCell entry)
+{
+  size_t slot = pageSlot(entry & ~PAGE_KIND);
+  while (pageTable[slot] != 0)
+  {
+    slot = (slot + 1) & (pageCapacity - 1);
+  }
+  pageTable[slot] = entry;
+  ++pageCount;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Remove entry from pageTable, moving back any later entries in its run that
+ * would otherwise no longer be found.
+ */
+static void removePage(UCell *entry)
+{
+  size_t mask = pageCapacity - 1;
+  size_t hole = entry - pageTable;
+  size_t slot;
+  pageTable[hole] = 0;
+  --pageCount;
+
+  for (slot = (hole + 1) & mask; pageTable[slot] != 0;
+       slot = (slot + 1) & mask)
+  {
+    // The entry can fill the hole unless its home slot lies after the hole.
+    size_t home = pageSlot(pageTable[slot] & ~PAGE_KIND);
+    if (((slot - home) & mask) >= ((slot - hole) & mask))
+    {
+      pageTable[hole] = pageTable[slot];
+      pageTable[slot] = 0;
+      hole = slot;
+    }
+  }
+} // removePage
+
+//-----------------------------------------------------------------------------
+/**
+ * Make room in pageTable for count more entries.  Return false if the memory
+ * for a larger table is not available.
+ */
+static int reservePages(size_t count)
+{
+  if ((pageCount + count) * 2 <= pageCapacity)
+  {
+    return 1;
+  }
+
+  size_t capacity = (pageCapacity != 0) ? pageCapacity : 256;
+  while ((pageCount + count) * 2 > capacity)
+  {
+    capacity *= 2;
+  }
+  UCell *table = mmap(NULL, capacity * sizeof (UCell), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (table == MAP_FAILED)
+  {
+    return 0;
+  }
+
+  UCell *oldTable = pageTable;
+  size_t oldCapacity = pageCapacity;
+  pageTable = table;
+  pageCapacity = capacity;
+  pageCount = 0;
+  size_t slot;
+  for (slot = 0; slot < oldCapacity; ++slot)
+  {
+    if (oldTable[slot] != 0)
+    {
+      insertPage(oldTable[slot]);
+    }
+  }
+  if (oldTable != NULL)
+  {
+    munmap(oldTable, oldCapacity * sizeof (UCell));
+  }
+  return 1;
+} // reservePages
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the header of the block at address, or NULL if address does not
+ * look like a live block.  Only headers in pages that the heap has mapped
+ * are read.
+ */
+static BlockHeader *liveHeader(void *address)
+{
+  BlockHeader *header = (BlockHeader*) address - 1;
+  UCell page = (UCell) header & ~PAGE_KIND;
+  if (((UCell) address & (sizeof (BlockHeader) - 1)) != 0)
+  {
+    return NULL;
+  }
+
+  UCell *entry = findPage(page);
+  if (entry == NULL)
+  {
+    return NULL;
+  }
+
+  // A large block's header starts its first page, and a small block's is on
+  // a boundary between the blocks of its slab's class.
+  UCell index = LARGE_CLASS;
+  if ((*entry & PAGE_TYPE) == PAGE_LARGE)
+  {
+    if ((UCell) header != page)
+    {
+      return NULL;
+    }
+  }
+  else
+  {
+    UCell place = (*entry >> PAGE_PLACE_SHIFT)
+                  & (TOMOKO_HEAP_SLAB / TOMOKO_HEAP_PAGE - 1);
+    UCell slab = page - place * TOMOKO_HEAP_PAGE;
+    index = (*entry & PAGE_KIND) >> PAGE_CLASS_SHIFT;
+    if (((UCell) header - slab) % classSizes[index] != 0)
+    {
+      return NULL;
+    }
+  }
+
+  if (header->tag != BLOCK_LIVE + index)
+  {
+    return NULL;
+  }
+  return header;
+} // liveHeader
+
+//-----------------------------------------------------------------------------
+/**
+ * heapAllocate(), with heapLock held.
+ */
+static void *allocateBlock(size_t size)
+{
+  size_t total = size + sizeof (BlockHeader);
+  if (total < size)
+  {
+    return NULL;
+  }
+
+  UCell index = classOf(total);
+  SizeClass *sizeClass = &classes[index];
+  BlockHeader *header;
+
+  if (index == LARGE_CLASS)
+  {
+    size_t length = mappedSize(total);
+    if (!reservePages(1))
+    {
+      return NULL;
+    }
+    header = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (header == MAP_FAILED)
+    {
+      return NULL;
+    }
+    insertPage((UCell) header | PAGE_LARGE);
+    sizeClass->reserved += length;
+  }
+  else if (sizeClass->freeList != NULL)
+  {
+    header = sizeClass->freeList;
+    sizeClass->freeList = *(void**) (header + 1);
+  }
+  else
+  {
+    if (sizeClass->next == sizeClass->limit)
+    {
+      if (!reservePages(TOMOKO_HEAP_SLAB / TOMOKO_HEAP_PAGE))
+      {
+        return NULL;
+      }
+      uint8_t *slab = mmap(NULL, TOMOKO_HEAP_SLAB, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (slab == MAP_FAILED)
+      {
+        return NULL;
+      }
+      size_t offset;
+      for (offset = 0; offset < TOMOKO_HEAP_SLAB; offset += TOMOKO_HEAP_PAGE)
+      {
+        insertPage((UCell) (slab + offset) | PAGE_SLAB
+                   | (offset / TOMOKO_HEAP_PAGE) << PAGE_PLACE_SHIFT
+                   | index << PAGE_CLASS_SHIFT);
+      }
+      sizeClass->next = slab;
+      sizeClass->limit = slab + TOMOKO_HEAP_SLAB -
+                         TOMOKO_HEAP_SLAB % classSizes[index];
+      sizeClass->reserved += TOMOKO_HEAP_SLAB;
+    }
+    header = (BlockHeader*) sizeClass->next;
+    sizeClass->next += classSizes[index];
+  }
+
+  header->size = size;
+  header->tag = BLOCK_LIVE + index;
+  ++sizeClass->blocks;
+  sizeClass->bytes += size;
+  return header + 1;
+} // allocateBlock
+
+//-----------------------------------------------------------------------------
+
+void *heapAllocate(size_t size)
+{
+  pthread_mutex_lock(&heapLock);
+  void *address = allocateBlock(size);
+  pthread_mutex_unlock(&heapLock);
+  return address;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * heapFree(), with heapLock held.
+ */
+static int freeBlock(void *address)
+{
+  if (address == NULL)
+  {
+    return 0;
+  }
+
+  BlockHeader *header = liveHeader(address);
+  if (header == NULL)
+  {
+    return TOMOKO_IOR_FREE;
+  }
+
+  UCell index = header->tag - BLOCK_LIVE;
+  SizeClass *sizeClass = &classes[index];
+  --sizeClass->blocks;
+  sizeClass->bytes -= header->size;
+
+  if (index == LARGE_CLASS)
+  {
+    size_t length = mappedSize(header->size + sizeof (BlockHeader));
+    sizeClass->reserved -= length;
+    removePage(findPage((UCell) header));
+    munmap(header, length);
+  }
+  else
+  {
+    header->tag = BLOCK_FREED;
+    *(void**) (header + 1) = sizeClass->freeList;
+    sizeClass->freeList = header;
+  }
+  return 0;
+} // freeBlock
+
+//-----------------------------------------------------------------------------
+
+int heapFree(void *address)
+{
+  pthread_mutex_lock(&heapLock);
+  int ior = freeBlock(address);
+  pthread_mutex_unlock(&heapLock);
+  return ior;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * heapResize(), with heapLock held.
+ */
+static void *resizeBlock(void *address, size_t size)
+{
+  BlockHeader *header = liveHeader(address);
+  size_t total = size + sizeof (BlockHeader);
+  if (header == NULL || total < size)
+  {
+    return NULL;
+  }
+
+  UCell index = header->tag - BLOCK_LIVE;
+  SizeClass *sizeClass = &classes[index];
+
+  // Stay put if the block already has room and would not fit a smaller class.
+  if (index != LARGE_CLASS && classOf(total) == index)
+  {
+    sizeClass->bytes += size - header->size;
+    header->size = size;
+    return address;
+  }
+
+#ifdef MREMAP_MAYMOVE
+  if (index == LARGE_CLASS && total > TOMOKO_HEAP_SMALL_MAX)
+  {
+    size_t oldLength = mappedSize(header->size + sizeof (BlockHeader));
+    size_t newLength = mappedSize(total);
+    BlockHeader *moved = mremap(header, oldLength, newLength, MREMAP_MAYMOVE);
+    if (moved == MAP_FAILED)
+    {
+      return NULL;
+    }
+    removePage(findPage((UCell) header));
+    insertPage((UCell) moved | PAGE_LARGE);
+    sizeClass->reserved += newLength - oldLength;
+    sizeClass->bytes += size - moved->size;
+    moved->size = size;
+    return moved + 1;
+  }
+#endif
+
+  void *moved = allocateBlock(size);
+  if (moved != NULL)
+  {
+    memcpy(moved, address, (size < header->size) ? size : header->size);
+    freeBlock(address);
+  }
+  return moved;
+} // resizeBlock
+
+//-----------------------------------------------------------------------------
+/**
+ * Resize the block at address to size bytes.  Return the new address, or
+ * NULL, leaving the block unchanged, if there is not enough memory or address
+ * is not a live block.
+ */
+static void *heapResize(void *address, size_t size)
+{
+  pthread_mutex_lock(&heapLock);
+  void *moved = resizeBlock(address, size);
+  pthread_mutex_unlock(&heapLock);
+  return moved;
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_ALLOCATE(void)
+{
+  void *address = heapAllocate((UCell) STACK_POP(sp));
+  STACK_PUSH(sp, address);
+  STACK_PUSH(sp, (address != NULL) ? 0 : TOMOKO_IOR_ALLOCATE);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FREE(void)
+{
+  int ior = heapFree((void*) STACK_POP(sp));
+  STACK_PUSH(sp, ior);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_RESIZE(void)
+{
+  size_t size = (UCell) STACK_POP(sp);
+  void *address = (void*) STACK_POP(sp);
+  void *moved = (address == NULL) ? heapAllocate(size)
+                                  : heapResize(address, size);
+  if (moved != NULL)
+  {
+    STACK_PUSH(sp, moved);
+    STACK_PUSH(sp, 0);
+  }
+  else
+  {
+    STACK_PUSH(sp, address);
+    STACK_PUSH(sp, TOMOKO_IOR_RESIZE);
+  }
+} // fn_RESIZE
+
+//-----------------------------------------------------------------------------
+
+void fn_HEAP_STATS(void)
+{
+  char line[80];
+  int length;
+  UCell index;
+
+  SizeClass snapshot[LARGE_CLASS + 1];
+  pthread_mutex_lock(&heapLock);
+  memcpy(snapshot, classes, sizeof (snapshot));
+  pthread_mutex_unlock(&heapLock);
+
+  length = snprintf(line, sizeof (line), "%8s %10s %12s %12s\n",
+                    "class", "blocks", "bytes", "reserved");
+  charsOut(line, length);
+  for (index = 0; index <= LARGE_CLASS; ++index)
+  {
+    const SizeClass *sizeClass = &snapshot[index];
+    if (sizeClass->reserved == 0)
+    {
+      continue;
+    }
+
+    char size[12];
+    if (index == LARGE_CLASS)
+    {
+      strcpy(size, "large");
+    }
+    else
+    {
+      snprintf(size, sizeof (size), "%u", (unsigned) classSizes[index]);
+    }
+    length = snprintf(line, sizeof (line), "%8s %10lu %12lu %12lu\n", size,
+                      (unsigned long) sizeClass->blocks,
+                      (unsigned long) sizeClass->bytes,
+                      (unsigned long) sizeClass->reserved);
+    charsOut(line, length);
+  }
+} // fn_HEAP_STATS
+
+//-----------------------------------------------------------------------------
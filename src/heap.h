@@ -0,0 +1,76 @@
+//-----------------------------------------------------------------------------
+// Heap
+//
+// The ANS Forth memory-allocation word set.  Blocks live outside the
+// dictionary: small blocks are carved from slabs, one free list per size
+// class, and large blocks are mapped from the operating system individually.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_HEAP_H
+#define TOMOKO_HEAP_H
+
+//-----------------------------------------------------------------------------
+/**
+ * The ior codes returned by ALLOCATE, FREE and RESIZE when they fail.  These
+ * are the THROW codes that ANS Forth reserves for those words.
+ */
+#define TOMOKO_IOR_ALLOCATE (-59)
+#define TOMOKO_IOR_FREE     (-60)
+#define TOMOKO_IOR_RESIZE   (-61)
+
+//-----------------------------------------------------------------------------
+/**
+ * Allocate a block of at least size bytes, aligned to two cells.  Return NULL
+ * if the memory is not available.
+ */
+extern void *heapAllocate(size_t size);
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the block at address to the heap.  Return 0 on success (including
+ * when address is NULL), or TOMOKO_IOR_FREE if address is not a block that
+ * is currently allocated.
+ */
+extern int heapFree(void *address);
+
+//-----------------------------------------------------------------------------
+/**
+ * ALLOCATE ( u -- a-addr ior )
+ *
+ * Allocate u bytes of contiguous data space, aligned to two cells.  On
+ * success, ior is 0.  Otherwise a-addr is undefined and ior is -59.
+ */
+extern void fn_ALLOCATE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * FREE ( a-addr -- ior )
+ *
+ * Return the space at a-addr, previously obtained from ALLOCATE or RESIZE, to
+ * the heap.  ior is -60 if a-addr is not a currently allocated block.
+ */
+extern void fn_FREE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * RESIZE ( a-addr1 u -- a-addr2 ior )
+ *
+ * Change the size of the block at a-addr1 to u bytes, moving it if need be.
+ * The contents are preserved up to the lesser of the old and new sizes.  If
+ * a-addr1 is 0, behave like ALLOCATE.  On failure, a-addr2 is a-addr1, which
+ * is left unchanged, and ior is -61.
+ */
+extern void fn_RESIZE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * HEAP-STATS ( -- )
+ *
+ * Print, for each size class in use and for large blocks, the number of
+ * blocks and bytes allocated and the bytes reserved from the system.
+ */
+extern void fn_HEAP_STATS(void);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_HEAP_H
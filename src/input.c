@@ -3,6 +3,7 @@
 //-----------------------------------------------------------------------------
 
 #include <ctype.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,13 +12,26 @@
 #include <readline/readline.h>
 #include <linux/limits.h>       // For PATH_MAX.
 
+#include "block.h"
 #include "input.h"
 #include "machine.h"
+#include "output.h"
+#include "thread.h"
+#include "task.h"
+
+//-----------------------------------------------------------------------------
+// External references to a few Forth global variables:
+
+extern Cell BLK_value;
+
+// ... and to EVALUATE (see tomoko.c).
+extern CodeWord *const evaluateWord;
 
 //-----------------------------------------------------------------------------
 
 char word[TOMOKO_WORD_MAX];
 char prompt[TOMOKO_PROMPT_MAX] = "> ";
+int terminalInput = 1;
  
 //-----------------------------------------------------------------------------
 
@@ -25,6 +39,7 @@ void die(const char *format, ...)
 {
   va_list args;
   va_start(args, format);
+  flushOutput();
   vfprintf(stderr, format, args);
   fflush(stderr);
   exit(EXIT_FAILURE);
@@ -43,37 +58,93 @@ void die(const char *format, ...)
 #define TOMOKO_LINE_MAX 256
 
 /**
- * The maximum number of simultaneous nested file inclusions using SOURCE.
+ * The initial capacity of the stack of nested input sources.  The stack grows
+ * as needed when SOURCE, EVALUATE or LOAD nest more deeply than this.
  */
 #define TOMOKO_MAX_SOURCES 8
 
 //-----------------------------------------------------------------------------
 /**
- * Records information about each file currently opened by the SOURCE statement.
+ * The kinds of InputSource.
+ */
+typedef enum
+{
+  /**
+   * Input is read a line at a time from the keyboard using readline(3).
+   */
+  SOURCE_TERMINAL,
+
+  /**
+   * Input is read a line at a time from a file opened by SOURCE.
+   */
+  SOURCE_FILE,
+
+  /**
+   * Input is read directly from a string in memory, passed to EVALUATE.  The
+   * string is not copied.
+   */
+  SOURCE_STRING,
+
+  /**
+   * Input is read from a block passed to LOAD, a line of TOMOKO_BLOCK_LINE
+   * characters at a time.  Each line is copied from the block buffer, so the
+   * block may leave the cache while it is being interpreted.
+   */
+  SOURCE_BLOCK
+} SourceKind;
+
+//-----------------------------------------------------------------------------
+/**
+ * Records information about each source currently being read.
  *
  * The terminal is counted as the first (0th) source, but it's file handle is 
  * NULL.  An array of these structures is used as a stack to record all of the
- * state needed to resume reading from the same position after a whole file has
- * been read using SOURCE.
+ * state needed to resume reading from the same position after a whole file
+ * or string has been read using SOURCE or EVALUATE.
  */
 typedef struct 
 {
+  /**
+   * Where the input comes from.
+   */
+  SourceKind kind;
+
   /**
    * The file handle to read from.  For the first InputSource, sources[0], the
    * handle is NULL and input is taken from the keyboard using readline(3).
+   * It is also NULL for SOURCE_STRING sources.
    */
   FILE *handle;
 
   /**
-   * Current line number, starting at 1.  Used in error reporting.
+   * Number of the line in lineBuffer, starting at 1 (0 until the first line
+   * is read).  Used in error reporting.
    */
   int lineNumber;
 
   /**
-   * Index of the next character to read from lineBuffer.
+   * Index of the next character to read from text.  This is the value
+   * accessed by >IN, so it is a Cell.
    */
-  int lineIndex;
-  
+  Cell lineIndex;
+
+  /**
+   * The characters currently being read: either lineBuffer, or the string
+   * passed to EVALUATE.
+   */
+  const char *text;
+
+  /**
+   * The number of characters in text.
+   */
+  Cell length;
+
+  /**
+   * The file offset of the start of the line in lineBuffer, so that
+   * RESTORE-INPUT can re-read it.
+   */
+  long lineStart;
+
   /**
    * The most recently read line from a file, using SOURCE, or the terminal.
    */
@@ -84,13 +155,32 @@ typedef struct
    * PATH_MAX can be 4096. Not storing all of that.
    */
   char fileName[TOMOKO_PATH_MAX];
+
+  /**
+   * The block being LOADed, for a SOURCE_BLOCK.
+   */
+  UCell block;
 } InputSource;
 
 //-----------------------------------------------------------------------------
 /**
- * The stack of open sources.
+ * The initial storage for the stack of sources, containing the terminal.
+ */
+static InputSource initialSources[TOMOKO_MAX_SOURCES] =
+{
+  { SOURCE_TERMINAL, NULL, 0, 0, initialSources[0].lineBuffer, 0 }
+};
+
+/**
+ * The stack of open sources.  Initially this is initialSources, but it is
+ * reallocated on the heap if the nesting gets deeper than that.
  */
-static InputSource sources[TOMOKO_MAX_SOURCES];
+static InputSource *sources = initialSources;
+
+/**
+ * The number of InputSources that sources can hold.
+ */
+static int sourcesCapacity = TOMOKO_MAX_SOURCES;
 
 /**
  * The index of the currently used source in the sources array.
@@ -102,53 +192,190 @@ static InputSource sources[TOMOKO_MAX_SOURCES];
 static int currentSource = 0;
 
 //-----------------------------------------------------------------------------
-
-void source(const char *fileName)
+/**
+ * Return a pointer to a new InputSource on top of the stack of sources,
+ * doubling the capacity of the stack if it is full.  The new source becomes
+ * the current source.
+ *
+ * Since the stack may move, pointers to existing InputSources (including
+ * addresses returned by >IN) are invalidated by this call.
+ */
+static InputSource *pushSource(SourceKind kind)
 {
-  // If we have not hit the limit on open sources.
-  if (currentSource + 1 < TOMOKO_MAX_SOURCES)
+  if (currentSource + 1 >= sourcesCapacity)
   {
-    InputSource *nextSource = &sources[currentSource + 1];
-
-    // Try to open the file.
-    nextSource->handle = fopen(fileName, "r");
-    if (nextSource->handle != NULL)
+    int capacity = 2 * sourcesCapacity;
+    InputSource *grown = malloc(capacity * sizeof (InputSource));
+    if (grown == NULL)
     {
-      // Advance the index to reference he new source.
-      ++currentSource;
-    
-      nextSource->lineNumber = 1;
-      nextSource->lineIndex = 0;
+      raiseFault("out of memory nesting input sources");
+    }
+    memcpy(grown, sources, sourcesCapacity * sizeof (InputSource));
 
-      // NUL terminate the line buffer, forcing a read.
-      nextSource->lineBuffer[0] = '\0';
-      
-      // Save the file part (excluding directories) of the name.
-      // TODO: This ('/' as separator) is not portable. Resolve.
-      // Find the last '/'
-      const char *lastSlash = strrchr(fileName, '/');
-
-      // Work out the start of the non-directory part of fileName.
-      const char *namePart = (lastSlash == NULL) ? fileName
-                                                 : lastSlash + 1;
-      // Leave the last character of fileName field untouched (0) always.
-      strncpy(nextSource->fileName, namePart, TOMOKO_PATH_MAX-1);
+    // Line-buffered sources point into their own lineBuffer, which has moved.
+    int i;
+    for (i = 0; i <= currentSource; ++i)
+    {
+      if (grown[i].kind != SOURCE_STRING)
+      {
+        grown[i].text = grown[i].lineBuffer;
+      }
     }
-    else // Failed to open the file to read.
+
+    if (sources != initialSources)
     {
-      // TODO: Better error handling.
-      die("could not open source \"%s\"", fileName);
+      free(sources);
     }
+    sources = grown;
+    sourcesCapacity = capacity;
+  }
+
+  InputSource *next = &sources[++currentSource];
+  next->kind = kind;
+  next->handle = NULL;
+  next->lineNumber = 0;
+  next->lineIndex = 0;
+  next->text = next->lineBuffer;
+  next->length = 0;
+  next->lineStart = 0;
+  next->lineBuffer[0] = '\0';
+  next->fileName[0] = '\0';
+  next->block = 0;
+  BLK_value = 0;
+  return next;
+} // pushSource
+
+//-----------------------------------------------------------------------------
+
+void source(const char *fileName)
+{
+  // Try to open the file.
+  FILE *handle = fopen(fileName, "r");
+  if (handle != NULL)
+  {
+    InputSource *nextSource = pushSource(SOURCE_FILE);
+    nextSource->handle = handle;
+
+    // Save the file part (excluding directories) of the name.
+    // TODO: This ('/' as separator) is not portable. Resolve.
+    // Find the last '/'
+    const char *lastSlash = strrchr(fileName, '/');
+
+    // Work out the start of the non-directory part of fileName.
+    const char *namePart = (lastSlash == NULL) ? fileName
+                                               : lastSlash + 1;
+    // Leave the last character of fileName field untouched (0) always.
+    strncpy(nextSource->fileName, namePart, TOMOKO_PATH_MAX-1);
+    nextSource->fileName[TOMOKO_PATH_MAX-1] = '\0';
   }
-  else // We have too many open sources to open another.
+  else // Failed to open the file to read.
   {
     // TODO: Better error handling.
-    die("too many open sources to open \"%s\"", fileName);
-  }  
+    die("could not open source \"%s\"", fileName);
+  }
 } // source
 
 //-----------------------------------------------------------------------------
 
+Cell evaluate(const char *text, Cell length)
+{
+  InputSource *nextSource = pushSource(SOURCE_STRING);
+  nextSource->text = text;
+  nextSource->length = (length > 0) ? length : 0;
+  return currentSource;
+} // evaluate
+
+//-----------------------------------------------------------------------------
+/**
+ * Copy the specified line (from 0) of the block being LOADed by source into
+ * its lineBuffer, with a '\n' terminator, ready to be read.
+ */
+static void readBlockLine(InputSource *source, int line)
+{
+  const char *contents = blockContents(source->block);
+  memcpy(source->lineBuffer, contents + line * TOMOKO_BLOCK_LINE,
+         TOMOKO_BLOCK_LINE);
+  source->lineBuffer[TOMOKO_BLOCK_LINE] = '\n';
+  source->length = TOMOKO_BLOCK_LINE + 1;
+  source->lineIndex = 0;
+  source->lineNumber = line + 1;
+} // readBlockLine
+
+//-----------------------------------------------------------------------------
+
+Cell loadBlock(UCell block)
+{
+  InputSource *nextSource = pushSource(SOURCE_BLOCK);
+  nextSource->block = block;
+  BLK_value = block;
+  return currentSource;
+} // loadBlock
+
+//-----------------------------------------------------------------------------
+
+char *readFile(const char *fileName, size_t *length)
+{
+  FILE *file = fopen(fileName, "r");
+  if (file == NULL)
+  {
+    return NULL;
+  }
+
+  char *text = NULL;
+  size_t size = 0;
+  int error = 0;
+  *length = 0;
+  for (;;)
+  {
+    if (*length == size)
+    {
+      size = (size == 0) ? 4096 : 2 * size;
+      char *bigger = realloc(text, size);
+      if (bigger == NULL)
+      {
+        error = ENOMEM;
+        break;
+      }
+      text = bigger;
+    }
+    size_t n = fread(text + *length, 1, size - *length, file);
+    if (n == 0)
+    {
+      error = ferror(file) ? errno : 0;
+      break;
+    }
+    *length += n;
+  }
+
+  fclose(file);
+  if (error != 0)
+  {
+    free(text);
+    errno = error;
+    return NULL;
+  }
+  return text;
+} // readFile
+
+//-----------------------------------------------------------------------------
+
+Cell sourceDepth(void)
+{
+  return currentSource;
+}
+
+//-----------------------------------------------------------------------------
+
+void endSources(Cell depth)
+{
+  while (currentSource > depth)
+  {
+    fn_ENDSOURCE();
+  }
+}
+
+//-----------------------------------------------------------------------------
+
 void fn_SOURCE(void)
 {
   const char *fileName = (const char*) STACK_POP(sp);
@@ -159,16 +386,175 @@ void fn_SOURCE(void)
 
 void fn_ENDSOURCE()
 {
-  // If we are actually reading from a file...
+  // If we are actually reading from a file or string...
   if (currentSource > 0)
   {
-    fclose(sources[currentSource].handle);
+    if (sources[currentSource].handle != NULL)
+    {
+      fclose(sources[currentSource].handle);
+    }
     
     // Refer to the previous source.
     --currentSource;
+    BLK_value = (sources[currentSource].kind == SOURCE_BLOCK)
+                ? sources[currentSource].block : 0;
   }
 } // fn_ENDSOURCE
 
+//-----------------------------------------------------------------------------
+
+void fn_STRINGSOURCE(void)
+{
+  Cell length = STACK_POP(sp);
+  const char *text = (const char *) STACK_POP(sp);
+  STACK_PUSH(sp, evaluate(text, length));
+} // fn_STRINGSOURCE
+
+//-----------------------------------------------------------------------------
+
+void fn_BLOCKSOURCE(void)
+{
+  UCell block = STACK_POP(sp);
+  STACK_PUSH(sp, loadBlock(block));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_SOURCEMORE(void)
+{
+  Cell depth = STACK_POP(sp);
+  Cell more;
+  if (currentSource > depth)
+  {
+    // Still reading something SOURCEd from within the string.
+    more = 1;
+  }
+  else if (currentSource < depth)
+  {
+    // The string was already ended by reading past its end.
+    more = 0;
+  }
+  else
+  {
+    // Skip trailing white space so that WORD is never asked to read past the
+    // end of the string, or of the last line of the block.
+    InputSource *source = &sources[currentSource];
+    for (;;)
+    {
+      while (source->lineIndex < source->length &&
+             source->text[source->lineIndex] <= 32)
+      {
+        ++source->lineIndex;
+      }
+      if (source->lineIndex < source->length ||
+          source->kind != SOURCE_BLOCK ||
+          source->lineNumber == TOMOKO_BLOCK_LINES)
+      {
+        break;
+      }
+      readBlockLine(source, source->lineNumber);
+    }
+
+    more = (source->lineIndex < source->length);
+    if (! more)
+    {
+      fn_ENDSOURCE();
+    }
+  }
+  STACK_PUSH(sp, BOOLEAN(more));
+} // fn_SOURCEMORE
+
+//-----------------------------------------------------------------------------
+
+void fn_SOURCE_ID(void)
+{
+  const InputSource *source = &sources[currentSource];
+  Cell id;
+  switch (source->kind)
+  {
+    case SOURCE_STRING:
+      id = -1;
+      break;
+
+    case SOURCE_FILE:
+      id = (Cell) source->handle;
+      break;
+
+    default:
+      id = 0;
+      break;
+  }
+  STACK_PUSH(sp, id);
+} // fn_SOURCE_ID
+
+//-----------------------------------------------------------------------------
+
+void fn_TOIN(void)
+{
+  STACK_PUSH(sp, &sources[currentSource].lineIndex);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_SAVE_INPUT(void)
+{
+  const InputSource *source = &sources[currentSource];
+  STACK_PUSH(sp, source->lineStart);
+  STACK_PUSH(sp, source->lineNumber);
+  STACK_PUSH(sp, source->lineIndex);
+  STACK_PUSH(sp, currentSource);
+  STACK_PUSH(sp, 4);
+} // fn_SAVE_INPUT
+
+//-----------------------------------------------------------------------------
+
+void fn_RESTORE_INPUT(void)
+{
+  Cell n = STACK_POP(sp);
+  if (n != 4)
+  {
+    // Not something that SAVE-INPUT produced.  Discard it and fail.
+    sp = STACK_ADDR(sp, n);
+    STACK_PUSH(sp, BOOLEAN(1));
+    return;
+  }
+
+  Cell depth      = STACK_POP(sp);
+  Cell lineIndex  = STACK_POP(sp);
+  Cell lineNumber = STACK_POP(sp);
+  Cell lineStart  = STACK_POP(sp);
+
+  // Input can only be restored within the source that is current.
+  InputSource *source = &sources[currentSource];
+  int failed = (depth != currentSource);
+  if (! failed && source->kind == SOURCE_FILE &&
+      source->lineStart != lineStart)
+  {
+    // Go back and re-read the saved line.
+    failed = (fseek(source->handle, lineStart, SEEK_SET) != 0 ||
+              fgets(source->lineBuffer, sizeof source->lineBuffer,
+                    source->handle) == NULL);
+    if (! failed)
+    {
+      source->lineStart = lineStart;
+      source->length = strlen(source->lineBuffer);
+    }
+  }
+
+  if (! failed && source->kind == SOURCE_BLOCK &&
+      source->lineNumber != lineNumber && lineNumber > 0)
+  {
+    readBlockLine(source, lineNumber - 1);
+  }
+
+  if (! failed)
+  {
+    source->lineNumber = lineNumber;
+    source->lineIndex = lineIndex;
+  }
+  STACK_PUSH(sp, BOOLEAN(failed));
+} // fn_RESTORE_INPUT
+
 //-----------------------------------------------------------------------------
 /**
  * Return TRUE if the character c is a white-space character.
@@ -190,7 +576,8 @@ void fn_WS(void)
 
 //-----------------------------------------------------------------------------
 /**
- * Return the next character from the input stream (the current SOURCEd file).
+ * Return the next character from the input stream (the current SOURCEd file,
+ * EVALUATEd string or the terminal).
  * 
  * This is the native implementation behind the KEY word.
  */
@@ -198,23 +585,50 @@ static char charIn(void)
 {
   InputSource *source = &sources[currentSource];
   
-  // Extract the next character from the buffer and advance the index.
-  Cell c = source->lineBuffer[source->lineIndex++];
-  
   // Have we reached the end of the buffer?
-  if (c != '\0')
+  if (source->lineIndex < source->length)
   {
-    // No. Return the character.
-    return c;
+    // No. Extract the next character and advance the index.
+    return source->text[source->lineIndex++];
   }
   else // End of the current buffered line. Read another.
   {
+    if (source->kind == SOURCE_STRING)
+    {
+      // The end of an EVALUATEd string reads as the end of a line, once, so
+      // that a word at the very end is terminated.  Reading any further
+      // resumes with the enclosing source.
+      if (source->lineIndex++ == source->length)
+      {
+        return '\n';
+      }
+      fn_ENDSOURCE();
+      return charIn();
+    }
+
+    if (source->kind == SOURCE_BLOCK)
+    {
+      // Move on to the next line of the block, or else back to the source
+      // that LOADed it.
+      if (source->lineNumber < TOMOKO_BLOCK_LINES)
+      {
+        readBlockLine(source, source->lineNumber);
+      }
+      else
+      {
+        fn_ENDSOURCE();
+      }
+      return charIn();
+    }
+
     // Reset the index pointing to the next character to return.
     source->lineIndex = 0;
+    source->length = 0;
   
     // Are we reading from a file?
     if (source->handle != NULL)
     {
+      source->lineStart = ftell(source->handle);
       char *result = fgets(source->lineBuffer, sizeof source->lineBuffer, source->handle);
       
       // If we reached the end of the file...
@@ -223,10 +637,25 @@ static char charIn(void)
         // Close the current source.
         fn_ENDSOURCE();
       }
+      else
+      {
+        source->length = strlen(source->lineBuffer);
+        ++source->lineNumber;
+      }
+    }
+    else if (! terminalInput)
+    {
+      raiseFault("unexpected end of input");
     }
     else // We are reading from the terminal.
     {
-     // Read a line.
+      // Make sure any prompting output is visible first.
+      flushOutput();
+
+      // Let other tasks run until there is something to read.
+      waitForInput(fileno(stdin));
+
+      // Read a line.
       char *line = readline(prompt);
       if (line == NULL)
       {
@@ -238,6 +667,8 @@ static char charIn(void)
       strncpy(source->lineBuffer, line, sizeof source->lineBuffer - 2);
       source->lineBuffer[sizeof source->lineBuffer - 2] = '\0';
       strcat(source->lineBuffer, "\n");
+      source->length = strlen(source->lineBuffer);
+      ++source->lineNumber;
       
       // Deallocate the buffer allocated by readline.
       free(line);
@@ -410,4 +841,40 @@ void fn_INIT(void)
 
 //-----------------------------------------------------------------------------
 
+int loadPrelude(void)
+{
+  const char *home = getenv("HOME");
+  if (home == NULL)
+  {
+    fprintf(stderr, "$HOME is not set\n");
+    return 0;
+  }
+  char fileName[strlen(home) + sizeof "/.tomoko"];
+  strcpy(fileName, home);
+  strcat(fileName, "/.tomoko");
+
+  size_t length;
+  char *text = readFile(fileName, &length);
+  if (text == NULL)
+  {
+    perror(fileName);
+    return 0;
+  }
+
+  // The text is kept, since words defined in it may point into it.
+  if (sigsetjmp(stackFaultRecovery, 1) == 0)
+  {
+    STACK_PUSH(sp, text);
+    STACK_PUSH(sp, length);
+    executeWord(evaluateWord);
+    flushOutput();
+    return 1;
+  }
+  flushOutput();
+  fprintf(stderr, "%s: %s\n", fileName, stackFault);
+  return 0;
+} // loadPrelude
+
+//-----------------------------------------------------------------------------
+
 
@@ -1,6 +1,8 @@
 #ifndef TOMOKO_INPUT_H
 #define TOMOKO_INPUT_H
 
+#include "types.h"
+
 //-----------------------------------------------------------------------------
 // Buffers.
 
@@ -24,6 +26,14 @@ extern char word[TOMOKO_WORD_MAX];
  */
 extern char prompt[TOMOKO_PROMPT_MAX];
 
+/**
+ * True if the outermost input source is the terminal.  When Tomoko is
+ * embedded in another program (see libtomoko.h) there is no terminal, and
+ * reading past the end of the outermost source is a fault, reported as
+ * stack faults are (see stackFault in machine.h).
+ */
+extern int terminalInput;
+
 
 //-----------------------------------------------------------------------------
 /**
@@ -41,6 +51,61 @@ extern void die(const char *format, ...);
  */
 extern void source(const char *fileName);
 
+//-----------------------------------------------------------------------------
+/**
+ * Make the string of the specified length at text the current input source.
+ * The string is not copied, so it must remain unchanged until it has been
+ * completely read.  Once the end of the string is reached, input continues
+ * from the previous source.
+ * @param text the characters to read.
+ * @param length the number of characters.
+ * @return the depth of the new source in the stack of input sources, for use
+ *         with SOURCE-MORE?.
+ */
+extern Cell evaluate(const char *text, Cell length);
+
+//-----------------------------------------------------------------------------
+/**
+ * Make the specified block the current input source, as LOAD does, and set
+ * BLK to its number.  The block is read a line at a time through the block
+ * buffers.  Once its last line has been read, input continues from the
+ * previous source.
+ * @param block the number of the block to interpret.
+ * @return the depth of the new source in the stack of input sources, for use
+ *         with SOURCE-MORE?.
+ */
+extern Cell loadBlock(UCell block);
+
+//-----------------------------------------------------------------------------
+/**
+ * Evaluate ~/.tomoko, as INIT and QUIT do at startup, for the modes that do
+ * not read the terminal (see serve.h and batch.h).  Return false, after
+ * reporting why, if it cannot be read or faults.
+ */
+extern int loadPrelude(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * Read the whole of the file named fileName (which may be a pipe) into a
+ * buffer from malloc(), for evaluate(), and set *length to its length.
+ * Return NULL, with errno set, if it cannot be read.
+ */
+extern char *readFile(const char *fileName, size_t *length);
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the depth of the current source in the stack of input sources: 0
+ * for the terminal.
+ */
+extern Cell sourceDepth(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * End the input sources above the specified depth, closing any files, after
+ * a fault has left them partly read.
+ */
+extern void endSources(Cell depth);
+
 //-----------------------------------------------------------------------------
 // Words.
 //-----------------------------------------------------------------------------
@@ -64,6 +129,80 @@ extern void fn_SOURCE(void);
  */
 extern void fn_ENDSOURCE();
 
+//-----------------------------------------------------------------------------
+/**
+ * STRING-SOURCE ( addr len -- depth )
+ *
+ * This is the Forth word corresponding to evaluate().
+ *
+ * Make the string (addr,len) the current input source, without copying it,
+ * and return the depth of the new source for SOURCE-MORE?.  This is the
+ * first half of EVALUATE.
+ */
+extern void fn_STRINGSOURCE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * BLOCK-SOURCE ( u -- depth )
+ *
+ * This is the Forth word corresponding to loadBlock().
+ *
+ * Make block u the current input source and return the depth of the new
+ * source for SOURCE-MORE?.  This is the first half of LOAD.
+ */
+extern void fn_BLOCKSOURCE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * SOURCE-MORE? ( depth -- flag )
+ *
+ * Return TRUE if the string or block source at the specified depth, as
+ * returned by STRING-SOURCE or BLOCK-SOURCE, still has words left to
+ * interpret.  Trailing white space is skipped, and once the source is
+ * exhausted it is ended and FALSE is returned.  Sources nested within it (by
+ * SOURCE) count as part of it.
+ */
+extern void fn_SOURCEMORE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * SOURCE-ID ( -- 0 | -1 | fileid )
+ *
+ * Identify the current input source: 0 for the terminal (or a block being
+ * LOADed, when BLK is non-zero), -1 for a string being EVALUATEd and the file
+ * handle for a file being SOURCEd.
+ */
+extern void fn_SOURCE_ID(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * >IN ( -- addr )
+ *
+ * Return the address of the index of the next character to be read from the
+ * current line of input (or EVALUATEd string).  The address is only valid
+ * until the next SOURCE or EVALUATE.
+ */
+extern void fn_TOIN(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * SAVE-INPUT ( -- x1 x2 x3 x4 4 )
+ *
+ * Save the position in the current input source, for RESTORE-INPUT.
+ */
+extern void fn_SAVE_INPUT(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * RESTORE-INPUT ( x1 ... xn n -- flag )
+ *
+ * Restore the input position saved by SAVE-INPUT.  Return FALSE if it was
+ * restored and TRUE if it could not be, because the saved position was not
+ * in the current input source.  Lines of files are re-read as necessary, but
+ * only the current line of the terminal can be restored.
+ */
+extern void fn_RESTORE_INPUT(void);
+
 //-----------------------------------------------------------------------------
 /**
  * WS? ( c -- flag )
@@ -0,0 +1,501 @@
+//-----------------------------------------------------------------------------
+// libtomoko
+//
+// Calling into an instance loads its registers and its dictionary variables,
+// saving those of whatever was running before (another instance, or
+// nothing), and returning saves the instance's and restores the others, much
+// as switching tasks does (see task.c).  A call into the instance that is
+// already running, from one of its host words, just carries on with the live
+// registers.
+//
+// Each call has its own sigsetjmp() target, as each thread does (see
+// thread.c), so that a stack fault ends the call rather than unwinding past
+// the host program.  Instances' stacks are mapped once and reused: a
+// destroyed instance goes on a spare list for the next tomokoCreate().
+//-----------------------------------------------------------------------------
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libtomoko.h"
+#include "dictionary.h"
+#include "input.h"
+#include "machine.h"
+#include "native.h"
+#include "output.h"
+#include "task.h"
+#include "thread.h"
+
+// External references to the Forth variables that each instance has its own
+// copy of:
+extern Cell HERE_value;
+extern Cell LATEST_value;
+extern Cell PIFA_value;
+extern Cell CASE_SENSITIVE_value;
+extern Cell OUTPUT_THRESHOLD_value;
+extern Cell PAR_GRAIN_value;
+
+// ... and to the words that instances start from (see tomoko.c).
+extern const Link lastBuiltInWord;
+extern CodeWord *const interpretWord;
+
+//-----------------------------------------------------------------------------
+/**
+ * The registers and variables of an instance, or of whatever was running
+ * before a call into one.
+ */
+typedef struct
+{
+  CodeWord **ip;
+  CodeWord *w;
+  Cell *sp;
+  Cell *rsp;
+  Float *fsp;
+  Cell *userArea;
+  Cell here;
+  char *limit;
+  Cell latest;
+  Cell pifa;
+  Cell caseSensitive;
+  Cell outputThreshold;
+  Cell parGrain;
+} Machine;
+
+/**
+ * An interpreter instance.
+ */
+struct Tomoko
+{
+  Tomoko *nextSpare;           ///< The next instance in the spare list.
+  Machine machine;             ///< Its state, while it is not running.
+  Cell userCells[USER_CELLS];  ///< Its user area.
+  Cell *dictionary;            ///< Its space for definitions.
+  const char *error;           ///< Its last fault, or NULL.
+};
+
+/**
+ * A call into an instance.
+ */
+typedef struct
+{
+  Tomoko *previous;      ///< The instance running before the call, or NULL.
+  Machine saved;         ///< What was running before, if not the instance.
+  sigjmp_buf recovery;   ///< The fault recovery point before the call.
+  Cell depth;            ///< The input source depth at the call.
+  CodeWord **ip;         ///< The instruction pointer at the call.
+  Cell *rsp;             ///< The return stack pointer at the call.
+} Call;
+
+/**
+ * The instance running in the calling thread, or NULL.
+ */
+static __thread Tomoko *running = NULL;
+
+/**
+ * Held, recursively, through each call into an instance, so that only one
+ * runs at a time, and while spareInstances is used.
+ */
+static pthread_mutex_t apiLock;
+
+static pthread_once_t libraryInitialised = PTHREAD_ONCE_INIT;
+
+/**
+ * Destroyed instances, with their stacks and dictionaries, kept for reuse.
+ */
+static Tomoko *spareInstances = NULL;
+
+//-----------------------------------------------------------------------------
+/**
+ * Set up the library, the first time an instance is created.
+ */
+static void initLibrary(void)
+{
+  pthread_mutexattr_t attributes;
+  pthread_mutexattr_init(&attributes);
+  pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&apiLock, &attributes);
+  pthread_mutexattr_destroy(&attributes);
+
+  terminalInput = 0;
+  allocateStacks(PARAMETER_STACK_CELLS, RETURN_STACK_CELLS,
+                 FLOAT_STACK_FLOATS);
+} // initLibrary
+
+//-----------------------------------------------------------------------------
+/**
+ * Save the live registers and variables into machine.
+ */
+static void saveMachine(Machine *machine)
+{
+  machine->ip = ip;
+  machine->w = w;
+  machine->sp = sp;
+  machine->rsp = rsp;
+  machine->fsp = fsp;
+  machine->userArea = userArea;
+  machine->here = HERE_value;
+  machine->limit = dictionaryLimit;
+  machine->latest = LATEST_value;
+  machine->pifa = PIFA_value;
+  machine->caseSensitive = CASE_SENSITIVE_value;
+  machine->outputThreshold = OUTPUT_THRESHOLD_value;
+  machine->parGrain = PAR_GRAIN_value;
+} // saveMachine
+
+//-----------------------------------------------------------------------------
+/**
+ * Load the live registers and variables from machine.
+ */
+static void loadMachine(const Machine *machine)
+{
+  ip = machine->ip;
+  w = machine->w;
+  sp = machine->sp;
+  rsp = machine->rsp;
+  fsp = machine->fsp;
+  userArea = machine->userArea;
+  HERE_value = machine->here;
+  dictionaryLimit = machine->limit;
+  LATEST_value = machine->latest;
+  PIFA_value = machine->pifa;
+  CASE_SENSITIVE_value = machine->caseSensitive;
+  OUTPUT_THRESHOLD_value = machine->outputThreshold;
+  PAR_GRAIN_value = machine->parGrain;
+} // loadMachine
+
+//-----------------------------------------------------------------------------
+/**
+ * Start a call into tomoko.  The caller then sets its own fault recovery
+ * point with sigsetjmp(stackFaultRecovery, 1).
+ */
+static void enter(Tomoko *tomoko, Call *call)
+{
+  pthread_mutex_lock(&apiLock);
+  call->previous = running;
+  if (running != tomoko)
+  {
+    saveMachine(&call->saved);
+    loadMachine(&tomoko->machine);
+    running = tomoko;
+  }
+  memcpy(call->recovery, stackFaultRecovery, sizeof (sigjmp_buf));
+  call->depth = sourceDepth();
+  call->ip = ip;
+  call->rsp = rsp;
+} // enter
+
+//-----------------------------------------------------------------------------
+/**
+ * Clean up after a fault in a call into tomoko: stop the task that faulted,
+ * if it was not the one that made the call, empty its parameter stack, as
+ * QUIT does, and unwind its return stack and input sources to where they
+ * were at the call.
+ */
+static void recover(Tomoko *tomoko, Call *call)
+{
+  tomoko->error = stackFault;
+  dropDictionaryLock();
+  recoverOperator();
+  userArea = tomoko->userCells;
+  endSources(call->depth);
+  sp = (Cell*) userArea[USER_S0];
+  fsp = (Float*) userArea[USER_F0];
+  rsp = call->rsp;
+  ip = call->ip;
+  userArea[USER_STATE] = 0;
+} // recover
+
+//-----------------------------------------------------------------------------
+/**
+ * End a call into tomoko, restoring what was running before.
+ */
+static void leave(Tomoko *tomoko, Call *call)
+{
+  memcpy(stackFaultRecovery, call->recovery, sizeof (sigjmp_buf));
+  if (call->previous != tomoko)
+  {
+    saveMachine(&tomoko->machine);
+    loadMachine(&call->saved);
+    running = call->previous;
+  }
+  if (running == NULL)
+  {
+    flushOutput();
+  }
+  pthread_mutex_unlock(&apiLock);
+} // leave
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the address of tomoko's parameter stack pointer: the live register,
+ * if tomoko is running in the calling thread, or else its saved value.
+ */
+static Cell **stackPointer(Tomoko *tomoko)
+{
+  return (tomoko == running) ? &sp : &tomoko->machine.sp;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * The code word of host words: call the function in the word's first
+ * parameter cell with the data in its second.
+ */
+static void callHost(void)
+{
+  const Cell *parameters = (const Cell*) w + 1;
+  TomokoFunction *function = (TomokoFunction*) parameters[0];
+  function(running, (void*) parameters[1]);
+} // callHost
+
+//-----------------------------------------------------------------------------
+
+Tomoko *tomokoCreate(void)
+{
+  pthread_once(&libraryInitialised, initLibrary);
+
+  pthread_mutex_lock(&apiLock);
+  Tomoko *tomoko = spareInstances;
+  if (tomoko != NULL)
+  {
+    spareInstances = tomoko->nextSpare;
+  }
+  pthread_mutex_unlock(&apiLock);
+
+  if (tomoko == NULL)
+  {
+    tomoko = malloc(sizeof (Tomoko));
+    Cell *dictionary = mapDictionary();
+    Cell *s0 = mapStack(parameterStackCells, 1);
+    Cell *r0 = mapStack(returnStackCells, 0);
+    Float *f0 = mapFloatStack(floatStackFloats);
+    if (tomoko == NULL || dictionary == NULL || s0 == NULL || r0 == NULL
+        || f0 == NULL)
+    {
+      free(tomoko);
+      unmapStack(dictionary);
+      unmapStack(s0);
+      unmapStack(r0);
+      unmapStack(f0);
+      return NULL;
+    }
+    tomoko->dictionary = dictionary;
+    tomoko->userCells[USER_S0] = (Cell) s0;
+    tomoko->userCells[USER_R0] = (Cell) r0;
+    tomoko->userCells[USER_F0] = (Cell) f0;
+  }
+
+  tomoko->userCells[USER_BASE] = 10;
+  tomoko->userCells[USER_STATE] = 0;
+
+  Machine *machine = &tomoko->machine;
+  machine->ip = NULL;
+  machine->w = NULL;
+  machine->sp = (Cell*) tomoko->userCells[USER_S0];
+  machine->rsp = (Cell*) tomoko->userCells[USER_R0];
+  machine->fsp = (Float*) tomoko->userCells[USER_F0];
+  machine->userArea = tomoko->userCells;
+  machine->here = (Cell) tomoko->dictionary;
+  machine->limit = (char*) tomoko->dictionary + DICTIONARY_SIZE;
+  machine->latest = (Cell) lastBuiltInWord;
+  machine->pifa = 0;
+  machine->caseSensitive = 1;
+  machine->outputThreshold = TOMOKO_OUTPUT_MAX;
+  machine->parGrain = 0;
+
+  tomoko->nextSpare = NULL;
+  tomoko->error = NULL;
+  return tomoko;
+} // tomokoCreate
+
+//-----------------------------------------------------------------------------
+
+void tomokoDestroy(Tomoko *tomoko)
+{
+  pthread_mutex_lock(&apiLock);
+  tomoko->nextSpare = spareInstances;
+  spareInstances = tomoko;
+  pthread_mutex_unlock(&apiLock);
+}
+
+//-----------------------------------------------------------------------------
+
+int tomokoEvaluate(Tomoko *tomoko, const char *text, size_t length)
+{
+  Call call;
+  int result = TOMOKO_OK;
+  enter(tomoko, &call);
+  if (sigsetjmp(stackFaultRecovery, 1) == 0)
+  {
+    Cell depth = evaluate(text, length);
+    for (;;)
+    {
+      STACK_PUSH(sp, depth);
+      fn_SOURCEMORE();
+      if (! STACK_POP(sp))
+      {
+        break;
+      }
+      executeWord(interpretWord);
+    }
+  }
+  else
+  {
+    recover(tomoko, &call);
+    result = TOMOKO_FAULT;
+  }
+  leave(tomoko, &call);
+  return result;
+} // tomokoEvaluate
+
+//-----------------------------------------------------------------------------
+
+int tomokoEvaluateFile(Tomoko *tomoko, const char *fileName)
+{
+  size_t length;
+  char *text = readFile(fileName, &length);
+  if (text == NULL)
+  {
+    return TOMOKO_NO_FILE;
+  }
+  int result = tomokoEvaluate(tomoko, text, length);
+  free(text);
+  return result;
+} // tomokoEvaluateFile
+
+//-----------------------------------------------------------------------------
+
+int tomokoPush(Tomoko *tomoko, Cell x)
+{
+  int result = TOMOKO_OVERFLOW;
+  pthread_mutex_lock(&apiLock);
+  Cell **stack = stackPointer(tomoko);
+  Cell *top = *stack;
+  if ((Cell*) tomoko->userCells[USER_S0] - top < (Cell) parameterStackCells)
+  {
+    STACK_PUSH(top, x);
+    *stack = top;
+    result = TOMOKO_OK;
+  }
+  pthread_mutex_unlock(&apiLock);
+  return result;
+} // tomokoPush
+
+//-----------------------------------------------------------------------------
+
+int tomokoPop(Tomoko *tomoko, Cell *x)
+{
+  int result = TOMOKO_UNDERFLOW;
+  pthread_mutex_lock(&apiLock);
+  Cell **stack = stackPointer(tomoko);
+  Cell *top = *stack;
+  if (top < (Cell*) tomoko->userCells[USER_S0])
+  {
+    *x = STACK_POP(top);
+    *stack = top;
+    result = TOMOKO_OK;
+  }
+  pthread_mutex_unlock(&apiLock);
+  return result;
+} // tomokoPop
+
+//-----------------------------------------------------------------------------
+
+Cell tomokoDepth(Tomoko *tomoko)
+{
+  pthread_mutex_lock(&apiLock);
+  Cell depth = (Cell*) tomoko->userCells[USER_S0] - *stackPointer(tomoko);
+  pthread_mutex_unlock(&apiLock);
+  return depth;
+}
+
+//-----------------------------------------------------------------------------
+
+TomokoXt tomokoFind(Tomoko *tomoko, const char *name)
+{
+  Call call;
+  const Cell *link = NULL;
+  enter(tomoko, &call);
+  if (sigsetjmp(stackFaultRecovery, 1) == 0)
+  {
+    STACK_PUSH(sp, name);
+    STACK_PUSH(sp, strlen(name));
+    fn_FIND();
+    link = (const Cell*) STACK_POP(sp);
+  }
+  else
+  {
+    recover(tomoko, &call);
+  }
+  leave(tomoko, &call);
+
+  if (link == NULL)
+  {
+    return NULL;
+  }
+
+  return codeField(link);
+} // tomokoFind
+
+//-----------------------------------------------------------------------------
+
+int tomokoCall(Tomoko *tomoko, TomokoXt xt)
+{
+  Call call;
+  int result = TOMOKO_OK;
+  enter(tomoko, &call);
+  if (sigsetjmp(stackFaultRecovery, 1) == 0)
+  {
+    executeWord(xt);
+  }
+  else
+  {
+    recover(tomoko, &call);
+    result = TOMOKO_FAULT;
+  }
+  leave(tomoko, &call);
+  return result;
+} // tomokoCall
+
+//-----------------------------------------------------------------------------
+
+int tomokoDefine(Tomoko *tomoko, const char *name, TomokoFunction *function,
+                 void *data)
+{
+  size_t length = strlen(name);
+  if (length == 0 || length > LENGTH_BITS)
+  {
+    return TOMOKO_BAD_NAME;
+  }
+
+  Call call;
+  int result = TOMOKO_NO_ROOM;
+  enter(tomoko, &call);
+  lockDictionary();
+
+  // The header, then the code word and the function and data as parameters,
+  // as CREATE would lay them out.
+  Cell *code = createHeader(name, length, 3);
+  if (code != NULL)
+  {
+    code[0] = (Cell) &callHost;
+    code[1] = (Cell) function;
+    code[2] = (Cell) data;
+    result = TOMOKO_OK;
+  }
+
+  unlockDictionary();
+  leave(tomoko, &call);
+  return result;
+} // tomokoDefine
+
+//-----------------------------------------------------------------------------
+
+const char *tomokoError(const Tomoko *tomoko)
+{
+  return tomoko->error;
+}
+
+//-----------------------------------------------------------------------------
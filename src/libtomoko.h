@@ -0,0 +1,150 @@
+//-----------------------------------------------------------------------------
+// libtomoko
+//
+// The C API for embedding Tomoko in another program, as libtomoko.a or
+// libtomoko.so.  The program creates any number of interpreter instances,
+// each with its own stacks, user area and dictionary space (and its own
+// HERE, LATEST and other variables), on top of the built-in words, which they
+// share.  It can then evaluate text in an instance, push and pop cells, call
+// its words, and add words of its own, written in C.
+//
+// Calls may come from any thread, and from within a host word, into the same
+// instance or another.  Calls from different threads take turns: only one
+// instance runs at a time.  The heap, blocks, channels, threads and tasks
+// are shared by the whole process, and a THREAD or PAR-DO started by an
+// instance sees whichever instance is running.
+//
+// There is no terminal: input comes only from the text being evaluated, and
+// output goes to stdout, flushed as each outermost call returns.  Tomoko
+// installs a SIGSEGV handler, the first time an instance is created, to catch
+// stack overflows and underflows.  It passes any other fault on to the
+// handler that the host program had installed before, if any.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_LIBTOMOKO_H
+#define TOMOKO_LIBTOMOKO_H
+
+#include <stddef.h>
+
+#include "types.h"
+
+//-----------------------------------------------------------------------------
+/**
+ * Marks the functions that libtomoko.so exports; everything else in the
+ * library is hidden.
+ */
+#define TOMOKO_API __attribute__ ((visibility ("default")))
+
+//-----------------------------------------------------------------------------
+// Results of the API functions.
+
+#define TOMOKO_OK         0  ///< Success.
+#define TOMOKO_FAULT     -1  ///< The instance faulted; see tomokoError().
+#define TOMOKO_UNDERFLOW -2  ///< The parameter stack is empty.
+#define TOMOKO_OVERFLOW  -3  ///< The parameter stack is full.
+#define TOMOKO_NO_ROOM   -4  ///< The dictionary or memory is full.
+#define TOMOKO_NO_FILE   -5  ///< The file could not be read; see errno.
+#define TOMOKO_BAD_NAME  -6  ///< A word name is empty or too long.
+
+//-----------------------------------------------------------------------------
+/**
+ * An interpreter instance.
+ */
+typedef struct Tomoko Tomoko;
+
+/**
+ * The execution token of a word, as found by tomokoFind().  It remains valid
+ * as long as the word's instance.
+ */
+typedef CodeWord *TomokoXt;
+
+/**
+ * A host word, defined by tomokoDefine().  It is called with the instance
+ * that is running it (in the thread that called into that instance) and the
+ * data given to tomokoDefine(), and uses tomokoPush() and tomokoPop() on the
+ * instance's parameter stack.
+ */
+typedef void TomokoFunction(Tomoko *tomoko, void *data);
+
+//-----------------------------------------------------------------------------
+/**
+ * Create an instance with empty stacks, BASE 10 and only the built-in words.
+ * Return NULL if there is not enough memory.
+ */
+extern TOMOKO_API Tomoko *tomokoCreate(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * Destroy an instance, which must not be running.  Its memory is kept for
+ * the next tomokoCreate().
+ */
+extern TOMOKO_API void tomokoDestroy(Tomoko *tomoko);
+
+//-----------------------------------------------------------------------------
+/**
+ * Interpret (or compile) the length characters of text in an instance, as
+ * EVALUATE does.  After a fault, the parameter stack is emptied and STATE is
+ * reset, as QUIT does.
+ */
+extern TOMOKO_API int tomokoEvaluate(Tomoko *tomoko, const char *text,
+                                     size_t length);
+
+//-----------------------------------------------------------------------------
+/**
+ * Interpret the file named fileName in an instance, as a whole, as
+ * tomokoEvaluate() does.
+ */
+extern TOMOKO_API int tomokoEvaluateFile(Tomoko *tomoko,
+                                         const char *fileName);
+
+//-----------------------------------------------------------------------------
+/**
+ * Push x onto an instance's parameter stack.
+ */
+extern TOMOKO_API int tomokoPush(Tomoko *tomoko, Cell x);
+
+//-----------------------------------------------------------------------------
+/**
+ * Pop the top of an instance's parameter stack into *x.
+ */
+extern TOMOKO_API int tomokoPop(Tomoko *tomoko, Cell *x);
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the number of cells on an instance's parameter stack.
+ */
+extern TOMOKO_API Cell tomokoDepth(Tomoko *tomoko);
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the execution token of the word named name (a NUL terminated
+ * string) in an instance, or NULL if there is none.  Look the word up once
+ * and keep the token for tomokoCall().
+ */
+extern TOMOKO_API TomokoXt tomokoFind(Tomoko *tomoko, const char *name);
+
+//-----------------------------------------------------------------------------
+/**
+ * EXECUTE the word xt in an instance, with the instance's parameter stack.
+ * After a fault, the stack is emptied.
+ */
+extern TOMOKO_API int tomokoCall(Tomoko *tomoko, TomokoXt xt);
+
+//-----------------------------------------------------------------------------
+/**
+ * Define a word named name (a NUL terminated string) in an instance, which
+ * calls function with the instance and data.
+ */
+extern TOMOKO_API int tomokoDefine(Tomoko *tomoko, const char *name,
+                                   TomokoFunction *function, void *data);
+
+//-----------------------------------------------------------------------------
+/**
+ * Return a description of an instance's last fault, or NULL if it has not
+ * faulted.
+ */
+extern TOMOKO_API const char *tomokoError(const Tomoko *tomoko);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_LIBTOMOKO_H
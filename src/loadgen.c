@@ -0,0 +1,231 @@
+//-----------------------------------------------------------------------------
+// Load generator for tomoko --serve
+//
+//   loadgen [-c clients] [-n requests] [-e text] socket
+//
+// Each client is a thread with its own connection, which sends the request
+// text n times, waiting for each reply before sending the next.  At the end,
+// the throughput of all the clients together and the percentiles of the
+// request latencies are reported.
+//-----------------------------------------------------------------------------
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+//-----------------------------------------------------------------------------
+/**
+ * A client thread.
+ */
+typedef struct
+{
+  pthread_t id;
+  long long *latencies;  ///< The time taken by each request, in nanoseconds.
+  int failed;            ///< True if the connection failed.
+} Client;
+
+static const char *socketPath;
+static const char *requestText = "1 2 + DROP";
+static long requests = 10000;
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the time, in nanoseconds, on a clock that does not jump.
+ */
+static long long nanoseconds(void)
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Connect to the server, waiting up to a few seconds for it to start, and
+ * return the socket, or -1.
+ */
+static int connectToServer(void)
+{
+  struct sockaddr_un address = { .sun_family = AF_UNIX };
+  strncpy(address.sun_path, socketPath, sizeof address.sun_path - 1);
+  int attempt;
+  for (attempt = 0; attempt < 500; ++attempt)
+  {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+      return -1;
+    }
+    if (connect(fd, (struct sockaddr*) &address, sizeof address) == 0)
+    {
+      return fd;
+    }
+    close(fd);
+    struct timespec pause = { 0, 10000000L };
+    nanosleep(&pause, NULL);
+  }
+  return -1;
+} // connectToServer
+
+//-----------------------------------------------------------------------------
+/**
+ * The start routine of a client thread.
+ */
+static void *runClient(void *argument)
+{
+  Client *client = argument;
+  int fd = connectToServer();
+  if (fd < 0)
+  {
+    client->failed = 1;
+    return NULL;
+  }
+
+  size_t length = strlen(requestText);
+  char *request = malloc(length + 1);
+  memcpy(request, requestText, length);
+  request[length] = '\n';
+
+  char reply[4096];
+  long i;
+  for (i = 0; i < requests && ! client->failed; ++i)
+  {
+    long long start = nanoseconds();
+    if (write(fd, request, length + 1) != (ssize_t) length + 1)
+    {
+      client->failed = 1;
+      break;
+    }
+
+    // Read until the NUL that ends the reply.
+    for (;;)
+    {
+      ssize_t n = read(fd, reply, sizeof reply);
+      if (n <= 0)
+      {
+        client->failed = (n < 0 && errno == EINTR) ? 0 : 1;
+        if (client->failed)
+        {
+          break;
+        }
+        continue;
+      }
+      if (memchr(reply, '\0', n) != NULL)
+      {
+        break;
+      }
+    }
+    client->latencies[i] = nanoseconds() - start;
+  }
+
+  free(request);
+  close(fd);
+  return NULL;
+} // runClient
+
+//-----------------------------------------------------------------------------
+/**
+ * Compare two latencies for qsort().
+ */
+static int compareLatencies(const void *a, const void *b)
+{
+  long long x = *(const long long*) a;
+  long long y = *(const long long*) b;
+  return (x > y) - (x < y);
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Print the command line usage and exit(EXIT_FAILURE).
+ */
+static void usage(const char *program)
+{
+  fprintf(stderr,
+          "usage: %s [-c clients] [-n requests] [-e text] socket\n"
+          "  -c clients   concurrent connections (default 4)\n"
+          "  -n requests  requests per connection (default 10000)\n"
+          "  -e text      the request (default \"1 2 + DROP\")\n",
+          program);
+  exit(EXIT_FAILURE);
+} // usage
+
+//-----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+  long clients = 4;
+  int option;
+  while ((option = getopt(argc, argv, "c:n:e:")) != -1)
+  {
+    switch (option)
+    {
+      case 'c':
+        clients = strtol(optarg, NULL, 0);
+        break;
+
+      case 'n':
+        requests = strtol(optarg, NULL, 0);
+        break;
+
+      case 'e':
+        requestText = optarg;
+        break;
+
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1 || clients < 1 || requests < 1)
+  {
+    usage(argv[0]);
+  }
+  socketPath = argv[optind];
+
+  long total = clients * requests;
+  long long *latencies = calloc(total, sizeof (long long));
+  Client *client = calloc(clients, sizeof (Client));
+  if (latencies == NULL || client == NULL)
+  {
+    fprintf(stderr, "not enough memory\n");
+    return EXIT_FAILURE;
+  }
+
+  long long start = nanoseconds();
+  long i;
+  for (i = 0; i < clients; ++i)
+  {
+    client[i].latencies = latencies + i * requests;
+    pthread_create(&client[i].id, NULL, runClient, &client[i]);
+  }
+  int failed = 0;
+  for (i = 0; i < clients; ++i)
+  {
+    pthread_join(client[i].id, NULL);
+    failed |= client[i].failed;
+  }
+  double seconds = (nanoseconds() - start) / 1e9;
+  if (failed)
+  {
+    fprintf(stderr, "%s: connection failed\n", socketPath);
+    return EXIT_FAILURE;
+  }
+
+  qsort(latencies, total, sizeof (long long), compareLatencies);
+  printf("%ld requests from %ld clients in %.3f s: %.0f requests/s\n",
+         total, clients, seconds, total / seconds);
+  printf("latency (us): p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+         latencies[total / 2] / 1e3, latencies[total * 90 / 100] / 1e3,
+         latencies[total * 99 / 100] / 1e3,
+         latencies[total * 999 / 1000] / 1e3, latencies[total - 1] / 1e3);
+  return EXIT_SUCCESS;
+} // main
+
+//-----------------------------------------------------------------------------
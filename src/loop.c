@@ -0,0 +1,214 @@
+//-----------------------------------------------------------------------------
+// Counted Loops
+//
+// The offsets compiled after the run-time words are in bytes, relative to the
+// offset cell, as BRANCH's are.  An offset waiting for LOOP or +LOOP instead
+// holds the address of the one chained before it, or 0 at the end of the
+// chain, whose head is userArea[USER_LEAVE].  DO and ?DO start a new chain and
+// leave the old one under dest, so loops nest.
+//-----------------------------------------------------------------------------
+
+#include <stddef.h>
+
+#include "loop.h"
+#include "machine.h"
+#include "thread.h"
+
+// External references to a few Forth global variables:
+extern Cell HERE_value;
+
+// ... and to the run-time words (see tomoko.c).
+extern CodeWord *const doWord;
+extern CodeWord *const qdoWord;
+extern CodeWord *const loopWord;
+extern CodeWord *const plusLoopWord;
+extern CodeWord *const leaveWord;
+
+//-----------------------------------------------------------------------------
+// Run-time words.
+//-----------------------------------------------------------------------------
+
+void fn_PDO(void)
+{
+  Cell start = STACK_POP(sp);
+  Cell limit = STACK_POP(sp);
+  STACK_PUSH(rsp, limit);
+  STACK_PUSH(rsp, start);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_PQDO(void)
+{
+  Cell start = STACK_POP(sp);
+  Cell limit = STACK_POP(sp);
+  if (start == limit)
+  {
+    ip = (CodeWord**) ((char*)ip + *(Cell*)ip);
+  }
+  else
+  {
+    STACK_PUSH(rsp, limit);
+    STACK_PUSH(rsp, start);
+    ++ip;
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_PLOOP(void)
+{
+  Cell index = (UCell) rsp[0] + 1;
+  if (index != rsp[1])
+  {
+    rsp[0] = index;
+    ip = (CodeWord**) ((char*)ip + *(Cell*)ip);
+  }
+  else
+  {
+    rsp += 2;
+    ++ip;
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_PPLUSLOOP(void)
+{
+  Cell n = STACK_POP(sp);
+
+  // The index crosses the boundary when index - limit changes sign from
+  // negative to non-negative (or back, for negative n) without wrapping
+  // around, which it can only do if it and n have different signs.
+  Cell before = (UCell) rsp[0] - (UCell) rsp[1];
+  Cell after = (UCell) before + (UCell) n;
+  if ((before ^ after) >= 0 || (before ^ n) >= 0)
+  {
+    rsp[0] = (UCell) rsp[0] + (UCell) n;
+    ip = (CodeWord**) ((char*)ip + *(Cell*)ip);
+  }
+  else
+  {
+    rsp += 2;
+    ++ip;
+  }
+} // fn_PPLUSLOOP
+
+//-----------------------------------------------------------------------------
+
+void fn_PLEAVE(void)
+{
+  rsp += 2;
+  ip = (CodeWord**) ((char*)ip + *(Cell*)ip);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_LOOP_I(void)
+{
+  STACK_PUSH(sp, rsp[0]);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_LOOP_J(void)
+{
+  STACK_PUSH(sp, rsp[2]);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_UNLOOP(void)
+{
+  rsp += 2;
+}
+
+//-----------------------------------------------------------------------------
+// Compiling words.
+//-----------------------------------------------------------------------------
+/**
+ * Compile word followed by operand at HERE, and return the operand's address.
+ */
+static Cell *compile(CodeWord *word, Cell operand)
+{
+  lockDictionary();
+  Cell *code = (Cell*) HERE_value;
+  code[0] = (Cell) word;
+  code[1] = operand;
+  HERE_value = (Cell) (code + 2);
+  unlockDictionary();
+  return &code[1];
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_DO(void)
+{
+  lockDictionary();
+  Cell *code = (Cell*) HERE_value;
+  code[0] = (Cell) doWord;
+  HERE_value = (Cell) (code + 1);
+  unlockDictionary();
+
+  STACK_PUSH(sp, userArea[USER_LEAVE]);
+  STACK_PUSH(sp, (Cell) (code + 1));
+  userArea[USER_LEAVE] = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_QDO(void)
+{
+  // The offset after (?DO) is the first in the chain.
+  Cell *out = compile(qdoWord, 0);
+  STACK_PUSH(sp, userArea[USER_LEAVE]);
+  STACK_PUSH(sp, (Cell) (out + 1));
+  userArea[USER_LEAVE] = (Cell) out;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Compile word, with an offset back to dest from the top of the stack, then
+ * resolve the chain of offsets to just after it and restore the enclosing
+ * loop's chain from under dest.
+ */
+static void endLoop(CodeWord *word)
+{
+  Cell *dest = (Cell*) STACK_POP(sp);
+  Cell leave = STACK_POP(sp);
+  Cell *back = compile(word, 0);
+  *back = (char*) dest - (char*) back;
+
+  Cell *end = back + 1;
+  Cell *out = (Cell*) userArea[USER_LEAVE];
+  while (out != NULL)
+  {
+    Cell *next = (Cell*) *out;
+    *out = (char*) end - (char*) out;
+    out = next;
+  }
+  userArea[USER_LEAVE] = leave;
+} // endLoop
+
+//-----------------------------------------------------------------------------
+
+void fn_LOOP(void)
+{
+  endLoop(loopWord);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_PLUSLOOP(void)
+{
+  endLoop(plusLoopWord);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_LEAVE(void)
+{
+  userArea[USER_LEAVE] = (Cell) compile(leaveWord, userArea[USER_LEAVE]);
+}
+
+//-----------------------------------------------------------------------------
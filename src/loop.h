@@ -0,0 +1,117 @@
+//-----------------------------------------------------------------------------
+// Counted Loops
+//
+// DO ... LOOP, ?DO ... +LOOP, I, J, LEAVE and UNLOOP.  A loop keeps its limit
+// and index on the return stack, the index on top, as ANS Forth describes
+// them, so I is just a fetch and J is the index two cells further down.
+//
+// The immediate words compile these run-time words, each but (DO) followed by
+// a branch offset, as BRANCH is:
+//
+//   limit start DO body LOOP       -->  (DO) body (LOOP) back
+//   limit start ?DO body n +LOOP   -->  (?DO) out body n (+LOOP) back
+//   LEAVE                          -->  (LEAVE) out
+//
+// (LOOP) increments, compares and branches in one instruction.  The offsets
+// after (?DO) and (LEAVE) are filled in by LOOP or +LOOP: until then, they
+// are chained together through the USER_LEAVE user variable, so a LEAVE
+// costs nothing at run time but (LEAVE) itself.  As with IF and BEGIN, DO
+// and the rest only work inside definitions.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_LOOP_H
+#define TOMOKO_LOOP_H
+
+//-----------------------------------------------------------------------------
+// Run-time words.
+//-----------------------------------------------------------------------------
+/**
+ * (DO) ( limit start -- ) R( -- limit start )
+ *
+ * Start a loop with the index start.
+ */
+extern void fn_PDO(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * (?DO) ( limit start -- ) R( -- limit start | )
+ *
+ * Start a loop like (DO), unless limit and start are equal, in which case
+ * branch past it by the offset in the cell after (?DO).
+ */
+extern void fn_PQDO(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * (LOOP) R( limit index -- limit index+1 | )
+ *
+ * Add 1 to the index and branch back by the offset in the cell after (LOOP),
+ * unless the index has reached the limit, in which case end the loop.
+ */
+extern void fn_PLOOP(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * (+LOOP) ( n -- ) R( limit index -- limit index+n | )
+ *
+ * Add n to the index and branch back like (LOOP), unless that takes the index
+ * across the boundary between limit-1 and limit, in either direction.
+ */
+extern void fn_PPLUSLOOP(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * (LEAVE) R( limit index -- )
+ *
+ * End the loop and branch out of it by the offset in the cell after (LEAVE).
+ */
+extern void fn_PLEAVE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * I      ( -- index ) R( limit index -- limit index )
+ * J      ( -- index ) R( limit index limit' index' -- limit index limit' index' )
+ * UNLOOP R( limit index -- )
+ *
+ * Return the index of the innermost loop, or of the one enclosing it, or end
+ * the innermost loop, so that EXIT can leave the definition from inside it.
+ */
+extern void fn_LOOP_I(void);
+extern void fn_LOOP_J(void);
+extern void fn_UNLOOP(void);
+
+//-----------------------------------------------------------------------------
+// Compiling words.  These are immediate words.
+//-----------------------------------------------------------------------------
+/**
+ * DO  ( -- leave dest )
+ * ?DO ( -- leave dest )
+ *
+ * Compile (DO) or (?DO) and start a new chain of offsets to resolve at the end
+ * of the loop, returning the previous one and the start of the loop body.
+ */
+extern void fn_DO(void);
+extern void fn_QDO(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * LOOP  ( leave dest -- )
+ * +LOOP ( leave dest -- )
+ *
+ * Compile (LOOP) or (+LOOP) to branch back to dest, point the offsets chained
+ * since DO or ?DO just past it, and restore the enclosing loop's chain.
+ */
+extern void fn_LOOP(void);
+extern void fn_PLUSLOOP(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * LEAVE ( -- )
+ *
+ * Compile (LEAVE), chaining its offset to be resolved by LOOP or +LOOP.
+ */
+extern void fn_LEAVE(void);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_LOOP_H
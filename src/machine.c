@@ -6,17 +6,296 @@
 //
 //-----------------------------------------------------------------------------
 
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
 #include "machine.h"
 
 //-----------------------------------------------------------------------------
 
-Cell parameterStack[PARAMETER_STACK_CELLS];
-Cell returnStack[RETURN_STACK_CELLS];
-Cell *sp = &parameterStack[PARAMETER_STACK_CELLS];
-Cell *rsp = &returnStack[RETURN_STACK_CELLS];
+UCell parameterStackCells;
+UCell returnStackCells;
+UCell floatStackFloats;
+__thread Cell *sp;
+__thread Cell *rsp;
+__thread Float *fsp;
 Cell dictionary[DICTIONARY_SIZE / sizeof (Cell)];
-CodeWord **ip;
-CodeWord *w;
+char *dictionaryLimit = (char*) dictionary + DICTIONARY_SIZE;
+__thread CodeWord **ip;
+__thread CodeWord *w;
+__thread sigjmp_buf stackFaultRecovery;
+__thread const char *volatile stackFault;
+
+/**
+ * The description of the last fault raised by raiseFault(), for stackFault.
+ */
+static __thread char faultMessage[256];
+
+/**
+ * The user area of the first task, which runs QUIT.
+ */
+static Cell operatorUserArea[USER_CELLS] = { 10, 0, 0, 0, 0, 0 };
+
+__thread Cell *userArea = operatorUserArea;
+
+//-----------------------------------------------------------------------------
+/**
+ * The extent of a mapped stack, excluding its guard pages.  These form a list
+ * that the SIGSEGV handler searches.
+ */
+typedef struct GuardedStack
+{
+  struct GuardedStack *next;      ///< The previously mapped stack.
+  struct GuardedStack *nextSpare; ///< The next record in spareStacks.
+  const char *overflow;           ///< The message for a lower guard fault.
+  const char *underflow;          ///< The message for an upper guard fault.
+  uint8_t *low;                   ///< The lowest usable address.
+  uint8_t *high;                  ///< The address just above the stack.
+} GuardedStack;
+
+/**
+ * The most recently mapped stack.  Stacks are added at the head and removed
+ * under stacksLock, and a removed record keeps its next pointer and is never
+ * freed, so the SIGSEGV handler can walk the list without the lock.
+ */
+static GuardedStack *volatile guardedStacks = NULL;
+
+/**
+ * The records of unmapped stacks, for mapGuarded() to reuse.
+ */
+static GuardedStack *spareStacks = NULL;
+
+static pthread_mutex_t stacksLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The size of the guard pages.
+ */
+static size_t pageSize;
+
+//-----------------------------------------------------------------------------
+
+/**
+ * Map size bytes of memory (a multiple of pageSize) between guard pages,
+ * whose faults are reported with the messages overflow (for the lower page)
+ * and underflow (for the upper), and return its extent, or NULL if there is
+ * not enough memory.
+ */
+static const GuardedStack *mapGuarded(size_t size, const char *overflow,
+                                      const char *underflow)
+{
+  if (size == 0)
+  {
+    size = pageSize;
+  }
+
+  uint8_t *guard = mmap(NULL, size + 2 * pageSize, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (guard == MAP_FAILED)
+  {
+    return NULL;
+  }
+  if (mprotect(guard + pageSize, size, PROT_READ | PROT_WRITE) != 0)
+  {
+    munmap(guard, size + 2 * pageSize);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&stacksLock);
+  GuardedStack *stack = spareStacks;
+  if (stack != NULL)
+  {
+    spareStacks = stack->nextSpare;
+  }
+  pthread_mutex_unlock(&stacksLock);
+  if (stack == NULL && (stack = malloc(sizeof (GuardedStack))) == NULL)
+  {
+    munmap(guard, size + 2 * pageSize);
+    return NULL;
+  }
+
+  stack->overflow = overflow;
+  stack->underflow = underflow;
+  stack->low = guard + pageSize;
+  stack->high = stack->low + size;
+  pthread_mutex_lock(&stacksLock);
+  stack->next = guardedStacks;
+  guardedStacks = stack;
+  pthread_mutex_unlock(&stacksLock);
+  return stack;
+} // mapGuarded
+
+//-----------------------------------------------------------------------------
+
+Cell *mapStack(UCell cells, int parameter)
+{
+  size_t size = ((cells * sizeof (Cell) + pageSize - 1) / pageSize) * pageSize;
+  const GuardedStack *stack =
+    mapGuarded(size,
+               parameter ? "parameter stack overflow" : "return stack overflow",
+               parameter ? "parameter stack underflow"
+                         : "return stack underflow");
+  return (stack != NULL) ? (Cell*) stack->high : NULL;
+} // mapStack
+
+//-----------------------------------------------------------------------------
+
+Float *mapFloatStack(UCell floats)
+{
+  size_t size = ((floats * sizeof (Float) + pageSize - 1) / pageSize)
+                * pageSize;
+  const GuardedStack *stack = mapGuarded(size,
+                                         "floating-point stack overflow",
+                                         "floating-point stack underflow");
+  return (stack != NULL) ? (Float*) stack->high : NULL;
+} // mapFloatStack
+
+//-----------------------------------------------------------------------------
+
+Cell *mapDictionary(void)
+{
+  size_t size = ((DICTIONARY_SIZE + pageSize - 1) / pageSize) * pageSize;
+  const GuardedStack *stack = mapGuarded(size, "dictionary full",
+                                         "dictionary full");
+  return (stack != NULL) ? (Cell*) stack->low : NULL;
+} // mapDictionary
 
 //-----------------------------------------------------------------------------
 
+void unmapStack(void *address)
+{
+  if (address == NULL)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&stacksLock);
+  GuardedStack *stack = guardedStacks;
+  GuardedStack *previous = NULL;
+  while (stack != NULL && (void*) stack->low != address &&
+         (void*) stack->high != address)
+  {
+    previous = stack;
+    stack = stack->next;
+  }
+  uint8_t *guard = NULL;
+  size_t length = 0;
+  if (stack != NULL)
+  {
+    if (previous == NULL)
+    {
+      guardedStacks = stack->next;
+    }
+    else
+    {
+      previous->next = stack->next;
+    }
+    guard = stack->low - pageSize;
+    length = (stack->high - stack->low) + 2 * pageSize;
+    stack->nextSpare = spareStacks;
+    spareStacks = stack;
+  }
+  pthread_mutex_unlock(&stacksLock);
+
+  if (guard != NULL)
+  {
+    munmap(guard, length);
+  }
+} // unmapStack
+
+//-----------------------------------------------------------------------------
+
+void raiseFault(const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  vsnprintf(faultMessage, sizeof faultMessage, format, args);
+  va_end(args);
+  stackFault = faultMessage;
+  siglongjmp(stackFaultRecovery, 1);
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * The SIGSEGV action that allocateStacks() replaced: the host program's, when
+ * Tomoko is embedded (see libtomoko.h), else the default.
+ */
+static struct sigaction previousAction;
+
+/**
+ * The SIGSEGV handler.  If the fault is in a stack's guard page, describe it
+ * in stackFault and jump to stackFaultRecovery.  Otherwise pass it on to the
+ * previous action, or reinstate the default action, so that the fault recurs
+ * and terminates the program as usual.
+ */
+static void onSegmentationFault(int signal, siginfo_t *info, void *context)
+{
+  uint8_t *address = info->si_addr;
+  const GuardedStack *stack;
+
+  for (stack = guardedStacks; stack != NULL; stack = stack->next)
+  {
+    if (address >= stack->low - pageSize && address < stack->low)
+    {
+      stackFault = stack->overflow;
+      siglongjmp(stackFaultRecovery, 1);
+    }
+    if (address >= stack->high && address < stack->high + pageSize)
+    {
+      stackFault = stack->underflow;
+      siglongjmp(stackFaultRecovery, 1);
+    }
+  }
+
+  if ((previousAction.sa_flags & SA_SIGINFO) != 0)
+  {
+    previousAction.sa_sigaction(signal, info, context);
+    return;
+  }
+  if (previousAction.sa_handler != SIG_DFL
+      && previousAction.sa_handler != SIG_IGN)
+  {
+    previousAction.sa_handler(signal);
+    return;
+  }
+
+  // A fault cannot be ignored: the kernel would kill the program anyway.
+  struct sigaction action;
+  action.sa_handler = SIG_DFL;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = 0;
+  sigaction(signal, &action, NULL);
+} // onSegmentationFault
+
+//-----------------------------------------------------------------------------
+
+void allocateStacks(UCell parameterCells, UCell returnCells, UCell floats)
+{
+  pageSize = sysconf(_SC_PAGESIZE);
+  parameterStackCells = parameterCells;
+  returnStackCells = returnCells;
+  floatStackFloats = floats;
+  sp = mapStack(parameterCells, 1);
+  rsp = mapStack(returnCells, 0);
+  fsp = mapFloatStack(floats);
+  if (sp == NULL || rsp == NULL || fsp == NULL)
+  {
+    fprintf(stderr, "could not allocate the stacks\n");
+    exit(EXIT_FAILURE);
+  }
+  userArea[USER_S0] = (Cell) sp;
+  userArea[USER_R0] = (Cell) rsp;
+  userArea[USER_F0] = (Cell) fsp;
+
+  struct sigaction action;
+  action.sa_sigaction = onSegmentationFault;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_SIGINFO;
+  sigaction(SIGSEGV, &action, &previousAction);
+} // allocateStacks
+
+//-----------------------------------------------------------------------------
@@ -9,6 +9,8 @@
 #ifndef TOMOKO_MACHINE_H
 #define TOMOKO_MACHINE_H
 
+#include <setjmp.h>
+
 #include "types.h"
 
 //-----------------------------------------------------------------------------
@@ -18,41 +20,141 @@
 // addressing with pre-decrement and post-increment.  So the use of
 // pre-decrement for push means that the stack pointer will always point to the
 // current top of the stack.
+//
+// The stacks are mapped at startup, with an inaccessible guard page at each
+// end, so that overflow and underflow fault instead of corrupting memory.
+// The fault is caught and turned into an error message and a return to QUIT,
+// without any bounds checks in STACK_PUSH or STACK_POP.
+//
+// Each OS thread (see thread.h) runs its own Forth machine over the shared
+// dictionary, so the registers, the stack pointers, the user area pointer and
+// the fault recovery state are all thread-local.
 
 /**
- * Size of the parameter stack in cells.
+ * Default size of the parameter stack in cells.  The size is rounded up to a
+ * whole number of pages.
  */
 #define PARAMETER_STACK_CELLS 64
 
 /**
- * Size of the parameter stack in cells.
+ * Default size of the return stack in cells.  The size is rounded up to a
+ * whole number of pages.
  */
 #define RETURN_STACK_CELLS 32
 
 /**
- * Size of the statically allocated dictionary, in bytes.
+ * Default size of the floating-point stack in floats.  The size is rounded up
+ * to a whole number of pages.
  */
-#define DICTIONARY_SIZE 8192
+#define FLOAT_STACK_FLOATS 32
 
 /**
- * Storage for the parameter stack.
+ * Size of the statically allocated dictionary, in bytes.
  */
-extern Cell parameterStack[PARAMETER_STACK_CELLS];
+#define DICTIONARY_SIZE 8192
 
 /**
- * Storage for the return stack.
+ * The sizes of the parameter and return stacks, in cells, and of the
+ * floating-point stack, in floats, that were passed to allocateStacks().
+ * Tasks get stacks of the same sizes.
  */
-extern Cell returnStack[RETURN_STACK_CELLS];
+extern UCell parameterStackCells;
+extern UCell returnStackCells;
+extern UCell floatStackFloats;
 
 /**
  * The parameter stack pointer.
  */
-extern Cell *sp; // = &parameterStack[PARAMETER_STACK_CELLS];
+extern __thread Cell *sp; // = (Cell*) userArea[USER_S0];
 
 /**
  * The return stack pointer.
  */
-extern Cell *rsp; // = &returnStack[RETURN_STACK_CELLS];
+extern __thread Cell *rsp; // = (Cell*) userArea[USER_R0];
+
+/**
+ * The floating-point stack pointer.
+ */
+extern __thread Float *fsp; // = (Float*) userArea[USER_F0];
+
+/**
+ * Where the SIGSEGV handler jumps (with siglongjmp()) when a stack overflows
+ * or underflows, after setting stackFault.  This must be set by sigsetjmp()
+ * before any Forth code runs, in each thread.
+ */
+extern __thread sigjmp_buf stackFaultRecovery;
+
+/**
+ * A description of the last stack fault, such as "return stack overflow".
+ */
+extern __thread const char *volatile stackFault;
+
+/**
+ * Stop the running word with a fault described by the printf() format and
+ * arguments, as a stack fault would: set stackFault and jump to
+ * stackFaultRecovery.
+ */
+extern void raiseFault(const char *format, ...)
+  __attribute__((noreturn, format(printf, 1, 2)));
+
+/**
+ * Map a parameter stack (if parameter is true) or return stack of
+ * the specified number of cells, between guard pages, and return the address
+ * just above it: the value of the stack pointer when the stack is empty.
+ * Return NULL if there is not enough memory.
+ */
+extern Cell *mapStack(UCell cells, int parameter);
+
+/**
+ * Map a floating-point stack of the specified number of floats, between guard
+ * pages, and return the address just above it.  Return NULL if there is not
+ * enough memory.
+ */
+extern Float *mapFloatStack(UCell floats);
+
+/**
+ * Map DICTIONARY_SIZE bytes (rounded up to whole pages) of dictionary space
+ * for a server connection or an embedded instance, between guard pages, so
+ * that filling it is a fault rather than an overrun, and return its start.
+ * Return NULL if there is not enough memory.
+ */
+extern Cell *mapDictionary(void);
+
+/**
+ * Unmap a region mapped by mapStack(), mapFloatStack() or mapDictionary(),
+ * given the address that it returned, along with its guard pages.  Do nothing
+ * if address is NULL.
+ */
+extern void unmapStack(void *address);
+
+/**
+ * Map the parameter and return stacks, with the specified sizes in cells, and
+ * the floating-point stack, with the specified size in floats, set S0, R0,
+ * F0, sp, rsp and fsp, and install the SIGSEGV handler that detects stack
+ * faults.
+ */
+extern void allocateStacks(UCell parameterCells, UCell returnCells,
+                           UCell floats);
+
+//-----------------------------------------------------------------------------
+// User Variables
+// ~~~~~~~~~~~~~~
+// Each task (see task.h) has its own copy of the variables that describe the
+// state of its interpreter, in an array called its user area.  They are
+// defined in the dictionary with DEF_USER(), by their index in the user area.
+
+#define USER_BASE  0 ///< BASE: the number base.
+#define USER_STATE 1 ///< STATE: true if compiling.
+#define USER_S0    2 ///< S0: the address just above the parameter stack.
+#define USER_R0    3 ///< The value of R0: the address just above the return stack.
+#define USER_F0    4 ///< The address just above the floating-point stack.
+#define USER_LEAVE 5 ///< The offsets for LOOP to resolve (see loop.h).
+#define USER_CELLS 6 ///< The number of user variables.
+
+/**
+ * The user area of the running task.
+ */
+extern __thread Cell *userArea;
 
 /**
  * The part of the dictionary that can be affected by HERE ALLOT CREATE , C,
@@ -69,6 +171,13 @@ extern Cell *rsp; // = &returnStack[RETURN_STACK_CELLS];
  */
 extern Cell dictionary[DICTIONARY_SIZE / sizeof (Cell)];
 
+/**
+ * The end of the dictionary space that HERE is in: the end of dictionary, or
+ * of the space from mapDictionary() of the server connection or embedded
+ * instance that is running.
+ */
+extern char *dictionaryLimit;
+
 //-----------------------------------------------------------------------------
 /**
  * The Forth instruction pointer.
@@ -85,7 +194,7 @@ extern Cell dictionary[DICTIONARY_SIZE / sizeof (Cell)];
  * The IP increments by the size of an XT (the size of a pointer, the same as
  * the size of a Cell), as each Forth word is invoked.
  */
-extern CodeWord **ip;
+extern __thread CodeWord **ip;
 
 //-----------------------------------------------------------------------------
 /**
@@ -107,7 +216,7 @@ extern CodeWord **ip;
  * we set w = TOS, then call (*w)(), then continue on our merry way in NEXT().
  * See the code for NEXT().
  */
-extern CodeWord *w;
+extern __thread CodeWord *w;
 
 //-----------------------------------------------------------------------------
 /**
@@ -145,6 +254,51 @@ extern CodeWord *w;
  */
 #define STACK_PICK(ptr,n) (*STACK_ADDR(ptr,n))
 
+/**
+ * Push the specified Float using the specified floating-point stack pointer.
+ */
+#define FLOAT_PUSH(ptr,value) do { *--ptr = (Float)(value); } while (0)
+
+/**
+ * Return the top of the floating-point stack popped from the specified stack
+ * pointer.
+ */
+#define FLOAT_POP(ptr) (*ptr++)
+
+//-----------------------------------------------------------------------------
+// Double Cells
+// ~~~~~~~~~~~~
+// A double cell number occupies two stack cells, with the most significant
+// cell on top of the stack.
+
+/**
+ * The number of bits in a Cell.
+ */
+#define CELL_BITS (8 * sizeof (Cell))
+
+/**
+ * Push the specified double cell value using the specified stack pointer.
+ */
+#define STACK_PUSH_DOUBLE(ptr,value)                                          \
+  do                                                                          \
+  {                                                                           \
+    UDCell d_ = (UDCell)(value);                                              \
+    STACK_PUSH(ptr, (Cell) d_);                                               \
+    STACK_PUSH(ptr, (Cell)(d_ >> CELL_BITS));                                 \
+  } while (0)
+
+/**
+ * Return the unsigned double cell popped from the specified stack pointer.
+ */
+#define STACK_POP_UDOUBLE(ptr)                                                \
+  ((ptr) += 2,                                                                \
+   ((UDCell)(UCell)(ptr)[-2] << CELL_BITS) | (UDCell)(UCell)(ptr)[-1])
+
+/**
+ * Return the signed double cell popped from the specified stack pointer.
+ */
+#define STACK_POP_DOUBLE(ptr) ((DCell) STACK_POP_UDOUBLE(ptr))
+
 //-----------------------------------------------------------------------------
 
 #endif // TOMOKO_MACHINE_H
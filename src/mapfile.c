@@ -0,0 +1,184 @@
+//-----------------------------------------------------------------------------
+// Mapped Files
+//
+// Mappings are MAP_SHARED, so that R/W mappings write through to the file and
+// pages of R/O mappings are shared with the page cache rather than copied.
+// Large-file support is enabled so that the size of a file of 2 GB or more is
+// read correctly and windows can be mapped from anywhere in it.  A window
+// starts at the page boundary at or below the offset asked for, as mmap()
+// requires, and the address returned points past the bytes in front of the
+// offset, so the words that take a mapping widen its range to whole pages.
+//-----------------------------------------------------------------------------
+
+#define _FILE_OFFSET_BITS 64
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mapfile.h"
+#include "machine.h"
+
+//-----------------------------------------------------------------------------
+/**
+ * Map up to count bytes of the file called name, of nameLength characters,
+ * starting offset bytes into it, with access mode fam.  Store the address of
+ * the byte at offset and the number of bytes mapped after it in *address and
+ * *length and return 0, or return an errno.
+ */
+static int mapFile(const char *name, UCell nameLength, Cell fam,
+                   UDCell offset, UDCell count,
+                   void **address, size_t *length)
+{
+  char path[PATH_MAX];
+  *address = NULL;
+  *length = 0;
+  if (nameLength >= sizeof (path))
+  {
+    return ENAMETOOLONG;
+  }
+  memcpy(path, name, nameLength);
+  path[nameLength] = '\0';
+
+  int writable = (fam & O_ACCMODE) != O_RDONLY;
+  int fd = open(path, writable ? O_RDWR : O_RDONLY);
+  if (fd < 0)
+  {
+    return errno;
+  }
+
+  int ior = 0;
+  struct stat status;
+  if (fstat(fd, &status) < 0)
+  {
+    ior = errno;
+  }
+  else if (offset < (UDCell) status.st_size)
+  {
+    UDCell available = (UDCell) status.st_size - offset;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t skip = (size_t) offset & (page - 1);
+    count = (count < available) ? count : available;
+    if (count > ((UCell) -1 >> 1) - skip)
+    {
+      ior = EFBIG;
+    }
+    else if (count > 0)
+    {
+      uint8_t *mapping = mmap(NULL, skip + count,
+                              writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                              MAP_SHARED, fd, (off_t) (offset - skip));
+      if (mapping == MAP_FAILED)
+      {
+        ior = errno;
+      }
+      else
+      {
+        *address = mapping + skip;
+        *length = count;
+      }
+    }
+  }
+
+  close(fd);
+  return ior;
+} // mapFile
+
+//-----------------------------------------------------------------------------
+/**
+ * Pop addr and len from the stack, widen the range they describe to whole
+ * pages, as msync() and madvise() require, and store it in *start and *length.
+ */
+static void popPages(void **start, size_t *length)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t count = (UCell) STACK_POP(sp);
+  uintptr_t address = (uintptr_t) STACK_POP(sp);
+  uintptr_t first = address & ~(page - 1);
+  *start = (void*) first;
+  *length = count + (address - first);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_MAP_FILE(void)
+{
+  Cell fam = STACK_POP(sp);
+  UCell nameLength = STACK_POP(sp);
+  const char *name = (const char*) STACK_POP(sp);
+  void *address;
+  size_t length;
+  int ior = mapFile(name, nameLength, fam, 0, (UDCell) -1, &address, &length);
+  STACK_PUSH(sp, address);
+  STACK_PUSH(sp, length);
+  STACK_PUSH(sp, ior);
+} // fn_MAP_FILE
+
+//-----------------------------------------------------------------------------
+
+void fn_MAP_FILE_AT(void)
+{
+  UCell count = STACK_POP(sp);
+  UDCell offset = STACK_POP_UDOUBLE(sp);
+  Cell fam = STACK_POP(sp);
+  UCell nameLength = STACK_POP(sp);
+  const char *name = (const char*) STACK_POP(sp);
+  void *address;
+  size_t length;
+  int ior = mapFile(name, nameLength, fam, offset, count, &address, &length);
+  STACK_PUSH(sp, address);
+  STACK_PUSH(sp, length);
+  STACK_PUSH(sp, ior);
+} // fn_MAP_FILE_AT
+
+//-----------------------------------------------------------------------------
+
+void fn_UNMAP_FILE(void)
+{
+  UCell count = sp[0];
+  void *start;
+  size_t length;
+  popPages(&start, &length);
+  int ior = (count == 0 || munmap(start, length) == 0) ? 0 : errno;
+  STACK_PUSH(sp, ior);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_SYNC_FILE(void)
+{
+  void *start;
+  size_t length;
+  popPages(&start, &length);
+  int ior = (msync(start, length, MS_SYNC) == 0) ? 0 : errno;
+  STACK_PUSH(sp, ior);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_SEQUENTIAL(void)
+{
+  void *start;
+  size_t length;
+  popPages(&start, &length);
+  int ior = (madvise(start, length, MADV_SEQUENTIAL) == 0) ? 0 : errno;
+  STACK_PUSH(sp, ior);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_WILLNEED(void)
+{
+  void *start;
+  size_t length;
+  popPages(&start, &length);
+  int ior = (madvise(start, length, MADV_WILLNEED) == 0) ? 0 : errno;
+  STACK_PUSH(sp, ior);
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,74 @@
+//-----------------------------------------------------------------------------
+// Mapped Files
+//
+// Words that map files, or windows of them, into memory, so that Forth code
+// can scan them in place with C@, @ and the memory words instead of reading
+// them into buffers.
+// As in the file words of jonesforth.f.txt, an ior is 0 on success or else
+// the (positive) errno of the failure.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_MAPFILE_H
+#define TOMOKO_MAPFILE_H
+
+//-----------------------------------------------------------------------------
+/**
+ * MAP-FILE ( c-addr u fam -- addr len ior )
+ *
+ * Map the whole of the file named by the string c-addr u into memory.  With
+ * fam R/O the mapping is read-only; with R/W, stores into it change the file.
+ * The file need not stay open.  An empty file gives addr and len 0.
+ */
+extern void fn_MAP_FILE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * MAP-FILE-AT ( c-addr u fam ud len -- addr len' ior )
+ *
+ * Map len bytes of the file named by the string c-addr u, starting ud bytes
+ * into it, like MAP-FILE.  len' is len, or less if the file ends sooner, and
+ * 0 if ud is at or past its end.  ud need not be a multiple of the page size.
+ * This maps a window of a file too big to map whole, which on a 32-bit system
+ * is any file of 2 GB or more.
+ */
+extern void fn_MAP_FILE_AT(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * UNMAP-FILE ( addr len -- ior )
+ *
+ * Remove a mapping made by MAP-FILE or MAP-FILE-AT.  Changes made through an
+ * R/W mapping are written back to the file by the system in due course.
+ */
+extern void fn_UNMAP_FILE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * SYNC-FILE ( addr len -- ior )
+ *
+ * Write changes made to len bytes of a mapping at addr back to the file, and
+ * wait for the writes to complete.
+ */
+extern void fn_SYNC_FILE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * SEQUENTIAL ( addr len -- ior )
+ *
+ * Advise the system that len bytes of a mapping at addr will be read in
+ * order, so it can read ahead aggressively and drop pages once read.
+ */
+extern void fn_SEQUENTIAL(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * WILLNEED ( addr len -- ior )
+ *
+ * Advise the system that len bytes of a mapping at addr will be needed soon,
+ * so it can start reading them in now.
+ */
+extern void fn_WILLNEED(void);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_MAPFILE_H
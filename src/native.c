@@ -3,6 +3,7 @@
 //-----------------------------------------------------------------------------
 
 #include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,11 +12,12 @@
 #include "native.h"
 #include "machine.h"
 #include "dictionary.h"
+#include "output.h"
 
 //-----------------------------------------------------------------------------
 // External references to a few Forth global variables:
 
-extern Cell STATE_value;
+extern Cell HERE_value;
 extern Cell LATEST_value;
 extern Cell CASE_SENSITIVE_value;
 
@@ -103,14 +105,14 @@ void fn_LITSTRING(void)
 
 void fn_LBRAC(void)
 {
-  STATE_value = 0;
+  userArea[USER_STATE] = 0;
 }
 
 //-----------------------------------------------------------------------------
 
 void fn_RBRAC(void)
 {
-  STATE_value = 1;
+  userArea[USER_STATE] = 1;
 }
 
 //-----------------------------------------------------------------------------
@@ -144,6 +146,15 @@ void fn_VAR(void)
 
 //-----------------------------------------------------------------------------
 
+void fn_USER(void)
+{
+  // The address of this codeword is in w.
+  // The Cell in the PFA is the index of the variable in the user area.
+  STACK_PUSH(sp, &userArea[(Cell) w[1]]);
+}
+
+//-----------------------------------------------------------------------------
+
 void fn_EXECUTE(void)
 {
   // Pop the eXecution Token / Code Field Address.
@@ -174,59 +185,151 @@ void fn_IPFETCH(void)
 
 void fn_HALT(void)
 {
+  // Buffered output is flushed by an atexit() handler.
   exit(EXIT_SUCCESS);
 }
 
+//-----------------------------------------------------------------------------
+// System calls.
+//
+// Each word takes the call number from the top of the stack, and the
+// parameters, the first uppermost, from beneath it, as in JonesForth.  Any
+// buffered output is flushed first, so that it comes out before whatever the
+// call writes, and before the process exits if the call is SYS_EXIT_GROUP.
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the result of syscall() as the kernel returned it: -errno for an
+ * error.
+ */
+static Cell kernelResult(long result)
+{
+  return (result == -1) ? -errno : (Cell) result;
+}
+
 //-----------------------------------------------------------------------------
 
 void fn_SYSCALL0(void)
 {
-  // TODO: get up to speeed with Linux inline assembler. :)
-	//pop %eax		// System call number (see <asm/unistd.h>)
-	//int $0x80
-	//push %eax		// Result (negative for -errno)
+  flushOutput();
+  Cell number = STACK_POP(sp);
+  STACK_PUSH(sp, kernelResult(syscall(number)));
 }
 
 //-----------------------------------------------------------------------------
 
 void fn_SYSCALL1(void)
 {
-  // TODO: get up to speeed with Linux inline assembler. :)
-	//pop %eax		// System call number (see <asm/unistd.h>)
-	//pop %ebx		// First parameter.
-	//int $0x80
-	//push %eax		// Result (negative for -errno)
+  flushOutput();
+  Cell number = STACK_POP(sp);
+  Cell p1 = STACK_POP(sp);
+  STACK_PUSH(sp, kernelResult(syscall(number, p1)));
 }
 
 //-----------------------------------------------------------------------------
 
 void fn_SYSCALL2(void)
 {
-  // TODO: get up to speeed with Linux inline assembler. :)
-	//pop %eax		// System call number (see <asm/unistd.h>)
-	//pop %ebx		// First parameter.
-	//pop %ecx		// Second parameter
-	//int $0x80
-	//push %eax		// Result (negative for -errno)
+  flushOutput();
+  Cell number = STACK_POP(sp);
+  Cell p1 = STACK_POP(sp);
+  Cell p2 = STACK_POP(sp);
+  STACK_PUSH(sp, kernelResult(syscall(number, p1, p2)));
 }
 
 //-----------------------------------------------------------------------------
 
 void fn_SYSCALL3(void)
 {
-  // TODO: get up to speeed with Linux inline assembler. :)
-  //pop %eax		// System call number (see <asm/unistd.h>)
-	//pop %ebx		// First parameter.
-	//pop %ecx		// Second parameter
-	//pop %edx		// Third parameter
-	//int $0x80
-	//push %eax		// Result (negative for -errno)
+  flushOutput();
+  Cell number = STACK_POP(sp);
+  Cell p1 = STACK_POP(sp);
+  Cell p2 = STACK_POP(sp);
+  Cell p3 = STACK_POP(sp);
+  STACK_PUSH(sp, kernelResult(syscall(number, p1, p2, p3)));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_SYSCALL4(void)
+{
+  flushOutput();
+  Cell number = STACK_POP(sp);
+  Cell p1 = STACK_POP(sp);
+  Cell p2 = STACK_POP(sp);
+  Cell p3 = STACK_POP(sp);
+  Cell p4 = STACK_POP(sp);
+  STACK_PUSH(sp, kernelResult(syscall(number, p1, p2, p3, p4)));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_SYSCALL5(void)
+{
+  flushOutput();
+  Cell number = STACK_POP(sp);
+  Cell p1 = STACK_POP(sp);
+  Cell p2 = STACK_POP(sp);
+  Cell p3 = STACK_POP(sp);
+  Cell p4 = STACK_POP(sp);
+  Cell p5 = STACK_POP(sp);
+  STACK_PUSH(sp, kernelResult(syscall(number, p1, p2, p3, p4, p5)));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_SYSCALL6(void)
+{
+  flushOutput();
+  Cell number = STACK_POP(sp);
+  Cell p1 = STACK_POP(sp);
+  Cell p2 = STACK_POP(sp);
+  Cell p3 = STACK_POP(sp);
+  Cell p4 = STACK_POP(sp);
+  Cell p5 = STACK_POP(sp);
+  Cell p6 = STACK_POP(sp);
+  STACK_PUSH(sp, kernelResult(syscall(number, p1, p2, p3, p4, p5, p6)));
 }
 
 //-----------------------------------------------------------------------------
 // Dictionary Manipulation.
 //-----------------------------------------------------------------------------
 
+Cell *createHeader(const char *name, UCell length, UCell cells)
+{
+  const UCell mask = ~(sizeof (Cell) - 1);
+  char *header = (char*) ((HERE_value + sizeof (Cell) - 1) & mask);
+  UCell headerSize = (sizeof (Cell) + 1 + length + 1 + sizeof (Cell) - 1)
+                     & mask;
+  Cell *code = (Cell*) (header + headerSize);
+  if (length == 0 || length > LENGTH_BITS || header > dictionaryLimit
+      || (UCell) (dictionaryLimit - header)
+         < headerSize + cells * sizeof (Cell))
+  {
+    return NULL;
+  }
+
+  memset(header, 0, headerSize);
+  *(Cell*) header = LATEST_value;
+  header[sizeof (Cell)] = (char) length;
+  memcpy(header + sizeof (Cell) + 1, name, length);
+  LATEST_value = (Cell) header;
+  HERE_value = (Cell) (code + cells);
+  return code;
+} // createHeader
+
+//-----------------------------------------------------------------------------
+
+CodeWord *codeField(const Cell *link)
+{
+  // The code field follows the name, its NUL and padding to a cell.
+  const char *lengthByte = (const char*) (link + 1);
+  UCell end = (UCell) (lengthByte + 1 + (*lengthByte & LENGTH_BITS) + 1);
+  return (CodeWord*) ((end + sizeof (Cell) - 1) & ~(sizeof (Cell) - 1));
+}
+
+//-----------------------------------------------------------------------------
+
 void fn_FIND(void)
 {
   Cell targetLength  = STACK_POP(sp);
@@ -468,6 +571,13 @@ void fn_FROMR(void)
 
 //-----------------------------------------------------------------------------
 
+void fn_R0(void)
+{
+  STACK_PUSH(sp, userArea[USER_R0]);
+}
+
+//-----------------------------------------------------------------------------
+
 void fn_RSPFETCH(void)
 {
   Cell value = (Cell) rsp;
@@ -489,6 +599,26 @@ void fn_RDROP(void)
   (void) STACK_POP(rsp);
 }
 
+//-----------------------------------------------------------------------------
+
+void fn_DTOR(void)
+{
+  Cell x2 = STACK_POP(sp);
+  Cell x1 = STACK_POP(sp);
+  STACK_PUSH(rsp, x1);
+  STACK_PUSH(rsp, x2);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_DFROMR(void)
+{
+  Cell x2 = STACK_POP(rsp);
+  Cell x1 = STACK_POP(rsp);
+  STACK_PUSH(sp, x1);
+  STACK_PUSH(sp, x2);
+}
+
 //-----------------------------------------------------------------------------
 // Arithmetic
 //-----------------------------------------------------------------------------
@@ -562,6 +692,150 @@ void fn_DIVMOD(void)
   STACK_PUSH(sp, n1 / n2);
 }
 
+//-----------------------------------------------------------------------------
+// Mixed and double-cell arithmetic.
+//
+// A double cell is two cells on the stack, the high half uppermost, and is
+// a DCell (or UDCell) while it is being worked on.  Division by zero faults
+// rather than raising SIGFPE; a quotient too big for a cell is truncated.
+//-----------------------------------------------------------------------------
+/**
+ * Fault if the divisor n is 0.
+ */
+static void checkDivisor(Cell n)
+{
+  if (n == 0)
+  {
+    raiseFault("division by zero");
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_MSTAR(void)
+{
+  Cell n2 = STACK_POP(sp);
+  Cell n1 = STACK_POP(sp);
+  STACK_PUSH_DOUBLE(sp, (DCell) n1 * n2);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_UMSTAR(void)
+{
+  UCell u2 = STACK_POP(sp);
+  UCell u1 = STACK_POP(sp);
+  STACK_PUSH_DOUBLE(sp, (UDCell) u1 * u2);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_UMDIVMOD(void)
+{
+  UCell u = STACK_POP(sp);
+  UDCell ud = STACK_POP_UDOUBLE(sp);
+  checkDivisor(u);
+  STACK_PUSH(sp, ud % u);
+  STACK_PUSH(sp, ud / u);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_SMDIVREM(void)
+{
+  Cell n = STACK_POP(sp);
+  DCell d = STACK_POP_DOUBLE(sp);
+  checkDivisor(n);
+  STACK_PUSH(sp, d % n);
+  STACK_PUSH(sp, d / n);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FMDIVMOD(void)
+{
+  Cell n = STACK_POP(sp);
+  DCell d = STACK_POP_DOUBLE(sp);
+  checkDivisor(n);
+  DCell quotient = d / n;
+  DCell remainder = d % n;
+  if (remainder != 0 && (remainder < 0) != (n < 0))
+  {
+    --quotient;
+    remainder += n;
+  }
+  STACK_PUSH(sp, remainder);
+  STACK_PUSH(sp, quotient);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_STARSLASH(void)
+{
+  Cell n3 = STACK_POP(sp);
+  Cell n2 = STACK_POP(sp);
+  Cell n1 = STACK_POP(sp);
+  checkDivisor(n3);
+  STACK_PUSH(sp, (DCell) n1 * n2 / n3);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_STARSLASHMOD(void)
+{
+  Cell n3 = STACK_POP(sp);
+  Cell n2 = STACK_POP(sp);
+  Cell n1 = STACK_POP(sp);
+  checkDivisor(n3);
+  DCell product = (DCell) n1 * n2;
+  STACK_PUSH(sp, product % n3);
+  STACK_PUSH(sp, product / n3);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_DADD(void)
+{
+  UDCell ud2 = STACK_POP_UDOUBLE(sp);
+  UDCell ud1 = STACK_POP_UDOUBLE(sp);
+  STACK_PUSH_DOUBLE(sp, ud1 + ud2);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_DSUB(void)
+{
+  UDCell ud2 = STACK_POP_UDOUBLE(sp);
+  UDCell ud1 = STACK_POP_UDOUBLE(sp);
+  STACK_PUSH_DOUBLE(sp, ud1 - ud2);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_DNEGATE(void)
+{
+  UDCell ud = STACK_POP_UDOUBLE(sp);
+  STACK_PUSH_DOUBLE(sp, -ud);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_DLT(void)
+{
+  DCell d2 = STACK_POP_DOUBLE(sp);
+  DCell d1 = STACK_POP_DOUBLE(sp);
+  STACK_PUSH(sp, BOOLEAN(d1 < d2));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_DEQ(void)
+{
+  UDCell ud2 = STACK_POP_UDOUBLE(sp);
+  UDCell ud1 = STACK_POP_UDOUBLE(sp);
+  STACK_PUSH(sp, BOOLEAN(ud1 == ud2));
+}
+
 //-----------------------------------------------------------------------------
 // Comparison
 //-----------------------------------------------------------------------------
@@ -667,83 +941,254 @@ void fn_CCOPY(void)
 
 //-----------------------------------------------------------------------------
 
-void fn_CMOVE(void)
+void fn_DSTORE(void)
 {
-  Cell count = STACK_POP(sp);
-        void *dest   = (void*)       STACK_POP(sp);
-  const void *source = (const void*) STACK_POP(sp);
-  if (count > 0)
+  Cell *addr = (Cell*) STACK_POP(sp);
+  addr[0] = STACK_POP(sp);
+  addr[1] = STACK_POP(sp);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_DFETCH(void)
+{
+  const Cell *addr = (const Cell*) STACK_POP(sp);
+  STACK_PUSH(sp, addr[1]);
+  STACK_PUSH(sp, addr[0]);
+}
+
+//-----------------------------------------------------------------------------
+// Bulk memory operations.
+//-----------------------------------------------------------------------------
+/**
+ * Lengths up to this many bytes are filled with an inline loop, rather than by
+ * calling the C library.
+ */
+#define TOMOKO_SMALL_BLOCK 16
+
+/**
+ * Lengths of at least this many bytes are copied or filled with the x86
+ * string instructions (rep movsb, rep stosb), which are fastest for large
+ * blocks on CPUs with Enhanced REP MOVSB (ERMS).
+ */
+#define TOMOKO_LARGE_BLOCK 4096
+
+#if defined(__i386__) || defined(__x86_64__)
+#define TOMOKO_HAVE_REP_STRINGS 1
+#endif
+
+//-----------------------------------------------------------------------------
+/**
+ * Copy count bytes from source to dest, which must not overlap.
+ */
+static void copyBytes(uint8_t *dest, const uint8_t *source, size_t count)
+{
+  // Short copies are left to memcpy(), since a byte loop can stall on false
+  // dependencies between the loads and stores.
+#ifdef TOMOKO_HAVE_REP_STRINGS
+  if (count >= TOMOKO_LARGE_BLOCK)
   {
-    memmove(dest, source, count);
+    __asm__ volatile ("rep movsb"
+                      : "+D" (dest), "+S" (source), "+c" (count)
+                      :
+                      : "memory");
+    return;
   }
-}
+#endif
+  memcpy(dest, source, count);
+} // copyBytes
 
 //-----------------------------------------------------------------------------
+/**
+ * Fill count bytes at dest with the value b.
+ */
+static void fillBytes(uint8_t *dest, uint8_t b, size_t count)
+{
+  if (count <= TOMOKO_SMALL_BLOCK)
+  {
+    while (count-- > 0)
+    {
+      *dest++ = b;
+    }
+  }
+#ifdef TOMOKO_HAVE_REP_STRINGS
+  else if (count >= TOMOKO_LARGE_BLOCK)
+  {
+    __asm__ volatile ("rep stosb"
+                      : "+D" (dest), "+c" (count)
+                      : "a" (b)
+                      : "memory");
+  }
+#endif
+  else
+  {
+    memset(dest, b, count);
+  }
+} // fillBytes
 
-void fn_FILL(void)
+//-----------------------------------------------------------------------------
+/**
+ * Copy count bytes from source to dest, which may overlap.
+ */
+static void moveBytes(uint8_t *dest, const uint8_t *source, size_t count)
 {
-  uint8_t b = STACK_POP(sp);
-  Cell n = STACK_POP(sp);
-  uint8_t *addr = (uint8_t*) STACK_POP(sp);
-  while (n-- > 0)
+  if (dest + count <= source || source + count <= dest)
   {
-    *addr++ = b;
+    copyBytes(dest, source, count);
   }
-}
+  else
+  {
+    memmove(dest, source, count);
+  }
+} // moveBytes
 
 //-----------------------------------------------------------------------------
-// Output
+/**
+ * Replicate the first period bytes at start through the rest of the count
+ * bytes there, as a byte-at-a-time copy from start to start+period would.
+ * The replicated region doubles in size on each pass, so that every copy is
+ * between non-overlapping regions.
+ */
+static void replicateForward(uint8_t *start, size_t period, size_t count)
+{
+  if (period == 1)
+  {
+    fillBytes(start + 1, start[0], count - 1);
+    return;
+  }
+
+  size_t done = period;
+  while (done < count)
+  {
+    size_t n = (done < count - done) ? done : count - done;
+    copyBytes(start + done, start, n);
+    done += n;
+  }
+} // replicateForward
+
 //-----------------------------------------------------------------------------
 /**
- * Output a single character to the terminal.
- *
- * This is intended to be a single maintenance point for porting this
- * functionality.
- *
- * @param c the character to display.
+ * Replicate the last period bytes before end down through the count bytes
+ * before end, as a byte-at-a-time copy from end-period-1 down to end-1 would.
  */
-static void charOut(char c)
+static void replicateBackward(uint8_t *end, size_t period, size_t count)
 {
-  putchar(c);
-  fflush(stdout);
-}
+  if (period == 1)
+  {
+    fillBytes(end - count, end[-1], count - 1);
+    return;
+  }
+
+  size_t done = period;
+  while (done < count)
+  {
+    size_t n = (done < count - done) ? done : count - done;
+    copyBytes(end - done - n, end - n, n);
+    done += n;
+  }
+} // replicateBackward
 
 //-----------------------------------------------------------------------------
 
-void fn_EMIT(void)
+void fn_CMOVE(void)
 {
-  charOut(STACK_POP(sp));
-}
+  Cell count = STACK_POP(sp);
+        uint8_t *dest   = (      uint8_t*) STACK_POP(sp);
+  const uint8_t *source = (const uint8_t*) STACK_POP(sp);
+  if (count > 0)
+  {
+    if (dest > source && dest < source + count)
+    {
+      // Copying forwards over the source: the first (dest - source) bytes of
+      // source repeat through the whole destination.
+      size_t period = dest - source;
+      replicateForward((uint8_t*) source, period, period + count);
+    }
+    else if (dest != source)
+    {
+      moveBytes(dest, source, count);
+    }
+  }
+} // fn_CMOVE
+
+//-----------------------------------------------------------------------------
+
+void fn_CMOVEUP(void)
+{
+  Cell count = STACK_POP(sp);
+        uint8_t *dest   = (      uint8_t*) STACK_POP(sp);
+  const uint8_t *source = (const uint8_t*) STACK_POP(sp);
+  if (count > 0)
+  {
+    if (source > dest && source < dest + count)
+    {
+      // Copying backwards over the source: the last (source - dest) bytes of
+      // source repeat downwards through the whole destination.
+      size_t period = source - dest;
+      replicateBackward((uint8_t*) source + count, period, period + count);
+    }
+    else if (dest != source)
+    {
+      moveBytes(dest, source, count);
+    }
+  }
+} // fn_CMOVEUP
 
 //-----------------------------------------------------------------------------
 
-void fn_TELL(void)
+void fn_MOVE(void)
 {
-  Cell length = STACK_POP(sp);
-  const char *addr = (const char*) STACK_POP(sp);
-  while (length-- > 0)
+  Cell count = STACK_POP(sp);
+        uint8_t *dest   = (      uint8_t*) STACK_POP(sp);
+  const uint8_t *source = (const uint8_t*) STACK_POP(sp);
+  if (count > 0)
   {
-    charOut(*addr++);
+    moveBytes(dest, source, count);
   }
-}
+} // fn_MOVE
 
 //-----------------------------------------------------------------------------
 
-void fn_DOT(void)
+void fn_FILL(void)
 {
+  uint8_t b = STACK_POP(sp);
   Cell n = STACK_POP(sp);
-  printf("%d", n);
-  fflush(stdout);
+  uint8_t *addr = (uint8_t*) STACK_POP(sp);
+  if (n > 0)
+  {
+    fillBytes(addr, b, n);
+  }
 }
 
-//-----------------------------------------------------------------------------
-// Time.
 //-----------------------------------------------------------------------------
 
-void fn_MSLEEP(void)
+void fn_ERASE(void)
 {
-  usleep(STACK_POP(sp) * 1000);
+  Cell n = STACK_POP(sp);
+  uint8_t *addr = (uint8_t*) STACK_POP(sp);
+  if (n > 0)
+  {
+    fillBytes(addr, 0, n);
+  }
 }
 
 //-----------------------------------------------------------------------------
 
+void fn_COMPARE(void)
+{
+  Cell len2 = STACK_POP(sp);
+  const uint8_t *addr2 = (const uint8_t*) STACK_POP(sp);
+  Cell len1 = STACK_POP(sp);
+  const uint8_t *addr1 = (const uint8_t*) STACK_POP(sp);
+
+  Cell common = (len1 < len2) ? len1 : len2;
+  int result = (common > 0) ? memcmp(addr1, addr2, common) : 0;
+  if (result == 0)
+  {
+    result = (len1 > len2) - (len1 < len2);
+  }
+  STACK_PUSH(sp, (result > 0) - (result < 0));
+} // fn_COMPARE
+
+//-----------------------------------------------------------------------------
+
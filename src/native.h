@@ -143,6 +143,12 @@ extern void fn_CONST_STRING(void);
  */
 extern void fn_VAR(void);
 
+//-----------------------------------------------------------------------------
+/**
+ * The native implementation of user variables.  See DEF_USER().
+ */
+extern void fn_USER(void);
+
 //-----------------------------------------------------------------------------
 /**
  * EXECUTE ( cfa -- )
@@ -184,17 +190,25 @@ extern void fn_HALT(void);
 
 //-----------------------------------------------------------------------------
 /**
- * SYSCALL0 ( call#          -- result )
- * SYSCALL1 ( call# p1       -- result )
- * SYSCALL2 ( call# p1 p2    -- result )
- * SYSCALL3 ( call# p1 p2 p3 -- result )
+ * SYSCALL0 (                   call# -- result )
+ * SYSCALL1 (                p1 call# -- result )
+ * SYSCALL2 (             p2 p1 call# -- result )
+ * SYSCALL3 (          p3 p2 p1 call# -- result )
+ * SYSCALL4 (       p4 p3 p2 p1 call# -- result )
+ * SYSCALL5 (    p5 p4 p3 p2 p1 call# -- result )
+ * SYSCALL6 ( p6 p5 p4 p3 p2 p1 call# -- result )
  *
- * Linux system calls with 0 to 3 parameters.
+ * Linux system calls with 0 to 6 parameters, made with syscall(2).  call# is
+ * one of the SYS_ constants, and the result is what the kernel returns: a
+ * negative result is -errno.
  */
 extern void fn_SYSCALL0(void);
 extern void fn_SYSCALL1(void);
 extern void fn_SYSCALL2(void);
 extern void fn_SYSCALL3(void);
+extern void fn_SYSCALL4(void);
+extern void fn_SYSCALL5(void);
+extern void fn_SYSCALL6(void);
 
 //-----------------------------------------------------------------------------
 // Dictionary Manipulation.
@@ -350,6 +364,16 @@ extern void fn_TOR(void);
  */
 extern void fn_FROMR(void);
 
+//-----------------------------------------------------------------------------
+/**
+ * R0 ( -- addr )
+ *
+ * Return the address just above the running task's return stack: the value
+ * of the return stack pointer when the stack is empty.  Each task has its own
+ * stacks, so unlike the other constants this is a native word.
+ */
+extern void fn_R0(void);
+
 //-----------------------------------------------------------------------------
 /**
  * RSP@ ( -- n )
@@ -374,6 +398,24 @@ extern void fn_RSPSTORE(void);
  */
 extern void fn_RDROP(void);
 
+//-----------------------------------------------------------------------------
+/**
+ * 2>R  ( x1 x2 --       )
+ *     R(       -- x1 x2 )
+ *
+ * Move a pair of cells from the parameter stack to the return stack.
+ */
+extern void fn_DTOR(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * 2R>  R( x1 x2 --       )
+ *      (       -- x1 x2 )
+ *
+ * Move a pair of cells from the return stack to the parameter stack.
+ */
+extern void fn_DFROMR(void);
+
 //-----------------------------------------------------------------------------
 // Arithmetic
 //-----------------------------------------------------------------------------
@@ -422,6 +464,85 @@ extern void fn_NEGATE(void);
  */
 extern void fn_DIVMOD(void);
 
+//-----------------------------------------------------------------------------
+// Mixed and double-cell arithmetic.  A double cell d is two cells, the high
+// half on top.  Division by 0 faults.
+//-----------------------------------------------------------------------------
+/**
+ * M* ( n1 n2 -- d )
+ *
+ * Multiply n1 by n2, giving the full double-cell product.
+ */
+extern void fn_MSTAR(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * UM* ( u1 u2 -- ud )
+ *
+ * Multiply u1 by u2, giving the full unsigned double-cell product.
+ */
+extern void fn_UMSTAR(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * UM/MOD ( ud u1 -- u2 u3 )
+ *
+ * Divide ud by u1, giving the remainder u2 and the quotient u3.
+ */
+extern void fn_UMDIVMOD(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * SM/REM ( d n1 -- n2 n3 )
+ *
+ * Divide d by n1, giving the remainder n2 and the quotient n3 rounded towards
+ * zero (symmetric division, as / and /MOD do).
+ */
+extern void fn_SMDIVREM(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * FM/MOD ( d n1 -- n2 n3 )
+ *
+ * Divide d by n1, giving the remainder n2 and the quotient n3 rounded towards
+ * negative infinity (floored division), so n2 has the sign of n1.
+ */
+extern void fn_FMDIVMOD(void);
+
+//-----------------------------------------------------------------------------
+// */ ( n1 n2 n3 -- n4 )
+//
+// Multiply n1 by n2 and divide the double-cell product by n3, as SM/REM does,
+// so n1 * n2 may be bigger than a cell.  (Line comments, since the name would
+// end a block comment.)
+
+extern void fn_STARSLASH(void);
+
+//-----------------------------------------------------------------------------
+// */MOD ( n1 n2 n3 -- n4 n5 )
+//
+// Like */, but give the remainder n4 as well as the quotient n5.
+
+extern void fn_STARSLASHMOD(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * D+ ( d1 d2 -- d3 )
+ * D- ( d1 d2 -- d3 )
+ * DNEGATE ( d1 -- d2 )
+ */
+extern void fn_DADD(void);
+extern void fn_DSUB(void);
+extern void fn_DNEGATE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * D< ( d1 d2 -- flag )
+ * D= ( d1 d2 -- flag )
+ */
+extern void fn_DLT(void);
+extern void fn_DEQ(void);
+
 //-----------------------------------------------------------------------------
 // Comparison
 //-----------------------------------------------------------------------------
@@ -502,52 +623,78 @@ extern void fn_CCOPY(void);
 
 //-----------------------------------------------------------------------------
 /**
- * CMOVE ( source dest count -- )
+ * 2! ( x1 x2 addr -- )
+ *
+ * Store the pair of cells x1 x2 at addr, x2 first.
  */
-extern void fn_CMOVE(void);
+extern void fn_DSTORE(void);
 
 //-----------------------------------------------------------------------------
 /**
- * FILL ( addr n b -- )
+ * 2@ ( addr -- x1 x2 )
  *
- * Fills n bytes of memory, beginning at the specified address, with value b.
+ * Fetch the pair of cells stored at addr by 2!.
  */
-extern void fn_FILL(void);
+extern void fn_DFETCH(void);
 
 //-----------------------------------------------------------------------------
-// Output
+// Bulk memory operations.  These use memcpy()/memset() (or the string
+// instructions on x86, for large blocks) rather than byte loops.
+//-----------------------------------------------------------------------------
+/**
+ * CMOVE ( source dest count -- )
+ *
+ * Copy count bytes from source to dest, proceeding from lower addresses to
+ * higher addresses.  If dest is within the source region, the bytes already
+ * copied are copied again, so the start of source is replicated through dest
+ * (e.g. "addr addr 1+ n CMOVE" fills with the byte at addr).
+ */
+extern void fn_CMOVE(void);
+
 //-----------------------------------------------------------------------------
 /**
- * EMIT ( c -- )
+ * CMOVE> ( source dest count -- )
  *
- * Write a single character to stdout, whose ASCII code is TOS.
+ * Copy count bytes from source to dest, proceeding from higher addresses to
+ * lower addresses.  If source is within the dest region, the end of source
+ * is replicated downwards through dest.
  */
-extern void fn_EMIT(void);
+extern void fn_CMOVEUP(void);
 
 //-----------------------------------------------------------------------------
 /**
- * TELL ( addr length -- )
+ * MOVE ( source dest count -- )
  *
- * Writes the string of characters at addr, with the specified length, to
- * stdout.
+ * Copy count bytes from source to dest, such that dest ends up with the
+ * bytes that were at source, even if the regions overlap.
  */
-extern void fn_TELL(void);
+extern void fn_MOVE(void);
 
 //-----------------------------------------------------------------------------
 /**
- * DOT ( n -- )
+ * FILL ( addr n b -- )
+ *
+ * Fills n bytes of memory, beginning at the specified address, with value b.
  */
-extern void fn_DOT(void);
+extern void fn_FILL(void);
 
 //-----------------------------------------------------------------------------
-// Time.
+/**
+ * ERASE ( addr n -- )
+ *
+ * Fill n bytes, starting at the specified address, with zero.
+ */
+extern void fn_ERASE(void);
+
 //-----------------------------------------------------------------------------
 /**
- * MSLEEP ( n -- )
+ * COMPARE ( addr1 len1 addr2 len2 -- n )
  *
- * Sleep n milliseconds.
+ * Compare two strings, byte by byte.  Return 0 if they are identical, -1 if
+ * the first string is less than the second (including being a prefix of it)
+ * and 1 if it is greater.
  */
-extern void fn_MSLEEP(void);
+extern void fn_COMPARE(void);
 
 //-----------------------------------------------------------------------------
 
@@ -0,0 +1,453 @@
+//-----------------------------------------------------------------------------
+// Output
+//
+// Output is accumulated in a buffer and written to stdout in one go, rather
+// than a character at a time.  The buffer is flushed when it reaches the
+// threshold in the Forth variable OUTPUT-THRESHOLD, before reading from the
+// terminal, by FLUSH-OUTPUT (and FLUSH) and at exit.  Each thread has its own
+// buffer, which is also flushed when the thread ends.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+
+#include "output.h"
+#include "machine.h"
+
+//-----------------------------------------------------------------------------
+// External references to a few Forth global variables:
+
+extern Cell OUTPUT_THRESHOLD_value;
+
+//-----------------------------------------------------------------------------
+/**
+ * Characters waiting to be written to stdout.
+ */
+static __thread char outputBuffer[TOMOKO_OUTPUT_MAX];
+
+/**
+ * The number of characters in outputBuffer.
+ */
+static __thread size_t outputLength = 0;
+
+/**
+ * Where outputBuffer is written, or NULL for stdout.
+ */
+static __thread FILE *outputFile = NULL;
+
+//-----------------------------------------------------------------------------
+
+void flushOutput(void)
+{
+  FILE *file = (outputFile != NULL) ? outputFile : stdout;
+  if (outputLength > 0)
+  {
+    fwrite(outputBuffer, 1, outputLength, file);
+    outputLength = 0;
+  }
+  fflush(file);
+} // flushOutput
+
+//-----------------------------------------------------------------------------
+
+void setOutputFile(FILE *file)
+{
+  flushOutput();
+  outputFile = file;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Flush the output buffer if it has reached OUTPUT-THRESHOLD.
+ */
+static void flushIfFull(void)
+{
+  if ((Cell) outputLength >= OUTPUT_THRESHOLD_value)
+  {
+    flushOutput();
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void charOut(char c)
+{
+  if (outputLength == sizeof outputBuffer)
+  {
+    flushOutput();
+  }
+  outputBuffer[outputLength++] = c;
+  flushIfFull();
+} // charOut
+
+//-----------------------------------------------------------------------------
+
+void charsOut(const char *chars, size_t length)
+{
+  while (length > 0)
+  {
+    size_t space = sizeof outputBuffer - outputLength;
+    if (space == 0)
+    {
+      flushOutput();
+      space = sizeof outputBuffer;
+    }
+
+    size_t n = (length < space) ? length : space;
+    memcpy(&outputBuffer[outputLength], chars, n);
+    outputLength += n;
+    chars += n;
+    length -= n;
+  }
+  flushIfFull();
+} // charsOut
+
+//-----------------------------------------------------------------------------
+/**
+ * Write n spaces (if n > 0).
+ */
+static void spacesOut(Cell n)
+{
+  static const char spaces[] = "                                ";
+  while (n > 0)
+  {
+    Cell count = (n < (Cell) sizeof spaces - 1) ? n : (Cell) sizeof spaces - 1;
+    charsOut(spaces, count);
+    n -= count;
+  }
+} // spacesOut
+
+//-----------------------------------------------------------------------------
+// Number formatting.
+//-----------------------------------------------------------------------------
+/**
+ * Digit characters, indexed by digit value.
+ */
+static const char digitChars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+/**
+ * Pairs of decimal digits: "00" to "99".  Converting two digits per division
+ * halves the number of divisions.
+ */
+static const char decimalPairs[] =
+  "0001020304050607080910111213141516171819202122232425262728293031"
+  "3233343536373839404142434445464748495051525354555657585960616263"
+  "6465666768697071727374757677787980818283848586878889909192939495"
+  "96979899";
+
+/**
+ * Pairs of hexadecimal digits: "00" to "FF".
+ */
+static const char hexPairs[] =
+  "000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+  "202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F"
+  "404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+  "606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+  "808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9F"
+  "A0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+  "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+  "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+/**
+ * Size of a buffer large enough to hold any number formatted by formatDigits()
+ * and a sign.
+ */
+#define TOMOKO_NUMBER_MAX (8 * sizeof (UDCell) + 2)
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the current value of BASE, or 10 if that is not a valid base.
+ */
+static Cell currentBase(void)
+{
+  Cell base = userArea[USER_BASE];
+  return (base >= 2 && base <= 36) ? base : 10;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Write the digits of u in the specified base backwards from end (i.e. the
+ * last digit goes in end[-1]) and return the address of the first digit.  At
+ * least one digit (0) is always written.
+ */
+static char *formatDigits(char *end, UDCell u, Cell base)
+{
+  // Divide double cells down until the rest fits in a Cell, where the
+  // division is much cheaper.
+  while (u > (UCell) ~(UCell) 0)
+  {
+    *--end = digitChars[u % base];
+    u /= base;
+  }
+
+  UCell n = (UCell) u;
+  if (base == 10)
+  {
+    while (n >= 100)
+    {
+      const char *pair = &decimalPairs[2 * (n % 100)];
+      n /= 100;
+      *--end = pair[1];
+      *--end = pair[0];
+    }
+    if (n >= 10)
+    {
+      *--end = decimalPairs[2 * n + 1];
+      *--end = decimalPairs[2 * n];
+      return end;
+    }
+  }
+  else if (base == 16)
+  {
+    while (n >= 0x100)
+    {
+      const char *pair = &hexPairs[2 * (n & 0xFF)];
+      n >>= 8;
+      *--end = pair[1];
+      *--end = pair[0];
+    }
+    if (n >= 0x10)
+    {
+      *--end = hexPairs[2 * n + 1];
+      *--end = hexPairs[2 * n];
+      return end;
+    }
+  }
+  else
+  {
+    while (n >= (UCell) base)
+    {
+      *--end = digitChars[n % base];
+      n /= base;
+    }
+  }
+
+  *--end = digitChars[n];
+  return end;
+} // formatDigits
+
+//-----------------------------------------------------------------------------
+/**
+ * Display the magnitude u, preceded by a minus sign if negative is true, right
+ * aligned in a field of the specified width and optionally followed by a
+ * space.
+ */
+static void numberOut(UDCell u, int negative, Cell width, int space)
+{
+  char buffer[TOMOKO_NUMBER_MAX + 1];
+  char *end = &buffer[TOMOKO_NUMBER_MAX];
+  char *start = formatDigits(end, u, currentBase());
+  if (negative)
+  {
+    *--start = '-';
+  }
+  if (space)
+  {
+    *end++ = ' ';
+    ++width;
+  }
+
+  Cell length = end - start;
+  spacesOut(width - length);
+  charsOut(start, length);
+} // numberOut
+
+//-----------------------------------------------------------------------------
+/**
+ * Display the signed Cell n, as for numberOut().
+ */
+static void signedOut(Cell n, Cell width, int space)
+{
+  UCell u = (UCell) n;
+  numberOut((n < 0) ? -u : u, n < 0, width, space);
+}
+
+//-----------------------------------------------------------------------------
+// Words.
+//-----------------------------------------------------------------------------
+
+void fn_EMIT(void)
+{
+  charOut(STACK_POP(sp));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_TELL(void)
+{
+  Cell length = STACK_POP(sp);
+  const char *addr = (const char*) STACK_POP(sp);
+  if (length > 0)
+  {
+    charsOut(addr, length);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_SPACES(void)
+{
+  spacesOut(STACK_POP(sp));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_DOT(void)
+{
+  signedOut(STACK_POP(sp), 0, 1);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_UDOT(void)
+{
+  numberOut((UCell) STACK_POP(sp), 0, 0, 1);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_DDOT(void)
+{
+  DCell d = STACK_POP_DOUBLE(sp);
+  numberOut((d < 0) ? -(UDCell) d : (UDCell) d, d < 0, 0, 1);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_DOTR(void)
+{
+  Cell width = STACK_POP(sp);
+  signedOut(STACK_POP(sp), width, 0);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_UDOTR(void)
+{
+  Cell width = STACK_POP(sp);
+  numberOut((UCell) STACK_POP(sp), 0, width, 0);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_UWIDTH(void)
+{
+  char buffer[TOMOKO_NUMBER_MAX];
+  char *end = &buffer[TOMOKO_NUMBER_MAX];
+  UCell u = STACK_POP(sp);
+  STACK_PUSH(sp, end - formatDigits(end, u, currentBase()));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_DOT_S(void)
+{
+  const Cell *bottom = (const Cell*) userArea[USER_S0];
+  Cell depth = bottom - sp;
+
+  charOut('<');
+  numberOut(depth, 0, 0, 0);
+  charOut('>');
+
+  // Display the deepest item first.
+  const Cell *item;
+  for (item = bottom - 1; item >= sp; --item)
+  {
+    charOut(' ');
+    signedOut(*item, 0, 0);
+  }
+  charOut('\n');
+} // fn_DOT_S
+
+//-----------------------------------------------------------------------------
+// Pictured numeric output.
+//-----------------------------------------------------------------------------
+/**
+ * The pictured numeric output buffer, filled from the end backwards.
+ */
+static __thread char holdBuffer[TOMOKO_HOLD_MAX];
+
+/**
+ * The index of the first character of the pictured numeric output string in
+ * holdBuffer.
+ */
+static __thread size_t holdStart = TOMOKO_HOLD_MAX;
+
+//-----------------------------------------------------------------------------
+/**
+ * Add c to the start of the pictured numeric output string.  Characters that
+ * would overflow the buffer are discarded.
+ */
+static void holdChar(char c)
+{
+  if (holdStart > 0)
+  {
+    holdBuffer[--holdStart] = c;
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_LESSNUM(void)
+{
+  holdStart = TOMOKO_HOLD_MAX;
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_NUM(void)
+{
+  UDCell ud = STACK_POP_UDOUBLE(sp);
+  Cell base = currentBase();
+  holdChar(digitChars[ud % base]);
+  STACK_PUSH_DOUBLE(sp, ud / base);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_NUMS(void)
+{
+  char buffer[TOMOKO_NUMBER_MAX];
+  char *end = &buffer[TOMOKO_NUMBER_MAX];
+  char *start = formatDigits(end, STACK_POP_UDOUBLE(sp), currentBase());
+  while (end > start)
+  {
+    holdChar(*--end);
+  }
+  STACK_PUSH_DOUBLE(sp, 0);
+} // fn_NUMS
+
+//-----------------------------------------------------------------------------
+
+void fn_HOLD(void)
+{
+  holdChar(STACK_POP(sp));
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_SIGN(void)
+{
+  if (STACK_POP(sp) < 0)
+  {
+    holdChar('-');
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_NUMGREATER(void)
+{
+  (void) STACK_POP_UDOUBLE(sp);
+  STACK_PUSH(sp, &holdBuffer[holdStart]);
+  STACK_PUSH(sp, TOMOKO_HOLD_MAX - holdStart);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FLUSH_OUTPUT(void)
+{
+  flushOutput();
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,227 @@
+//-----------------------------------------------------------------------------
+// Output
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_OUTPUT_H
+#define TOMOKO_OUTPUT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "types.h"
+
+//-----------------------------------------------------------------------------
+/**
+ * Size of the output buffer, in bytes.
+ */
+#define TOMOKO_OUTPUT_MAX 4096
+
+/**
+ * Size of the pictured numeric output buffer, used by <# HOLD #> and
+ * friends.  Enough for a double cell in binary, plus a sign and some text.
+ */
+#define TOMOKO_HOLD_MAX 160
+
+//-----------------------------------------------------------------------------
+/**
+ * Append a single character to the output buffer.
+ *
+ * This is intended to be a single maintenance point for porting this
+ * functionality.
+ *
+ * @param c the character to display.
+ */
+extern void charOut(char c);
+
+//-----------------------------------------------------------------------------
+/**
+ * Append length characters starting at chars to the output buffer, flushing
+ * the buffer as often as necessary.
+ *
+ * @param chars the characters to display.
+ * @param length the number of characters.
+ */
+extern void charsOut(const char *chars, size_t length);
+
+//-----------------------------------------------------------------------------
+/**
+ * Write everything in the output buffer to stdout (or the file given to
+ * setOutputFile()).
+ *
+ * This is called automatically before reading a line from the terminal and
+ * when the program exits.
+ */
+extern void flushOutput(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * Send the calling thread's output to file rather than stdout, or to stdout
+ * again if file is NULL.  Flush the output buffer first.
+ */
+extern void setOutputFile(FILE *file);
+
+//-----------------------------------------------------------------------------
+// Words.
+//-----------------------------------------------------------------------------
+/**
+ * EMIT ( c -- )
+ *
+ * Write a single character to stdout, whose ASCII code is TOS.
+ */
+extern void fn_EMIT(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * TELL ( addr length -- )
+ *
+ * Writes the string of characters at addr, with the specified length, to
+ * stdout.
+ */
+extern void fn_TELL(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * SPACES ( n -- )
+ *
+ * Write n spaces to stdout.  Nothing is written if n <= 0.
+ */
+extern void fn_SPACES(void);
+
+//-----------------------------------------------------------------------------
+// Numeric output.
+//
+// All of these words display numbers in the base given by BASE, which should
+// be between 2 and 36 inclusive.  Decimal is used if it isn't.
+//-----------------------------------------------------------------------------
+/**
+ * . ( n -- )
+ *
+ * Display n as a signed number, followed by a space.
+ */
+extern void fn_DOT(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * U. ( u -- )
+ *
+ * Display u as an unsigned number, followed by a space.
+ */
+extern void fn_UDOT(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * D. ( d -- )
+ *
+ * Display the double cell d as a signed number, followed by a space.
+ */
+extern void fn_DDOT(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * .R ( n width -- )
+ *
+ * Display n as a signed number, right-aligned in a field of width characters.
+ * The whole number is displayed even if it is wider than that.
+ */
+extern void fn_DOTR(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * U.R ( u width -- )
+ *
+ * Display u as an unsigned number, right-aligned in a field of width
+ * characters.  The whole number is displayed even if it is wider than that.
+ */
+extern void fn_UDOTR(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * UWIDTH ( u -- width )
+ *
+ * Return the number of characters needed to display u as an unsigned number.
+ */
+extern void fn_UWIDTH(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * .S ( -- )
+ *
+ * Non-destructively display the contents of the stack, in the form:
+ * <n> sn ... s2 s1 s0
+ *
+ * where n is the number of items and s0 is the TOS.
+ */
+extern void fn_DOT_S(void);
+
+//-----------------------------------------------------------------------------
+// Pictured numeric output.
+//
+// <# begins the conversion of a double cell number into a string in the hold
+// buffer, which is built from right to left by # #S HOLD and SIGN.  #>
+// finishes it, returning the string.  For example, to display a double cell
+// number d with at least 4 digits:
+//
+//   DUP >R DABS <# # # # #S R> SIGN #> TELL
+//-----------------------------------------------------------------------------
+/**
+ * <# ( -- )
+ *
+ * Start pictured numeric output, emptying the hold buffer.
+ */
+extern void fn_LESSNUM(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * # ( ud1 -- ud2 )
+ *
+ * Divide ud1 by BASE, HOLD the digit for the remainder and return the
+ * quotient.
+ */
+extern void fn_NUM(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * #S ( ud -- 0 0 )
+ *
+ * Convert all of the remaining digits of ud, as if by #, until the quotient
+ * is zero.  At least one digit is always converted.
+ */
+extern void fn_NUMS(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * HOLD ( c -- )
+ *
+ * Add the character c to the start of the pictured numeric output string.
+ */
+extern void fn_HOLD(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * SIGN ( n -- )
+ *
+ * If n is negative, HOLD a minus sign.
+ */
+extern void fn_SIGN(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * #> ( xd -- addr len )
+ *
+ * Finish pictured numeric output, dropping xd and returning the string built
+ * in the hold buffer.
+ */
+extern void fn_NUMGREATER(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * FLUSH-OUTPUT ( -- )
+ *
+ * Write any buffered output to stdout immediately.  The block word FLUSH
+ * does this too.
+ */
+extern void fn_FLUSH_OUTPUT(void);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_OUTPUT_H
@@ -0,0 +1,437 @@
+//-----------------------------------------------------------------------------
+// Parallel Loops
+//
+// The pool's workers are started by the first parallel loop, and then wait
+// for loops on a condition variable.  A loop deals the indices out evenly as
+// one range per worker.  A worker takes PAR-GRAIN indices at a time from the
+// front of its own range; when that is empty, it steals the back half of
+// another worker's range and carries on.  The loop ends when no range has any
+// indices left and every worker has finished its last chunk.  A fault in
+// the body empties every range, ending the loop, and is raised again in the
+// thread that started it, as if that thread had run the loop itself.
+//
+// Each worker's range is guarded by a mutex of its own, and the Worker
+// records are cache-line aligned, so that workers taking chunks from their
+// own ranges do not contend with one another.
+//-----------------------------------------------------------------------------
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "par.h"
+#include "machine.h"
+#include "output.h"
+#include "thread.h"
+
+//-----------------------------------------------------------------------------
+// External references to a few Forth global variables:
+
+extern Cell PAR_GRAIN_value;
+
+//-----------------------------------------------------------------------------
+
+UCell parWorkers = 0;
+
+//-----------------------------------------------------------------------------
+/**
+ * The kinds of parallel loop.
+ */
+typedef enum
+{
+  LOOP_DO,     ///< PAR-DO: xt ( i -- ).
+  LOOP_MAP,    ///< PAR-MAP: xt ( x -- y ) from src to dst.
+  LOOP_REDUCE  ///< PAR-REDUCE: xt ( x1 x2 -- x3 ) over src.
+} LoopKind;
+
+/**
+ * A parallel loop.
+ */
+typedef struct
+{
+  LoopKind kind;
+  CodeWord *xt;    ///< The loop body.
+  const Cell *src; ///< The array read by PAR-MAP and PAR-REDUCE.
+  Cell *dst;       ///< The array written by PAR-MAP.
+  Cell x0;         ///< The identity of PAR-REDUCE's xt.
+  UCell grain;     ///< The number of indices a worker takes at a time.
+  const char *fault; ///< The first fault in the body, or NULL.
+} Loop;
+
+/**
+ * A worker thread.
+ */
+typedef struct
+{
+  pthread_mutex_t lock;  ///< Held while lo and hi are used.
+  UCell lo;              ///< The first index of the range left to do.
+  UCell hi;              ///< The index just after the range.
+  Cell partial;          ///< The worker's partial result for PAR-REDUCE.
+  UCell generation;      ///< The loop the worker last started.
+  int working;           ///< True from starting a loop to finishing it.
+  Cell userCells[USER_CELLS]; ///< The worker's user area.
+} __attribute__ ((aligned (64))) Worker;
+
+/**
+ * The workers, of which workerCount have been started.
+ */
+static Worker workers[TOMOKO_PAR_MAX_WORKERS];
+static int workerCount = 0;
+
+/**
+ * The loop that the pool is running, or last ran.
+ */
+static Loop loop;
+
+/**
+ * poolLock guards the variables that follow it.  jobStarted is signalled
+ * when generation changes, starting a loop, and jobFinished when pending
+ * (the number of workers yet to finish the loop) reaches 0.
+ */
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobStarted = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t jobFinished = PTHREAD_COND_INITIALIZER;
+static UCell generation = 0;
+static int pending = 0;
+static int poolBusy = 0;
+
+//-----------------------------------------------------------------------------
+/**
+ * Run the body of a loop for the indices from first to end - 1, in the
+ * calling thread.  For PAR-REDUCE, combine the cells with accumulator, and
+ * return the result.
+ */
+static Cell runRange(const Loop *body, UCell first, UCell end,
+                     Cell accumulator)
+{
+  UCell i;
+  for (i = first; i < end; ++i)
+  {
+    switch (body->kind)
+    {
+      case LOOP_DO:
+        STACK_PUSH(sp, i);
+        executeWord(body->xt);
+        break;
+
+      case LOOP_MAP:
+        STACK_PUSH(sp, body->src[i]);
+        executeWord(body->xt);
+        body->dst[i] = STACK_POP(sp);
+        break;
+
+      case LOOP_REDUCE:
+        STACK_PUSH(sp, accumulator);
+        STACK_PUSH(sp, body->src[i]);
+        executeWord(body->xt);
+        accumulator = STACK_POP(sp);
+        break;
+    }
+  }
+  return accumulator;
+} // runRange
+
+//-----------------------------------------------------------------------------
+/**
+ * Take up to grain indices from the front of self's range, as first to
+ * end - 1.  Return false if the range is empty.
+ */
+static int claim(Worker *self, UCell grain, UCell *first, UCell *end)
+{
+  int claimed = 0;
+  pthread_mutex_lock(&self->lock);
+  if (self->lo < self->hi)
+  {
+    *first = self->lo;
+    *end = (self->hi - self->lo > grain) ? self->lo + grain : self->hi;
+    self->lo = *end;
+    claimed = 1;
+  }
+  pthread_mutex_unlock(&self->lock);
+  return claimed;
+} // claim
+
+//-----------------------------------------------------------------------------
+/**
+ * Move the back half of the next nonempty range after self's to self.
+ * Return false if every range is empty.
+ */
+static int steal(Worker *self)
+{
+  int index = self - workers;
+  int k;
+  for (k = 1; k < workerCount; ++k)
+  {
+    Worker *victim = &workers[(index + k) % workerCount];
+    pthread_mutex_lock(&victim->lock);
+    if (victim->lo < victim->hi)
+    {
+      UCell hi = victim->hi;
+      UCell lo = hi - (hi - victim->lo + 1) / 2;
+      victim->hi = lo;
+      pthread_mutex_unlock(&victim->lock);
+
+      pthread_mutex_lock(&self->lock);
+      self->lo = lo;
+      self->hi = hi;
+      pthread_mutex_unlock(&self->lock);
+      return 1;
+    }
+    pthread_mutex_unlock(&victim->lock);
+  }
+  return 0;
+} // steal
+
+//-----------------------------------------------------------------------------
+/**
+ * Record the fault in stackFault as the loop's, unless another worker has
+ * faulted first, and empty every range so that the workers finish.
+ */
+static void abandonLoop(void)
+{
+  pthread_mutex_lock(&poolLock);
+  if (loop.fault == NULL)
+  {
+    loop.fault = stackFault;
+  }
+  pthread_mutex_unlock(&poolLock);
+
+  int k;
+  for (k = 0; k < workerCount; ++k)
+  {
+    pthread_mutex_lock(&workers[k].lock);
+    workers[k].lo = workers[k].hi;
+    pthread_mutex_unlock(&workers[k].lock);
+  }
+} // abandonLoop
+
+//-----------------------------------------------------------------------------
+/**
+ * The start routine of a worker.
+ */
+static void *runWorker(void *argument)
+{
+  Worker *self = argument;
+  userArea = self->userCells;
+  sp = (Cell*) userArea[USER_S0];
+  rsp = (Cell*) userArea[USER_R0];
+  fsp = (Float*) userArea[USER_F0];
+
+  if (sigsetjmp(stackFaultRecovery, 1) != 0)
+  {
+    // Abandon the loop, and leave runLoop to raise the fault.
+    dropDictionaryLock();
+    flushOutput();
+    abandonLoop();
+    sp = (Cell*) userArea[USER_S0];
+    rsp = (Cell*) userArea[USER_R0];
+    fsp = (Float*) userArea[USER_F0];
+  }
+
+  for (;;)
+  {
+    if (! self->working)
+    {
+      pthread_mutex_lock(&poolLock);
+      while (self->generation == generation)
+      {
+        pthread_cond_wait(&jobStarted, &poolLock);
+      }
+      self->generation = generation;
+      self->working = 1;
+      pthread_mutex_unlock(&poolLock);
+    }
+
+    for (;;)
+    {
+      UCell first, end;
+      if (claim(self, loop.grain, &first, &end))
+      {
+        self->partial = runRange(&loop, first, end, self->partial);
+      }
+      else if (! steal(self))
+      {
+        break;
+      }
+    }
+    flushOutput();
+    self->working = 0;
+
+    pthread_mutex_lock(&poolLock);
+    if (--pending == 0)
+    {
+      pthread_cond_signal(&jobFinished);
+    }
+    pthread_mutex_unlock(&poolLock);
+  }
+  return NULL;
+} // runWorker
+
+//-----------------------------------------------------------------------------
+/**
+ * Start the workers, if they have not been started, and return how many
+ * there are.  poolLock must be held.
+ */
+static int startWorkers(void)
+{
+  if (workerCount > 0)
+  {
+    return workerCount;
+  }
+
+  long count = (parWorkers > 0) ? (long) parWorkers
+                                : sysconf(_SC_NPROCESSORS_ONLN);
+  if (count < 1)
+  {
+    count = 1;
+  }
+  if (count > TOMOKO_PAR_MAX_WORKERS)
+  {
+    count = TOMOKO_PAR_MAX_WORKERS;
+  }
+
+  int started;
+  for (started = 0; started < count; ++started)
+  {
+    Worker *worker = &workers[started];
+    Cell *s0 = mapStack(parameterStackCells, 1);
+    Cell *r0 = mapStack(returnStackCells, 0);
+    Float *f0 = mapFloatStack(floatStackFloats);
+    if (s0 == NULL || r0 == NULL || f0 == NULL)
+    {
+      unmapStack(s0);
+      unmapStack(r0);
+      unmapStack(f0);
+      break;
+    }
+    pthread_mutex_init(&worker->lock, NULL);
+    worker->lo = worker->hi = 0;
+    worker->generation = generation;
+    worker->working = 0;
+    worker->userCells[USER_BASE] = 10;
+    worker->userCells[USER_STATE] = 0;
+    worker->userCells[USER_S0] = (Cell) s0;
+    worker->userCells[USER_R0] = (Cell) r0;
+    worker->userCells[USER_F0] = (Cell) f0;
+
+    pthread_t id;
+    if (pthread_create(&id, NULL, runWorker, worker) != 0)
+    {
+      pthread_mutex_destroy(&worker->lock);
+      unmapStack(s0);
+      unmapStack(r0);
+      unmapStack(f0);
+      break;
+    }
+    pthread_detach(id);
+  }
+  workerCount = started;
+  return workerCount;
+} // startWorkers
+
+//-----------------------------------------------------------------------------
+/**
+ * Run a loop over the indices from 0 to n - 1 on the pool, or serially in
+ * the calling thread if the pool is busy or could not be started.  Return
+ * the result for PAR-REDUCE, or jump to stackFaultRecovery with the first
+ * fault that a worker met.
+ */
+static Cell runLoop(Loop *request, UCell n)
+{
+  pthread_mutex_lock(&poolLock);
+  if (n == 0 || poolBusy || startWorkers() == 0)
+  {
+    pthread_mutex_unlock(&poolLock);
+    return runRange(request, 0, n, request->x0);
+  }
+  poolBusy = 1;
+
+  request->grain = (PAR_GRAIN_value > 0) ? (UCell) PAR_GRAIN_value
+                   : n / ((UCell) workerCount * TOMOKO_PAR_CHUNKS_PER_WORKER);
+  if (request->grain == 0)
+  {
+    request->grain = 1;
+  }
+  loop = *request;
+
+  // Deal the indices out evenly.  The workers are all waiting for poolLock.
+  int i;
+  for (i = 0; i < workerCount; ++i)
+  {
+    workers[i].lo = (UCell) ((UDCell) n * i / workerCount);
+    workers[i].hi = (UCell) ((UDCell) n * (i + 1) / workerCount);
+    workers[i].partial = request->x0;
+    workers[i].userCells[USER_BASE] = userArea[USER_BASE];
+  }
+
+  pending = workerCount;
+  ++generation;
+  pthread_cond_broadcast(&jobStarted);
+  while (pending > 0)
+  {
+    pthread_cond_wait(&jobFinished, &poolLock);
+  }
+
+  Cell partials[TOMOKO_PAR_MAX_WORKERS];
+  int count = workerCount;
+  for (i = 0; i < count; ++i)
+  {
+    partials[i] = workers[i].partial;
+  }
+  const char *fault = loop.fault;
+  poolBusy = 0;
+  pthread_mutex_unlock(&poolLock);
+
+  if (fault != NULL)
+  {
+    stackFault = fault;
+    siglongjmp(stackFaultRecovery, 1);
+  }
+
+  // Combine the workers' partial results.
+  Cell result = request->x0;
+  if (request->kind == LOOP_REDUCE)
+  {
+    for (i = 0; i < count; ++i)
+    {
+      STACK_PUSH(sp, result);
+      STACK_PUSH(sp, partials[i]);
+      executeWord(request->xt);
+      result = STACK_POP(sp);
+    }
+  }
+  return result;
+} // runLoop
+
+//-----------------------------------------------------------------------------
+
+void fn_PAR_DO(void)
+{
+  UCell n = STACK_POP(sp);
+  Loop request = { LOOP_DO, (CodeWord*) STACK_POP(sp), NULL, NULL, 0, 0, NULL };
+  runLoop(&request, n);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_PAR_MAP(void)
+{
+  UCell n = STACK_POP(sp);
+  Cell *dst = (Cell*) STACK_POP(sp);
+  const Cell *src = (const Cell*) STACK_POP(sp);
+  Loop request = { LOOP_MAP, (CodeWord*) STACK_POP(sp), src, dst, 0, 0, NULL };
+  runLoop(&request, n);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_PAR_REDUCE(void)
+{
+  Cell x0 = STACK_POP(sp);
+  UCell n = STACK_POP(sp);
+  const Cell *src = (const Cell*) STACK_POP(sp);
+  Loop request = { LOOP_REDUCE, (CodeWord*) STACK_POP(sp), src, NULL, x0, 0,
+                   NULL };
+  STACK_PUSH(sp, runLoop(&request, n));
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,73 @@
+//-----------------------------------------------------------------------------
+// Parallel Loops
+//
+// Words that spread the iterations of a loop over a pool of worker threads,
+// one per processor.  Each worker has its own stacks, registers and user area
+// (see thread.h) and runs the loop body against the shared dictionary, which
+// the body should only read.  Iterations are handed out in chunks of
+// PAR-GRAIN indices, and idle workers steal work from busy ones, so uneven
+// iterations still keep every processor busy.
+//
+// A parallel word called from within a loop body, or by another thread while
+// the pool is busy, runs its loop serially in the calling thread instead.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_PAR_H
+#define TOMOKO_PAR_H
+
+#include "types.h"
+
+//-----------------------------------------------------------------------------
+/**
+ * The most worker threads in the pool, whatever the number of processors.
+ */
+#define TOMOKO_PAR_MAX_WORKERS 64
+
+/**
+ * With PAR-GRAIN 0, each worker's share of the indices is divided into about
+ * this many chunks, to leave enough chunks to steal.
+ */
+#define TOMOKO_PAR_CHUNKS_PER_WORKER 8
+
+//-----------------------------------------------------------------------------
+/**
+ * The number of workers to start, set by the -w option; 0 means one per
+ * processor online.
+ */
+extern UCell parWorkers;
+
+//-----------------------------------------------------------------------------
+// Words.
+//-----------------------------------------------------------------------------
+/**
+ * PAR-DO ( xt n -- )
+ *
+ * Execute xt ( i -- ) for each i from 0 to n - 1, in parallel and in no
+ * particular order.
+ */
+extern void fn_PAR_DO(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * PAR-MAP ( xt src dst n -- )
+ *
+ * Store the result of xt ( x -- y ) applied to each of the n cells of the
+ * array src in the corresponding cell of the array dst, in parallel.  src and
+ * dst may be the same array.
+ */
+extern void fn_PAR_MAP(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * PAR-REDUCE ( xt src n x0 -- x )
+ *
+ * Combine x0 and the n cells of the array src with xt ( x1 x2 -- x3 ), in
+ * parallel.  xt must be associative and commutative, such as + or MAX, and
+ * x0 must be its identity, since each worker starts its own partial result
+ * from x0 and combines the cells in whichever order it reaches them.
+ */
+extern void fn_PAR_REDUCE(void);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_PAR_H
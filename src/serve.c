@@ -0,0 +1,476 @@
+//-----------------------------------------------------------------------------
+// Server
+//
+// One thread serves every connection, with epoll, evaluating one request at
+// a time.  A connection's stacks, user area, HERE and LATEST are loaded for
+// each of its requests and saved afterwards, much as a task switch does (see
+// task.c); its return stack starts empty each time.  A request's output goes
+// to a memory stream (see setOutputFile()), which becomes its reply.  The
+// tasks, operations and timers that a request starts end with it (see
+// endTasks()), since they would otherwise run during other requests, with
+// their dictionaries and into their replies.
+//
+// A connection whose replies are not being read is not read either, until
+// they have all been sent.
+//-----------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "serve.h"
+#include "input.h"
+#include "machine.h"
+#include "output.h"
+#include "task.h"
+#include "thread.h"
+
+// External references to a few Forth global variables:
+extern Cell HERE_value;
+extern Cell LATEST_value;
+
+// ... and to EVALUATE (see tomoko.c).
+extern CodeWord *const evaluateWord;
+
+//-----------------------------------------------------------------------------
+/**
+ * Characters received or waiting to be sent.
+ */
+typedef struct
+{
+  char *chars;    ///< The characters, from malloc().
+  size_t start;   ///< The number already used (evaluated or sent).
+  size_t length;  ///< The number in chars.
+  size_t size;    ///< The size of chars.
+} Buffer;
+
+/**
+ * A client connection.
+ */
+typedef struct Connection
+{
+  struct Connection *nextSpare;  ///< The next record in the spare list.
+  int fd;                        ///< The socket.
+  uint32_t events;               ///< What epoll waits for on fd.
+  int closing;                   ///< True once the client has finished.
+  Buffer input;                  ///< Requests received.
+  Buffer output;                 ///< Replies to send.
+  Cell *sp;                      ///< The parameter stack pointer.
+  Float *fsp;                    ///< The floating-point stack pointer.
+  Cell here;                     ///< HERE.
+  Cell latest;                   ///< LATEST.
+  Cell *dictionary;              ///< Its space for definitions.
+  Cell userCells[USER_CELLS];    ///< The user area.
+} Connection;
+
+/**
+ * Records of closed connections, with their stacks, kept for reuse.
+ */
+static Connection *spareConnections = NULL;
+
+/**
+ * The epoll instance that the server waits on.
+ */
+static int epollFd;
+
+/**
+ * LATEST after loading ~/.tomoko, which each connection's definitions
+ * follow.
+ */
+static Cell baseLatest;
+
+/**
+ * The limits on each request (see serve()).
+ */
+static UCell budgetInstructions;
+static Cell budgetMilliseconds;
+
+//-----------------------------------------------------------------------------
+/**
+ * Append length characters at chars to buffer, and return false if there is
+ * not enough memory.
+ */
+static int append(Buffer *buffer, const char *chars, size_t length)
+{
+  if (buffer->length + length > buffer->size)
+  {
+    size_t size = (buffer->size == 0) ? 4096 : buffer->size;
+    while (size < buffer->length + length)
+    {
+      size *= 2;
+    }
+    char *bigger = realloc(buffer->chars, size);
+    if (bigger == NULL)
+    {
+      return 0;
+    }
+    buffer->chars = bigger;
+    buffer->size = size;
+  }
+  memcpy(buffer->chars + buffer->length, chars, length);
+  buffer->length += length;
+  return 1;
+} // append
+
+//-----------------------------------------------------------------------------
+/**
+ * Move the unused characters in buffer to its start.
+ */
+static void compact(Buffer *buffer)
+{
+  buffer->length -= buffer->start;
+  memmove(buffer->chars, buffer->chars + buffer->start, buffer->length);
+  buffer->start = 0;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Return a connection record for the socket fd, with stacks and an empty
+ * dictionary, or NULL if there is not enough memory.
+ */
+static Connection *newConnection(int fd)
+{
+  Connection *connection = spareConnections;
+  if (connection != NULL)
+  {
+    spareConnections = connection->nextSpare;
+  }
+  else
+  {
+    connection = calloc(1, sizeof (Connection));
+    Cell *dictionary = mapDictionary();
+    Cell *s0 = mapStack(parameterStackCells, 1);
+    Cell *r0 = mapStack(returnStackCells, 0);
+    Float *f0 = mapFloatStack(floatStackFloats);
+    if (connection == NULL || dictionary == NULL || s0 == NULL || r0 == NULL
+        || f0 == NULL)
+    {
+      free(connection);
+      unmapStack(dictionary);
+      unmapStack(s0);
+      unmapStack(r0);
+      unmapStack(f0);
+      return NULL;
+    }
+    connection->dictionary = dictionary;
+    connection->userCells[USER_S0] = (Cell) s0;
+    connection->userCells[USER_R0] = (Cell) r0;
+    connection->userCells[USER_F0] = (Cell) f0;
+  }
+
+  connection->fd = fd;
+  connection->events = EPOLLIN;
+  connection->closing = 0;
+  connection->input.start = connection->input.length = 0;
+  connection->output.start = connection->output.length = 0;
+  connection->sp = (Cell*) connection->userCells[USER_S0];
+  connection->fsp = (Float*) connection->userCells[USER_F0];
+  connection->here = (Cell) connection->dictionary;
+  connection->latest = baseLatest;
+  connection->userCells[USER_BASE] = 10;
+  connection->userCells[USER_STATE] = 0;
+  return connection;
+} // newConnection
+
+//-----------------------------------------------------------------------------
+/**
+ * Close a connection and put its record on the spare list.  Its buffers are
+ * kept too.
+ */
+static void closeConnection(Connection *connection)
+{
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, NULL);
+  close(connection->fd);
+  connection->nextSpare = spareConnections;
+  spareConnections = connection;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Evaluate the length characters of text for connection, and append the
+ * reply to its output.  Return false if there is not enough memory for it.
+ */
+static int evaluateRequest(Connection *connection, const char *text,
+                           size_t length)
+{
+  char *reply = NULL;
+  size_t replyLength = 0;
+  FILE *file = open_memstream(&reply, &replyLength);
+  if (file == NULL)
+  {
+    return 0;
+  }
+  setOutputFile(file);
+
+  userArea = connection->userCells;
+  sp = connection->sp;
+  fsp = connection->fsp;
+  rsp = (Cell*) userArea[USER_R0];
+  HERE_value = connection->here;
+  dictionaryLimit = (char*) connection->dictionary + DICTIONARY_SIZE;
+  LATEST_value = connection->latest;
+
+  const char *fault = NULL;
+  long long deadline = (budgetMilliseconds > 0)
+                       ? now() + budgetMilliseconds : 0;
+  if (sigsetjmp(stackFaultRecovery, 1) == 0)
+  {
+    STACK_PUSH(sp, text);
+    STACK_PUSH(sp, length);
+    executeWordWithin(evaluateWord, budgetInstructions, deadline);
+  }
+  else
+  {
+    // As QUIT would after a fault: empty the parameter stack and stop
+    // compiling.
+    fault = stackFault;
+    dropDictionaryLock();
+    recoverOperator();
+    userArea = connection->userCells;
+    endSources(0);
+    sp = (Cell*) userArea[USER_S0];
+    fsp = (Float*) userArea[USER_F0];
+    userArea[USER_STATE] = 0;
+  }
+  endTasks();
+
+  connection->sp = sp;
+  connection->fsp = fsp;
+  connection->here = HERE_value;
+  connection->latest = LATEST_value;
+
+  setOutputFile(NULL);
+  fclose(file);
+  int appended = append(&connection->output, reply, replyLength);
+  if (fault != NULL)
+  {
+    if (replyLength > 0 && reply[replyLength - 1] != '\n')
+    {
+      appended = appended && append(&connection->output, "\n", 1);
+    }
+    appended = appended && append(&connection->output, fault, strlen(fault))
+               && append(&connection->output, "\n", 1);
+  }
+  free(reply);
+  return appended && append(&connection->output, "", 1);
+} // evaluateRequest
+
+//-----------------------------------------------------------------------------
+/**
+ * Send as much of connection's output as the socket will take, and return
+ * false if the connection has failed.
+ */
+static int sendReplies(Connection *connection)
+{
+  Buffer *output = &connection->output;
+  while (output->start < output->length)
+  {
+    ssize_t n = send(connection->fd, output->chars + output->start,
+                     output->length - output->start, MSG_NOSIGNAL);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    output->start += n;
+  }
+  output->start = output->length = 0;
+  return 1;
+} // sendReplies
+
+//-----------------------------------------------------------------------------
+/**
+ * Evaluate the complete requests that connection has sent and send the
+ * replies, until it runs out of requests or the replies back up.  Then
+ * close it if it is finished, or else wait for whichever of more requests or
+ * room for the replies it needs.
+ */
+static void service(Connection *connection)
+{
+  Buffer *input = &connection->input;
+  int ok = 1;
+  while (ok && (ok = sendReplies(connection))
+         && connection->output.length == 0)
+  {
+    char *start = input->chars + input->start;
+    size_t available = input->length - input->start;
+    char *end = memchr(start, '\n', available);
+    if (end != NULL)
+    {
+      input->start += end + 1 - start;
+    }
+    else if (connection->closing && available > 0)
+    {
+      // The last request need not end with a newline.
+      end = start + available;
+      input->start = input->length;
+    }
+    else
+    {
+      break;
+    }
+    ok = evaluateRequest(connection, start, end - start);
+  }
+  compact(input);
+
+  if (! ok || (connection->closing && connection->output.length == 0))
+  {
+    closeConnection(connection);
+    return;
+  }
+
+  uint32_t events = (connection->output.length > 0) ? EPOLLOUT
+                    : connection->closing ? 0 : EPOLLIN;
+  if (events != connection->events)
+  {
+    struct epoll_event change = { events, { .ptr = connection } };
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->fd, &change);
+    connection->events = events;
+  }
+} // service
+
+//-----------------------------------------------------------------------------
+/**
+ * Read what connection has sent, then service it.
+ */
+static void receive(Connection *connection)
+{
+  Buffer *input = &connection->input;
+  if (input->length == input->size)
+  {
+    if (input->size >= TOMOKO_REQUEST_MAX)
+    {
+      // No newline in all that.
+      static const char tooLong[] = "request too long\n";
+      input->start = input->length = 0;
+      connection->closing = 1;
+      append(&connection->output, tooLong, sizeof tooLong);
+      service(connection);
+      return;
+    }
+    size_t size = (input->size == 0) ? 4096 : 2 * input->size;
+    char *bigger = realloc(input->chars, size);
+    if (bigger == NULL)
+    {
+      closeConnection(connection);
+      return;
+    }
+    input->chars = bigger;
+    input->size = size;
+  }
+
+  ssize_t n = read(connection->fd, input->chars + input->length,
+                   input->size - input->length);
+  if (n > 0)
+  {
+    input->length += n;
+  }
+  else if (n == 0 || (errno != EINTR && errno != EAGAIN))
+  {
+    connection->closing = 1;
+  }
+  service(connection);
+} // receive
+
+//-----------------------------------------------------------------------------
+/**
+ * Accept the waiting connections on listener.
+ */
+static void acceptConnections(int listener)
+{
+  int fd;
+  while ((fd = accept4(listener, NULL, NULL,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+  {
+    Connection *connection = newConnection(fd);
+    struct epoll_event change = { EPOLLIN, { .ptr = connection } };
+    if (connection == NULL
+        || epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &change) != 0)
+    {
+      close(fd);
+      if (connection != NULL)
+      {
+        connection->nextSpare = spareConnections;
+        spareConnections = connection;
+      }
+    }
+  }
+} // acceptConnections
+
+//-----------------------------------------------------------------------------
+
+void serve(const char *path, UCell instructions, Cell milliseconds)
+{
+  budgetInstructions = instructions;
+  budgetMilliseconds = milliseconds;
+  terminalInput = 0;
+  if (! loadPrelude())
+  {
+    return;
+  }
+  baseLatest = LATEST_value;
+
+  struct sockaddr_un address = { .sun_family = AF_UNIX };
+  if (strlen(path) >= sizeof address.sun_path)
+  {
+    fprintf(stderr, "%s: socket path too long\n", path);
+    return;
+  }
+  strcpy(address.sun_path, path);
+
+  // Replace a socket left by an earlier server, but nothing else.
+  struct stat status;
+  if (stat(path, &status) == 0 && S_ISSOCK(status.st_mode))
+  {
+    unlink(path);
+  }
+
+  int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        0);
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event change = { EPOLLIN, { .ptr = NULL } };
+  if (listener < 0 || epollFd < 0
+      || bind(listener, (struct sockaddr*) &address, sizeof address) != 0
+      || listen(listener, SOMAXCONN) != 0
+      || epoll_ctl(epollFd, EPOLL_CTL_ADD, listener, &change) != 0)
+  {
+    perror(path);
+    return;
+  }
+
+  for (;;)
+  {
+    struct epoll_event ready[TOMOKO_SERVE_EVENTS_MAX];
+    int count = epoll_wait(epollFd, ready, TOMOKO_SERVE_EVENTS_MAX, -1);
+    int i;
+    for (i = 0; i < count; ++i)
+    {
+      Connection *connection = ready[i].data.ptr;
+      if (connection == NULL)
+      {
+        acceptConnections(listener);
+      }
+      else if (connection->events & EPOLLIN)
+      {
+        receive(connection);
+      }
+      else
+      {
+        service(connection);
+      }
+    }
+  }
+} // serve
+
+//-----------------------------------------------------------------------------
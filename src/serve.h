@@ -0,0 +1,46 @@
+//-----------------------------------------------------------------------------
+// Server
+//
+// With --serve, Tomoko loads ~/.tomoko once and then evaluates requests from
+// clients connected to a Unix domain socket, instead of reading the terminal.
+// Each request is a line of text, which is evaluated as EVALUATE would; the
+// reply is everything the request output, then, if it faulted, a
+// description of the fault on a line of its own, then a NUL character.
+//
+// Each connection has its own stacks, user area (so BASE and STATE),
+// dictionary space and output.  Its definitions last as long as it does,
+// and no other connection sees them; what is on its parameter stack carries
+// over from one request to the next.  A request that faults, or overruns
+// its budget, empties its connection's parameter stack, as QUIT does.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_SERVE_H
+#define TOMOKO_SERVE_H
+
+#include "types.h"
+
+//-----------------------------------------------------------------------------
+/**
+ * The longest request line, in characters.  A connection that sends a
+ * longer one is told so and closed.
+ */
+#define TOMOKO_REQUEST_MAX 65536
+
+/**
+ * The most connections that one turn of the server's loop takes from epoll.
+ */
+#define TOMOKO_SERVE_EVENTS_MAX 64
+
+//-----------------------------------------------------------------------------
+/**
+ * Load ~/.tomoko, then serve requests on a Unix domain socket at path,
+ * replacing any stale socket there, until the process is killed.  Stop each
+ * request after instructions instructions, or milliseconds milliseconds, or
+ * neither if they are 0 (see executeWordWithin()).  Return only if the
+ * socket cannot be set up, after reporting why.
+ */
+extern void serve(const char *path, UCell instructions, Cell milliseconds);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_SERVE_H
@@ -0,0 +1,558 @@
+//-----------------------------------------------------------------------------
+// Tasks
+//
+// The tasks form a ring, starting with the operator, and PAUSE passes control
+// to the next task in the ring that is ready: awake, and not in an MSLEEP that
+// has yet to end.  Switching tasks saves the VM registers (ip, w, sp and rsp)
+// and the user area pointer of the running task and loads those of the next.
+//
+// While the operator waits for terminal input, the other tasks run in a
+// nested inner interpreter loop, and when the turn comes back round to the
+// operator, that loop ends and the operator polls the terminal again.  If no
+// task is ready, the thread runs its event loop (see event.h) until the
+// earliest MSLEEP ends, an event wakes a task or (for the operator) input
+// arrives.
+//
+// FREE-TASK takes a task out of the ring and puts its record, with its
+// stacks, on a spare list, which TASK takes from before mapping new stacks.
+//-----------------------------------------------------------------------------
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "task.h"
+#include "event.h"
+#include "machine.h"
+#include "output.h"
+
+//-----------------------------------------------------------------------------
+/**
+ * A task.  The registers are saved only while it is not running.
+ */
+struct Task
+{
+  struct Task *next;  ///< The next task in the ring.
+  CodeWord **ip;      ///< The saved instruction pointer.
+  CodeWord *w;        ///< The saved W register.
+  Cell *sp;           ///< The saved parameter stack pointer.
+  Cell *rsp;          ///< The saved return stack pointer.
+  Float *fsp;         ///< The saved floating-point stack pointer.
+  Cell *user;         ///< The task's user area.
+  int awake;          ///< False if the task is STOPped or not yet ACTIVATEd.
+  long long wakeAt;   ///< When its MSLEEP ends (see now()), or 0 if none.
+  Cell userCells[USER_CELLS]; ///< The user area of tasks made by TASK.
+};
+
+/**
+ * The operator: the task that was running when the thread first used a task
+ * word.  Its user pointer is filled in when it is first saved.  Each thread
+ * (see thread.h) has its own operator and ring of tasks.
+ */
+static __thread Task operatorTask;
+
+/**
+ * The running task, or NULL until initTasks() is called.
+ */
+static __thread Task *runningTask = NULL;
+
+/**
+ * The operator while it is waiting for terminal input, else NULL.  The scan
+ * for the next task stops here, whether or not it is ready.
+ */
+static __thread Task *inputWaiter = NULL;
+
+/**
+ * Records of freed tasks, with their stacks, kept for reuse.
+ */
+static Task *spareTasks = NULL;
+
+/**
+ * Held while spareTasks is used.
+ */
+static pthread_mutex_t tasksLock = PTHREAD_MUTEX_INITIALIZER;
+
+//-----------------------------------------------------------------------------
+/**
+ * Make the operator the running task, in a ring of its own, if this thread
+ * has not used tasks before.
+ */
+static void initTasks(void)
+{
+  if (runningTask == NULL)
+  {
+    operatorTask.next = &operatorTask;
+    operatorTask.awake = 1;
+    runningTask = &operatorTask;
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+long long now(void)
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (long long) time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Return true if task can run at time t.
+ */
+static int isReady(const Task *task, long long t)
+{
+  return task->awake && task->wakeAt <= t;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Save the registers of the running task.
+ */
+static void saveTask(void)
+{
+  runningTask->ip = ip;
+  runningTask->w = w;
+  runningTask->sp = sp;
+  runningTask->rsp = rsp;
+  runningTask->fsp = fsp;
+  runningTask->user = userArea;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Load the registers of task and make it the running task.
+ */
+static void loadTask(Task *task)
+{
+  ip = task->ip;
+  w = task->w;
+  sp = task->sp;
+  rsp = task->rsp;
+  fsp = task->fsp;
+  userArea = task->user;
+  task->wakeAt = 0;
+  runningTask = task;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the next task after the running task that is ready, or the input
+ * waiter if it comes first.  Return NULL if no task is ready.
+ */
+static Task *nextReady(void)
+{
+  long long t = now();
+  Task *task = runningTask;
+  do
+  {
+    task = task->next;
+    if (task == inputWaiter || isReady(task, t))
+    {
+      return task;
+    }
+  }
+  while (task != runningTask);
+  return NULL;
+} // nextReady
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the number of milliseconds until a task other than except (which
+ * may be NULL) is ready: 0 if one is ready now, or -1 if none will be without
+ * a WAKE.
+ */
+static int timeUntilReady(const Task *except)
+{
+  long long t = now();
+  long long earliest = -1;
+  const Task *task = &operatorTask;
+  do
+  {
+    if (task == except)
+    {
+      continue;
+    }
+    if (isReady(task, t))
+    {
+      return 0;
+    }
+    if (task->awake && (earliest < 0 || task->wakeAt < earliest))
+    {
+      earliest = task->wakeAt;
+    }
+  }
+  while ((task = task->next) != &operatorTask);
+  return (earliest < 0) ? -1 : (int) (earliest - t);
+} // timeUntilReady
+
+//-----------------------------------------------------------------------------
+/**
+ * Sleep for the specified number of milliseconds.
+ */
+static void sleepFor(Cell milliseconds)
+{
+  if (milliseconds > 0)
+  {
+    struct timespec pause = { milliseconds / 1000,
+                              (milliseconds % 1000) * 1000000L };
+    nanosleep(&pause, NULL);
+  }
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * Switch to the next task that is ready, which may be the running task
+ * itself, sleeping until there is one.
+ */
+static void switchTask(void)
+{
+  Task *next;
+  if (hasEvents())
+  {
+    runEvents(0, -1);
+  }
+  while ((next = nextReady()) == NULL)
+  {
+    int delay = timeUntilReady(NULL);
+    if (delay < 0 && ! hasEvents())
+    {
+      // Nothing can run again, but the operator is never stopped for good.
+      next = &operatorTask;
+      break;
+    }
+    runEvents(delay, -1);
+  }
+
+  if (next != runningTask)
+  {
+    saveTask();
+    loadTask(next);
+  }
+  else
+  {
+    next->wakeAt = 0;
+  }
+} // switchTask
+
+//-----------------------------------------------------------------------------
+/**
+ * The code run when a task returns from the definition that ACTIVATEd it:
+ * stop, and stay stopped even if woken.
+ */
+static void taskEnded(void);
+
+static CodeWord taskEndedCodeWord = &taskEnded;
+
+/**
+ * A one-instruction thread that ends a task.  ACTIVATE puts its address on a
+ * new task's return stack, for the definition's EXIT to return to.
+ */
+static CodeWord *taskEnd[] = { &taskEndedCodeWord };
+
+static void taskEnded(void)
+{
+  runningTask->awake = 0;
+  ip = taskEnd;
+  switchTask();
+}
+
+//-----------------------------------------------------------------------------
+
+void waitForInput(int fd)
+{
+  initTasks();
+  Task *self = runningTask;
+  if (self != &operatorTask || (self->next == self && ! hasEvents()))
+  {
+    return;
+  }
+
+  for (;;)
+  {
+    if (runEvents(timeUntilReady(self), fd))
+    {
+      // There is input (or end of file, or an error for the reader to see).
+      return;
+    }
+
+    // Run the other tasks until the turn comes back round.
+    Task *next;
+    inputWaiter = self;
+    if ((next = nextReady()) != self)
+    {
+      saveTask();
+      loadTask(next);
+      while (runningTask != self)
+      {
+        NEXT();
+      }
+    }
+    inputWaiter = NULL;
+
+    // Show what the other tasks printed while the terminal was idle.
+    flushOutput();
+  }
+} // waitForInput
+
+//-----------------------------------------------------------------------------
+
+void recoverOperator(void)
+{
+  initTasks();
+  if (runningTask != &operatorTask)
+  {
+    runningTask->awake = 0;
+    runningTask->ip = taskEnd;
+    runningTask = &operatorTask;
+    userArea = operatorTask.user;
+  }
+  operatorTask.awake = 1;
+  cancelEvents(&operatorTask);
+  inputWaiter = NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+int hasTasks(void)
+{
+  // Tasks that have ended, or are STOPped with nothing to WAKE them, stay in
+  // the ring but can never run, so do not count.
+  return runningTask != NULL
+         && (timeUntilReady(runningTask) >= 0 || hasEvents());
+}
+
+//-----------------------------------------------------------------------------
+
+int timeUntilOthersReady(void)
+{
+  initTasks();
+  return timeUntilReady(runningTask);
+}
+
+//-----------------------------------------------------------------------------
+
+Task *suspendTask(void)
+{
+  initTasks();
+  runningTask->awake = 0;
+  return runningTask;
+}
+
+//-----------------------------------------------------------------------------
+
+void resumeTask(Task *task, const Cell *results, int count)
+{
+  Cell **stack = (task == runningTask) ? &sp : &task->sp;
+  int i;
+  for (i = 0; i < count; ++i)
+  {
+    STACK_PUSH(*stack, results[i]);
+  }
+  task->awake = 1;
+  task->wakeAt = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+/**
+ * Return a task record with its stacks, from the spare list if there is one
+ * there, or NULL if there is not enough memory.
+ */
+static Task *newTask(void)
+{
+  pthread_mutex_lock(&tasksLock);
+  Task *task = spareTasks;
+  if (task != NULL)
+  {
+    spareTasks = task->next;
+  }
+  pthread_mutex_unlock(&tasksLock);
+  if (task != NULL)
+  {
+    return task;
+  }
+
+  task = malloc(sizeof (Task));
+  Cell *s0 = mapStack(parameterStackCells, 1);
+  Cell *r0 = mapStack(returnStackCells, 0);
+  Float *f0 = mapFloatStack(floatStackFloats);
+  if (task == NULL || s0 == NULL || r0 == NULL || f0 == NULL)
+  {
+    free(task);
+    unmapStack(s0);
+    unmapStack(r0);
+    unmapStack(f0);
+    return NULL;
+  }
+  task->userCells[USER_S0] = (Cell) s0;
+  task->userCells[USER_R0] = (Cell) r0;
+  task->userCells[USER_F0] = (Cell) f0;
+  return task;
+} // newTask
+
+//-----------------------------------------------------------------------------
+/**
+ * Take task, which is not the running task, out of the ring, forget the
+ * operations it is waiting for, and put its record on the spare list.
+ * Return false if it is not in the ring.
+ */
+static int freeTask(Task *task)
+{
+  Task *previous = &operatorTask;
+  while (previous->next != task)
+  {
+    previous = previous->next;
+    if (previous == &operatorTask)
+    {
+      return 0;
+    }
+  }
+  previous->next = task->next;
+  cancelEvents(task);
+
+  pthread_mutex_lock(&tasksLock);
+  task->next = spareTasks;
+  spareTasks = task;
+  pthread_mutex_unlock(&tasksLock);
+  return 1;
+} // freeTask
+
+//-----------------------------------------------------------------------------
+
+void endTasks(void)
+{
+  recoverOperator();
+  while (operatorTask.next != &operatorTask)
+  {
+    freeTask(operatorTask.next);
+  }
+  endEvents();
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_TASK(void)
+{
+  initTasks();
+  Task *task = newTask();
+  if (task == NULL)
+  {
+    STACK_PUSH(sp, 0);
+    return;
+  }
+
+  if (runningTask == &operatorTask)
+  {
+    operatorTask.user = userArea;
+  }
+  task->user = task->userCells;
+  task->user[USER_BASE] = userArea[USER_BASE];
+  task->user[USER_STATE] = 0;
+  task->ip = taskEnd;
+  task->w = NULL;
+  task->sp = (Cell*) task->user[USER_S0];
+  task->rsp = (Cell*) task->user[USER_R0];
+  task->fsp = (Float*) task->user[USER_F0];
+  task->awake = 0;
+  task->wakeAt = 0;
+
+  task->next = runningTask->next;
+  runningTask->next = task;
+  STACK_PUSH(sp, task);
+} // fn_TASK
+
+//-----------------------------------------------------------------------------
+
+void fn_ACTIVATE(void)
+{
+  initTasks();
+  Task *task = (Task*) STACK_POP(sp);
+  CodeWord **rest = ip;
+
+  // Return from the definition, like EXIT.
+  ip = (CodeWord**) STACK_POP(rsp);
+  if (task == runningTask)
+  {
+    saveTask();
+  }
+
+  task->ip = rest;
+  task->sp = (Cell*) task->user[USER_S0];
+  task->rsp = (Cell*) task->user[USER_R0];
+  task->fsp = (Float*) task->user[USER_F0];
+  STACK_PUSH(task->rsp, taskEnd);
+  task->user[USER_STATE] = 0;
+  task->awake = 1;
+  task->wakeAt = 0;
+
+  if (task == runningTask)
+  {
+    loadTask(task);
+  }
+} // fn_ACTIVATE
+
+//-----------------------------------------------------------------------------
+
+void fn_PAUSE(void)
+{
+  initTasks();
+  switchTask();
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_STOP(void)
+{
+  initTasks();
+  if (runningTask != &operatorTask)
+  {
+    runningTask->awake = 0;
+  }
+  switchTask();
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_WAKE(void)
+{
+  Task *task = (Task*) STACK_POP(sp);
+  task->awake = 1;
+  task->wakeAt = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_FREE_TASK(void)
+{
+  initTasks();
+  Task *task = (Task*) STACK_POP(sp);
+  if (task == runningTask || task == &operatorTask)
+  {
+    raiseFault("FREE-TASK of the running task or the operator");
+  }
+  if (! freeTask(task))
+  {
+    raiseFault("FREE-TASK of a task that is not in the ring");
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_MSLEEP(void)
+{
+  initTasks();
+  Cell milliseconds = STACK_POP(sp);
+  if (operatorTask.next == &operatorTask && ! hasEvents())
+  {
+    sleepFor(milliseconds);
+    return;
+  }
+
+  runningTask->wakeAt = now() + ((milliseconds > 0) ? milliseconds : 0);
+  switchTask();
+}
+
+//-----------------------------------------------------------------------------
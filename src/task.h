@@ -0,0 +1,153 @@
+//-----------------------------------------------------------------------------
+// Tasks
+//
+// Cooperative multitasking in the classic Forth style.  Each task has its own
+// stacks and user area, and runs until it PAUSEs, STOPs or waits (in MSLEEP,
+// for terminal input or for an event; see event.h), when the next task that
+// is ready takes over.  The first task, the operator, runs QUIT and is never
+// stopped.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_TASK_H
+#define TOMOKO_TASK_H
+
+#include "types.h"
+
+//-----------------------------------------------------------------------------
+/**
+ * A task.
+ */
+typedef struct Task Task;
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the time, in milliseconds, on a clock that does not jump.
+ */
+extern long long now(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * Give the other tasks a chance to run until there is input to read from the
+ * file descriptor fd.  This is called before reading a line from the terminal.
+ * It returns straight away if there are no other tasks, or if the running
+ * task is not the operator.
+ */
+extern void waitForInput(int fd);
+
+//-----------------------------------------------------------------------------
+/**
+ * Make the operator the running task after a stack fault, stopping the task
+ * that faulted if it was another one.  The caller then restarts the operator
+ * in QUIT.
+ */
+extern void recoverOperator(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * Make the operator the running task, free the calling thread's other tasks
+ * and forget its operations and timers.  This is called when a server
+ * request ends, so that nothing it started runs during the next one.
+ */
+extern void endTasks(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * Return true if the calling thread has tasks other than the running task
+ * that are ready or will be, after an MSLEEP or an event, so that a word
+ * waiting for something another task does can PAUSE instead of blocking the
+ * thread.
+ */
+extern int hasTasks(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * Return the number of milliseconds until a task other than the running task
+ * is ready: 0 if one is ready now, or -1 if none will be without a WAKE or
+ * an event.
+ */
+extern int timeUntilOthersReady(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * Put the running task, even the operator, to sleep until resumeTask() wakes
+ * it, and return it.  The caller then PAUSEs.
+ */
+extern Task *suspendTask(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * Push the count cells of results onto task's parameter stack and wake it.
+ */
+extern void resumeTask(Task *task, const Cell *results, int count);
+
+//-----------------------------------------------------------------------------
+// Words.
+//-----------------------------------------------------------------------------
+/**
+ * TASK ( -- task )
+ *
+ * Create a task, with stacks of the sizes given on the command line and a
+ * copy of the running task's BASE.  The task is asleep until ACTIVATEd.
+ * Return 0 if there is not enough memory.
+ */
+extern void fn_TASK(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * ACTIVATE ( task -- )
+ *
+ * Used within a colon definition.  Make task run the rest of the definition,
+ * after ACTIVATE, from empty stacks, and wake it; then return from the
+ * definition.  If the task reaches the end of the definition, it stops.
+ *
+ *     : COUNTER ( task -- ) ACTIVATE 0 BEGIN 1+ PAUSE AGAIN ;
+ */
+extern void fn_ACTIVATE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * PAUSE ( -- )
+ *
+ * Let the other tasks that are ready run, round-robin, before continuing.
+ */
+extern void fn_PAUSE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * STOP ( -- )
+ *
+ * Put the running task to sleep until another task WAKEs it.  For the
+ * operator, STOP is the same as PAUSE.
+ */
+extern void fn_STOP(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * WAKE ( task -- )
+ *
+ * Wake task, so that it continues from where it STOPped (or MSLEEPs), the
+ * next time its turn comes.
+ */
+extern void fn_WAKE(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * FREE-TASK ( task -- )
+ *
+ * Take task out of the ring, whether or not it has ended, and free it, for
+ * TASK to reuse.  task must not be the running task or the operator, and
+ * must not be used again.
+ */
+extern void fn_FREE_TASK(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * MSLEEP ( n -- )
+ *
+ * Sleep for n milliseconds.  Other tasks run in the meantime.
+ */
+extern void fn_MSLEEP(void);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_TASK_H
@@ -0,0 +1,299 @@
+//-----------------------------------------------------------------------------
+// Threads
+//
+// A thread runs its word with executeWord(): EXECUTE, then a nested inner
+// interpreter loop that ends when the word returns to a native word that
+// stops the loop.  The thread has its own sigsetjmp() target, so a stack
+// fault ends the thread (with a message) instead of unwinding into another
+// thread.
+//
+// Threads' stacks are mapped once and reused: a JOINed thread's record, which
+// holds its stacks, goes on a spare list for the next THREAD.
+//-----------------------------------------------------------------------------
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "thread.h"
+#include "event.h"
+#include "machine.h"
+#include "native.h"
+#include "output.h"
+#include "task.h"
+
+//-----------------------------------------------------------------------------
+/**
+ * A thread started by THREAD.
+ */
+typedef struct Thread
+{
+  pthread_t id;              ///< The OS thread.
+  struct Thread *nextSpare;  ///< The next record in the spare list.
+  CodeWord *xt;              ///< The word the thread runs.
+  Cell argument;             ///< The cell on the thread's stack at the start.
+  Cell result;               ///< The cell on top of its stack at the end.
+  Cell userCells[USER_CELLS]; ///< The thread's user area.
+} Thread;
+
+/**
+ * Records of JOINed threads, with their stacks, kept for reuse.
+ */
+static Thread *spareThreads = NULL;
+
+/**
+ * Held while spareThreads is used.
+ */
+static pthread_mutex_t threadsLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The dictionary lock, and the number of times the calling thread holds it.
+ */
+static pthread_mutex_t dictionaryLock = PTHREAD_MUTEX_INITIALIZER;
+static __thread int dictionaryDepth = 0;
+
+/**
+ * Set when executeWord()'s word returns.
+ */
+static __thread int wordReturned;
+
+//-----------------------------------------------------------------------------
+
+void lockDictionary(void)
+{
+  if (dictionaryDepth++ == 0)
+  {
+    pthread_mutex_lock(&dictionaryLock);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void unlockDictionary(void)
+{
+  if (dictionaryDepth > 0 && --dictionaryDepth == 0)
+  {
+    pthread_mutex_unlock(&dictionaryLock);
+  }
+}
+
+//-----------------------------------------------------------------------------
+
+void dropDictionaryLock(void)
+{
+  if (dictionaryDepth > 0)
+  {
+    dictionaryDepth = 0;
+    pthread_mutex_unlock(&dictionaryLock);
+  }
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * The native word that ends executeWord()'s loop.
+ */
+static void endWord(void)
+{
+  wordReturned = 1;
+}
+
+static CodeWord endWordCodeWord = &endWord;
+
+/**
+ * A one-instruction thread for the word run by executeWord() to return to.
+ */
+static CodeWord *endWordThread[] = { &endWordCodeWord };
+
+//-----------------------------------------------------------------------------
+
+void executeWord(CodeWord *xt)
+{
+  CodeWord **caller = ip;
+  int callerReturned = wordReturned;
+  ip = endWordThread;
+  wordReturned = 0;
+
+  STACK_PUSH(sp, xt);
+  fn_EXECUTE();
+  while (! wordReturned)
+  {
+    NEXT();
+  }
+
+  ip = caller;
+  wordReturned = callerReturned;
+} // executeWord
+
+//-----------------------------------------------------------------------------
+
+void executeWordWithin(CodeWord *xt, UCell instructions, long long deadline)
+{
+  CodeWord **caller = ip;
+  int callerReturned = wordReturned;
+  ip = endWordThread;
+  wordReturned = 0;
+
+  STACK_PUSH(sp, xt);
+  fn_EXECUTE();
+  UCell count = 0;
+  while (! wordReturned)
+  {
+    NEXT();
+    ++count;
+    if (instructions != 0 && count >= instructions)
+    {
+      raiseFault("instruction budget exhausted");
+    }
+    // Reading the clock costs more than many instructions, so only look
+    // every so often.
+    if (deadline != 0 && (count % TOMOKO_CLOCK_INTERVAL) == 0
+        && now() >= deadline)
+    {
+      raiseFault("time budget exhausted");
+    }
+  }
+
+  ip = caller;
+  wordReturned = callerReturned;
+} // executeWordWithin
+
+//-----------------------------------------------------------------------------
+/**
+ * The start routine of a thread.
+ */
+static void *runThread(void *argument)
+{
+  Thread *thread = argument;
+  userArea = thread->userCells;
+  Cell *s0 = (Cell*) userArea[USER_S0];
+  sp = s0;
+  rsp = (Cell*) userArea[USER_R0];
+  fsp = (Float*) userArea[USER_F0];
+  STACK_PUSH(sp, thread->argument);
+
+  if (sigsetjmp(stackFaultRecovery, 1) == 0)
+  {
+    executeWord(thread->xt);
+    thread->result = (sp < s0) ? *sp : 0;
+  }
+  else
+  {
+    dropDictionaryLock();
+    flushOutput();
+    fprintf(stderr, "thread: %s\n", stackFault);
+    thread->result = 0;
+  }
+  endEvents();
+  flushOutput();
+  return NULL;
+} // runThread
+
+//-----------------------------------------------------------------------------
+/**
+ * Return a thread record with stacks, or NULL if there is not enough memory.
+ */
+static Thread *newThread(void)
+{
+  pthread_mutex_lock(&threadsLock);
+  Thread *thread = spareThreads;
+  if (thread != NULL)
+  {
+    spareThreads = thread->nextSpare;
+  }
+  pthread_mutex_unlock(&threadsLock);
+  if (thread != NULL)
+  {
+    return thread;
+  }
+
+  thread = malloc(sizeof (Thread));
+  Cell *s0 = mapStack(parameterStackCells, 1);
+  Cell *r0 = mapStack(returnStackCells, 0);
+  Float *f0 = mapFloatStack(floatStackFloats);
+  if (thread == NULL || s0 == NULL || r0 == NULL || f0 == NULL)
+  {
+    free(thread);
+    unmapStack(s0);
+    unmapStack(r0);
+    unmapStack(f0);
+    return NULL;
+  }
+  thread->userCells[USER_S0] = (Cell) s0;
+  thread->userCells[USER_R0] = (Cell) r0;
+  thread->userCells[USER_F0] = (Cell) f0;
+  return thread;
+} // newThread
+
+//-----------------------------------------------------------------------------
+/**
+ * Put a finished thread's record on the spare list.
+ */
+static void spareThread(Thread *thread)
+{
+  pthread_mutex_lock(&threadsLock);
+  thread->nextSpare = spareThreads;
+  spareThreads = thread;
+  pthread_mutex_unlock(&threadsLock);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_THREAD(void)
+{
+  CodeWord *xt = (CodeWord*) STACK_POP(sp);
+  Cell argument = STACK_POP(sp);
+  Thread *thread = newThread();
+  if (thread == NULL)
+  {
+    STACK_PUSH(sp, 0);
+    return;
+  }
+
+  thread->xt = xt;
+  thread->argument = argument;
+  thread->result = 0;
+  thread->userCells[USER_BASE] = userArea[USER_BASE];
+  thread->userCells[USER_STATE] = 0;
+  if (pthread_create(&thread->id, NULL, runThread, thread) != 0)
+  {
+    spareThread(thread);
+    STACK_PUSH(sp, 0);
+    return;
+  }
+  STACK_PUSH(sp, thread);
+} // fn_THREAD
+
+//-----------------------------------------------------------------------------
+
+void fn_JOIN(void)
+{
+  Thread *thread = (Thread*) STACK_POP(sp);
+  pthread_join(thread->id, NULL);
+  STACK_PUSH(sp, thread->result);
+  spareThread(thread);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_CPUS(void)
+{
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  STACK_PUSH(sp, (count > 0) ? count : 1);
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_LOCK_DICTIONARY(void)
+{
+  lockDictionary();
+}
+
+//-----------------------------------------------------------------------------
+
+void fn_UNLOCK_DICTIONARY(void)
+{
+  unlockDictionary();
+}
+
+//-----------------------------------------------------------------------------
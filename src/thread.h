@@ -0,0 +1,117 @@
+//-----------------------------------------------------------------------------
+// Threads
+//
+// OS threads that run Forth words in parallel, on as many cores as there
+// are.  Each thread has its own registers, stacks, user area (BASE, STATE, S0
+// and R0), output buffer and ring of tasks; all threads share the dictionary
+// and the heap.  Dictionary writes (through HERE and LATEST) are serialized
+// by the dictionary lock.
+//
+// A thread should not read input, use blocks or compile whole definitions
+// while another thread does so: those share state that is not locked.
+//-----------------------------------------------------------------------------
+
+#ifndef TOMOKO_THREAD_H
+#define TOMOKO_THREAD_H
+
+#include "types.h"
+
+//-----------------------------------------------------------------------------
+/**
+ * Acquire the dictionary lock, which a thread may hold more than once.  This
+ * is the native implementation behind LOCK-DICTIONARY.
+ */
+extern void lockDictionary(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * Release the dictionary lock once.  This is the native implementation
+ * behind UNLOCK-DICTIONARY.
+ */
+extern void unlockDictionary(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * Release the dictionary lock completely, if the calling thread holds it.
+ * This is called after a stack fault, which may have interrupted a word
+ * between LOCK-DICTIONARY and UNLOCK-DICTIONARY.
+ */
+extern void dropDictionaryLock(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * How many instructions executeWordWithin() runs between looks at the clock.
+ */
+#define TOMOKO_CLOCK_INTERVAL 4096
+
+//-----------------------------------------------------------------------------
+/**
+ * EXECUTE the word xt from native code, running the inner interpreter until
+ * it returns, and then restore ip.  Its stack effect is xt's.
+ */
+extern void executeWord(CodeWord *xt);
+
+//-----------------------------------------------------------------------------
+/**
+ * executeWord() with a budget: stop xt with a fault, as a stack fault stops
+ * it (see stackFault in machine.h), once the inner interpreter has run
+ * instructions instructions, or once now() (see task.h) reaches deadline.
+ * Either limit may be 0 for none.  Words run by nested executeWord() calls,
+ * such as PAR-DO's, are not counted.
+ */
+extern void executeWordWithin(CodeWord *xt, UCell instructions,
+                              long long deadline);
+
+//-----------------------------------------------------------------------------
+// Words.
+//-----------------------------------------------------------------------------
+/**
+ * THREAD ( x xt -- thread )
+ *
+ * Start an OS thread that EXECUTEs xt with x alone on its parameter stack.
+ * The thread's stacks are the sizes given on the command line, and it starts
+ * with a copy of the running task's BASE.  Return 0 if the thread could not
+ * be started.
+ */
+extern void fn_THREAD(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * JOIN ( thread -- x )
+ *
+ * Wait for thread to finish and return the top of its parameter stack (or 0
+ * if the stack was empty, or the thread ended with a stack fault).  Each
+ * thread must be JOINed exactly once, which frees it.
+ */
+extern void fn_JOIN(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * CPUS ( -- n )
+ *
+ * Return the number of processors online.
+ */
+extern void fn_CPUS(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * LOCK-DICTIONARY ( -- )
+ *
+ * Acquire the dictionary lock, waiting while another thread holds it.  ALLOT
+ * , C, and CREATE hold it while they update HERE and LATEST; a thread holds
+ * it around longer sequences of dictionary writes that must not interleave
+ * with other threads'.
+ */
+extern void fn_LOCK_DICTIONARY(void);
+
+//-----------------------------------------------------------------------------
+/**
+ * UNLOCK-DICTIONARY ( -- )
+ *
+ * Release the dictionary lock, once for each LOCK-DICTIONARY.
+ */
+extern void fn_UNLOCK_DICTIONARY(void);
+
+//-----------------------------------------------------------------------------
+
+#endif // TOMOKO_THREAD_H
@@ -14,11 +14,15 @@
 //
 //-----------------------------------------------------------------------------
 
+#include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "dictionary.h"
 #include "machine.h"
 #include "input.h"
+#include "output.h"
 
 //-----------------------------------------------------------------------------
 // Built-In Constants.
@@ -32,12 +36,13 @@
 
 extern void fn_DOCOL(void);
 extern void fn_DODOES(void);
+extern void fn_R0(void);
 
 DEF_CONST(NULL,              VERSION,     "VERSION",     100);       // 0.01.00
 DEF_CONST(LINK(VERSION),     CELL,        "CELL",        sizeof (Cell));
 DEF_CONST(LINK(CELL),        CELL_1,      "CELL-1",      sizeof (Cell) - 1);
 DEF_CONST(LINK(CELL_1),      CELLMASK,    "CELLMASK",    ~(sizeof (Cell) - 1));
-DEF_CONST(LINK(CELLMASK),    R0,          "R0",          (Cell)(&returnStack[RETURN_STACK_CELLS]));
+DEF_CODE(LINK(CELLMASK),     R0,          "R0",          0);
 DEF_CONST(LINK(R0),          DOCOL,       "DOCOL",       (Cell)(&fn_DOCOL));
 DEF_CONST(LINK(DOCOL),       DODOES,      "DODOES",      (Cell)(&fn_DODOES));
 DEF_CONST(LINK(DODOES),      F_IMMED,     "F_IMMED",     IMMEDIATE_BIT);
@@ -49,23 +54,19 @@ DEF_CONST(LINK(ONE),         BL,          "BL",          ' '); // A space.
 DEF_CONST_STRING(LINK(BL),   QUITPROMPT,  "QUITPROMPT",  "ok "); // Prompt from QUIT.
 
 //-----------------------------------------------------------------------------
-// These constants define Linux system calls and related flags.
-// TODO: Actually make syscalls work.
+// These constants are the numbers of the Linux system calls, SYS_READ and so
+// on, for the target ABI.  syscalls.h is generated from <sys/syscall.h> by the
+// Makefile, as a chain of DEF_CONST()s after SYSCALLS_AFTER that ends with
+// LAST_SYSCALL.
 
-//#include <asm-i386/unistd.h>	// you might need this instead
-#include <asm/unistd.h>
+#include <sys/syscall.h>
 
-DEF_CONST(LINK(QUITPROMPT),  SYS_EXIT,    "SYS_EXIT",    __NR_exit);
-DEF_CONST(LINK(SYS_EXIT),    SYS_OPEN,    "SYS_OPEN",    __NR_open);
-DEF_CONST(LINK(SYS_OPEN),    SYS_CLOSE,   "SYS_CLOSE",   __NR_close);
-DEF_CONST(LINK(SYS_CLOSE),   SYS_READ,    "SYS_READ",    __NR_read);
-DEF_CONST(LINK(SYS_READ),    SYS_WRITE,   "SYS_WRITE",   __NR_write);
-DEF_CONST(LINK(SYS_WRITE),   SYS_CREAT,   "SYS_CREAT",   __NR_creat);
-DEF_CONST(LINK(SYS_CREAT),   SYS_BRK,     "SYS_BRK",     __NR_brk);
+#define SYSCALLS_AFTER QUITPROMPT
+#include "syscalls.h"
 
 // These constants lifed from /usr/include/asm-generic/fcntl.h. Duplicated since
 // they are #defined there and JonesForth needs these names.
-DEF_CONST(LINK(SYS_BRK),     O_RDONLY,    "O_RDONLY",    00000000);
+DEF_CONST(LINK(LAST_SYSCALL), O_RDONLY,    "O_RDONLY",    00000000);
 DEF_CONST(LINK(O_RDONLY),    O_WRONLY,    "O_WRONLY",    00000001);
 DEF_CONST(LINK(O_WRONLY),    O_RDWR,      "O_RDWR",      00000002);
 DEF_CONST(LINK(O_RDWR),      O_CREAT,     "O_CREAT",     00000100);
@@ -84,21 +85,50 @@ DEF_CONST(LINK(O_APPEND),    O_NONBLOCK,  "O_NONBLOCK",  00004000);
 //
 // If CASE-SENSITIVE is TRUE, dictionary lookups are case sensitive.  Otherwise
 // they are not.
+//
+// Output is flushed to stdout whenever OUTPUT-THRESHOLD or more characters are
+// buffered.  Set it to 1 to flush after every character.
+//
+// STATE, S0 and BASE are user variables: each task has its own (see task.h).
 
 DEF_VAR(LINK(O_NONBLOCK),    PIFA,        "^IFA",        0); // Address of IFA.
-DEF_VAR(LINK(PIFA),          STATE,       "STATE",       0); // True if compiling.
+DEF_USER(LINK(PIFA),         STATE,       "STATE",       USER_STATE);
 DEF_VAR(LINK(STATE),         LATEST,      "LATEST",      0); // Set in main().
 DEF_VAR(LINK(LATEST),        HERE,        "HERE",       (Cell)(&dictionary[0]));
-DEF_VAR(LINK(HERE),          S0,          "S0",         (Cell)(&parameterStack[PARAMETER_STACK_CELLS]));
-DEF_VAR(LINK(S0),            BASE,        "BASE",       10);
+DEF_USER(LINK(HERE),         S0,          "S0",          USER_S0);
+DEF_USER(LINK(S0),           BASE,        "BASE",        USER_BASE);
 DEF_VAR(LINK(BASE),          CASE_SENSITIVE, "CASE-SENSITIVE", 1);
+DEF_VAR(LINK(CASE_SENSITIVE), OUTPUT_THRESHOLD, "OUTPUT-THRESHOLD", TOMOKO_OUTPUT_MAX);
+DEF_VAR(LINK(OUTPUT_THRESHOLD), BLK,      "BLK",         0); // Block being LOADed.
+DEF_VAR(LINK(BLK),           BLOCK_HITS,  "BLOCK-HITS",  0);
+DEF_VAR(LINK(BLOCK_HITS),    BLOCK_MISSES, "BLOCK-MISSES", 0);
+DEF_VAR(LINK(BLOCK_MISSES),  BLOCK_READS, "BLOCK-READS", 0); // Blocks read.
+DEF_VAR(LINK(BLOCK_READS),   BLOCK_WRITES, "BLOCK-WRITES", 0); // Blocks written.
+DEF_VAR(LINK(BLOCK_WRITES),  PAR_GRAIN,   "PAR-GRAIN",   0); // 0 = automatic.
 
 //-----------------------------------------------------------------------------
 // Native Words.
 
 #include "native.h"
-
-DEF_CODE(LINK(CASE_SENSITIVE), EXIT,      "EXIT",        0);
+#include "cells.h"
+#include "heap.h"
+#include "arena.h"
+#include "mapfile.h"
+#include "block.h"
+#include "task.h"
+#include "thread.h"
+#include "par.h"
+#include "channel.h"
+#include "event.h"
+#include "serve.h"
+#include "ffi.h"
+#include "file.h"
+#include "floating.h"
+#include "loop.h"
+#include "case.h"
+#include "batch.h"
+
+DEF_CODE(LINK(PAR_GRAIN),    EXIT,      "EXIT",        0);
 DEF_CODE(LINK(EXIT),         BRANCH,      "BRANCH",      0);
 DEF_CODE(LINK(BRANCH),       ZBRANCH,     "0BRANCH",     0);
 DEF_CODE(LINK(ZBRANCH),      LIT,         "LIT",         0);
@@ -113,7 +143,10 @@ DEF_CODE(LINK(HALT),         SYSCALL0,    "SYSCALL0",    0);
 DEF_CODE(LINK(SYSCALL0),     SYSCALL1,    "SYSCALL1",    0);
 DEF_CODE(LINK(SYSCALL1),     SYSCALL2,    "SYSCALL2",    0);
 DEF_CODE(LINK(SYSCALL2),     SYSCALL3,    "SYSCALL3",    0);
-DEF_CODE(LINK(SYSCALL3),     FIND,        "FIND",        0);
+DEF_CODE(LINK(SYSCALL3),     SYSCALL4,    "SYSCALL4",    0);
+DEF_CODE(LINK(SYSCALL4),     SYSCALL5,    "SYSCALL5",    0);
+DEF_CODE(LINK(SYSCALL5),     SYSCALL6,    "SYSCALL6",    0);
+DEF_CODE(LINK(SYSCALL6),     FIND,        "FIND",        0);
 DEF_CODE(LINK(FIND),         DROP,        "DROP",        0);
 DEF_CODE(LINK(DROP),         SWAP,        "SWAP",        0);
 DEF_CODE(LINK(SWAP),         DUP,         "DUP",         0);
@@ -134,7 +167,9 @@ DEF_CODE(LINK(TOR),          FROMR,       "R>",          0);
 DEF_CODE(LINK(FROMR),        RSPFETCH,    "RSP@",        0);
 DEF_CODE(LINK(RSPFETCH),     RSPSTORE,    "RSP!",        0);
 DEF_CODE(LINK(RSPSTORE),     RDROP,       "RDROP",       0);
-DEF_CODE(LINK(RDROP),        INCR,        "1+",          0);
+DEF_CODE(LINK(RDROP),        DTOR,        "2>R",         0);
+DEF_CODE(LINK(DTOR),         DFROMR,      "2R>",         0);
+DEF_CODE(LINK(DFROMR),       INCR,        "1+",          0);
 DEF_CODE(LINK(INCR),         DECR,        "1-",          0);
 DEF_NATIVE(LINK(DECR),       FOURPLUS,  fn_CELLPLUS,  "4+", 0);
 DEF_NATIVE(LINK(FOURPLUS),   FOURMINUS, fn_CELLMINUS, "4-", 0);
@@ -147,7 +182,19 @@ DEF_CODE(LINK(MUL),          DIV,         "/",           0);
 DEF_CODE(LINK(DIV),          MOD,         "MOD",         0);
 DEF_CODE(LINK(MOD),          NEGATE,      "NEGATE",      0);
 DEF_CODE(LINK(NEGATE),       DIVMOD,      "/MOD",        0);
-DEF_CODE(LINK(DIVMOD),       EQ,          "=",           0);
+DEF_CODE(LINK(DIVMOD),       MSTAR,       "M*",          0);
+DEF_CODE(LINK(MSTAR),        UMSTAR,      "UM*",         0);
+DEF_CODE(LINK(UMSTAR),       UMDIVMOD,    "UM/MOD",      0);
+DEF_CODE(LINK(UMDIVMOD),     SMDIVREM,    "SM/REM",      0);
+DEF_CODE(LINK(SMDIVREM),     FMDIVMOD,    "FM/MOD",      0);
+DEF_CODE(LINK(FMDIVMOD),     STARSLASH,   "*/",          0);
+DEF_CODE(LINK(STARSLASH),    STARSLASHMOD, "*/MOD",      0);
+DEF_CODE(LINK(STARSLASHMOD), DADD,        "D+",          0);
+DEF_CODE(LINK(DADD),         DSUB,        "D-",          0);
+DEF_CODE(LINK(DSUB),         DNEGATE,     "DNEGATE",     0);
+DEF_CODE(LINK(DNEGATE),      DLT,         "D<",          0);
+DEF_CODE(LINK(DLT),          DEQ,         "D=",          0);
+DEF_CODE(LINK(DEQ),          EQ,          "=",           0);
 DEF_CODE(LINK(EQ),           NE,          "<>",          0);
 DEF_CODE(LINK(NE),           LT,          "<",           0);
 DEF_CODE(LINK(LT),           GT,          ">",           0);
@@ -170,18 +217,172 @@ DEF_CODE(LINK(PLUSSTORE),    MINUSSTORE,  "-!",          0);
 DEF_CODE(LINK(MINUSSTORE),   CSTORE,      "C!",          0);
 DEF_CODE(LINK(CSTORE),       CFETCH,      "C@",          0);
 DEF_CODE(LINK(CFETCH),       CCOPY,       "C@C!",        0);
-DEF_CODE(LINK(CCOPY),        CMOVE,       "CMOVE",       0);
-DEF_CODE(LINK(CMOVE),        FILL,        "FILL",        0);
-DEF_CODE(LINK(FILL),         WS,          "WS?",         0);
+DEF_CODE(LINK(CCOPY),        DSTORE,      "2!",          0);
+DEF_CODE(LINK(DSTORE),       DFETCH,      "2@",          0);
+DEF_CODE(LINK(DFETCH),       CMOVE,       "CMOVE",       0);
+DEF_CODE(LINK(CMOVE),        CMOVEUP,     "CMOVE>",      0);
+DEF_CODE(LINK(CMOVEUP),      MOVE,        "MOVE",        0);
+DEF_CODE(LINK(MOVE),         FILL,        "FILL",        0);
+DEF_CODE(LINK(FILL),         ERASE,       "ERASE",       0);
+DEF_CODE(LINK(ERASE),        COMPARE,     "COMPARE",     0);
+DEF_CODE(LINK(COMPARE),      CELLS_SUM,   "CELLS-SUM",   0);
+DEF_CODE(LINK(CELLS_SUM),    CELLS_MAX,   "CELLS-MAX",   0);
+DEF_CODE(LINK(CELLS_MAX),    CELLS_MIN,   "CELLS-MIN",   0);
+DEF_CODE(LINK(CELLS_MIN),    CELLS_ADD,   "CELLS-ADD",   0);
+DEF_CODE(LINK(CELLS_ADD),    CELLS_SCALE, "CELLS-SCALE", 0);
+DEF_CODE(LINK(CELLS_SCALE),  CELLS_DOT,   "CELLS-DOT",   0);
+DEF_CODE(LINK(CELLS_DOT),    CELLS_FIND,  "CELLS-FIND",  0);
+DEF_CODE(LINK(CELLS_FIND),   CELLS_COUNT, "CELLS-COUNT", 0);
+DEF_CODE(LINK(CELLS_COUNT),  ALLOCATE,    "ALLOCATE",    0);
+DEF_CODE(LINK(ALLOCATE),     FREE,        "FREE",        0);
+DEF_CODE(LINK(FREE),         RESIZE,      "RESIZE",      0);
+DEF_CODE(LINK(RESIZE),       HEAP_STATS,  "HEAP-STATS",  0);
+DEF_CODE(LINK(HEAP_STATS),   ARENA_NEW,   "ARENA-NEW",   0);
+DEF_CODE(LINK(ARENA_NEW),    ARENA_ALLOT, "ARENA-ALLOT", 0);
+DEF_CODE(LINK(ARENA_ALLOT),  ARENA_MARK,  "ARENA-MARK",  0);
+DEF_CODE(LINK(ARENA_MARK),   ARENA_RELEASE, "ARENA-RELEASE", 0);
+DEF_CODE(LINK(ARENA_RELEASE), ARENA_FREE, "ARENA-FREE",  0);
+DEF_CODE(LINK(ARENA_FREE),   WITH_ARENA,  "WITH-ARENA",  0);
+DEF_CODE(LINK(WITH_ARENA),   END_ARENA,   "END-ARENA",   0);
+DEF_CODE(LINK(END_ARENA),    AALLOT,      "AALLOT",      0);
+DEF_CODE(LINK(AALLOT),       ACOMMA,      "A,",          0);
+DEF_CODE(LINK(ACOMMA),       MAP_FILE,    "MAP-FILE",    0);
+DEF_CODE(LINK(MAP_FILE),     MAP_FILE_AT, "MAP-FILE-AT", 0);
+DEF_CODE(LINK(MAP_FILE_AT),  UNMAP_FILE,  "UNMAP-FILE",  0);
+DEF_CODE(LINK(UNMAP_FILE),   SYNC_FILE,   "SYNC-FILE",   0);
+DEF_CODE(LINK(SYNC_FILE),    SEQUENTIAL,  "SEQUENTIAL",  0);
+DEF_CODE(LINK(SEQUENTIAL),   WILLNEED,    "WILLNEED",    0);
+DEF_CODE(LINK(WILLNEED),     WS,          "WS?",         0);
 DEF_CODE(LINK(WS),           KEY,         "KEY",         0);
 DEF_CODE(LINK(KEY),          WORD,        "WORD",        0);
 DEF_CODE(LINK(WORD),         XNUMBERIN,   ">NUMBERIN",   0);
 DEF_CODE(LINK(XNUMBERIN),    NUMBERIN,    "NUMBERIN",    0);
 DEF_CODE(LINK(NUMBERIN),     INIT,        "INIT",        0);
-DEF_CODE(LINK(INIT),         EMIT,        "EMIT",        0);
+DEF_CODE(LINK(INIT),         STRINGSOURCE, "STRING-SOURCE", 0);
+DEF_CODE(LINK(STRINGSOURCE), BLOCKSOURCE, "BLOCK-SOURCE", 0);
+DEF_CODE(LINK(BLOCKSOURCE),  SOURCEMORE,  "SOURCE-MORE?", 0);
+DEF_CODE(LINK(SOURCEMORE),   SOURCE_ID,   "SOURCE-ID",   0);
+DEF_CODE(LINK(SOURCE_ID),    TOIN,        ">IN",         0);
+DEF_CODE(LINK(TOIN),         SAVE_INPUT,  "SAVE-INPUT",  0);
+DEF_CODE(LINK(SAVE_INPUT),   RESTORE_INPUT, "RESTORE-INPUT", 0);
+DEF_CODE(LINK(RESTORE_INPUT), EMIT,       "EMIT",        0);
 DEF_CODE(LINK(EMIT),         TELL,        "TELL",        0);
 DEF_CODE(LINK(TELL),         DOT,         ".",           0);
-DEF_CODE(LINK(DOT),          MSLEEP,      "MSLEEP",      0);
+DEF_CODE(LINK(DOT),          UDOT,        "U.",          0);
+DEF_CODE(LINK(UDOT),         DDOT,        "D.",          0);
+DEF_CODE(LINK(DDOT),         DOTR,        ".R",          0);
+DEF_CODE(LINK(DOTR),         UDOTR,       "U.R",         0);
+DEF_CODE(LINK(UDOTR),        UWIDTH,      "UWIDTH",      0);
+DEF_CODE(LINK(UWIDTH),       DOT_S,       ".S",          0);
+DEF_CODE(LINK(DOT_S),        SPACES,      "SPACES",      0);
+DEF_CODE(LINK(SPACES),       LESSNUM,     "<#",          0);
+DEF_CODE(LINK(LESSNUM),      NUM,         "#",           0);
+DEF_CODE(LINK(NUM),          NUMS,        "#S",          0);
+DEF_CODE(LINK(NUMS),         HOLD,        "HOLD",        0);
+DEF_CODE(LINK(HOLD),         SIGN,        "SIGN",        0);
+DEF_CODE(LINK(SIGN),         NUMGREATER,  "#>",          0);
+DEF_CODE(LINK(NUMGREATER),   FLUSH_OUTPUT, "FLUSH-OUTPUT", 0);
+DEF_CODE(LINK(FLUSH_OUTPUT), BLOCK_FILE,  "BLOCK-FILE",  0);
+DEF_CODE(LINK(BLOCK_FILE),   BLOCK,       "BLOCK",       0);
+DEF_CODE(LINK(BLOCK),        BUFFER,      "BUFFER",      0);
+DEF_CODE(LINK(BUFFER),       UPDATE,      "UPDATE",      0);
+DEF_CODE(LINK(UPDATE),       SAVE_BUFFERS, "SAVE-BUFFERS", 0);
+DEF_CODE(LINK(SAVE_BUFFERS), EMPTY_BUFFERS, "EMPTY-BUFFERS", 0);
+DEF_CODE(LINK(EMPTY_BUFFERS), FLUSH,      "FLUSH",       0);
+DEF_CODE(LINK(FLUSH),        MSLEEP,      "MSLEEP",      0);
+DEF_CODE(LINK(MSLEEP),       TASK,        "TASK",        0);
+DEF_CODE(LINK(TASK),         ACTIVATE,    "ACTIVATE",    0);
+DEF_CODE(LINK(ACTIVATE),     PAUSE,       "PAUSE",       0);
+DEF_CODE(LINK(PAUSE),        STOP,        "STOP",        0);
+DEF_CODE(LINK(STOP),         WAKE,        "WAKE",        0);
+DEF_CODE(LINK(WAKE),         FREE_TASK,   "FREE-TASK",   0);
+DEF_CODE(LINK(FREE_TASK),    THREAD,      "THREAD",      0);
+DEF_CODE(LINK(THREAD),       JOIN,        "JOIN",        0);
+DEF_CODE(LINK(JOIN),         CPUS,        "CPUS",        0);
+DEF_CODE(LINK(CPUS),         LOCK_DICTIONARY, "LOCK-DICTIONARY", 0);
+DEF_CODE(LINK(LOCK_DICTIONARY), UNLOCK_DICTIONARY, "UNLOCK-DICTIONARY", 0);
+DEF_CODE(LINK(UNLOCK_DICTIONARY), PAR_DO,  "PAR-DO",      0);
+DEF_CODE(LINK(PAR_DO),       PAR_MAP,     "PAR-MAP",     0);
+DEF_CODE(LINK(PAR_MAP),      PAR_REDUCE,  "PAR-REDUCE",  0);
+DEF_CODE(LINK(PAR_REDUCE),   CHANNEL,     "CHANNEL",     0);
+DEF_CODE(LINK(CHANNEL),      SPSC_CHANNEL, "SPSC-CHANNEL", 0);
+DEF_CODE(LINK(SPSC_CHANNEL), SEND,        "SEND",        0);
+DEF_CODE(LINK(SEND),         RECV,        "RECV",        0);
+DEF_CODE(LINK(RECV),         TRY_SEND,    "TRY-SEND",    0);
+DEF_CODE(LINK(TRY_SEND),     TRY_RECV,    "TRY-RECV",    0);
+DEF_CODE(LINK(TRY_RECV),     SEND_N,      "SEND-N",      0);
+DEF_CODE(LINK(SEND_N),       RECV_N,      "RECV-N",      0);
+DEF_CODE(LINK(RECV_N),       ASYNC_READ,  "ASYNC-READ",  0);
+DEF_CODE(LINK(ASYNC_READ),   ASYNC_WRITE, "ASYNC-WRITE", 0);
+DEF_CODE(LINK(ASYNC_WRITE),  TIMER_AFTER, "TIMER-AFTER", 0);
+DEF_CODE(LINK(TIMER_AFTER),  LIBRARY,     "LIBRARY",     0);
+DEF_CODE(LINK(LIBRARY),      FUNCTION_COLON, "FUNCTION:", 0);
+DEF_CONST(LINK(FUNCTION_COLON), R_O,      "R/O",         00000000); // O_RDONLY
+DEF_CONST(LINK(R_O),         W_O,         "W/O",         00000001); // O_WRONLY
+DEF_CONST(LINK(W_O),         R_W,         "R/W",         00000002); // O_RDWR
+DEF_CODE(LINK(R_W),          BIN,         "BIN",         0);
+DEF_CODE(LINK(BIN),          OPEN_FILE,   "OPEN-FILE",   0);
+DEF_CODE(LINK(OPEN_FILE),    CREATE_FILE, "CREATE-FILE", 0);
+DEF_CODE(LINK(CREATE_FILE),  CLOSE_FILE,  "CLOSE-FILE",  0);
+DEF_CODE(LINK(CLOSE_FILE),   READ_FILE,   "READ-FILE",   0);
+DEF_CODE(LINK(READ_FILE),    READ_LINE,   "READ-LINE",   0);
+DEF_CODE(LINK(READ_LINE),    NEXT_LINE,   "NEXT-LINE",   0);
+DEF_CODE(LINK(NEXT_LINE),    WRITE_FILE,  "WRITE-FILE",  0);
+DEF_CODE(LINK(WRITE_FILE),   WRITE_LINE,  "WRITE-LINE",  0);
+DEF_CODE(LINK(WRITE_LINE),   FILE_SIZE,   "FILE-SIZE",   0);
+DEF_CODE(LINK(FILE_SIZE),    FILE_POSITION, "FILE-POSITION", 0);
+DEF_CODE(LINK(FILE_POSITION), REPOSITION_FILE, "REPOSITION-FILE", 0);
+DEF_CODE(LINK(REPOSITION_FILE), FDROP,    "FDROP",       0);
+DEF_CODE(LINK(FDROP),        FDUP,        "FDUP",        0);
+DEF_CODE(LINK(FDUP),         FSWAP,       "FSWAP",       0);
+DEF_CODE(LINK(FSWAP),        FOVER,       "FOVER",       0);
+DEF_CODE(LINK(FOVER),        FDEPTH,      "FDEPTH",      0);
+DEF_CODE(LINK(FDEPTH),       FFETCH,      "F@",          0);
+DEF_CODE(LINK(FFETCH),       FSTORE,      "F!",          0);
+DEF_CODE(LINK(FSTORE),       FLOATS,      "FLOATS",      0);
+DEF_CODE(LINK(FLOATS),       FLOATPLUS,   "FLOAT+",      0);
+DEF_CODE(LINK(FLOATPLUS),    FADD,        "F+",          0);
+DEF_CODE(LINK(FADD),         FSUB,        "F-",          0);
+DEF_CODE(LINK(FSUB),         FMUL,        "F*",          0);
+DEF_CODE(LINK(FMUL),         FDIV,        "F/",          0);
+DEF_CODE(LINK(FDIV),         FNEGATE,     "FNEGATE",     0);
+DEF_CODE(LINK(FNEGATE),      FSQRT,       "FSQRT",       0);
+DEF_CODE(LINK(FSQRT),        FEXP,        "FEXP",        0);
+DEF_CODE(LINK(FEXP),         FLN,         "FLN",         0);
+DEF_CODE(LINK(FLN),          FLT,         "F<",          0);
+DEF_CODE(LINK(FLT),          FEQ0,        "F0=",         0);
+DEF_CODE(LINK(FEQ0),         FLT0,        "F0<",         0);
+DEF_CODE(LINK(FLT0),         DTOF,        "D>F",         0);
+DEF_CODE(LINK(DTOF),         FTOD,        "F>D",         0);
+DEF_CODE(LINK(FTOD),         F_SUM,       "F-SUM",       0);
+DEF_CODE(LINK(F_SUM),        F_DOT,       "F-DOT",       0);
+DEF_CODE(LINK(F_DOT),        TOFLOAT,     ">FLOAT",      0);
+DEF_CODE(LINK(TOFLOAT),      TOFLOAT_LITERAL, ">FLOAT-LITERAL", 0);
+DEF_CODE(LINK(TOFLOAT_LITERAL), FLIT,     "FLIT",        0);
+DEF_CODE(LINK(FLIT),         FLITERAL,    "FLITERAL",    IMMEDIATE_BIT);
+DEF_CODE(LINK(FLITERAL),     FDOT,        "F.",          0);
+DEF_CODE(LINK(FDOT),         PDO,         "(DO)",        0);
+DEF_CODE(LINK(PDO),          PQDO,        "(?DO)",       0);
+DEF_CODE(LINK(PQDO),         PLOOP,       "(LOOP)",      0);
+DEF_CODE(LINK(PLOOP),        PPLUSLOOP,   "(+LOOP)",     0);
+DEF_CODE(LINK(PPLUSLOOP),    PLEAVE,      "(LEAVE)",     0);
+DEF_CODE(LINK(PLEAVE),       LOOP_I,      "I",           0);
+DEF_CODE(LINK(LOOP_I),       LOOP_J,      "J",           0);
+DEF_CODE(LINK(LOOP_J),       UNLOOP,      "UNLOOP",      0);
+DEF_CODE(LINK(UNLOOP),       DO,          "DO",          IMMEDIATE_BIT);
+DEF_CODE(LINK(DO),           QDO,         "?DO",         IMMEDIATE_BIT);
+DEF_CODE(LINK(QDO),          LOOP,        "LOOP",        IMMEDIATE_BIT);
+DEF_CODE(LINK(LOOP),         PLUSLOOP,    "+LOOP",       IMMEDIATE_BIT);
+DEF_CODE(LINK(PLUSLOOP),     LEAVE,       "LEAVE",       IMMEDIATE_BIT);
+DEF_CODE(LINK(LEAVE),        POF,         "(OF)",        0);
+DEF_CODE(LINK(POF),          PLITOF,      "(LIT-OF)",    0);
+DEF_CODE(LINK(PLITOF),       PTABLEOF,    "(TABLE-OF)",  0);
+DEF_CODE(LINK(PTABLEOF),     PSEARCHOF,   "(SEARCH-OF)", 0);
+DEF_CODE(LINK(PSEARCHOF),    PENDCASE,    "(ENDCASE)",   0);
+DEF_CODE(LINK(PENDCASE),     CASE,        "CASE",        IMMEDIATE_BIT);
+DEF_CODE(LINK(CASE),         OF,          "OF",          IMMEDIATE_BIT);
+DEF_CODE(LINK(OF),           ENDOF,       "ENDOF",       IMMEDIATE_BIT);
+DEF_CODE(LINK(ENDOF),        ENDCASE,     "ENDCASE",     IMMEDIATE_BIT);
 
 //-----------------------------------------------------------------------------
 // String literals as inline code in hand-compiled Forth.
@@ -196,7 +397,7 @@ DEF_CODE(LINK(DOT),          MSLEEP,      "MSLEEP",      0);
  * 
  * For compatibility with the JonesForth number input routine.
  */
-BEGIN_COLON(LINK(MSLEEP), NUMBER, "NUMBER", 0, 5)
+BEGIN_COLON(LINK(ENDCASE), NUMBER, "NUMBER", 0, 5)
   XT(BASE), XT(FETCH),              // ( addr len base ) Set up to call NUMBERIN.
   XT(NUMBERIN),                     // ( n addr2 len2 )
   XT(SWAP), XT(DROP),               // ( n len2 )
@@ -263,36 +464,6 @@ BEGIN_COLON(LINK(CHAR), SPHASH, "SP#", 0, 7)
   XT(DECR),                         // Discount the cell used to hold the depth.
 END_COLON();
 
-//-----------------------------------------------------------------------------
-/**
- * .S ( -- )
- *
- * Non-destructively display the contents of the stack, in the form:
- * <n> sn ... s2 s1 s0
- *
- * where n is the number of items and s0 is the TOS.  Handy for debugging,
- * so I won't wait for full self-hosting capability before defining this.
- */
-BEGIN_COLON(LINK(SPHASH), DOT_S, ".S", 0, 23)
-  XT(SPHASH),                       // ( depth )
-  XT(DUP),                          // ( depth depth )
-  XT(LIT), '<', XT(EMIT),           // Show stack depth.
-  XT(DOT),                          // ( depth )
-  XT(LIT), '>', XT(EMIT),
-
-  XT(DUP),                          // ( depth depth )
-  XT(ZBRANCH), 8 * sizeof (Cell),   // Loop done?
-
-  XT(DUP),                          // ( ...stuff... index index ) Note: 0 ==> index itself.
-  XT(PICK),                         // ( index si ) Grab item at index.
-  XT(SPACE),                        // Precede item by space.
-  XT(DOT),                          // ( index )
-  XT(DECR),                         // ( index -- index-1 )
-  XT(BRANCH), -9 * sizeof (Cell),
-  XT(CR),
-  XT(DROP),
-END_COLON();
-
 //-----------------------------------------------------------------------------
 /**
  * >CFA ( lfa -- cfa )
@@ -300,7 +471,7 @@ END_COLON();
  * Convert Link Field Address to Code Field Address
  * (skip over length and name).  If lfa is 0, return 0.
  */
-BEGIN_COLON(LINK(DOT_S), TOCFA, ">CFA", 0, 15)
+BEGIN_COLON(LINK(SPHASH), TOCFA, ">CFA", 0, 15)
   XT(DUP),
   XT(ZBRANCH), 13 * sizeof (Cell),  // If lfa == 0, skip all this and return 0.
   XT(CELLPLUS),                     // ( ^link -- ^len ) Point to length.
@@ -338,8 +509,10 @@ END_COLON();
  * Increment the address of the next available dictionary byte (stored in HERE)
  * by the specified count of bytes.
  */
-BEGIN_COLON(LINK(TODFA), ALLOT, "ALLOT", 0, 2)
+BEGIN_COLON(LINK(TODFA), ALLOT, "ALLOT", 0, 4)
+  XT(LOCK_DICTIONARY),
   XT(HERE), XT(PLUSSTORE),
+  XT(UNLOCK_DICTIONARY),
 END_COLON();
 
 //-----------------------------------------------------------------------------
@@ -348,9 +521,11 @@ END_COLON();
  *
  * Compile a cell to the dictionary.
  */
-BEGIN_COLON(LINK(ALLOT), COMMA, ",", 0, 5)
+BEGIN_COLON(LINK(ALLOT), COMMA, ",", 0, 7)
+  XT(LOCK_DICTIONARY),              // Keep other threads off HERE.
   XT(HERE), XT(FETCH), XT(STORE),   // Store cell where HERE points.
   XT(CELL), XT(ALLOT),              // Advance HERE by cell size.
+  XT(UNLOCK_DICTIONARY),
 END_COLON();
 
 //-----------------------------------------------------------------------------
@@ -359,19 +534,11 @@ END_COLON();
  *
  * Compile a byte to the dictionary.
  */
-BEGIN_COLON(LINK(COMMA), CCOMMA, "C,", 0, 5)
+BEGIN_COLON(LINK(COMMA), CCOMMA, "C,", 0, 7)
+  XT(LOCK_DICTIONARY),              // Keep other threads off HERE.
   XT(HERE), XT(FETCH), XT(CSTORE),  // Store byte where HERE points.
   XT(ONE), XT(ALLOT),               // Advance HERE by byte size.
-END_COLON();
-
-//-----------------------------------------------------------------------------
-/**
- * ERASE ( addr n -- )
- *
- * Fill n bytes, starting at the specified address, with zero.
- */
-BEGIN_COLON(LINK(CCOMMA), ERASE, "ERASE", 0, 2)
-  XT(ZERO), XT(FILL),
+  XT(UNLOCK_DICTIONARY),
 END_COLON();
 
 //-----------------------------------------------------------------------------
@@ -389,8 +556,9 @@ END_COLON();
  * TODO: This definition might be able to be optimised a bit since I changed how
  * HERE works to be compatible with JonesForth.
  */
-BEGIN_COLON(LINK(ERASE), CREATE, "CREATE", 0, 33)
+BEGIN_COLON(LINK(CCOMMA), CREATE, "CREATE", 0, 35)
   XT(WORD),                         // ( addr len ) Name.
+  XT(LOCK_DICTIONARY),              // Keep other threads off HERE and LATEST.
   XT(HERE), XT(FETCH),              // ( addr len here ) HERE is the LFA.  Save it.
   XT(LATEST), XT(FETCH), XT(COMMA), // ( addr len here ) Put LATEST in the link.
   XT(LATEST), XT(STORE),            // ( addr len ) Set LATEST to point to link.
@@ -406,6 +574,7 @@ BEGIN_COLON(LINK(ERASE), CREATE, "CREATE", 0, 33)
   XT(HERE), XT(FETCH), XT(SWAP),    // ( here padding ) Set up for ERASE.
   XT(DUP), XT(ALLOT),               // Advance HERE by padding count.
   XT(ERASE),                        // Fill padding with zeroes.
+  XT(UNLOCK_DICTIONARY),
 END_COLON();
 
 //-----------------------------------------------------------------------------
@@ -499,10 +668,11 @@ END_COLON();
  * INTERPRET
  *
  * Read one word of input and either compile or execute it, depending on the
- * value of STATE.  This word came out very convoluted.  There must be
- * a better way...
+ * value of STATE.  A word that is not in the dictionary is parsed as an
+ * integer, then as a float literal (see floating.h).  This word came out very
+ * convoluted.  There must be a better way...
  */
-BEGIN_COLON(LINK(WORDS), INTERPRET, "INTERPRET", 0, 51)
+BEGIN_COLON(LINK(WORDS), INTERPRET, "INTERPRET", 0, 64)
   XT(WORD),                         // ( addr len ) Read word.
   XT(DDUP),                         // ( addr len addr len )
   XT(FIND), XT(DUP),                // ( addr len lfa lfa ) Find LFA, or 0.
@@ -533,35 +703,95 @@ BEGIN_COLON(LINK(WORDS), INTERPRET, "INTERPRET", 0, 51)
 
 // #4                               // ( addr len 0 ) Not in the dictionary.
   XT(DROP),                         // ( addr len )
-  XT(BASE), XT(FETCH),              // ( addr len base )
-  XT(NUMBERIN),                     // ( num addr2 len2 ) Parse as number.
-  XT(DUP),                          // ( num addr2 len2 len2 )
-  XT(ZBRANCH), 7 * sizeof (Cell),   // If a valid number, branch to #5.
-                                    // ( num addr2 len2 ) Invalid number.
+  XT(DDUP),                         // ( addr len addr len )
+  XT(BASE), XT(FETCH),              // ( addr len addr len base )
+  XT(NUMBERIN),                     // ( addr len num addr2 len2 ) Parse as number.
+  XT(ZBRANCH), 18 * sizeof (Cell),  // If a valid number, branch to #6.
+                                    // ( addr len num addr2 ) Not an integer.
+  XT(DDROP),                        // ( addr len )
+  XT(DDUP), XT(TOFLOAT_LITERAL),    // ( addr len flag ) (F: r? ) Parse as float.
+  XT(ZBRANCH), 8 * sizeof (Cell),   // If not a float either, branch to #5.
+  XT(DDROP),                        // () (F: r ) Float is valid.
+  XT(STATE), XT(FETCH),             // Are we compiling?
+  XT(ZBRANCH), 2 * sizeof (Cell),   // If not then leave r on the FP stack.
+  XT(FLITERAL),                     // Compile FLIT and r.
+  XT(EXIT),                         // Return.
+
+// #5                               // ( addr len ) Invalid number.
   XT(TELL),                         // Display what couldn't be parsed.
-  XT(DROP),                         // ()
   XT(LIT), '?', XT(EMIT),           // Half-baked error message.
   XT(EXIT),                         // Return.
 
-// #5                               // ( num addr2 len2 ) Number is valid.
-  XT(DDROP),                        // ( num )
+// #6                               // ( addr len num addr2 ) Number is valid.
+  XT(DROP), XT(ROT), XT(DDROP),     // ( num )
   XT(STATE), XT(FETCH),             // Are we compiling?
-  XT(ZBRANCH), 5 * sizeof (Cell),   // If not then branch to #6
+  XT(ZBRANCH), 5 * sizeof (Cell),   // If not then branch to #7
                                     // ( num ) Compiling.
   XT(LIT), XT(LIT), XT(COMMA),      // Compile LIT.
   XT(COMMA),                        // Compile the number.
 
                                     // Else, not compiling... so just leave the
-// #6                               // number on TOS.
+// #7                               // number on TOS.
 END_COLON();                        // Return.
 
+//-----------------------------------------------------------------------------
+/**
+ * EVALUATE ( addr len -- )
+ *
+ * Interpret the string (addr,len) as if it were a line of input, then
+ * continue after EVALUATE.  The string is read in place, not copied.  The
+ * depth returned by STRING-SOURCE is kept on the return stack, out of the way
+ * of the code being interpreted.
+ */
+BEGIN_COLON(LINK(INTERPRET), EVALUATE, "EVALUATE", 0, 11)
+  XT(STRINGSOURCE), XT(TOR),        // ( ) Make the string the input source.
+  XT(RSPFETCH), XT(FETCH),          // ( depth ) Loop start.
+  XT(SOURCEMORE),                   // ( flag ) Anything left to interpret?
+  XT(ZBRANCH), 4 * sizeof (Cell),   // If not, exit loop.
+  XT(INTERPRET),
+  XT(BRANCH), -7 * sizeof (Cell),   // Branch back to loop start.
+  XT(RDROP),
+END_COLON();
+
+//-----------------------------------------------------------------------------
+/**
+ * LOAD ( u -- )
+ *
+ * Interpret block u, then continue after LOAD.  This is EVALUATE with
+ * BLOCK-SOURCE in place of STRING-SOURCE.
+ */
+BEGIN_COLON(LINK(EVALUATE), LOAD, "LOAD", 0, 11)
+  XT(BLOCKSOURCE), XT(TOR),         // ( ) Make the block the input source.
+  XT(RSPFETCH), XT(FETCH),          // ( depth ) Loop start.
+  XT(SOURCEMORE),                   // ( flag ) Anything left to interpret?
+  XT(ZBRANCH), 4 * sizeof (Cell),   // If not, exit loop.
+  XT(INTERPRET),
+  XT(BRANCH), -7 * sizeof (Cell),   // Branch back to loop start.
+  XT(RDROP),
+END_COLON();
+
+//-----------------------------------------------------------------------------
+/**
+ * THRU ( u1 u2 -- )
+ *
+ * LOAD blocks u1 to u2 in turn.
+ */
+BEGIN_COLON(LINK(LOAD), THRU, "THRU", 0, 12)
+  XT(INCR), XT(SWAP),               // ( u2+1 u ) Loop start.
+  XT(DDUP), XT(GT),                 // ( u2+1 u flag ) More blocks?
+  XT(ZBRANCH), 6 * sizeof (Cell),   // If not, exit loop.
+  XT(DUP), XT(LOAD), XT(INCR),      // ( u2+1 u+1 ) LOAD block u.
+  XT(BRANCH), -8 * sizeof (Cell),   // Branch back to loop start.
+  XT(DDROP),
+END_COLON();
+
 //-----------------------------------------------------------------------------
 /**
  * QUIT
  *
  * Reset the return stack and repeatedly call INTERPRET.
  */
-BEGIN_COLON(LINK(INTERPRET), QUIT, "QUIT", 0, 5)
+BEGIN_COLON(LINK(THRU), QUIT, "QUIT", 0, 5)
   XT(R0), XT(RSPSTORE),             // Initialise return stack.
   XT(INTERPRET),
   XT(BRANCH),  -4 * sizeof (Cell),  // Branch back to start.
@@ -602,16 +832,169 @@ BEGIN_COLON(LINK(SEMICOLON), MAIN, "MAIN", 0, 2)
 END_COLON();
 
 //-----------------------------------------------------------------------------
+// The words that the embedding API (see libtomoko.h) and the server (see
+// serve.h) start from: the last built-in word, which new instances'
+// definitions link to, INTERPRET and EVALUATE.
+
+const Link lastBuiltInWord = LINK(MAIN);
+CodeWord *const interpretWord = (CodeWord*) &INTERPRET.codeWord;
+CodeWord *const evaluateWord = (CodeWord*) &EVALUATE.codeWord;
+
+// ... and FLIT, which FLITERAL (see floating.c) compiles.
+CodeWord *const flitWord = (CodeWord*) &FLIT.codeWord;
+
+// ... and the run-time words that DO, ?DO, LOOP, +LOOP and LEAVE (see loop.c)
+// compile.
+CodeWord *const doWord = (CodeWord*) &PDO.codeWord;
+CodeWord *const qdoWord = (CodeWord*) &PQDO.codeWord;
+CodeWord *const loopWord = (CodeWord*) &PLOOP.codeWord;
+CodeWord *const plusLoopWord = (CodeWord*) &PPLUSLOOP.codeWord;
+CodeWord *const leaveWord = (CodeWord*) &PLEAVE.codeWord;
+
+// ... and the words that CASE, OF, ENDOF and ENDCASE (see case.c) look for and
+// compile.
+CodeWord *const litWord = (CodeWord*) &LIT.codeWord;
+CodeWord *const tickWord = (CodeWord*) &TICK.codeWord;
+CodeWord *const branchWord = (CodeWord*) &BRANCH.codeWord;
+CodeWord *const dropWord = (CodeWord*) &DROP.codeWord;
+CodeWord *const ofWord = (CodeWord*) &POF.codeWord;
+CodeWord *const litOfWord = (CodeWord*) &PLITOF.codeWord;
+CodeWord *const tableOfWord = (CodeWord*) &PTABLEOF.codeWord;
+CodeWord *const searchOfWord = (CodeWord*) &PSEARCHOF.codeWord;
+CodeWord *const endCaseWord = (CodeWord*) &PENDCASE.codeWord;
+
+//-----------------------------------------------------------------------------
+// The main program, which the library build (with TOMOKO_LIBRARY defined)
+// leaves out.
+
+#ifndef TOMOKO_LIBRARY
+
 /**
- * Main program.
+ * Print the command line usage and exit(EXIT_FAILURE).
  */
-int main()
+static void usage(const char *program)
 {
+  fprintf(stderr,
+          "usage: %s [-s cells] [-r cells] [-f floats] [-w workers]\n"
+          "          [--serve socket [--budget n] [--timeout ms]]\n"
+          "          [-j jobs script...]\n"
+          "  -s cells    parameter stack size (default %d)\n"
+          "  -r cells    return stack size (default %d)\n"
+          "  -f floats   floating-point stack size (default %d)\n"
+          "  -w workers  worker threads for PAR-DO and the like\n"
+          "              (default one per processor)\n"
+          "  --serve socket  evaluate requests from a Unix domain socket\n"
+          "  --budget n      stop each request after n instructions\n"
+          "  --timeout ms    stop each request after ms milliseconds\n"
+          "  -j jobs     run the scripts in jobs worker processes\n",
+          program, PARAMETER_STACK_CELLS, RETURN_STACK_CELLS,
+          FLOAT_STACK_FLOATS);
+  exit(EXIT_FAILURE);
+} // usage
+
+//-----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+  static const struct option longOptions[] =
+  {
+    { "serve",   required_argument, NULL, 'S' },
+    { "budget",  required_argument, NULL, 'b' },
+    { "timeout", required_argument, NULL, 't' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  UCell parameterCells = PARAMETER_STACK_CELLS;
+  UCell returnCells = RETURN_STACK_CELLS;
+  UCell floats = FLOAT_STACK_FLOATS;
+  const char *servePath = NULL;
+  UCell budget = 0;
+  Cell timeout = 0;
+  int jobs = 0;
+  int option;
+  while ((option = getopt_long(argc, argv, "s:r:f:w:j:", longOptions, NULL))
+         != -1)
+  {
+    switch (option)
+    {
+      case 's':
+        parameterCells = strtoul(optarg, NULL, 0);
+        break;
+
+      case 'r':
+        returnCells = strtoul(optarg, NULL, 0);
+        break;
+
+      case 'f':
+        floats = strtoul(optarg, NULL, 0);
+        break;
+
+      case 'w':
+        parWorkers = strtoul(optarg, NULL, 0);
+        break;
+
+      case 'S':
+        servePath = optarg;
+        break;
+
+      case 'b':
+        budget = strtoul(optarg, NULL, 0);
+        break;
+
+      case 't':
+        timeout = strtol(optarg, NULL, 0);
+        break;
+
+      case 'j':
+        jobs = strtol(optarg, NULL, 0);
+        break;
+
+      default:
+        usage(argv[0]);
+    }
+  }
+  if ((jobs > 0) != (optind < argc) || jobs < 0)
+  {
+    usage(argv[0]);
+  }
+
+  allocateStacks(parameterCells, returnCells, floats);
+
   // Set LATEST to the LFA of the last word defined.
   LATEST_value = (Cell) LINK(MAIN);
 
-  // Start in MAIN.
-  ip = (CodeWord**) MAIN.code;
+  // Write out whatever is still buffered on the way out (HALT, Ctrl-D, ...).
+  atexit(flushOutput);
+
+  if (servePath != NULL)
+  {
+    serve(servePath, budget, timeout);
+    return EXIT_FAILURE;
+  }
+  if (jobs > 0)
+  {
+    return runBatch(jobs, argv + optind, argc - optind);
+  }
+
+  if (sigsetjmp(stackFaultRecovery, 1) == 0)
+  {
+    // Start in MAIN.
+    ip = (CodeWord**) MAIN.code;
+  }
+  else
+  {
+    // A stack overflowed or underflowed.  Report it, stop the task if it was
+    // not the operator, empty the operator's parameter and floating-point
+    // stacks and return to QUIT, which empties the return stack.
+    flushOutput();
+    fprintf(stderr, "%s\n", stackFault);
+    dropDictionaryLock();
+    recoverOperator();
+    sp = (Cell*) userArea[USER_S0];
+    fsp = (Float*) userArea[USER_F0];
+    userArea[USER_STATE] = 0;
+    ip = (CodeWord**) QUIT.code;
+  }
 
   for (;;)
   {
@@ -620,4 +1003,6 @@ int main()
   return 0;
 } // main
 
+#endif // TOMOKO_LIBRARY
+
 //-----------------------------------------------------------------------------
@@ -12,13 +12,23 @@ typedef int32_t Cell;
 /**
  * This type defines the width of a stack element as a unsigned integer.
  */
-typedef int32_t UCell;
+typedef uint32_t UCell;
 
 /**
  * This type defines the double-width signed integer type.
  */
 typedef int64_t DCell;
 
+/**
+ * This type defines the double-width unsigned integer type.
+ */
+typedef uint64_t UDCell;
+
+/**
+ * This type defines a floating-point stack element: an IEEE double.
+ */
+typedef double Float;
+
 /**
  * Type of the function pointer that is the codeword of a Forth word.
  *